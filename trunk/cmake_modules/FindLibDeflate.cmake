@@ -0,0 +1,39 @@
+# Try pkg-config first
+find_package(PkgConfig)
+pkg_check_modules(PKGC_LIBDEFLATE QUIET libdeflate)
+
+if(PKGC_LIBDEFLATE_FOUND)
+  # Found lib using pkg-config.
+  if(CMAKE_DEBUG)
+    message(STATUS "\${PKGC_LIBDEFLATE_LIBRARIES} = ${PKGC_LIBDEFLATE_LIBRARIES}")
+    message(STATUS "\${PKGC_LIBDEFLATE_LIBRARY_DIRS} = ${PKGC_LIBDEFLATE_LIBRARY_DIRS}")
+    message(STATUS "\${PKGC_LIBDEFLATE_LDFLAGS} = ${PKGC_LIBDEFLATE_LDFLAGS}")
+    message(STATUS "\${PKGC_LIBDEFLATE_LDFLAGS_OTHER} = ${PKGC_LIBDEFLATE_LDFLAGS_OTHER}")
+    message(STATUS "\${PKGC_LIBDEFLATE_INCLUDE_DIRS} = ${PKGC_LIBDEFLATE_INCLUDE_DIRS}")
+    message(STATUS "\${PKGC_LIBDEFLATE_CFLAGS} = ${PKGC_LIBDEFLATE_CFLAGS}")
+    message(STATUS "\${PKGC_LIBDEFLATE_CFLAGS_OTHER} = ${PKGC_LIBDEFLATE_CFLAGS_OTHER}")
+  endif(CMAKE_DEBUG)
+
+  set(LIBDEFLATE_LIBRARIES ${PKGC_LIBDEFLATE_LIBRARIES})
+  set(LIBDEFLATE_INCLUDE_DIRS ${PKGC_LIBDEFLATE_INCLUDE_DIRS})
+else(PKGC_LIBDEFLATE_FOUND)
+  # Didn't find lib using pkg-config. Try to find it manually. LibDeflate is
+  # optional, so don't warn if it isn't there.
+  find_path(LIBDEFLATE_INCLUDE_DIR libdeflate.h)
+  find_library(LIBDEFLATE_LIBRARY NAMES deflate libdeflate)
+
+  if(CMAKE_DEBUG)
+    message(STATUS "\${LIBDEFLATE_LIBRARY} = ${LIBDEFLATE_LIBRARY}")
+    message(STATUS "\${LIBDEFLATE_INCLUDE_DIR} = ${LIBDEFLATE_INCLUDE_DIR}")
+  endif(CMAKE_DEBUG)
+
+  if(LIBDEFLATE_INCLUDE_DIR AND LIBDEFLATE_LIBRARY)
+    set(LIBDEFLATE_LIBRARIES ${LIBDEFLATE_LIBRARY})
+    set(LIBDEFLATE_INCLUDE_DIRS ${LIBDEFLATE_INCLUDE_DIR})
+  endif(LIBDEFLATE_INCLUDE_DIR AND LIBDEFLATE_LIBRARY)
+endif(PKGC_LIBDEFLATE_FOUND)
+
+include(FindPackageHandleStandardArgs)
+# Handle the QUIETLY and REQUIRED arguments and set <PREFIX>_FOUND to TRUE if
+# all listed variables are TRUE
+find_package_handle_standard_args(LibDeflate DEFAULT_MSG LIBDEFLATE_LIBRARIES)
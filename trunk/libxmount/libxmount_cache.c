@@ -0,0 +1,121 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libxmount_cache.h"
+
+/*
+ * LibXmountCacheSet
+ *
+ * Returns the first entry of the set the given data is cached in.
+ */
+static pts_LibXmountCacheEntry LibXmountCacheSet(pts_LibXmountCache p_cache,
+                                                 const void *p_owner,
+                                                 uint64_t key)
+{
+  uint64_t hash;
+
+  // Keys often are multiples of a block size, so their bits are mixed
+  hash=(key^(uint64_t)(uintptr_t)p_owner)*0x9E3779B97F4A7C15ULL;
+  hash^=hash>>32;
+  return &(p_cache->p_entries[(hash%p_cache->sets)*LIBXMOUNT_CACHE_WAYS]);
+}
+
+/*
+ * LibXmountCacheInit
+ */
+int LibXmountCacheInit(pts_LibXmountCache p_cache, uint64_t entries) {
+  memset(p_cache,0,sizeof(ts_LibXmountCache));
+  if(entries==0) return 0;
+  // Round up to whole sets
+  p_cache->sets=(entries+LIBXMOUNT_CACHE_WAYS-1)/LIBXMOUNT_CACHE_WAYS;
+  entries=p_cache->sets*LIBXMOUNT_CACHE_WAYS;
+  p_cache->p_entries=
+    (pts_LibXmountCacheEntry)calloc(entries,sizeof(ts_LibXmountCacheEntry));
+  if(p_cache->p_entries==NULL) return ENOMEM;
+  p_cache->entries=entries;
+  return 0;
+}
+
+/*
+ * LibXmountCacheFree
+ */
+void LibXmountCacheFree(pts_LibXmountCache p_cache) {
+  for(uint64_t i=0;i<p_cache->entries;i++) {
+    free(p_cache->p_entries[i].p_buf);
+  }
+  free(p_cache->p_entries);
+  p_cache->p_entries=NULL;
+  p_cache->entries=0;
+}
+
+/*
+ * LibXmountCacheGet
+ */
+int LibXmountCacheGet(pts_LibXmountCache p_cache,
+                      const void *p_owner,
+                      uint64_t key,
+                      uint64_t pos,
+                      uint64_t count,
+                      void *p_dst)
+{
+  pts_LibXmountCacheEntry p_entry;
+
+  if(p_cache->entries==0) return 0;
+  p_entry=LibXmountCacheSet(p_cache,p_owner,key);
+  for(uint32_t i=0;i<LIBXMOUNT_CACHE_WAYS;i++,p_entry++) {
+    if(p_entry->p_owner!=p_owner || p_entry->key!=key) continue;
+    memcpy(p_dst,p_entry->p_buf+pos,count);
+    p_entry->last_used=++(p_cache->use_counter);
+    p_cache->hits++;
+    return 1;
+  }
+  p_cache->misses++;
+  return 0;
+}
+
+/*
+ * LibXmountCachePut
+ */
+void LibXmountCachePut(pts_LibXmountCache p_cache,
+                       const void *p_owner,
+                       uint64_t key,
+                       char **pp_buf)
+{
+  pts_LibXmountCacheEntry p_entry;
+  pts_LibXmountCacheEntry p_lru=NULL;
+
+  if(p_cache->entries==0) return;
+  p_entry=LibXmountCacheSet(p_cache,p_owner,key);
+  for(uint32_t i=0;i<LIBXMOUNT_CACHE_WAYS;i++,p_entry++) {
+    if(p_entry->p_owner==p_owner && p_entry->key==key) return;
+    if(p_lru==NULL || p_entry->last_used<p_lru->last_used) p_lru=p_entry;
+  }
+
+  free(p_lru->p_buf);
+  p_lru->p_owner=p_owner;
+  p_lru->key=key;
+  p_lru->p_buf=*pp_buf;
+  p_lru->last_used=++(p_cache->use_counter);
+  *pp_buf=NULL;
+}
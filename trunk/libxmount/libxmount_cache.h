@@ -0,0 +1,104 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#ifndef LIBXMOUNT_CACHE_H
+#define LIBXMOUNT_CACHE_H
+
+//! Number of entries of a set of the cache
+#define LIBXMOUNT_CACHE_WAYS 8
+
+//! Entry of an LRU cache
+typedef struct s_LibXmountCacheEntry {
+  //! Owner (image, extent, ...) and key (offset, sector, ...) of the cached
+  //! data, p_owner is NULL if unused
+  const void *p_owner;
+  uint64_t key;
+  //! Value of the cache's use counter when the entry was last used
+  uint64_t last_used;
+  //! Cached data
+  char *p_buf;
+} ts_LibXmountCacheEntry, *pts_LibXmountCacheEntry;
+
+//! LRU cache of blocks of equal size, e.g. tables or uncompressed clusters
+/*!
+ * The cache is set-associative: data is looked up only in the
+ * LIBXMOUNT_CACHE_WAYS entries of the set its owner and key hash to. It isn't
+ * thread-safe, callers must serialize access to it.
+ */
+typedef struct s_LibXmountCache {
+  pts_LibXmountCacheEntry p_entries;
+  uint64_t entries;
+  uint64_t sets;
+  uint64_t use_counter;
+  //! Statistics
+  uint64_t hits;
+  uint64_t misses;
+} ts_LibXmountCache, *pts_LibXmountCache;
+
+//! Initialize a cache
+/*!
+ * \param p_cache Cache to initialize
+ * \param entries Number of entries, rounded up to whole sets. With 0 entries,
+ * the cache is disabled.
+ * \return 0 on success, ENOMEM if memory couldn't be allocated
+ */
+int LibXmountCacheInit(pts_LibXmountCache p_cache, uint64_t entries);
+
+//! Free a cache and all data cached in it
+/*!
+ * \param p_cache Cache to free
+ */
+void LibXmountCacheFree(pts_LibXmountCache p_cache);
+
+//! Look up cached data
+/*!
+ * Copies count bytes at pos of the data cached for the given owner and key to
+ * p_dst.
+ *
+ * \param p_cache Cache to look in
+ * \param p_owner Owner of the data
+ * \param key Key of the data
+ * \param pos Position in the cached data to copy from
+ * \param count Number of bytes to copy
+ * \param p_dst Buffer to copy to
+ * \return 1 on a cache hit, 0 otherwise
+ */
+int LibXmountCacheGet(pts_LibXmountCache p_cache,
+                      const void *p_owner,
+                      uint64_t key,
+                      uint64_t pos,
+                      uint64_t count,
+                      void *p_dst);
+
+//! Add data to the cache
+/*!
+ * Replaces the least recently used entry of the data's set. The cache takes
+ * over *pp_buf, which must have been allocated with malloc, and sets it to
+ * NULL. If the data is already cached (added by another thread in the
+ * meantime) or the cache is disabled, *pp_buf is left to the caller.
+ *
+ * \param p_cache Cache to add to
+ * \param p_owner Owner of the data
+ * \param key Key of the data
+ * \param pp_buf Data to add
+ */
+void LibXmountCachePut(pts_LibXmountCache p_cache,
+                       const void *p_owner,
+                       uint64_t key,
+                       char **pp_buf);
+
+#endif // LIBXMOUNT_CACHE_H
@@ -41,6 +41,15 @@
 #include <zlib.h>
 #include <time.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <strings.h>
+#ifdef HAVE_LIBLZMA
+   #include <lzma.h>
+#endif
 
 #include "../libxmount_input.h"
 
@@ -51,6 +60,12 @@ static const char* AaffGetErrorMessage (int ErrNum);
 
 #define AAFF_OPTION_MAXPAGEARRMEM   "aaffmaxmem"
 #define AAFF_OPTION_LOG             "aafflog"
+#define AAFF_OPTION_INDEX           "aaffindex"
+#define AAFF_OPTION_PAGECACHE       "aaffpagecache"
+#define AAFF_OPTION_THREADS         "aaffthreads"
+#define AAFF_OPTION_MAXFILES        "aaffmaxfiles"
+
+#define AAFF_AFD_EXTENSION          ".aff"   // Files looked for in AFD directories
 
 // ----------------------------
 //  Logging and error handling
@@ -61,6 +76,7 @@ static const char* AaffGetErrorMessage (int ErrNum);
 int LogvEntry (const char *pLogFileName, uint8_t LogStdout, const char *pFileName, const char *pFunctionName, int LineNr, const char *pFormat, va_list pArguments)
 {
    time_t       NowT;
+   struct tm    NowTM;
    struct tm  *pNowTM;
    FILE       *pFile;
    int          wr;
@@ -73,7 +89,7 @@ int LogvEntry (const char *pLogFileName, uint8_t LogStdout, const char *pFileNam
       return AAFF_OK;
 
    time (&NowT);
-   pNowTM = localtime (&NowT);
+   pNowTM = localtime_r (&NowT, &NowTM);   // The page scan thread logs, too
    OwnPID = getpid();  // pthread_self()
    wr  = (int) strftime (&LogLineHeader[0] , sizeof(LogLineHeader)   , "%a %d.%b.%Y %H:%M:%S ", pNowTM); //lint !e713
    wr += snprintf (&LogLineHeader[wr], sizeof(LogLineHeader)-wr, "%5d ", OwnPID);                  //lint !e737
@@ -185,8 +201,8 @@ uint64_t AaffU64 (char *pData)
    uint64_t Val=0;
    int      i;
 
-   for (i=4; i<8; i++)  Val = (Val << 8) | pData[i];
-   for (i=0; i<4; i++)  Val = (Val << 8) | pData[i];
+   for (i=4; i<8; i++)  Val = (Val << 8) | (unsigned char) pData[i];
+   for (i=0; i<4; i++)  Val = (Val << 8) | (unsigned char) pData[i];
 
    return Val;
 }
@@ -196,32 +212,69 @@ static int AaffPageNumberFromSegmentName (char *pSegmentName, uint64_t *pPageNum
    char *pSegmentNamePageNumber;
    char *pTail;
 
+   if (strncmp (pSegmentName, AFF_SEGNAME_PAGE, strlen(AFF_SEGNAME_PAGE)) != 0)
+      return AAFF_WRONG_SEGMENT;
    pSegmentNamePageNumber = &pSegmentName[strlen(AFF_SEGNAME_PAGE)];
+   if ((*pSegmentNamePageNumber < '0') || (*pSegmentNamePageNumber > '9'))
+      return AAFF_INVALID_PAGE_NUMBER;
    *pPageNumber = strtoull (pSegmentNamePageNumber, &pTail, 10);
    if (*pTail != '\0')
-      return AAFF_INVALID_PAGE_NUMBER;  // There should be no extra chars after the number
+      return AAFF_INVALID_PAGE_NUMBER;  // There should be no extra chars after the number (afflib writes page<n>_md5 segments, for instance)
 
    return AAFF_OK;
 }
 
-static inline uint64_t AaffGetCurrentSeekPos (t_Aaff *pAaff)
+static int AaffPageType (unsigned int Flags)
 {
-   return ftello (pAaff->pFile);
+   if ((Flags & AFF_PAGEFLAGS_COMPRESSED) == 0)
+      return AAFF_PAGETYPE_UNCOMPRESSED;
+
+   switch (Flags & AFF_PAGEFLAGS_ALG_MASK)
+   {
+      case AFF_PAGEFLAGS_ALG_ZLIB: return AAFF_PAGETYPE_ZLIB;
+      case AFF_PAGEFLAGS_ALG_LZMA: return AAFF_PAGETYPE_LZMA;
+      case AFF_PAGEFLAGS_ALG_ZERO: return AAFF_PAGETYPE_ZERO;
+   }
+   return AAFF_PAGETYPE_UNKNOWN;
 }
 
-static inline uint64_t AaffSetCurrentSeekPos (t_Aaff *pAaff, uint64_t Val, int Whence)
+static int AaffReadFilePos (int File, void *pData, uint32_t DataLen, uint64_t Seek)
 {
-   if (fseeko (pAaff->pFile, Val, Whence) != 0)
-      return AAFF_CANNOT_SEEK;
+   char    *pDst = (char *) pData;
+   ssize_t   rd;
+
+   while (DataLen)
+   {
+      rd = pread (File, pDst, DataLen, (off_t) Seek);
+      if (rd < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return AAFF_CANNOT_READ_DATA;
+      }
+      if (rd == 0)
+         return AAFF_CANNOT_READ_DATA;
+      pDst    += rd;
+      Seek    += rd;
+      DataLen -= rd;
+   }
    return AAFF_OK;
 }
 
-
-static int AaffReadFile (t_Aaff *pAaff, void *pData, uint32_t DataLen)
+static int AaffFileStat (const char *pName, uint64_t *pFileSize, int64_t *pMTimeSec, int64_t *pMTimeNSec)
 {
-   if (fread (pData, DataLen, 1, pAaff->pFile) != 1)
-      return AAFF_CANNOT_READ_DATA;
-
+   struct stat Stat;
+
+   if (stat (pName, &Stat))
+      return AAFF_FILE_OPEN_FAILED;
+   *pFileSize  = (uint64_t) Stat.st_size;
+#ifdef __APPLE__
+   *pMTimeSec  = Stat.st_mtimespec.tv_sec;
+   *pMTimeNSec = Stat.st_mtimespec.tv_nsec;
+#else
+   *pMTimeSec  = Stat.st_mtim.tv_sec;
+   *pMTimeNSec = Stat.st_mtim.tv_nsec;
+#endif
    return AAFF_OK;
 }
 
@@ -237,12 +290,118 @@ static int AaffRealloc (void **ppBuff, uint32_t *pCurrentLen, uint32_t NewLen)
    return AAFF_OK;
 }
 
-static int AaffReadSegment (t_pAaff pAaff, char **ppName, uint32_t *pArg, char **ppData, uint32_t *pDataLen)
+// AaffOpenFile makes sure the given image file is open and registers the caller as a
+// user of it. Files in use are never closed by the cache, so every call must be paired
+// with AaffReleaseFile once the caller is done reading. Both functions may be called
+// concurrently.
+
+static int AaffOpenFile (t_pAaff pAaff, unsigned FileNr, int *pFile)
+{
+   t_pAaffFile pFileEntry = &pAaff->pFileArr[FileNr];
+   t_pAaffFile pOldest;
+   int          rc = AAFF_OK;
+
+   pthread_mutex_lock (&pAaff->FileMutex);
+   pFileEntry->LastUsed = ++pAaff->FileUseCounter;
+   pFileEntry->Users++;
+   if (pFileEntry->File >= 0) // is already opened ?
+   {
+      pAaff->FileCacheHits++;
+      *pFile = pFileEntry->File;
+      pthread_mutex_unlock (&pAaff->FileMutex);
+      return AAFF_OK;
+   }
+   pAaff->FileCacheMisses++;
+
+   // Check if another file must be closed first
+   // ------------------------------------------
+   while (pAaff->OpenFiles >= pAaff->MaxOpenFiles)
+   {
+      pOldest = NULL;
+      for (unsigned i=0; i<pAaff->Files; i++)
+      {
+         if ((pAaff->pFileArr[i].File < 0) || pAaff->pFileArr[i].Users)
+            continue;
+         if ((pOldest == NULL) || (pAaff->pFileArr[i].LastUsed < pOldest->LastUsed))
+            pOldest = &pAaff->pFileArr[i];
+      }
+      if (pOldest == NULL)  // All open files are in use, exceed MaxOpenFiles temporarily
+         break;
+
+      LOG ("Closing %s", pOldest->pName)
+      if (close (pOldest->File))
+         rc = AAFF_CANNOT_CLOSE_FILE;
+      pOldest->File = -1;
+      pAaff->OpenFiles--;
+      if (rc != AAFF_OK)
+         break;
+   }
+
+   // Open the desired file
+   // ---------------------
+   if (rc == AAFF_OK)
+   {
+      LOG ("Opening %s", pFileEntry->pName)
+      pFileEntry->File = open (pFileEntry->pName, O_RDONLY);
+      if (pFileEntry->File < 0)
+           rc = AAFF_FILE_OPEN_FAILED;
+      else pAaff->OpenFiles++;
+   }
+   if (rc == AAFF_OK)
+        *pFile = pFileEntry->File;
+   else pFileEntry->Users--;
+   pthread_mutex_unlock (&pAaff->FileMutex);
+   CHK (rc)
+
+   return AAFF_OK;
+}
+
+static void AaffReleaseFile (t_pAaff pAaff, unsigned FileNr)
+{
+   pthread_mutex_lock (&pAaff->FileMutex);
+   pAaff->pFileArr[FileNr].Users--;
+   pthread_mutex_unlock (&pAaff->FileMutex);
+}
+
+// AaffReadSegmentHeader reads the header and the name of the segment at the given position. Names
+// longer than AAFF_SCAN_MAX_NAMELEN are not read, they can't belong to page segments, an empty name
+// is returned instead. *pSegmentLen is set to the total segment length, including the footer.
+static int AaffReadSegmentHeader (int File, uint64_t Seek, t_AffSegmentHeader *pHeader, char *pName, uint64_t *pSegmentLen)
+{
+   const size_t HeaderLen = offsetof(t_AffSegmentHeader, Name);
+   int          rc;
+
+   rc = AaffReadFilePos (File, pHeader, HeaderLen, Seek);
+   if (rc != AAFF_OK)
+      return rc;
+   if (strcmp (&pHeader->Magic[0], AFF_SEGMENT_HEADER_MAGIC) != 0)
+      return AAFF_INVALID_HEADER;
+   pHeader->NameLen  = ntohl (pHeader->NameLen );
+   pHeader->DataLen  = ntohl (pHeader->DataLen );
+   pHeader->Argument = ntohl (pHeader->Argument);
+   pName[0] = '\0';
+   if (pHeader->NameLen <= AAFF_SCAN_MAX_NAMELEN)
+   {
+      rc = AaffReadFilePos (File, pName, pHeader->NameLen, Seek+HeaderLen);
+      if (rc != AAFF_OK)
+         return rc;
+      pName[pHeader->NameLen] = '\0';
+   }
+   *pSegmentLen = HeaderLen + (uint64_t) pHeader->NameLen + pHeader->DataLen + sizeof(t_AffSegmentFooter);
+
+   return AAFF_OK;
+}
+
+// AaffReadSegment reads a complete segment into pNameBuff and pDataBuff. It is used for the
+// segments in front of the first page. *pSeek is moved to the next segment.
+static int AaffReadSegment (t_pAaff pAaff, int File, uint64_t *pSeek, char **ppName, uint32_t *pArg, char **ppData, uint32_t *pDataLen)
 {
    t_AffSegmentHeader Header;
    t_AffSegmentFooter Footer;
+   uint64_t           Seek = *pSeek;
 
-   CHK (AaffReadFile (pAaff, &Header, offsetof(t_AffSegmentHeader, Name)))
+   CHK (AaffReadFilePos (File, &Header, offsetof(t_AffSegmentHeader, Name), Seek))
+   Seek += offsetof(t_AffSegmentHeader, Name);
    if (strcmp (&Header.Magic[0], AFF_SEGMENT_HEADER_MAGIC) != 0)
       return AAFF_INVALID_HEADER;
    Header.NameLen  = ntohl (Header.NameLen );
@@ -250,9 +409,11 @@ static int AaffReadSegment (t_pAaff pAaff, char **ppName, uint32_t *pArg, char *
    Header.Argument = ntohl (Header.Argument);
    CHK (AaffRealloc ((void**)&pAaff->pNameBuff, &pAaff->NameBuffLen, Header.NameLen+1)) // alloc +1, as is might be a string which can be more
    CHK (AaffRealloc ((void**)&pAaff->pDataBuff, &pAaff->DataBuffLen, Header.DataLen+1)) // easily handled by the calling fn when adding a \0
-   CHK (AaffReadFile (pAaff, pAaff->pNameBuff, Header.NameLen))
+   CHK (AaffReadFilePos (File, pAaff->pNameBuff, Header.NameLen, Seek))
+   Seek += Header.NameLen;
    if (Header.DataLen)
-      CHK (AaffReadFile (pAaff, pAaff->pDataBuff, Header.DataLen))
+      CHK (AaffReadFilePos (File, pAaff->pDataBuff, Header.DataLen, Seek))
+   Seek += Header.DataLen;
 
    pAaff->pNameBuff[Header.NameLen] = '\0';
    pAaff->pDataBuff[Header.DataLen] = '\0';
@@ -262,150 +423,743 @@ static int AaffReadSegment (t_pAaff pAaff, char **ppName, uint32_t *pArg, char *
    if (ppData)   *ppData   = pAaff->pDataBuff;
    if (pDataLen) *pDataLen = Header.DataLen;
 
-   // Read footer and position file pointer to next segemnt at the same time
-   // ----------------------------------------------------------------------
-   CHK (AaffReadFile (pAaff, &Footer, sizeof(Footer)))
+   // Read footer and position to next segment at the same time
+   // ----------------------------------------------------------
+   CHK (AaffReadFilePos (File, &Footer, sizeof(Footer), Seek))
    if (strcmp (&Footer.Magic[0], AFF_SEGMENT_FOOTER_MAGIC) != 0)
       return AAFF_INVALID_FOOTER;
+   *pSeek = Seek + sizeof(Footer);
 
    return AAFF_OK;
 }
 
-static int AaffReadSegmentPage (t_pAaff pAaff, uint64_t SearchPage, uint64_t *pFoundPage, char **ppData, uint32_t *pDataLen)
+// AaffLocatePage returns the position of the segment of the given page. If the page seek array
+// doesn't contain it, the segments are walked through, starting at the closest entry before the
+// page. Segments other than pages are skipped and the walk continues with the next file at the
+// end of a file. All pages passed on the way are entered into the page seek array.
+static int AaffLocatePage (t_pAaff pAaff, uint64_t Page, uint64_t *pSeek)
 {
    t_AffSegmentHeader Header;
-   t_AffSegmentFooter Footer;
-   char               SearchPageStr[128];
-   int                rc = AAFF_OK;
+   char               Name[AAFF_SCAN_MAX_NAMELEN+1];
+   t_pAaffFile       pFileEntry;
+   int64_t            Entry;
+   uint64_t           EntrySeek;
+   uint64_t           Seek;
+   uint64_t           SegmentLen;
+   uint64_t           FoundPage;
+   unsigned           FileNr;
+   int                File;
+   int                Hops = 0;
+   int                rc   = AAFF_OK;
+
+   // Find the closest entry in PageSeekArr
+   // -------------------------------------
+   Entry = Page / pAaff->Interleave;
+   pthread_mutex_lock (&pAaff->SeekArrMutex);   // The scan thread might be filling in entries
+   while ((EntrySeek = pAaff->pPageSeekArr[Entry]) == 0)
+   {
+      Entry--;
+      if (Entry<0)
+         break;
+   }
+   pthread_mutex_unlock (&pAaff->SeekArrMutex);
+   if (Entry<0)
+      return AAFF_SEEKARR_CORRUPT;
+   if ((uint64_t) Entry * pAaff->Interleave == Page)
+   {
+      *pSeek = EntrySeek;
+      return AAFF_OK;
+   }
 
-   *ppData   = NULL;
-   *pDataLen = 0;
-   sprintf (SearchPageStr, "page%" PRIu64, SearchPage);
+   // Run through segment list until page is found
+   // --------------------------------------------
+   FileNr = AAFF_SEEK_FILENR (EntrySeek);
+   Seek   = AAFF_SEEK_OFS    (EntrySeek);
+   CHK (AaffOpenFile (pAaff, FileNr, &File))
+   for (;;)
+   {
+      pFileEntry = &pAaff->pFileArr[FileNr];
+      if (Seek >= pFileEntry->Size)                         // End of file reached, continue
+      {                                                     // with the next one containing pages
+         AaffReleaseFile (pAaff, FileNr);
+         do
+         {
+            FileNr++;
+         } while ((FileNr < pAaff->Files) && (pAaff->pFileArr[FileNr].FirstPageSeek == 0));
+         if (FileNr >= pAaff->Files)
+            return AAFF_PAGE_NOT_FOUND;
+         Seek = pAaff->pFileArr[FileNr].FirstPageSeek;
+         CHK (AaffOpenFile (pAaff, FileNr, &File))
+         continue;
+      }
+      rc = AaffReadSegmentHeader (File, Seek, &Header, &Name[0], &SegmentLen);
+      if (rc != AAFF_OK)
+         break;
+      if (AaffPageNumberFromSegmentName (&Name[0], &FoundPage) == AAFF_OK)
+      {
+         Hops++;
+         if ((FoundPage % pAaff->Interleave) == 0)
+         {
+            pthread_mutex_lock   (&pAaff->SeekArrMutex);
+            pAaff->pPageSeekArr[FoundPage/pAaff->Interleave] = AAFF_SEEK (FileNr, Seek);
+            pthread_mutex_unlock (&pAaff->SeekArrMutex);
+         }
+         if (FoundPage == Page)
+         {
+            *pSeek = AAFF_SEEK (FileNr, Seek);
+            break;
+         }
+         if (FoundPage > Page)
+         {
+            rc = AAFF_PAGE_NOT_FOUND;
+            break;
+         }
+      }
+      Seek += SegmentLen;
+   }
+   AaffReleaseFile (pAaff, FileNr);
+   LOG ("Searched for page %" PRIu64 ", %d hops, rc=%d", Page, Hops, rc)
+   CHK (rc)
 
-   CHK (AaffReadFile (pAaff, &Header, offsetof(t_AffSegmentHeader, Name)))
-   if (strcmp (&Header.Magic[0], AFF_SEGMENT_HEADER_MAGIC) != 0)
-      return AAFF_INVALID_HEADER;
-   Header.NameLen  = ntohl (Header.NameLen );
-   Header.DataLen  = ntohl (Header.DataLen );
-   Header.Argument = ntohl (Header.Argument);
-   CHK (AaffRealloc ((void**)&pAaff->pNameBuff, &pAaff->NameBuffLen, Header.NameLen+1))
-   CHK (AaffReadFile (pAaff, pAaff->pNameBuff, Header.NameLen))
-   pAaff->pNameBuff[Header.NameLen] = '\0';
+   return AAFF_OK;
+}
 
-   if (strncmp (pAaff->pNameBuff, AFF_SEGNAME_PAGE, strlen(AFF_SEGNAME_PAGE)) != 0)
-      return AAFF_WRONG_SEGMENT;
+// ------------------------------------
+//             Page cache
+// ------------------------------------
+
+#ifdef HAVE_LIBLZMA
+// LZMA pages are stored in the format of the LZMA SDK's LzmaUtil, which liblzma calls LZMA_Alone:
+// 5 bytes of properties, the uncompressed size (8 bytes) and the compressed stream.
+static int AaffUncompressLzma (char *pDst, uint32_t *pDstLen, const char *pSrc, uint32_t SrcLen)
+{
+   lzma_stream Strm = LZMA_STREAM_INIT;
+   lzma_ret    lrc;
+
+   if (lzma_alone_decoder (&Strm, UINT64_MAX) != LZMA_OK)
+      return AAFF_UNCOMPRESS_FAILED;
+   Strm.next_in   = (const uint8_t *) pSrc;
+   Strm.avail_in  = SrcLen;
+   Strm.next_out  = (uint8_t *) pDst;
+   Strm.avail_out = *pDstLen;
+   lrc = lzma_code (&Strm, LZMA_FINISH);
+   *pDstLen -= Strm.avail_out;
+   lzma_end (&Strm);
+   if (lrc != LZMA_STREAM_END)
+      return AAFF_UNCOMPRESS_FAILED;
+
+   return AAFF_OK;
+}
+#endif
+
+// AaffReadPageSegment reads the segment of pPage->Page at pPage->Seek and puts the
+// uncompressed page data into pPage->pData. It only touches the cache entry and the file
+// cache, so it may run in one of the page threads.
+static int AaffReadPageSegment (t_pAaff pAaff, t_pAaffPage pPage)
+{
+   t_AffSegmentHeader Header;
+   char               Name[AAFF_SCAN_MAX_NAMELEN+1];
+   unsigned           FileNr = AAFF_SEEK_FILENR (pPage->Seek);
+   uint64_t           Seek   = AAFF_SEEK_OFS    (pPage->Seek);
+   uint64_t           SegmentLen;
+   uint64_t           FoundPage;
+   uint32_t           Len;
+   uLongf             ZLen;
+   int                File;
+   int                rc;
 
-   CHK (AaffPageNumberFromSegmentName (pAaff->pNameBuff, pFoundPage))
-   if (*pFoundPage == SearchPage)
+   rc = AaffOpenFile (pAaff, FileNr, &File);
+   if (rc != AAFF_OK)
+      return rc;
+   rc = AaffReadSegmentHeader (File, Seek, &Header, &Name[0], &SegmentLen);
+   if (rc == AAFF_OK)
    {
-      unsigned int Len;
-      uLongf       ZLen;
-      int          zrc;
+      rc = AaffPageNumberFromSegmentName (&Name[0], &FoundPage);
+      if ((rc == AAFF_OK) && (FoundPage != pPage->Page))
+         rc = AAFF_UNEXPECTED_PAGE_NUMBER;
+   }
+   Seek += offsetof(t_AffSegmentHeader, Name) + Header.NameLen;
 
-      switch (Header.Argument)
+   if (rc == AAFF_OK)
+   {
+      pPage->Type = AaffPageType (Header.Argument);
+      switch (pPage->Type)
       {
-         case AFF_PAGEFLAGS_UNCOMPRESSED:
-            CHK (AaffReadFile (pAaff, pAaff->pPageBuff, Header.DataLen))
-            pAaff->PageBuffDataLen = Header.DataLen;
+         case AAFF_PAGETYPE_UNCOMPRESSED:
+            if (Header.DataLen > pAaff->PageSize)
+               rc = AAFF_INVALID_PAGE_ARGUMENT;
+            else
+               rc = AaffReadFilePos (File, pPage->pData, Header.DataLen, Seek);
+            pPage->DataLen = Header.DataLen;
             break;
-         case AFF_PAGEFLAGS_COMPRESSED_ZERO:
-            CHK (AaffReadFile (pAaff, &Len, sizeof(Len)))
+         case AAFF_PAGETYPE_ZERO:
+            rc = AaffReadFilePos (File, &Len, sizeof(Len), Seek);
             Len = ntohl (Len);
-            memset (pAaff->pPageBuff, 0, Len);
-            pAaff->PageBuffDataLen = Len;
+            if ((rc == AAFF_OK) && (Len > pAaff->PageSize))
+               rc = AAFF_INVALID_PAGE_ARGUMENT;
+            if (rc == AAFF_OK)
+            {
+               memset (pPage->pData, 0, Len);
+               pPage->DataLen = Len;
+            }
             break;
-         case AFF_PAGEFLAGS_COMPRESSED_ZLIB:
-            CHK (AaffRealloc ((void**)&pAaff->pDataBuff, &pAaff->DataBuffLen, Header.DataLen));
-            CHK (AaffReadFile (pAaff, pAaff->pDataBuff, Header.DataLen))                     // read into pDataBuff
-            ZLen = pAaff->PageSize;                                                          // size of pPageBuff
-            zrc = uncompress ((unsigned char*)(pAaff->pPageBuff), &ZLen, (unsigned char*)(pAaff->pDataBuff), Header.DataLen);    // uncompress into pPageBuff
-            pAaff->PageBuffDataLen = ZLen;
-            if (zrc != Z_OK)
-               return AAFF_UNCOMPRESS_FAILED;
+         case AAFF_PAGETYPE_ZLIB:
+         case AAFF_PAGETYPE_LZMA:
+            rc = AaffRealloc ((void**)&pPage->pRaw, &pPage->RawBuffLen, Header.DataLen);
+            if (rc == AAFF_OK)
+               rc = AaffReadFilePos (File, pPage->pRaw, Header.DataLen, Seek);
+            pPage->RawLen = Header.DataLen;
             break;
          default:
-            return AAFF_INVALID_PAGE_ARGUMENT;
+            rc = AAFF_INVALID_PAGE_ARGUMENT;
       }
-      *ppData   = pAaff->pPageBuff;
-      *pDataLen = pAaff->PageBuffDataLen;
-      pAaff->CurrentPage = *pFoundPage;
-      rc = AAFF_FOUND;
    }
-   else
+   AaffReleaseFile (pAaff, FileNr);
+   if (rc != AAFF_OK)
+      return rc;
+
+   // Uncompress
+   // ----------
+   switch (pPage->Type)
    {
-      CHK (AaffSetCurrentSeekPos (pAaff, Header.DataLen, SEEK_CUR))
+      case AAFF_PAGETYPE_ZLIB:
+         ZLen = pAaff->PageSize;
+         if (uncompress ((unsigned char*)(pPage->pData), &ZLen, (unsigned char*)(pPage->pRaw), pPage->RawLen) != Z_OK)
+            return AAFF_UNCOMPRESS_FAILED;
+         pPage->DataLen = ZLen;
+         break;
+      case AAFF_PAGETYPE_LZMA:
+#ifdef HAVE_LIBLZMA
+         pPage->DataLen = pAaff->PageSize;
+         rc = AaffUncompressLzma (pPage->pData, &pPage->DataLen, pPage->pRaw, pPage->RawLen);
+         if (rc != AAFF_OK)
+            return rc;
+#else
+         return AAFF_LZMA_NOT_SUPPORTED;
+#endif
+         break;
+      default:
+         break;
    }
 
-   // Read footer and position file pointer to next segemnt at the same time
-   // ----------------------------------------------------------------------
-   CHK (AaffReadFile (pAaff, &Footer, sizeof(Footer)))
-   if (strcmp (&Footer.Magic[0], AFF_SEGMENT_FOOTER_MAGIC) != 0)
-      return AAFF_INVALID_FOOTER;
+   return AAFF_OK;
+}
+
+static void* AaffThreadReadPage (void *pArg)
+{
+   t_pAaffPage pPage = (t_pAaffPage) pArg;
 
+   pPage->ReturnCode = AaffReadPageSegment (pPage->pAaff, pPage);
+   return NULL;
+}
+
+// AaffPageWait waits until the data of a cache entry is ready. Entries with
+// errors are dropped from the cache, so the page is read again next time.
+static int AaffPageWait (t_pAaff pAaff, t_pAaffPage pPage)
+{
+   int rc;
+
+   if (pPage->State == AAFF_PAGE_LAUNCHED)
+   {
+      pthread_join (pPage->ID, NULL);
+      pPage->State = AAFF_PAGE_VALID;
+   }
+   rc = pPage->ReturnCode;
+   if (rc != AAFF_OK)
+   {
+      pPage->State = AAFF_PAGE_EMPTY;
+      pPage->Page  = AAFF_CURRENTPAGE_NOTSET;
+   }
    return rc;
 }
 
-static int AaffReadPage (t_pAaff pAaff, uint64_t Page, char **ppBuffer, uint32_t *pLen)
+static t_pAaffPage AaffFindPage (t_pAaff pAaff, uint64_t Page)
+{
+   t_pAaffPage pPage;
+
+   for (unsigned i=0; i<pAaff->PageCacheLen; i++)
+   {
+      pPage = &pAaff->pPageCache[i];
+      if ((pPage->State != AAFF_PAGE_EMPTY) && (pPage->Page == Page))
+         return pPage;
+   }
+   return NULL;
+}
+
+// AaffLoadPage makes sure the given page is in the cache or on its way into it. The least
+// recently used entry is recycled if needed. If Threads > 1, reading and uncompressing the
+// page is done by a thread, so AaffPageWait must be called before using the data.
+static int AaffLoadPage (t_pAaff pAaff, uint64_t Page, t_pAaffPage *ppPage)
 {
-    if (Page >= pAaff->TotalPages)
-       return AAFF_READ_BEYOND_LAST_PAGE;
+   t_pAaffPage pPage;
+   uint64_t     PageSeek;
+   int          rc;
+
+   if (Page >= pAaff->TotalPages)
+      return AAFF_READ_BEYOND_LAST_PAGE;
 
-   // Check if it's the current page
-   // ------------------------------
-   if (Page == pAaff->CurrentPage)
+   // Check if the page already is cached
+   // -----------------------------------
+   pPage = AaffFindPage (pAaff, Page);
+   if (pPage)
    {
-      *ppBuffer = pAaff->pPageBuff;
-      *pLen     = pAaff->PageBuffDataLen;
+      pPage->LastUsed = ++pAaff->PageCacheUseCounter;
+      *ppPage = pPage;
+      pAaff->PageCacheHits++;
       return AAFF_OK;
    }
 
-   // Set the seek position for starting the search
-   // ---------------------------------------------
-   int MaxHops;
+   // Recycle the least recently used entry and read the page data
+   // -------------------------------------------------------------
+   CHK (AaffLocatePage (pAaff, Page, &PageSeek))
+   pAaff->CurrentPage = Page;
 
-   if ((pAaff->CurrentPage   != AAFF_CURRENTPAGE_NOTSET) &&
-       (pAaff->CurrentPage+1 == Page))             // The current seek pos already is the correct one
+   pPage = &pAaff->pPageCache[0];
+   for (unsigned i=1; i<pAaff->PageCacheLen; i++)
+   {
+      if (pAaff->pPageCache[i].LastUsed < pPage->LastUsed)
+         pPage = &pAaff->pPageCache[i];
+   }
+   if (pPage->State == AAFF_PAGE_LAUNCHED)
+      (void) AaffPageWait (pAaff, pPage);
+   pPage->State      = AAFF_PAGE_EMPTY;
+   pPage->Page       = Page;
+   pPage->Seek       = PageSeek;
+   pPage->LastUsed   = ++pAaff->PageCacheUseCounter;
+   pPage->ReturnCode = AAFF_OK;
+   pAaff->PageCacheMisses++;
+
+   if ((pAaff->Threads > 1) && (pthread_create (&pPage->ID, NULL, AaffThreadReadPage, pPage) == 0))
    {
-      MaxHops = 1;
+      pPage->State = AAFF_PAGE_LAUNCHED;
+      *ppPage = pPage;
+      return AAFF_OK;
    }
-   else                                            // Find the closest entry in PageSeekArr
+   rc = AaffReadPageSegment (pAaff, pPage);
+   if (rc != AAFF_OK)
    {
-      int64_t Entry;
+      pPage->Page = AAFF_CURRENTPAGE_NOTSET;
+      CHK (rc)
+   }
+   pPage->State = AAFF_PAGE_VALID;
+   *ppPage = pPage;
+
+   return AAFF_OK;
+}
+
+// AaffPrefetch is called for sequential reads. It loads the pages following the ones
+// just read, so they are read and uncompressed in the background while the caller is
+// busy. Errors are ignored here, they will show up again when the page is really read.
+static void AaffPrefetch (t_pAaff pAaff, uint64_t FromPage)
+{
+   t_pAaffPage pPage;
+   uint64_t    Page;
 
-      Entry = Page / pAaff->Interleave;
-      while (pAaff->pPageSeekArr[Entry] == 0)
+   for (Page=FromPage; (Page < FromPage+pAaff->PagesPerLoop) && (Page < pAaff->TotalPages); Page++)
+   {
+      if (AaffFindPage (pAaff, Page))
+         continue;
+      if (AaffLoadPage (pAaff, Page, &pPage) != AAFF_OK)
+         break;
+      pAaff->PagesPrefetched++;
+      pAaff->PageCacheMisses--;    // Prefetched pages are no cache misses
+   }
+}
+
+// AaffCalcInterleave sets up the geometry of the page seek array, so that it doesn't
+// exceed MaxPageArrMem.
+static void AaffCalcInterleave (t_pAaff pAaff)
+{
+   uint64_t MaxEntries;
+
+   MaxEntries = (pAaff->MaxPageArrMem*1024*1024) / (sizeof (unsigned long long *) + 1); // +1 in order not to risk a result of 0
+   MaxEntries = GETMIN (MaxEntries, pAaff->TotalPages);
+   MaxEntries = GETMAX (MaxEntries, 1);
+
+   pAaff->Interleave = pAaff->TotalPages / MaxEntries;
+   if (pAaff->TotalPages % MaxEntries)
+      pAaff->Interleave++;
+
+   pAaff->PageSeekArrLen = pAaff->TotalPages / pAaff->Interleave;
+   if (pAaff->TotalPages % pAaff->Interleave)
+      pAaff->PageSeekArrLen++;
+}
+
+// ------------------------------------
+//     Index file (option aaffindex)
+// ------------------------------------
+
+// AaffIndexLoad sets up the header info and the complete page seek array from the index
+// file instead of reading them from the image. It only succeeds if the index has been
+// written for the same image files, none of them changed in size or modification time
+// since and the seek array has the same geometry as the one AaffOpen would build. On
+// failure, nothing is left allocated and the caller falls back to reading the image.
+
+static int AaffIndexLoad (t_pAaff pAaff)
+{
+   FILE               *pFile;
+   char               *pData = NULL;
+   char               *pCur;
+   char               *pEnd;
+   char               *pStr;
+   off_t                DataLen;
+   uint32_t             Adler;
+   t_pAaffIndexHeader  pHeader;
+   t_pAaffIndexFile    pIndexFileArr;
+   t_pAaffIndexFile    pIndexFile;
+   t_AaffFile           FileEntry;
+   uint64_t            *pSeekArr;
+   uint64_t             Seek;
+   uint64_t             FileSize;
+   int64_t              MTimeSec;
+   int64_t              MTimeNSec;
+   unsigned             i, j;
+   int                  rc = AAFF_OK;
+
+   #define RET_ERR(ErrCode)  \
+   {                         \
+      rc = ErrCode;          \
+      goto CleanUp;          \
+   }
+
+   #define GET(pDest, Len)                            \
+   {                                                  \
+      if ((uint64_t)(pEnd - pCur) < (uint64_t)(Len))  \
+         RET_ERR (AAFF_INDEX_INVALID)                 \
+      pDest = (void *) pCur;                          \
+      pCur += (Len);                                  \
+   }
+
+   // Read the whole index and check it
+   // ---------------------------------
+   pFile = fopen (pAaff->pIndexPath, "r");
+   if (pFile == NULL)
+      return AAFF_FILE_OPEN_FAILED;
+   if ((fseeko (pFile, 0, SEEK_END) != 0) || ((DataLen = ftello (pFile)) < 0) ||
+       (fseeko (pFile, 0, SEEK_SET) != 0))
+   {
+      (void) fclose (pFile);
+      return AAFF_CANNOT_SEEK;
+   }
+   if (DataLen < (off_t)(sizeof (t_AaffIndexHeader) + sizeof (Adler)))
+   {
+      (void) fclose (pFile);
+      return AAFF_INDEX_INVALID;
+   }
+   pData = (char *) malloc (DataLen);
+   if (pData == NULL)
+   {
+      (void) fclose (pFile);
+      return AAFF_MEMALLOC_FAILED;
+   }
+   if (fread (pData, DataLen, 1, pFile) != 1)
+   {
+      (void) fclose (pFile);
+      RET_ERR (AAFF_CANNOT_READ_DATA)
+   }
+   (void) fclose (pFile);
+
+   DataLen -= sizeof (Adler);
+   memcpy (&Adler, &pData[DataLen], sizeof (Adler));
+   if (Adler != adler32 (1, (Bytef *) pData, DataLen))
+      RET_ERR (AAFF_INDEX_INVALID)
+
+   pCur = pData;
+   pEnd = pData + DataLen;
+   GET (pHeader, sizeof (t_AaffIndexHeader))
+   if ((memcmp (pHeader->Magic, AAFF_INDEX_MAGIC, sizeof (pHeader->Magic)) != 0) ||
+       (pHeader->Version    != AAFF_INDEX_VERSION) ||
+       (pHeader->HeaderSize != sizeof (t_AaffIndexHeader)))
+      RET_ERR (AAFF_INDEX_INVALID)
+
+   // Check that the index has been written for the given, unchanged image files. The
+   // file array is sorted like in the index, as the seek array refers to file numbers.
+   // ---------------------------------------------------------------------------------
+   if (pHeader->Files != pAaff->Files)
+      RET_ERR (AAFF_INDEX_OUTDATED)
+   GET (pIndexFileArr, pHeader->Files * sizeof (t_AaffIndexFile))
+   for (i=0; i<pAaff->Files; i++)
+   {
+      pIndexFile = &pIndexFileArr[i];
+      GET (pStr, pIndexFile->NameLen)
+      for (j=i; j<pAaff->Files; j++)
       {
-         Entry--;
-         if (Entry<0)
-            return AAFF_SEEKARR_CORRUPT;
+         if ((strlen (pAaff->pFileArr[j].pName) == pIndexFile->NameLen) &&
+             (memcmp (pAaff->pFileArr[j].pName, pStr, pIndexFile->NameLen) == 0))
+            break;
       }
-      AaffSetCurrentSeekPos (pAaff, pAaff->pPageSeekArr[Entry], SEEK_SET);
-      MaxHops = Page - (Entry * pAaff->Interleave) +1;
+      if (j >= pAaff->Files)
+         RET_ERR (AAFF_INDEX_OUTDATED)
+      FileEntry           = pAaff->pFileArr[i];
+      pAaff->pFileArr[i] = pAaff->pFileArr[j];
+      pAaff->pFileArr[j] = FileEntry;
+
+      if (AaffFileStat (pAaff->pFileArr[i].pName, &FileSize, &MTimeSec, &MTimeNSec) != AAFF_OK)
+         RET_ERR (AAFF_INDEX_OUTDATED)
+      if ((FileSize  != pIndexFile->FileSize) ||
+          (MTimeSec  != pIndexFile->MTimeSec) ||
+          (MTimeNSec != pIndexFile->MTimeNSec))
+         RET_ERR (AAFF_INDEX_OUTDATED)
+      if (pIndexFile->FirstPageSeek >= FileSize)
+         RET_ERR (AAFF_INDEX_INVALID)
+      pAaff->pFileArr[i].Size          = FileSize;
+      pAaff->pFileArr[i].FirstPageSeek = pIndexFile->FirstPageSeek;
+      pAaff->pFileArr[i].FirstPage     = pIndexFile->FirstPage;
+   }
+   if (pAaff->pFileArr[0].FirstPage != 0)
+      RET_ERR (AAFF_INDEX_INVALID)
+
+   // Header info and page seek array
+   // -------------------------------
+   if ((pHeader->PageSize == 0) || (pHeader->TotalPages == 0))
+      RET_ERR (AAFF_INDEX_INVALID)
+   pAaff->PageSize   = pHeader->PageSize;
+   pAaff->SectorSize = pHeader->SectorSize;
+   pAaff->Sectors    = pHeader->Sectors;
+   pAaff->ImageSize  = pHeader->ImageSize;
+   pAaff->TotalPages = pHeader->TotalPages;
+   AaffCalcInterleave (pAaff);
+   if ((pAaff->Interleave     != pHeader->Interleave) ||   // aaffmaxmem changed
+       (pAaff->PageSeekArrLen != pHeader->PageSeekArrLen))
+      RET_ERR (AAFF_INDEX_OUTDATED)
+
+   GET (pSeekArr, pHeader->PageSeekArrLen * sizeof (uint64_t))
+   pAaff->pPageSeekArr = (uint64_t *) malloc (pHeader->PageSeekArrLen * sizeof (uint64_t));
+   if (pAaff->pPageSeekArr == NULL)
+      RET_ERR (AAFF_MEMALLOC_FAILED)
+   memcpy (pAaff->pPageSeekArr, pSeekArr, pHeader->PageSeekArrLen * sizeof (uint64_t));
+   for (uint64_t k=0; k<pAaff->PageSeekArrLen; k++)
+   {
+      Seek = pAaff->pPageSeekArr[k];
+      if ((Seek == 0) || (AAFF_SEEK_FILENR (Seek) >= pAaff->Files) ||
+          (AAFF_SEEK_OFS (Seek) >= pAaff->pFileArr[AAFF_SEEK_FILENR (Seek)].Size))
+         RET_ERR (AAFF_INDEX_INVALID)
    }
 
-   // Run through segment list until page is found
-   // --------------------------------------------
-   uint64_t Seek;
-   uint64_t FoundPage=0;
-   int                rc;
+   GET (pStr, pHeader->LibVersionLen)
+   pAaff->pLibVersion = strndup (pStr, pHeader->LibVersionLen);
+   GET (pStr, pHeader->FileTypeLen)
+   pAaff->pFileType   = strndup (pStr, pHeader->FileTypeLen);
+   if ((pAaff->pLibVersion == NULL) || (pAaff->pFileType == NULL))
+      RET_ERR (AAFF_MEMALLOC_FAILED)
+   if (((uint64_t)(pEnd - pCur) != pHeader->InfoLen) || (pHeader->InfoLen >= (uint64_t) AaffInfoBuffLen))
+      RET_ERR (AAFF_INDEX_INVALID)
+   memcpy (pAaff->pInfoBuffConst, pCur, pHeader->InfoLen);
+   pAaff->pInfoBuffConst[pHeader->InfoLen] = '\0';
+
+   pAaff->ScanState = AAFF_SCAN_INDEX;
+   pAaff->ScanPages = pAaff->TotalPages;
+
+   #undef RET_ERR
+   #undef GET
+
+CleanUp:
+   free (pData);
+   if (rc != AAFF_OK)
+   {
+      free (pAaff->pPageSeekArr);
+      free (pAaff->pLibVersion);
+      free (pAaff->pFileType);
+      pAaff->pPageSeekArr   = NULL;
+      pAaff->pLibVersion    = NULL;
+      pAaff->pFileType      = NULL;
+      pAaff->PageSeekArrLen = 0;
+   }
+   return rc;
+}
+
+// AaffIndexSave is called by the scan thread as soon as the page seek array is complete.
+// The index first is written to a temporary file which then is renamed, so concurrent
+// mounts never see a partial index.
+
+static int AaffIndexSave (t_pAaff pAaff)
+{
+   t_AaffIndexHeader  Header;
+   t_pAaffIndexFile  pIndexFileArr;
+   FILE             *pFile;
+   char             *pTmpPath  = NULL;
+   uint32_t           Adler   = adler32 (0, Z_NULL, 0);
+   int                rc      = AAFF_OK;
+
+   #define WRITE(pSrc, Len)                                   \
+   {                                                          \
+      if (fwrite ((pSrc), (Len), 1, pFile) != 1)              \
+      {                                                       \
+         rc = AAFF_INDEX_WRITE_FAILED;                        \
+         goto CleanUp;                                        \
+      }                                                       \
+      Adler = adler32 (Adler, (const Bytef *) (pSrc), (Len)); \
+   }
 
-   LOG ("Searching for page %" PRIu64 ", MaxHops=%d", Page, MaxHops);
-   while (MaxHops--)
+   pIndexFileArr = (t_pAaffIndexFile) calloc (pAaff->Files, sizeof (t_AaffIndexFile));
+   if (pIndexFileArr == NULL)
+      return AAFF_MEMALLOC_FAILED;
+   for (unsigned i=0; i<pAaff->Files; i++)
    {
-      Seek = AaffGetCurrentSeekPos (pAaff);
-      rc   = AaffReadSegmentPage   (pAaff, Page, &FoundPage, ppBuffer, pLen);
-      if (rc != AAFF_FOUND)
-         CHK (rc)
-      LOG ("   %" PRIu64 " (%d)", FoundPage, rc);
-      if ((FoundPage % pAaff->Interleave) == 0)
-         pAaff->pPageSeekArr[FoundPage/pAaff->Interleave] = Seek;
-      if (rc == AAFF_FOUND)
+      t_pAaffIndexFile pIndexFile = &pIndexFileArr[i];
+      uint64_t          FileSize;
+      int64_t           MTimeSec;
+      int64_t           MTimeNSec;
+
+      if (AaffFileStat (pAaff->pFileArr[i].pName, &FileSize, &MTimeSec, &MTimeNSec) != AAFF_OK)
+      {
+         free (pIndexFileArr);
+         return AAFF_FILE_OPEN_FAILED;
+      }
+      pIndexFile->FileSize      = FileSize;
+      pIndexFile->MTimeSec      = MTimeSec;
+      pIndexFile->MTimeNSec     = MTimeNSec;
+      pIndexFile->NameLen       = strlen (pAaff->pFileArr[i].pName);
+      pIndexFile->FirstPageSeek = pAaff->pFileArr[i].FirstPageSeek;
+      pIndexFile->FirstPage     = pAaff->pFileArr[i].FirstPage;
+   }
+   if (asprintf (&pTmpPath, "%s.tmp_%d", pAaff->pIndexPath, getpid()) < 0)
+   {
+      free (pIndexFileArr);
+      return AAFF_MEMALLOC_FAILED;
+   }
+   pFile = fopen (pTmpPath, "w");
+   if (pFile == NULL)
+   {
+      free (pIndexFileArr);
+      free (pTmpPath);
+      return AAFF_FILE_OPEN_FAILED;
+   }
+
+   memset (&Header, 0, sizeof (Header));
+   memcpy (Header.Magic, AAFF_INDEX_MAGIC, sizeof (Header.Magic));
+   Header.Version        = AAFF_INDEX_VERSION;
+   Header.HeaderSize     = sizeof (t_AaffIndexHeader);
+   Header.Files          = pAaff->Files;
+   Header.PageSize       = pAaff->PageSize;
+   Header.SectorSize     = pAaff->SectorSize;
+   Header.Sectors        = pAaff->Sectors;
+   Header.ImageSize      = pAaff->ImageSize;
+   Header.TotalPages     = pAaff->TotalPages;
+   Header.Interleave     = pAaff->Interleave;
+   Header.PageSeekArrLen = pAaff->PageSeekArrLen;
+   Header.LibVersionLen  = pAaff->pLibVersion ? strlen (pAaff->pLibVersion) : 0;
+   Header.FileTypeLen    = pAaff->pFileType   ? strlen (pAaff->pFileType)   : 0;
+   Header.InfoLen        = strlen (pAaff->pInfoBuffConst);
+   WRITE (&Header, sizeof (Header))
+   WRITE (pIndexFileArr, pAaff->Files * sizeof (t_AaffIndexFile))
+   for (unsigned i=0; i<pAaff->Files; i++)
+      WRITE (pAaff->pFileArr[i].pName, pIndexFileArr[i].NameLen)
+
+   pthread_mutex_lock (&pAaff->SeekArrMutex);   // AaffLocatePage still might update entries (with the same values)
+   if (fwrite (pAaff->pPageSeekArr, pAaff->PageSeekArrLen * sizeof (uint64_t), 1, pFile) != 1)
+      rc = AAFF_INDEX_WRITE_FAILED;
+   else
+      Adler = adler32 (Adler, (const Bytef *) pAaff->pPageSeekArr, pAaff->PageSeekArrLen * sizeof (uint64_t));
+   pthread_mutex_unlock (&pAaff->SeekArrMutex);
+   if (rc != AAFF_OK)
+      goto CleanUp;
+
+   if (Header.LibVersionLen)
+      WRITE (pAaff->pLibVersion, Header.LibVersionLen)
+   if (Header.FileTypeLen)
+      WRITE (pAaff->pFileType, Header.FileTypeLen)
+   if (Header.InfoLen)
+      WRITE (pAaff->pInfoBuffConst, Header.InfoLen)
+   if (fwrite (&Adler, sizeof (Adler), 1, pFile) != 1)
+      rc = AAFF_INDEX_WRITE_FAILED;
+
+   #undef WRITE
+
+CleanUp:
+   if (fclose (pFile) && (rc == AAFF_OK))
+      rc = AAFF_INDEX_WRITE_FAILED;
+   if ((rc == AAFF_OK) && rename (pTmpPath, pAaff->pIndexPath))
+      rc = AAFF_INDEX_WRITE_FAILED;
+   if (rc != AAFF_OK)
+      (void) unlink (pTmpPath);
+   else
+      LOG ("Index file %s written", pAaff->pIndexPath)
+   free (pTmpPath);
+   free (pIndexFileArr);
+
+   return rc;
+}
+
+// AaffThreadScan is started at the end of AaffOpen. It walks through the segments of all
+// files and fills in every entry of the page seek array, so that random reads need no
+// more than a single seek once it is done. It uses its own file descriptors, the file
+// cache is left to the readers.
+static void* AaffThreadScan (void *pArg)
+{
+   t_pAaff            pAaff = (t_pAaff) pArg;
+   t_AffSegmentHeader Header;
+   char               Name[AAFF_SCAN_MAX_NAMELEN+1];
+   t_pAaffFile       pFileEntry;
+   uint64_t           Seek;
+   uint64_t           SegmentLen;
+   uint64_t           Page;
+   uint64_t           Pages = 0;
+   uint8_t            Abort = FALSE;
+   time_t             StartT, EndT;
+   int                File;
+   int                rc = AAFF_OK;
+
+   time (&StartT);
+   for (unsigned FileNr=0; (FileNr<pAaff->Files) && (rc == AAFF_OK) && !Abort && (Pages < pAaff->TotalPages); FileNr++)
+   {
+      pFileEntry = &pAaff->pFileArr[FileNr];
+      if (pFileEntry->FirstPageSeek == 0)
+         continue;
+      File = open (pFileEntry->pName, O_RDONLY);
+      if (File < 0)
+      {
+         rc = AAFF_FILE_OPEN_FAILED;
          break;
+      }
+      Seek = pFileEntry->FirstPageSeek;
+      while ((Seek < pFileEntry->Size) && !Abort && (Pages < pAaff->TotalPages))
+      {
+         rc = AaffReadSegmentHeader (File, Seek, &Header, &Name[0], &SegmentLen);
+         if (rc != AAFF_OK)
+            break;
+         if (AaffPageNumberFromSegmentName (&Name[0], &Page) == AAFF_OK)   // Other segments are skipped
+         {
+            if (Page >= pAaff->TotalPages)
+            {
+               rc = AAFF_INVALID_PAGE_NUMBER;
+               break;
+            }
+            pthread_mutex_lock (&pAaff->SeekArrMutex);
+            if ((Page % pAaff->Interleave) == 0)
+               pAaff->pPageSeekArr[Page/pAaff->Interleave] = AAFF_SEEK (FileNr, Seek);
+            pAaff->ScanPages = ++Pages;
+            Abort = pAaff->ScanAbort;
+            pthread_mutex_unlock (&pAaff->SeekArrMutex);
+         }
+         Seek += SegmentLen;
+      }
+      (void) close (File);
    }
-   if (MaxHops < 0)
-      return AAFF_PAGE_NOT_FOUND;
+   time (&EndT);
 
-   return AAFF_OK;
+   pthread_mutex_lock (&pAaff->SeekArrMutex);
+   if      (rc != AAFF_OK)               pAaff->ScanState = AAFF_SCAN_FAILED;
+   else if (Pages == pAaff->TotalPages)  pAaff->ScanState = AAFF_SCAN_DONE;
+   else                                  pAaff->ScanState = AAFF_SCAN_STOPPED;
+   pAaff->ScanSeconds = (uint64_t) (EndT - StartT);
+   pthread_mutex_unlock (&pAaff->SeekArrMutex);
+
+   if ((rc == AAFF_OK) && (Pages == pAaff->TotalPages) && pAaff->pIndexPath)
+   {
+      rc = AaffIndexSave (pAaff);
+      if (rc != AAFF_OK)
+         LOG ("Writing index file %s failed (%s)", pAaff->pIndexPath, AaffGetErrorMessage (rc))
+      rc = AAFF_OK;
+   }
+
+   if (rc != AAFF_OK)
+      LOG ("Page scan failed after %" PRIu64 " pages: %s", Pages, AaffGetErrorMessage(rc))
+   else
+      LOG ("Page scan ended after %" PRIu64 " of %" PRIu64 " pages and %" PRIu64 " s, seek array uses %" PRIu64 " bytes",
+           Pages, pAaff->TotalPages, pAaff->ScanSeconds, pAaff->PageSeekArrLen * sizeof(uint64_t))
+
+   return NULL;
 }
 
 // ---------------
@@ -424,7 +1178,12 @@ static int AaffCreateHandle (void **ppHandle, const char *pFormat, uint8_t Debug
 
    memset (pAaff, 0, sizeof(t_Aaff));
    pAaff->MaxPageArrMem = AAFF_DEFAULT_MAX_PAGE_ARR_MEM;
+   pAaff->PageCacheMem  = AAFF_DEFAULT_PAGE_CACHE_MEM;
+   pAaff->Threads       = AAFF_DEFAULT_THREADS;
+   pAaff->MaxOpenFiles  = AAFF_DEFAULT_MAX_OPEN_FILES;
    pAaff->LogStdout     = Debug;
+   pthread_mutex_init (&pAaff->SeekArrMutex, NULL);
+   pthread_mutex_init (&pAaff->FileMutex   , NULL);
 
    *ppHandle = (void*) pAaff;
 
@@ -435,15 +1194,32 @@ static int AaffDestroyHandle (void **ppHandle)
 {
    t_pAaff pAaff = (t_pAaff) *ppHandle;
 
-   if (pAaff->pFilename)       free (pAaff->pFilename);
+   if (pAaff->pFileArr)
+   {
+      for (unsigned i=0; i<pAaff->Files; i++)
+         free (pAaff->pFileArr[i].pName);
+      free (pAaff->pFileArr);
+   }
+   if (pAaff->pIndexPath)      free (pAaff->pIndexPath);
    if (pAaff->pPageSeekArr)    free (pAaff->pPageSeekArr);
    if (pAaff->pLibVersion)     free (pAaff->pLibVersion);
    if (pAaff->pFileType)       free (pAaff->pFileType);
    if (pAaff->pNameBuff)       free (pAaff->pNameBuff);
    if (pAaff->pDataBuff)       free (pAaff->pDataBuff);
-   if (pAaff->pPageBuff)       free (pAaff->pPageBuff);
+   if (pAaff->pPageCache)
+   {
+      for (unsigned i=0; i<pAaff->PageCacheLen; i++)
+      {
+         free (pAaff->pPageCache[i].pData);
+         free (pAaff->pPageCache[i].pRaw);
+      }
+      free (pAaff->pPageCache);
+   }
+   if (pAaff->ppLoopPageArr)   free (pAaff->ppLoopPageArr);
    if (pAaff->pInfoBuffConst)  free (pAaff->pInfoBuffConst);
    if (pAaff->pInfoBuff)       free (pAaff->pInfoBuff);
+   pthread_mutex_destroy (&pAaff->SeekArrMutex);
+   pthread_mutex_destroy (&pAaff->FileMutex);
 
    memset (pAaff, 0, sizeof(t_Aaff));
    free (pAaff);
@@ -452,41 +1228,98 @@ static int AaffDestroyHandle (void **ppHandle)
    return AAFF_OK;
 }
 
+static int AaffAddFile (t_pAaff pAaff, const char *pFilename)
+{
+   t_pAaffFile pFileArr;
+   t_pAaffFile pFileEntry;
 
-int AaffOpen (void *pHandle, const char **ppFilenameArr, uint64_t FilenameArrLen)
+   if (pAaff->Files >= AAFF_MAX_FILES)
+      return AAFF_TOO_MANY_FILES;
+   pFileArr = (t_pAaffFile) realloc (pAaff->pFileArr, (pAaff->Files+1) * sizeof (t_AaffFile));
+   if (pFileArr == NULL)
+      return AAFF_MEMALLOC_FAILED;
+   pAaff->pFileArr = pFileArr;
+
+   pFileEntry = &pFileArr[pAaff->Files];
+   memset (pFileEntry, 0, sizeof (t_AaffFile));
+   pFileEntry->File      = -1;
+   pFileEntry->FirstPage = UINT64_MAX;
+   pFileEntry->pName     = realpath (pFilename, NULL);
+   if (pFileEntry->pName == NULL)
+   {
+      LOG ("Cannot find %s", pFilename)
+      return AAFF_FILE_OPEN_FAILED;
+   }
+   pAaff->Files++;
+
+   return AAFF_OK;
+}
+
+static int AaffFilterAff (const struct dirent *pEntry)
 {
-   t_pAaff  pAaff = (t_pAaff) pHandle;
-   char      Signature[strlen(AFF_HEADER)+1];
-   uint64_t  Seek;
+   size_t Len = strlen (pEntry->d_name);
 
-   LOG ("Called - Files=%" PRIu64, FilenameArrLen);
+   return (Len > strlen(AAFF_AFD_EXTENSION)) && (strcasecmp (&pEntry->d_name[Len-strlen(AAFF_AFD_EXTENSION)], AAFF_AFD_EXTENSION) == 0);
+}
 
-   if (FilenameArrLen != 1)
-      CHK (AAFF_SPLIT_IMAGES_NOT_SUPPORTED)
+// AaffAddFiles adds the given image file to the file array. If it is a directory (afflib's
+// AFD format), all AFF files inside are added instead.
+static int AaffAddFiles (t_pAaff pAaff, const char *pFilename)
+{
+   struct stat      Stat;
+   struct dirent **ppEntryArr;
+   char           *pPath;
+   int              Entries;
+   int              rc = AAFF_OK;
 
-   pAaff->pFilename = strdup (ppFilenameArr[0]);
-   pAaff->pFile     = fopen  (ppFilenameArr[0],"r");
-   if(pAaff->pFile==NULL)
+   if (stat (pFilename, &Stat))
    {
-      (void) AaffDestroyHandle ((void**) &pAaff);
-      CHK (AAFF_FILE_OPEN_FAILED)
+      LOG ("Cannot find %s", pFilename)
+      return AAFF_FILE_OPEN_FAILED;
    }
-
-   // Check signature
-   // ---------------
-   CHK (AaffReadFile (pAaff, &Signature, sizeof(Signature)))
-   if (memcmp (Signature, AFF_HEADER, sizeof(Signature)) !=0)
+   if (!S_ISDIR (Stat.st_mode))
+      return AaffAddFile (pAaff, pFilename);
+
+   Entries = scandir (pFilename, &ppEntryArr, AaffFilterAff, alphasort);
+   if (Entries < 0)
+      return AAFF_FILE_OPEN_FAILED;
+   LOG ("Directory %s contains %d AFF files", pFilename, Entries)
+   for (int i=0; i<Entries; i++)
    {
-      (void)AaffClose((void**)&pAaff);
-      CHK (AAFF_INVALID_SIGNATURE)
+      if (rc == AAFF_OK)
+      {
+         if (asprintf (&pPath, "%s/%s", pFilename, ppEntryArr[i]->d_name) < 0)
+         {
+            rc = AAFF_MEMALLOC_FAILED;
+         }
+         else
+         {
+            rc = AaffAddFile (pAaff, pPath);
+            free (pPath);
+         }
+      }
+      free (ppEntryArr[i]);
    }
+   free (ppEntryArr);
+   if ((rc == AAFF_OK) && (Entries == 0))
+      rc = AAFF_FILE_OPEN_FAILED;
 
-   // Read header segments
-   // --------------------
+   return rc;
+}
+
+// AaffReadHeaderSegments reads the segments in front of the first page of a file. The header
+// info is taken from all files, the info text only from the first one.
+static int AaffReadHeaderSegments (t_pAaff pAaff, unsigned FileNr, int File)
+{
+   t_pAaffFile    pFileEntry = &pAaff->pFileArr[FileNr];
+   char            Signature[strlen(AFF_HEADER)+1];
    char          *pName;
    uint32_t        Arg;
    char          *pData;
    uint32_t        DataLen;
+   uint64_t        Seek;
+   uint64_t        SegmentSeek;
+   uint64_t        Page;
    const int       MAX_HEADER_SEGMENTS = 100;
    int             Seg;
    unsigned int    i;
@@ -494,27 +1327,37 @@ int AaffOpen (void *pHandle, const char **ppFilenameArr, uint64_t FilenameArrLen
    int             Pos = 0;
    const unsigned  HexStrLen = 32;
    char            HexStr[HexStrLen+1];
+   uint8_t         Info = (FileNr == 0);
 
    #define REM (AaffInfoBuffLen-Pos)
 
-   pAaff->pInfoBuffConst = (char *) malloc (AaffInfoBuffLen);
-   pAaff->pInfoBuff      = (char *) malloc (AaffInfoBuffLen*2);
+   // Check signature
+   // ---------------
+   CHK (AaffReadFilePos (File, &Signature, sizeof(Signature), 0))
+   if (memcmp (Signature, AFF_HEADER, sizeof(Signature)) !=0)
+   {
+      LOG ("Invalid signature in %s", pFileEntry->pName)
+      return AAFF_INVALID_SIGNATURE;
+   }
 
    // Search for known segments at the image start
-   for (Seg=0; Seg<MAX_HEADER_SEGMENTS; Seg++)
+   Seek = sizeof(Signature);
+   for (Seg=0; (Seg<MAX_HEADER_SEGMENTS) && (Seek < pFileEntry->Size); Seg++)
    {
-      Seek = AaffGetCurrentSeekPos (pAaff);
-      CHK (AaffReadSegment (pAaff, &pName, &Arg, &pData, &DataLen))
+      SegmentSeek = Seek;
+      CHK (AaffReadSegment (pAaff, File, &Seek, &pName, &Arg, &pData, &DataLen))
 
       if      (strcmp (pName, AFF_SEGNAME_PAGESIZE)       == 0 )    pAaff->PageSize    = Arg;
       else if (strcmp (pName, AFF_SEGNAME_SECTORSIZE)     == 0 )    pAaff->SectorSize  = Arg;
       else if (strcmp (pName, AFF_SEGNAME_SECTORS)        == 0 )    pAaff->Sectors     = AaffU64(pData);
       else if (strcmp (pName, AFF_SEGNAME_IMAGESIZE)      == 0 )    pAaff->ImageSize   = AaffU64(pData);
-      else if (strcmp (pName, AFF_SEGNAME_AFFLIB_VERSION) == 0 )    pAaff->pLibVersion = strdup((char*)pData);
-      else if (strcmp (pName, AFF_SEGNAME_FILETYPE)       == 0 )    pAaff->pFileType   = strdup((char*)pData);
+      else if (strcmp (pName, AFF_SEGNAME_AFFLIB_VERSION) == 0 )  { if (pAaff->pLibVersion == NULL) pAaff->pLibVersion = strdup((char*)pData); }
+      else if (strcmp (pName, AFF_SEGNAME_FILETYPE)       == 0 )  { if (pAaff->pFileType   == NULL) pAaff->pFileType   = strdup((char*)pData); }
       else if ((strcmp(pName, AFF_SEGNAME_GID)            == 0 ) ||
                (strcmp(pName, AFF_SEGNAME_BADFLAG)        == 0 ))
       {
+         if (!Info)
+            continue;
          wr=0;
          for (i=0; i<GETMIN(DataLen,HexStrLen/2); i++)
             wr += sprintf (&HexStr[wr], "%02X", pData[i]);
@@ -526,60 +1369,179 @@ int AaffOpen (void *pHandle, const char **ppFilenameArr, uint64_t FilenameArrLen
       }
       else if (strncmp(pName,AFF_SEGNAME_PAGE,strlen(AFF_SEGNAME_PAGE))==0)
       {
-         break;
+         if (AaffPageNumberFromSegmentName (pName, &Page) == AAFF_OK)   // Not for other page related segments, like page<n>_md5
+         {
+            pFileEntry->FirstPageSeek = SegmentSeek;
+            pFileEntry->FirstPage     = Page;
+            break;
+         }
       }
       else
       {
-         if ((Arg == 0) && DataLen)
+         if (Info && (Arg == 0) && DataLen)
          Pos += snprintf (&(pAaff->pInfoBuffConst[Pos]), REM,"%-25s %s\n", pName, pData);
       }
    }
    #undef REM
 
-   if (Seg >= MAX_HEADER_SEGMENTS)
-   {
-      (void) AaffClose ((void**)&pAaff);
-      CHK (AAFF_TOO_MANY_HEADER_SEGEMENTS)
-   }
+   if ((Seg >= MAX_HEADER_SEGMENTS) && (pFileEntry->FirstPageSeek == 0))
+      return AAFF_TOO_MANY_HEADER_SEGEMENTS;
 
-   if (strstr (pAaff->pLibVersion, "Guymager") == NULL)
-   {
-      (void) AaffClose ((void**)&pAaff);
-      CHK (AAFF_NOT_CREATED_BY_GUYMAGER)
-   }
+   if (pFileEntry->FirstPageSeek)
+        LOG ("%s: First page %" PRIu64 " at %" PRIu64, pFileEntry->pName, pFileEntry->FirstPage, pFileEntry->FirstPageSeek)
+   else LOG ("%s: No pages", pFileEntry->pName)
 
-   // Prepare page seek array
-   // -----------------------
-   uint64_t MaxEntries;
-   int      ArrBytes;
+   return AAFF_OK;
+}
+
+static int AaffReadHeader (t_pAaff pAaff, unsigned FileNr)
+{
+   t_pAaffFile pFileEntry = &pAaff->pFileArr[FileNr];
+   int64_t      MTimeSec;
+   int64_t      MTimeNSec;
+   int          File;
+   int          rc;
+
+   CHK (AaffFileStat (pFileEntry->pName, &pFileEntry->Size, &MTimeSec, &MTimeNSec))
+   CHK (AaffOpenFile (pAaff, FileNr, &File))
+   rc = AaffReadHeaderSegments (pAaff, FileNr, File);
+   AaffReleaseFile (pAaff, FileNr);
+   CHK (rc)
+
+   return AAFF_OK;
+}
+
+static int AaffCompareFiles (const void *pA, const void *pB)
+{
+   uint64_t FirstPageA = ((const t_AaffFile *) pA)->FirstPage;
+   uint64_t FirstPageB = ((const t_AaffFile *) pB)->FirstPage;
+
+   if (FirstPageA < FirstPageB) return -1;
+   if (FirstPageA > FirstPageB) return  1;
+   return 0;
+}
+
+// AaffPrepareSeekArr is called after the headers of all files have been read. It sorts
+// the files by their first page and sets up the page seek array.
+static int AaffPrepareSeekArr (t_pAaff pAaff)
+{
+   if ((pAaff->PageSize == 0) || (pAaff->ImageSize == 0))
+      return AAFF_HEADER_INCOMPLETE;
+   if ((pAaff->pLibVersion == NULL) || (strstr (pAaff->pLibVersion, "Guymager") == NULL))
+      LOG ("Image not created by Guymager (%s)", pAaff->pLibVersion ? pAaff->pLibVersion : "no afflib version segment")
+
+   qsort (pAaff->pFileArr, pAaff->Files, sizeof (t_AaffFile), AaffCompareFiles);
+   if (pAaff->pFileArr[0].FirstPage != 0)
+      return AAFF_UNEXPECTED_PAGE_NUMBER;
 
    pAaff->TotalPages = pAaff->ImageSize / pAaff->PageSize;
    if (pAaff->ImageSize % pAaff->PageSize)
       pAaff->TotalPages++;
 
-   MaxEntries = (pAaff->MaxPageArrMem*1024*1024) / (sizeof (unsigned long long *) + 1); // +1 in order not to risk a result of 0
-   MaxEntries = GETMIN (MaxEntries, pAaff->TotalPages);
+   AaffCalcInterleave (pAaff);
+   pAaff->pPageSeekArr = (uint64_t*) calloc (pAaff->PageSeekArrLen, sizeof(uint64_t));
+   if (pAaff->pPageSeekArr == NULL)
+      return AAFF_MEMALLOC_FAILED;
+   pAaff->pPageSeekArr[0] = AAFF_SEEK (0, pAaff->pFileArr[0].FirstPageSeek);
 
-   pAaff->Interleave = pAaff->TotalPages / MaxEntries;
-   if (pAaff->TotalPages % MaxEntries)
-      pAaff->Interleave++;
+   return AAFF_OK;
+}
 
-   pAaff->PageSeekArrLen = pAaff->TotalPages / pAaff->Interleave;
-   ArrBytes              = pAaff->PageSeekArrLen * sizeof(uint64_t *);
-   pAaff->pPageSeekArr   = (uint64_t*)malloc (ArrBytes);
-   memset (pAaff->pPageSeekArr, 0, ArrBytes);
-   CHK (AaffPageNumberFromSegmentName (pName, &pAaff->CurrentPage));
-   if (pAaff->CurrentPage != 0)
+int AaffOpen (void *pHandle, const char **ppFilenameArr, uint64_t FilenameArrLen)
+{
+   t_pAaff  pAaff = (t_pAaff) pHandle;
+   int       rc    = AAFF_OK;
+
+   LOG ("Called - Files=%" PRIu64, FilenameArrLen);
+
+   pAaff->pInfoBuffConst = (char *) malloc (AaffInfoBuffLen);
+   pAaff->pInfoBuff      = (char *) malloc (AaffInfoBuffLen*2);
+   if ((pAaff->pInfoBuffConst == NULL) || (pAaff->pInfoBuff == NULL))
+      CHK (AAFF_MEMALLOC_FAILED)
+   pAaff->pInfoBuffConst[0] = '\0';
+
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+      CHK (AaffAddFiles (pAaff, ppFilenameArr[i]))
+   if (pAaff->Files == 0)
+      CHK (AAFF_FILE_OPEN_FAILED)
+   if (pAaff->MaxOpenFiles == 0)
+      pAaff->MaxOpenFiles = 1;
+   LOG ("%u image files, max. %" PRIu64 " open at the same time", pAaff->Files, pAaff->MaxOpenFiles)
+
+   // Get header info and page seek array, either from the index file or from the image
+   // ----------------------------------------------------------------------------------
+   if (pAaff->pIndexPath)
+   {
+      rc = AaffIndexLoad (pAaff);
+      if (rc == AAFF_OK)
+           LOG ("Header info and page seek array read from index file %s", pAaff->pIndexPath)
+      else LOG ("Index file %s not usable (%s), scanning image", pAaff->pIndexPath, AaffGetErrorMessage (rc))
+   }
+   if ((pAaff->pIndexPath == NULL) || (rc != AAFF_OK))
    {
-      (void) AaffClose ((void**)&pAaff);
-      CHK (AAFF_UNEXPECTED_PAGE_NUMBER)
+      rc = AAFF_OK;
+      for (unsigned FileNr=0; (FileNr<pAaff->Files) && (rc == AAFF_OK); FileNr++)
+         rc = AaffReadHeader (pAaff, FileNr);
+      if (rc == AAFF_OK)
+         rc = AaffPrepareSeekArr (pAaff);
+      if (rc != AAFF_OK)
+      {
+         (void) AaffClose (pAaff);
+         CHK (rc)
+      }
+   }
+
+   // Alloc page cache
+   // ----------------
+   pAaff->CurrentPage  = AAFF_CURRENTPAGE_NOTSET;
+   pAaff->LastReadPage = AAFF_CURRENTPAGE_NOTSET;
+   if (pAaff->Threads == 0)
+      pAaff->Threads = 1;
+   pAaff->PageCacheLen  = GETMAX ((pAaff->PageCacheMem*1024*1024) / pAaff->PageSize, 2);
+   pAaff->PageCacheLen  = GETMIN (pAaff->PageCacheLen, AAFF_MAX_PAGE_CACHE_LEN);
+   pAaff->PagesPerLoop  = GETMAX (GETMIN (pAaff->Threads, pAaff->PageCacheLen/2), 1);   // The pages of one loop in AaffRead plus the
+   pAaff->pPageCache    = (t_pAaffPage)  calloc (pAaff->PageCacheLen, sizeof (t_AaffPage));  // prefetched ones must fit into the cache
+   pAaff->ppLoopPageArr = (t_pAaffPage*) calloc (pAaff->PagesPerLoop, sizeof (t_pAaffPage));
+   if ((pAaff->pPageCache == NULL) || (pAaff->ppLoopPageArr == NULL))
+   {
+      (void) AaffClose (pAaff);
+      CHK (AAFF_MEMALLOC_FAILED)
    }
-   pAaff->pPageSeekArr[0] = Seek;
+   for (unsigned i=0; i<pAaff->PageCacheLen; i++)
+   {
+      t_pAaffPage pPage = &pAaff->pPageCache[i];
 
-   // Alloc Buffers
-   // -------------
-   pAaff->pPageBuff   = (char *) malloc (pAaff->PageSize);
-   pAaff->CurrentPage = AAFF_CURRENTPAGE_NOTSET;
+      pPage->pAaff = pAaff;
+      pPage->Page  = AAFF_CURRENTPAGE_NOTSET;
+      pPage->State = AAFF_PAGE_EMPTY;
+      pPage->pData = (char *) malloc (pAaff->PageSize);
+      if (pPage->pData == NULL)
+      {
+         (void) AaffClose (pAaff);
+         CHK (AAFF_MEMALLOC_FAILED)
+      }
+   }
+   LOG ("Page cache with %u pages, %" PRIu64 " threads", pAaff->PageCacheLen, pAaff->Threads)
+
+   // Start background scan for filling the page seek array
+   // ------------------------------------------------------
+   if (pAaff->ScanState == AAFF_SCAN_INDEX)
+   {
+      LOG ("Page seek array complete, no scan needed")
+   }
+   else
+   {
+      pAaff->ScanState = AAFF_SCAN_RUNNING;
+      if (pthread_create (&pAaff->ScanThread, NULL, AaffThreadScan, pAaff) == 0)
+      {
+         pAaff->ScanThreadStarted = TRUE;
+      }
+      else
+      {
+         pAaff->ScanState = AAFF_SCAN_FAILED;
+         LOG ("Cannot start page scan thread, page seek array will be filled on the fly")
+      }
+   }
 
    LOG ("Ret");
    return AAFF_OK;
@@ -592,8 +1554,31 @@ static int AaffClose (void *pHandle)
 
    LOG ("Called");
 
-   if (fclose (pAaff->pFile))
-      rc = AAFF_CANNOT_CLOSE_FILE;
+   for (unsigned i=0; pAaff->pPageCache && (i<pAaff->PageCacheLen); i++)
+   {
+      if (pAaff->pPageCache[i].State == AAFF_PAGE_LAUNCHED)
+         (void) AaffPageWait (pAaff, &pAaff->pPageCache[i]);
+   }
+
+   if (pAaff->ScanThreadStarted)
+   {
+      pthread_mutex_lock   (&pAaff->SeekArrMutex);
+      pAaff->ScanAbort = TRUE;
+      pthread_mutex_unlock (&pAaff->SeekArrMutex);
+      pthread_join (pAaff->ScanThread, NULL);
+      pAaff->ScanThreadStarted = FALSE;
+   }
+
+   for (unsigned i=0; i<pAaff->Files; i++)
+   {
+      if (pAaff->pFileArr[i].File >= 0)
+      {
+         if (close (pAaff->pFileArr[i].File))
+            rc = AAFF_CANNOT_CLOSE_FILE;
+         pAaff->pFileArr[i].File = -1;
+      }
+   }
+   pAaff->OpenFiles = 0;
 
    LOG ("Ret");
    return rc;
@@ -612,13 +1597,15 @@ static int AaffSize (void *pHandle, uint64_t *pSize)
 
 static int AaffRead (void *pHandle, char *pBuf, off_t Seek, size_t Count, size_t *pRead, int *pErrno)
 {
-   t_pAaff   pAaff = (t_pAaff) pHandle;
-   char     *pPageBuffer=NULL;
-   uint64_t   Page;
-   uint64_t   Seek64;
-   uint64_t   Remaining;
-   uint32_t   PageLen=0, Ofs, ToCopy;
-   int        Ret = AAFF_OK;
+   t_pAaff      pAaff = (t_pAaff) pHandle;
+   t_pAaffPage pPage;
+   uint64_t      Page;
+   uint64_t      Seek64;
+   uint64_t      Remaining;
+   uint64_t      LoopPages;
+   uint32_t      PageLen=0, Ofs, ToCopy;
+   int           Sequential;
+   int           Ret = AAFF_OK;
 
    LOG ("Called - Seek=%'" PRIu64 ",Count=%'" PRIu64, Seek, Count);
    *pRead  = 0;
@@ -636,27 +1623,50 @@ static int AaffRead (void *pHandle, char *pBuf, off_t Seek, size_t Count, size_t
    if ((Seek64+Count) > pAaff->ImageSize) // image simply return what
       Count = pAaff->ImageSize - Seek64;  // is possible.
 
-   Page      = Seek64 / pAaff->PageSize;
-   Ofs       = Seek64 % pAaff->PageSize;
-   Remaining = Count;
+   Page       = Seek64 / pAaff->PageSize;
+   Ofs        = Seek64 % pAaff->PageSize;
+   Remaining  = Count;
+   Sequential = (Page == pAaff->LastReadPage) || (Page == pAaff->LastReadPage+1);
 
-   while (Count)
+   while (Remaining)
    {
-      Ret = AaffReadPage (pAaff, Page, &pPageBuffer, &PageLen);
-      if (Ret)
-         goto Leave;
-      if (PageLen == 0)
+      // Get up to PagesPerLoop pages into the cache, compressed
+      // ones are uncompressed in parallel if Threads > 1
+      // -------------------------------------------------------
+      LoopPages = (Ofs + Remaining + pAaff->PageSize - 1) / pAaff->PageSize;
+      LoopPages = GETMIN (LoopPages, pAaff->PagesPerLoop);
+      for (uint64_t i=0; i<LoopPages; i++)
+      {
+         Ret = AaffLoadPage (pAaff, Page+i, &pAaff->ppLoopPageArr[i]);
+         if (Ret)
+            goto Leave;
+      }
+      if (Sequential && (pAaff->Threads > 1) && ((Ofs + Remaining) <= (LoopPages * pAaff->PageSize)))
+         AaffPrefetch (pAaff, Page+LoopPages);   // Last loop, uncompress next pages while we are copying
+
+      // Copy the data
+      // -------------
+      for (uint64_t i=0; i<LoopPages; i++)
       {
-         Ret = AAFF_PAGE_LENGTH_ZERO;
-         goto Leave;
+         pPage = pAaff->ppLoopPageArr[i];
+         Ret   = AaffPageWait (pAaff, pPage);
+         if (Ret)
+            goto Leave;
+         PageLen = pPage->DataLen;
+         if (PageLen <= Ofs)
+         {
+            Ret = AAFF_PAGE_LENGTH_ZERO;
+            goto Leave;
+         }
+         ToCopy = GETMIN (PageLen-Ofs, Remaining);
+         memcpy (pBuf, pPage->pData+Ofs, ToCopy);
+         Remaining -= ToCopy;
+         pBuf      += ToCopy;
+         *pRead    += ToCopy;
+         Ofs=0;
+         pAaff->LastReadPage = Page;
+         Page++;
       }
-      ToCopy = GETMIN (PageLen-Ofs, Remaining);
-      memcpy (pBuf, pPageBuffer+Ofs, ToCopy);
-      Remaining -= ToCopy;
-      pBuf      += ToCopy;
-      *pRead    += ToCopy;
-      Ofs=0;
-      Page++;
    }
 
 Leave:
@@ -685,10 +1695,20 @@ static int AaffOptionsHelp (const char **ppHelp)
 
    wr = asprintf (&pHelp, "    %-12s : Maximum amount of RAM cache, in MiB, for image seek offsets. Default: %"PRIu64" MiB\n"
                           "    %-12s : Log file name.\n"
-                          "    Specify full path for %s. The given file name is extended by _<pid>.\n",
+                          "    %-12s : Index file name. Stores the header info and the page seek offsets of the image, so they\n"
+                          "                   needn't be searched again on the next mount. Rebuilt if the image file changes.\n"
+                          "    %-12s : Amount of RAM, in MiB, for caching uncompressed pages. Default: %"PRIu64" MiB\n"
+                          "    %-12s : Max. number of threads for reading and uncompressing pages in parallel. Default: %"PRIu64"\n"
+                          "                   On sequential reads, as many pages are uncompressed in advance.\n"
+                          "    %-12s : Max. number of image files kept open at the same time (split images). Default: %"PRIu64"\n"
+                          "    Specify full path for %s and %s. The given log file name is extended by _<pid>.\n",
                           AAFF_OPTION_MAXPAGEARRMEM, AAFF_DEFAULT_MAX_PAGE_ARR_MEM,
                           AAFF_OPTION_LOG,
-                          AAFF_OPTION_LOG);
+                          AAFF_OPTION_INDEX,
+                          AAFF_OPTION_PAGECACHE, AAFF_DEFAULT_PAGE_CACHE_MEM,
+                          AAFF_OPTION_THREADS, AAFF_DEFAULT_THREADS,
+                          AAFF_OPTION_MAXFILES, AAFF_DEFAULT_MAX_OPEN_FILES,
+                          AAFF_OPTION_LOG, AAFF_OPTION_INDEX);
    if ((pHelp == NULL) || (wr<=0))
       return AAFF_MEMALLOC_FAILED;
 
@@ -734,7 +1754,23 @@ static int AaffOptionsParse (void *pHandle, uint32_t OptionCount, const pts_LibX
          pOption->valid = TRUE;
          LOG ("Option %s set to %s", AAFF_OPTION_LOG, pAaff->pLogFilename);
       }
+      else if (strcmp (pOption->p_key, AAFF_OPTION_INDEX) == 0)
+      {
+         if (pAaff->pIndexPath)
+            free (pAaff->pIndexPath);
+         pAaff->pIndexPath = strdup (pOption->p_value);
+         if (pAaff->pIndexPath == NULL)
+         {
+            pError = "Memory allocation failed";
+            break;
+         }
+         pOption->valid = TRUE;
+         LOG ("Option %s set to %s", AAFF_OPTION_INDEX, pAaff->pIndexPath);
+      }
       else TEST_OPTION_UINT64 (AAFF_OPTION_MAXPAGEARRMEM, MaxPageArrMem)
+      else TEST_OPTION_UINT64 (AAFF_OPTION_PAGECACHE    , PageCacheMem)
+      else TEST_OPTION_UINT64 (AAFF_OPTION_THREADS      , Threads)
+      else TEST_OPTION_UINT64 (AAFF_OPTION_MAXFILES     , MaxOpenFiles)
    }
    #undef TEST_OPTION_UINT64
 
@@ -757,7 +1793,18 @@ static int AaffGetInfofileContent (void *pHandle, const char **ppInfoBuf)
 
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM,   "AFF IMAGE INFORMATION");
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\n---------------------");
-   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nAFF file    %s"  , pAaff->pFilename  );
+   if (pAaff->Files == 1)
+   {
+      Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nAFF file    %s"  , pAaff->pFileArr[0].pName);
+   }
+   else
+   {
+      Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nAFF files   %u"  , pAaff->Files);
+      for (i=0; (i<pAaff->Files) && (i<AaffInfoMaxFiles); i++)
+         Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\n   %s", pAaff->pFileArr[i].pName);
+      if (pAaff->Files > AaffInfoMaxFiles)
+         Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\n   ...");
+   }
 
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nPage size   %u"  , pAaff->PageSize   );
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nSector size %d"  , pAaff->SectorSize );
@@ -774,12 +1821,34 @@ static int AaffGetInfofileContent (void *pHandle, const char **ppInfoBuf)
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nSeek array length  %" PRIu64, pAaff->PageSeekArrLen);
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nSeek interleave    %" PRIu64, pAaff->Interleave);
 
+   pthread_mutex_lock (&pAaff->SeekArrMutex);
    for (i=0; i<pAaff->PageSeekArrLen; i++)
    {
       if (pAaff->pPageSeekArr[i])
          Entries++;
    }
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nSeek array entries %" PRIu64, Entries);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nSeek array memory  %" PRIu64 " bytes", pAaff->PageSeekArrLen * sizeof(uint64_t));
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nPage scan          ");
+   switch (pAaff->ScanState)
+   {
+      case AAFF_SCAN_RUNNING: Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "running, %" PRIu64 " of %" PRIu64 " pages", pAaff->ScanPages, pAaff->TotalPages); break;
+      case AAFF_SCAN_DONE   : Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "complete after %" PRIu64 " s", pAaff->ScanSeconds); break;
+      case AAFF_SCAN_INDEX  : Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "not needed, read from index file %s", pAaff->pIndexPath); break;
+      case AAFF_SCAN_STOPPED: Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "stopped after %" PRIu64 " of %" PRIu64 " pages", pAaff->ScanPages, pAaff->TotalPages); break;
+      default               : Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "failed after %" PRIu64 " pages", pAaff->ScanPages); break;
+   }
+   pthread_mutex_unlock (&pAaff->SeekArrMutex);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nPage cache         %u pages (%" PRIu64 " bytes)", pAaff->PageCacheLen, (uint64_t) pAaff->PageCacheLen * pAaff->PageSize);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nPage cache hits    %" PRIu64, pAaff->PageCacheHits);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nPage cache misses  %" PRIu64, pAaff->PageCacheMisses);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nPages prefetched   %" PRIu64, pAaff->PagesPrefetched);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nThreads            %" PRIu64, pAaff->Threads);
+   pthread_mutex_lock (&pAaff->FileMutex);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nOpen files         %u (max. %" PRIu64 ")", pAaff->OpenFiles, pAaff->MaxOpenFiles);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nFile cache hits    %" PRIu64, pAaff->FileCacheHits);
+   Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\nFile cache misses  %" PRIu64, pAaff->FileCacheMisses);
+   pthread_mutex_unlock (&pAaff->FileMutex);
    Pos += snprintf (&pAaff->pInfoBuff[Pos], REM, "\n");
    #undef REM
 
@@ -804,10 +1873,11 @@ static const char* AaffGetErrorMessage (int ErrNum)
       ADD_ERR (AAFF_FOUND)
       ADD_ERR (AAFF_MEMALLOC_FAILED)
       ADD_ERR (AAFF_OPTIONS_ERROR)
-      ADD_ERR (AAFF_SPLIT_IMAGES_NOT_SUPPORTED)
+      ADD_ERR (AAFF_TOO_MANY_FILES)
       ADD_ERR (AAFF_INVALID_SIGNATURE)
-      ADD_ERR (AAFF_NOT_CREATED_BY_GUYMAGER)
+      ADD_ERR (AAFF_HEADER_INCOMPLETE)
       ADD_ERR (AAFF_CANNOT_OPEN_LOGFILE)
+      ADD_ERR (AAFF_LZMA_NOT_SUPPORTED)
       ADD_ERR (AAFF_FILE_OPEN_FAILED)
       ADD_ERR (AAFF_CANNOT_READ_DATA)
      case AAFF_CANNOT_WRITE_DATA:
@@ -831,6 +1901,9 @@ static const char* AaffGetErrorMessage (int ErrNum)
       ADD_ERR (AAFF_READ_BEYOND_LAST_PAGE)
       ADD_ERR (AAFF_PAGE_LENGTH_ZERO)
       ADD_ERR (AAFF_NEGATIVE_SEEK)
+      ADD_ERR (AAFF_INDEX_INVALID)
+      ADD_ERR (AAFF_INDEX_OUTDATED)
+      ADD_ERR (AAFF_INDEX_WRITE_FAILED)
       default:
          pMsg = "Unknown error";
    }
@@ -981,20 +2054,19 @@ int main(int argc, const char *argv[])
    setlocale (LC_ALL, "");
 
    printf ("AFF to DD converter\n");
-   if (argc != 3)
+   if ((argc > 1) && (argv[argc-1][0] == '-'))
+   {
+      pOptions = strdup (&(argv[argc-1][1]));
+      argc--;
+   }
+   if (argc < 3)
    {
       (void) AaffOptionsHelp (&pHelp);
-      printf ("Usage: %s <EWF segment file 1> <EWF segment file 2> <...> [-comma_separated_options]\n", argv[0]);
+      printf ("Usage: %s <AFF file(s) or AFD directory> <destination file> [-comma_separated_options]\n", argv[0]);
       printf ("Possible options:\n%s\n", pHelp);
-      printf ("The output file will be named dd.\n");
       CHK (AaffFreeBuffer ((void*) pHelp))
       exit (1);
    }
-   if (argv[argc-1][0] == '-')
-   {
-      pOptions = strdup (&(argv[argc-1][1]));
-      argc--;
-   }
 
    rc = AaffCreateHandle ((void**) &pAaff, "aaff", LOG_STDOUT);
    if (rc != AAFF_OK)
@@ -1002,7 +2074,7 @@ int main(int argc, const char *argv[])
    if (pOptions)
       CHK (ParseOptions(pAaff, pOptions))
 
-   rc = AaffOpen (pAaff, &argv[1], 1);
+   rc = AaffOpen (pAaff, &argv[1], argc-2);
    if (rc)
    {
       printf ("Error %d while opening file %s\n", rc, argv[1]);
@@ -1017,7 +2089,7 @@ int main(int argc, const char *argv[])
    // Create destination file and fill it with data from aff
    // ------------------------------------------------------
    FILE *pFile;
-   pFile = fopen (argv[2], "w");
+   pFile = fopen (argv[argc-1], "w");
 //   const unsigned BuffSize = 13;  // weird Buffsize for testing
    const unsigned  BuffSize = 65536;
    char          *pBuff;
@@ -36,7 +36,13 @@ typedef struct _t_Aaff *t_pAaff;
 #define TRUE  1
 
 const uint64_t AAFF_DEFAULT_MAX_PAGE_ARR_MEM = 10;  // Default max. memory for caching seek points for fast page access (MiB)
+const uint64_t AAFF_DEFAULT_PAGE_CACHE_MEM   = 128; // Default memory for caching uncompressed pages (MiB)
+const uint64_t AAFF_DEFAULT_THREADS          = 4;
+const uint64_t AAFF_MAX_PAGE_CACHE_LEN       = 4096; // The cache is searched linearly, so don't let it grow too big with small pages
 const uint64_t AAFF_CURRENTPAGE_NOTSET       = UINT64_MAX;
+const unsigned AAFF_SCAN_MAX_NAMELEN         = 64;  // Segments with longer names are no page segments
+const uint64_t AAFF_DEFAULT_MAX_OPEN_FILES   = 10;  // Default max. number of image files kept open at the same time
+const unsigned AAFF_MAX_FILES                = 65535;
 
 // -----------------
 //  AFF definitions
@@ -76,6 +82,12 @@ const uint64_t AAFF_CURRENTPAGE_NOTSET       = UINT64_MAX;
 #define AFF_PAGEFLAGS_COMPRESSED_ZLIB 0x0001
 #define AFF_PAGEFLAGS_COMPRESSED_ZERO 0x0033
 
+#define AFF_PAGEFLAGS_COMPRESSED      0x0001 // The page flags as defined by afflib: Bit 0 tells if the page is compressed,
+#define AFF_PAGEFLAGS_ALG_MASK        0x00F0 // bits 4 to 7 contain the compression algorithm
+#define AFF_PAGEFLAGS_ALG_ZLIB        0x0000
+#define AFF_PAGEFLAGS_ALG_LZMA        0x0020
+#define AFF_PAGEFLAGS_ALG_ZERO        0x0030
+
 #define AAFF_MD5_LEN                16
 #define AAFF_SHA256_LEN             32
 #define AAFF_BADSECTORMARKER_MAXLEN 65536
@@ -99,11 +111,110 @@ typedef struct
 } __attribute__ ((packed)) t_AffSegmentFooter;
 
 const int AaffInfoBuffLen = 1024*1024;
+const unsigned AaffInfoMaxFiles = 20;  // Max. number of image file names listed in the info file
+
+// Page types, derived from the page flags
+enum
+{
+   AAFF_PAGETYPE_UNKNOWN = 0,
+   AAFF_PAGETYPE_UNCOMPRESSED,
+   AAFF_PAGETYPE_ZLIB,
+   AAFF_PAGETYPE_LZMA,
+   AAFF_PAGETYPE_ZERO
+};
+
+// Page cache entry
+enum
+{
+   AAFF_PAGE_EMPTY = 0,
+   AAFF_PAGE_LAUNCHED,  // Thread for reading and uncompressing the page data is running
+   AAFF_PAGE_VALID
+};
+
+typedef struct
+{
+   t_pAaff        pAaff;
+   uint64_t       Page;
+   uint64_t       Seek;            // Position of the page segment, see AAFF_SEEK
+   int            State;
+   int            Type;            // AAFF_PAGETYPE_xxx
+   char         *pRaw;             // Compressed data as read from the image
+   unsigned int   RawLen;
+   unsigned int   RawBuffLen;
+   char         *pData;            // Uncompressed data, length is PageSize
+   unsigned int   DataLen;         // The same for all pages, but the last one might contain less data
+   uint64_t       LastUsed;
+   pthread_t      ID;
+   int            ReturnCode;
+} t_AaffPage, *t_pAaffPage;
+
+// Image files. A split image (afflib's AFD format) consists of several AFF files, each
+// one starting with its own header segments, followed by a part of the page segments.
+// The files are sorted by their first page number.
+typedef struct
+{
+   char         *pName;            // Real path
+   int            File;            // File descriptor, -1 if not open
+   unsigned int   Users;           // Number of threads currently reading from File
+   uint64_t       LastUsed;
+   uint64_t       Size;
+   uint64_t       FirstPageSeek;   // Position of the first page segment, 0 if the file contains no pages
+   uint64_t       FirstPage;       // Its page number, UINT64_MAX if the file contains no pages
+} t_AaffFile, *t_pAaffFile;
+
+// Positions in the page seek array and in the page cache contain the file number in the
+// upper 16 bits and the offset within the file in the lower 48 bits. As the first page
+// segment never is at offset 0, a value of 0 still means "unknown".
+#define AAFF_SEEK(FileNr,Ofs) ((((uint64_t)(FileNr)) << 48) | (uint64_t)(Ofs))
+#define AAFF_SEEK_FILENR(Seek) ((unsigned)((Seek) >> 48))
+#define AAFF_SEEK_OFS(Seek)    ((Seek) & 0x0000FFFFFFFFFFFFULL)
+
+// Index file (option aaffindex). It starts with t_AaffIndexHeader, followed by one
+// t_AaffIndexFile per image file, the real paths of the image files, the page seek
+// array, the afflib version, the file type, the info text and an Adler-32 of all
+// preceding bytes. The index is written in host byte order; it only is meant to be
+// reused on the machine that wrote it.
+
+#define AAFF_INDEX_MAGIC   "AAFFIDX"
+#define AAFF_INDEX_VERSION 2
+
+typedef struct
+{
+   uint64_t           NameLen;
+   uint64_t           FileSize;       // FileSize and the modification time are compared against the image
+   int64_t            MTimeSec;       // file when loading the index. The index is discarded if anything changed.
+   int64_t            MTimeNSec;
+   uint64_t           FirstPageSeek;
+   uint64_t           FirstPage;
+} __attribute__ ((packed)) t_AaffIndexFile, *t_pAaffIndexFile;
+
+typedef struct
+{
+   char               Magic[8];
+   uint32_t           Version;
+   uint32_t           HeaderSize;     // sizeof (t_AaffIndexHeader), for detecting layout changes
+   uint64_t           Files;
+   uint64_t           PageSize;
+   uint64_t           SectorSize;
+   uint64_t           Sectors;
+   uint64_t           ImageSize;
+   uint64_t           TotalPages;
+   uint64_t           Interleave;
+   uint64_t           PageSeekArrLen;
+   uint64_t           LibVersionLen;
+   uint64_t           FileTypeLen;
+   uint64_t           InfoLen;
+} __attribute__ ((packed)) t_AaffIndexHeader, *t_pAaffIndexHeader;
 
 typedef struct _t_Aaff
 {
-   char         *pFilename;
-   FILE         *pFile;
+   t_pAaffFile   pFileArr;
+   unsigned int   Files;
+   unsigned int   OpenFiles;
+   uint64_t       FileUseCounter;
+   uint64_t       FileCacheHits;
+   uint64_t       FileCacheMisses;
+   pthread_mutex_t FileMutex;      // Protects the file array and the fields above, page threads open files, too
 
    char         *pLibVersion;  // AFF File Header info
    char         *pFileType;
@@ -118,9 +229,17 @@ typedef struct _t_Aaff
    unsigned int   NameBuffLen;
    unsigned int   DataBuffLen;
 
-   uint64_t       CurrentPage;
-   char         *pPageBuff;        // Length is PageSize, contains data of CurrentPage
-   unsigned int   PageBuffDataLen; // Length of current data in PageBuff (the same for all pages, but the last one might contain less data)
+   uint64_t       CurrentPage;     // Page whose segment has been located last
+   uint64_t       LastReadPage;    // Last page copied by AaffRead, for recognising sequential reads
+
+   t_pAaffPage   pPageCache;
+   unsigned int   PageCacheLen;
+   uint64_t       PageCacheUseCounter;
+   uint64_t       PagesPerLoop;    // Max. number of pages handled in one loop in AaffRead and prefetched afterwards
+   t_pAaffPage *ppLoopPageArr;
+   uint64_t       PageCacheHits;
+   uint64_t       PageCacheMisses;
+   uint64_t       PagesPrefetched;
 
    char         *pInfoBuff;
    char         *pInfoBuffConst;
@@ -128,14 +247,37 @@ typedef struct _t_Aaff
    uint64_t     *pPageSeekArr;
    uint64_t       PageSeekArrLen;
    uint64_t       Interleave;      // The number of pages lying between 2 entries in the PageSeekArr
+   pthread_mutex_t SeekArrMutex;   // Protects PageSeekArr and the scan fields below
+
+   pthread_t      ScanThread;      // Background thread filling in the complete PageSeekArr
+   uint8_t        ScanThreadStarted;
+   int            ScanState;
+   uint8_t        ScanAbort;
+   uint64_t       ScanPages;       // Number of page segments found by the scan thread so far
+   uint64_t       ScanSeconds;
 
    // Options
    char         *pLogFilename;
+   char         *pIndexPath;
    uint64_t       MaxPageArrMem;   // Maximum amount of memory (in MiB) for storing page pointers
+   uint64_t       PageCacheMem;    // Amount of memory (in MiB) for caching uncompressed pages
+   uint64_t       Threads;
+   uint64_t       MaxOpenFiles;
    uint8_t        LogStdout;
 } t_Aaff;
 
 
+// Page scan states
+enum
+{
+   AAFF_SCAN_NONE = 0,
+   AAFF_SCAN_RUNNING,
+   AAFF_SCAN_DONE,
+   AAFF_SCAN_STOPPED,
+   AAFF_SCAN_FAILED,
+   AAFF_SCAN_INDEX      // Not needed, the complete page seek array has been read from the index file
+};
+
 // Possible error codes
 enum
 {
@@ -148,10 +290,11 @@ enum
 
    AAFF_ERROR_EINVAL_START=2000,
    AAFF_OPTIONS_ERROR,
-   AAFF_SPLIT_IMAGES_NOT_SUPPORTED,
+   AAFF_TOO_MANY_FILES,
    AAFF_INVALID_SIGNATURE,
-   AAFF_NOT_CREATED_BY_GUYMAGER,
+   AAFF_HEADER_INCOMPLETE,
    AAFF_CANNOT_OPEN_LOGFILE,
+   AAFF_LZMA_NOT_SUPPORTED,
    AAFF_ERROR_EINVAL_END,
 
    AAFF_ERROR_EIO_START=3000,
@@ -176,6 +319,9 @@ enum
    AAFF_WRITE_BEYOND_LAST_PAGE,
    AAFF_PAGE_LENGTH_ZERO,
    AAFF_NEGATIVE_SEEK,
+   AAFF_INDEX_INVALID,
+   AAFF_INDEX_OUTDATED,
+   AAFF_INDEX_WRITE_FAILED,
    AAFF_ERROR_EIO_END,
 };
 
@@ -48,12 +48,18 @@
 #include <limits.h>
 #include <time.h>       //lint !e537 !e451  Include file messages
 #include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+   #include <libdeflate.h>
+#endif
 #include <unistd.h>     //lint !e537
 #include <wchar.h>      //lint !e537 !e451
 #include <stdarg.h>     //lint !e537 !e451
 #include <limits.h>     //lint !e537 !e451
 #include <errno.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "../libxmount_input.h"
 
@@ -76,6 +82,8 @@
 #define AEWF_OPTION_STATSREFRESH    "aewfrefresh"
 #define AEWF_OPTION_LOG             "aewflog"
 #define AEWF_OPTION_THREADS         "aewfthreads"
+#define AEWF_OPTION_INDEX           "aewfindex"
+#define AEWF_OPTION_CACHEFULLCHUNKS "aewfcachefull"
 
 static int         AewfClose           (void *pHandle);
 static const char* AewfGetErrorMessage (int ErrNum);
@@ -96,6 +104,7 @@ const uint64_t AEWF_DEFAULT_THREADS         =  4;  // There normally is no sense
 int LogvEntry (const char *pLogPath, uint8_t LogStdout, const char *pFileName, const char *pFunctionName, int LineNr, const char *pFormat, va_list pArguments)
 {
    time_t       NowT;
+   struct tm    NowTM;
    struct tm  *pNowTM;
    FILE       *pFile;
    int          wr;
@@ -109,7 +118,7 @@ int LogvEntry (const char *pLogPath, uint8_t LogStdout, const char *pFileName, c
       return AEWF_OK;
 
    time (&NowT);
-   pNowTM = localtime (&NowT);
+   pNowTM = localtime_r (&NowT, &NowTM);   // The scan threads log, too
    OwnPID = getpid();  // pthread_self()
    wr  = (int) strftime (&LogLineHeader[0] , sizeof(LogLineHeader)   , "%a %d.%b.%Y %H:%M:%S ", pNowTM); //lint !e713
    wr += snprintf (&LogLineHeader[wr], sizeof(LogLineHeader)-wr, "%5d ", OwnPID);                        //lint !e737
@@ -221,63 +230,140 @@ static void AewfCheckError (t_pAewf pAewf, int Ret, int *pErrno)
 //         Internal functions
 // ------------------------------------
 
-static int OpenFile (FILE **ppFile, const char *pFilename)
+static int OpenFile (int *pFile, const char *pFilename)
 {
-   *ppFile = fopen (pFilename, "r");
-   if (*ppFile == NULL)
+   *pFile = open (pFilename, O_RDONLY);
+   if (*pFile < 0)
       return AEWF_FILE_OPEN_FAILED;
    return AEWF_OK;
 }
 
-static int CloseFile (FILE **ppFile)
+static int CloseFile (int *pFile)
 {
-   if (fclose (*ppFile))
+   if (close (*pFile))
       return AEWF_FILE_CLOSE_FAILED;
-   *ppFile = NULL;
+   *pFile = -1;
 
    return AEWF_OK;
 }
 
-#define NO_SEEK ULLONG_MAX
+// ReadFilePos uses pread, so it doesn't touch any shared file position and may be
+// called concurrently on the same descriptor.
 
-static int ReadFilePos (t_pAewf pAewf, FILE *pFile, void *pMem, unsigned int Size, uint64_t Pos)
+static int ReadFilePos (t_pAewf pAewf, int File, void *pMem, unsigned int Size, uint64_t Pos)
 {
-   if (Size == 0)
-      return AEWF_OK;
+   char    *pDst = (char *) pMem;
+   ssize_t   Read;
 
-   if (Pos != NO_SEEK)
+   while (Size)
    {
-      if (fseeko64 (pFile, Pos, SEEK_SET))
-         return AEWF_FILE_SEEK_FAILED;
+      Read = pread (File, pDst, Size, (off_t) Pos);
+      if (Read < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return AEWF_FILE_READ_FAILED;
+      }
+      if (Read == 0)        // Unexpected end of file
+         return AEWF_FILE_READ_FAILED;
+      pDst += Read;
+      Pos  += Read;
+      Size -= Read;
    }
-   if (fread (pMem, Size, 1UL, pFile) != 1)
-      return AEWF_FILE_READ_FAILED;
 
    return AEWF_OK;
 }
 
-static int ReadFileAllocPos (t_pAewf pAewf, FILE *pFile, void **ppMem, unsigned int Size, uint64_t Pos)
+static int ReadFileAllocPos (t_pAewf pAewf, int File, void **ppMem, unsigned int Size, uint64_t Pos)
 {
    *ppMem = (void*) malloc (Size);
    if (*ppMem == NULL)
       return AEWF_MEMALLOC_FAILED;
 
-   CHK (ReadFilePos (pAewf, pFile, *ppMem, Size, Pos))
+   CHK (ReadFilePos (pAewf, File, *ppMem, Size, Pos))
+   return AEWF_OK;
+}
+
+// ------------------------------------
+//        Decompression backend
+// ------------------------------------
+
+// Chunks are uncompressed with libdeflate if it was found at build time (HAVE_LIBDEFLATE) and with zlib
+// otherwise. libdeflate's decompressor is considerably faster and it comes with a vectorised Adler-32.
+// Both check the Adler-32 contained in the zlib stream while uncompressing, so the CRC only needs to be
+// calculated for chunks stored uncompressed. A libdeflate decompressor must not be shared between threads.
+
+#ifdef HAVE_LIBDEFLATE
+   #define AEWF_DECOMPRESSOR "libdeflate"
+#else
+   #define AEWF_DECOMPRESSOR "zlib"
+#endif
+
+static int AewfDecompressorAlloc (t_pAewfDecompressor *ppDecompressor)
+{
+#ifdef HAVE_LIBDEFLATE
+   *ppDecompressor = libdeflate_alloc_decompressor ();
+   if (*ppDecompressor == NULL)
+      return AEWF_MEMALLOC_FAILED;
+#else
+   *ppDecompressor = NULL;
+#endif
    return AEWF_OK;
 }
 
-static int ReadFileAlloc (t_pAewf pAewf, FILE *pFile, void **ppMem, unsigned int Size)
+static void AewfDecompressorFree (t_pAewfDecompressor pDecompressor)
 {
-   CHK (ReadFileAllocPos (pAewf, pFile, ppMem, Size, NO_SEEK))
+#ifdef HAVE_LIBDEFLATE
+   if (pDecompressor)
+      libdeflate_free_decompressor (pDecompressor);
+#else
+   (void) pDecompressor;
+#endif
+}
+
+static int AewfUncompressZlib (char *pDst, uint64_t DstSize, uint64_t *pDstLen, const char *pSrc, uint64_t SrcLen)
+{
+   uLongf DstLen0 = DstSize;
+
+   if (uncompress ((Bytef *)pDst, &DstLen0, (const Bytef *)pSrc, SrcLen) != Z_OK)
+      return AEWF_UNCOMPRESS_FAILED;
+   *pDstLen = DstLen0;
 
    return AEWF_OK;
 }
 
-static int QsortCompareSegments (const void *pA, const void *pB)
+static int AewfUncompress (t_pAewfDecompressor pDecompressor, char *pDst, uint64_t DstSize, uint64_t *pDstLen, const char *pSrc, uint64_t SrcLen)
 {
-   const t_pSegment pSegmentA = ((const t_pSegment)pA); //lint !e1773 Attempt to cast way const
-   const t_pSegment pSegmentB = ((const t_pSegment)pB); //lint !e1773 Attempt to cast way const
-   return (int)pSegmentA->Number - (int)pSegmentB->Number;
+#ifdef HAVE_LIBDEFLATE
+   size_t DstLen0;
+
+   if (libdeflate_zlib_decompress (pDecompressor, pSrc, SrcLen, pDst, DstSize, &DstLen0) == LIBDEFLATE_SUCCESS)
+   {
+      *pDstLen = DstLen0;
+      return AEWF_OK;
+   }
+   // libdeflate is stricter than zlib about what follows the compressed stream. Some imagers
+   // store chunks that zlib accepts nevertheless, so give zlib a chance before failing.
+#else
+   (void) pDecompressor;
+#endif
+   return AewfUncompressZlib (pDst, DstSize, pDstLen, pSrc, SrcLen);
+}
+
+static uint32_t AewfAdler32 (const char *pData, uint64_t Len)
+{
+#ifdef HAVE_LIBDEFLATE
+   return libdeflate_adler32 (1, pData, Len);
+#else
+   return (uint32_t) adler32 (1, (const Bytef *) pData, Len);
+#endif
+}
+
+static int QsortCompareScans (const void *pA, const void *pB)
+{
+   const t_pAewfScan pScanA = ((const t_pAewfScan)pA); //lint !e1773 Attempt to cast way const
+   const t_pAewfScan pScanB = ((const t_pAewfScan)pB); //lint !e1773 Attempt to cast way const
+   return (int)pScanA->Segment.Number - (int)pScanB->Segment.Number;
 }
 
 static int CreateInfoData (t_pAewf pAewf, t_pAewfSectionVolume pVolume,
@@ -413,6 +499,7 @@ static int CreateInfoData (t_pAewf pAewf, t_pAewfSectionVolume pVolume,
       char       *pValue;
       int          wr = 0;
       time_t       Time;
+      struct tm    TM;
       struct tm  *pTM;
       char         TimeBuff[64];
 
@@ -450,7 +537,7 @@ static int CreateInfoData (t_pAewf pAewf, t_pAewfSectionVolume pVolume,
                   size_t w;
 
                   Time = atoll (pCurData);
-                  pTM = localtime (&Time);
+                  pTM = localtime_r (&Time, &TM);
                   pValue = &TimeBuff[0];
                   w = strftime (pValue, sizeof(TimeBuff), "%Y-%m-%d %H:%M:%S (%z)", pTM);
                   sprintf (&pValue[w], " (epoch %s)", pCurData);
@@ -502,13 +589,23 @@ CleanUp:
    return rc;
 }
 
-static int AewfOpenSegment (t_pAewf pAewf, t_pTable pTable)
+// AewfOpenSegment makes sure the given segment file is open and registers the caller
+// as a user of it. Segments in use are never closed by the cache, so every call must
+// be paired with AewfReleaseSegment once the caller is done reading. Both functions
+// may be called concurrently.
+
+static int AewfOpenSegment (t_pAewf pAewf, t_pSegment pSegment)
 {
    t_pSegment pOldestSegment;
+   int         rc = AEWF_OK;
 
-   if (pTable->pSegment->pFile != NULL) // is already opened ?
+   pthread_mutex_lock (&pAewf->SegmentMutex);
+   pSegment->LastUsed = time (NULL);
+   pSegment->Users++;
+   if (pSegment->File >= 0) // is already opened ?
    {
       pAewf->SegmentCacheHits++;
+      pthread_mutex_unlock (&pAewf->SegmentMutex);
       return AEWF_OK;
    }
    pAewf->SegmentCacheMisses++;
@@ -521,7 +618,7 @@ static int AewfOpenSegment (t_pAewf pAewf, t_pTable pTable)
 
       for (unsigned i=0; i<pAewf->Segments; i++)
       {
-         if (pAewf->pSegmentArr[i].pFile == NULL)
+         if ((pAewf->pSegmentArr[i].File < 0) || pAewf->pSegmentArr[i].Users)
             continue;
          if (pOldestSegment == NULL)
          {
@@ -533,26 +630,44 @@ static int AewfOpenSegment (t_pAewf pAewf, t_pTable pTable)
                pOldestSegment = &pAewf->pSegmentArr[i];
          }
       }
-      if (pOldestSegment == NULL)
+      if (pOldestSegment == NULL)  // All open segments are in use, exceed MaxOpenSegments temporarily
          break;
 
       LOG ("Closing %s", pOldestSegment->pName);
-      CHK (CloseFile (&pOldestSegment->pFile))
+      rc = CloseFile (&pOldestSegment->File);
+      if (rc != AEWF_OK)
+         break;
       pAewf->OpenSegments--;
    }
 
    // Open the desired segment file
    // -----------------------------
-   LOG ("Opening %s", pTable->pSegment->pName);
-   CHK (OpenFile(&pTable->pSegment->pFile, pTable->pSegment->pName))
-   pAewf->OpenSegments++;
+   if (rc == AEWF_OK)
+   {
+      LOG ("Opening %s", pSegment->pName);
+      rc = OpenFile (&pSegment->File, pSegment->pName);
+      if (rc == AEWF_OK)
+         pAewf->OpenSegments++;
+   }
+   if (rc != AEWF_OK)
+      pSegment->Users--;
+   pthread_mutex_unlock (&pAewf->SegmentMutex);
+   CHK (rc)
 
    return AEWF_OK;
 }
 
+static void AewfReleaseSegment (t_pAewf pAewf, t_pSegment pSegment)
+{
+   pthread_mutex_lock (&pAewf->SegmentMutex);
+   pSegment->Users--;
+   pthread_mutex_unlock (&pAewf->SegmentMutex);
+}
+
 static int AewfLoadEwfTable (t_pAewf pAewf, t_pTable pTable)
 {
    t_pTable pOldestTable = NULL;
+   int       rc;
 
    if (pTable->pEwfTable != NULL) // is already loaded?
    {
@@ -592,8 +707,15 @@ static int AewfLoadEwfTable (t_pAewf pAewf, t_pTable pTable)
    // Read the desired table into RAM
    // -------------------------------
    LOG ("Loading table %" PRIu64 " (%lu bytes)", pTable->Nr, pTable->Size);
-   CHK (AewfOpenSegment (pAewf, pTable));
-   CHK (ReadFileAllocPos (pAewf, pTable->pSegment->pFile, (void**) &pTable->pEwfTable, pTable->Size, pTable->Offset))
+   CHK (AewfOpenSegment (pAewf, pTable->pSegment))
+   rc = ReadFileAllocPos (pAewf, pTable->pSegment->File, (void**) &pTable->pEwfTable, pTable->Size, pTable->Offset);
+   AewfReleaseSegment (pAewf, pTable->pSegment);
+   if (rc != AEWF_OK)
+   {
+      free (pTable->pEwfTable);
+      pTable->pEwfTable = NULL;
+      CHK (rc)
+   }
    pAewf->TableCache += pTable->Size;
    pAewf->TablesReadFromImage += pTable->Size;
 
@@ -635,6 +757,7 @@ static int UpdateStats (t_pAewf pAewf, int Force)
          fprintf (pFile, "Chunk   %10" PRIu64 "  %10" PRIu64 "  %5.1f%%\n", pAewf->ChunkCacheHits  , pAewf->ChunkCacheMisses  , (100.0*pAewf->ChunkCacheHits)  /(pAewf->ChunkCacheHits  +pAewf->ChunkCacheMisses  ));
          fprintf (pFile, "\n");
          fprintf (pFile, "Read operations          %10" PRIu64 "\n", pAewf->ReadOperations);
+         fprintf (pFile, "Chunks read w/o copying  %10" PRIu64 "\n", pAewf->ChunksZeroCopy);
          fprintf (pFile, "Errors                   %10" PRIu64 "\n", pAewf->Errors);
          fprintf (pFile, "Open segment files       %10" PRIu64"\n" , pAewf->OpenSegments);
          fprintf (pFile, "Last error               %10d (%s)\n"         , pAewf->LastError, AewfGetErrorMessage (pAewf->LastError));
@@ -677,29 +800,25 @@ static int UpdateStats (t_pAewf pAewf, int Force)
 // AewfReadChunkLegacy0 reads exactly one chunk. It expects the EWF table be present
 // in memory and the required segment be opened.
 
-static int AewfReadChunkLegacy0 (t_pAewf pAewf, t_pTable pTable, uint64_t AbsoluteChunk, unsigned TableChunk)
+// AewfChunkLocation calculates where the data of a chunk is stored in its segment file, how many
+// bytes are stored there and how big the chunk is after uncompression. It expects the EWF table be
+// present in memory.
+
+static int AewfChunkLocation (t_pAewf pAewf, t_pTable pTable, uint64_t AbsoluteChunk, unsigned TableChunk,
+                              int *pCompressed, uint64_t *pSeekPos, unsigned int *pReadLen, uint64_t *pChunkSize)
 {
-   int                  Compressed;
-   uint64_t             SeekPos;
    t_pAewfSectionTable pEwfTable;
    unsigned int         Offset;
    unsigned int         ReadLen;
-   uLongf               DstLen0;
-   int                  zrc;
-   uint                 CalcCRC;
-   uint               *pStoredCRC;
    uint64_t             ChunkSize;
-   int                  Ret = AEWF_OK;
 
-   pEwfTable  = pTable->pEwfTable;
+   pEwfTable = pTable->pEwfTable;
    if (pEwfTable == NULL)
       return AEWF_ERROR_EWF_TABLE_NOT_READY;
-   if (pTable->pSegment->pFile == NULL)
-      return AEWF_ERROR_EWF_SEGMENT_NOT_READY;
 
-   Compressed = pEwfTable->OffsetArray[TableChunk] &  AEWF_COMPRESSED;
-   Offset     = pEwfTable->OffsetArray[TableChunk] & ~AEWF_COMPRESSED;
-   SeekPos    = pEwfTable->TableBaseOffset + Offset;
+   *pCompressed = pEwfTable->OffsetArray[TableChunk] &  AEWF_COMPRESSED;
+   Offset       = pEwfTable->OffsetArray[TableChunk] & ~AEWF_COMPRESSED;
+   *pSeekPos    = pEwfTable->TableBaseOffset + Offset;
 
    if (TableChunk < (pEwfTable->ChunkCount-1))
         ReadLen = (pEwfTable->OffsetArray[TableChunk+1] & ~AEWF_COMPRESSED) - Offset;
@@ -711,6 +830,7 @@ static int AewfReadChunkLegacy0 (t_pAewf pAewf, t_pTable pTable, uint64_t Absolu
       LOG ("Chunk too big %u / %u", ReadLen, pAewf->ChunkBuffSize);
       return AEWF_CHUNK_TOO_BIG;
    }
+   *pReadLen = ReadLen;
 
    ChunkSize = pAewf->ChunkSize;
    if (AbsoluteChunk == (pAewf->Chunks-1))   // The very last chunk of the image may be smaller than the default
@@ -719,21 +839,39 @@ static int AewfReadChunkLegacy0 (t_pAewf pAewf, t_pTable pTable, uint64_t Absolu
       if (ChunkSize == 0)
          ChunkSize = pAewf->ChunkSize;
    }
+   *pChunkSize = ChunkSize;
+
+   return AEWF_OK;
+}
+
+static int AewfReadChunkLegacy0 (t_pAewf pAewf, t_pTable pTable, uint64_t AbsoluteChunk, unsigned TableChunk)
+{
+   int                  Compressed;
+   uint64_t             SeekPos;
+   unsigned int         ReadLen;
+   uint64_t             DstLen0;
+   uint                 CalcCRC;
+   uint               *pStoredCRC;
+   uint64_t             ChunkSize;
+   int                  Ret = AEWF_OK;
+
+   if (pTable->pSegment->File < 0)
+      return AEWF_ERROR_EWF_SEGMENT_NOT_READY;
+   Ret = AewfChunkLocation (pAewf, pTable, AbsoluteChunk, TableChunk, &Compressed, &SeekPos, &ReadLen, &ChunkSize);
+   if (Ret != AEWF_OK)
+      return Ret;
 
    if (Compressed)
    {
-      CHK (ReadFilePos (pAewf, pTable->pSegment->pFile, pAewf->pChunkBuffCompressed, ReadLen, SeekPos))
-      DstLen0 = pAewf->ChunkBuffSize;
-      zrc = uncompress ((unsigned char*)pAewf->pChunkBuffUncompressed, &DstLen0, (const Bytef*)pAewf->pChunkBuffCompressed, ReadLen);
-      if (zrc != Z_OK)
-         Ret = AEWF_UNCOMPRESS_FAILED;
-      if (DstLen0 != ChunkSize)
+      CHK (ReadFilePos (pAewf, pTable->pSegment->File, pAewf->pChunkBuffCompressed, ReadLen, SeekPos))
+      Ret = AewfUncompress (pAewf->pDecompressor, pAewf->pChunkBuffUncompressed, pAewf->ChunkBuffSize, &DstLen0, pAewf->pChunkBuffCompressed, ReadLen);
+      if ((Ret == AEWF_OK) && (DstLen0 != ChunkSize))
          Ret = AEWF_BAD_UNCOMPRESSED_LENGTH;
    }
    else
    {
-      CHK (ReadFilePos (pAewf, pTable->pSegment->pFile, pAewf->pChunkBuffUncompressed, ReadLen, SeekPos))
-      CalcCRC    =  adler32 (1, (const Bytef *) pAewf->pChunkBuffUncompressed, ChunkSize);
+      CHK (ReadFilePos (pAewf, pTable->pSegment->File, pAewf->pChunkBuffUncompressed, ReadLen, SeekPos))
+      CalcCRC    =  AewfAdler32 (pAewf->pChunkBuffUncompressed, ChunkSize);
       pStoredCRC = (uint *) (pAewf->pChunkBuffUncompressed + ChunkSize);  //lint !e826 Suspicious pointer-to-pointer conversion (area too small)
       if (CalcCRC != *pStoredCRC)
          Ret = AEWF_CHUNK_CRC_ERROR;
@@ -760,6 +898,7 @@ static int AewfReadChunkLegacy (t_pAewf pAewf, uint64_t AbsoluteChunk, char **pp
    int        Found=FALSE;
    unsigned   TableChunk;
    unsigned   TableNr;
+   int        rc;
 
    *ppBuffer = pAewf->pChunkBuffUncompressed;
    *pLen     = 0;
@@ -788,15 +927,16 @@ static int AewfReadChunkLegacy (t_pAewf pAewf, uint64_t AbsoluteChunk, char **pp
    // Load corresponding table and get chunk
    // --------------------------------------
    pTable->LastUsed = time(NULL);                  //lint !e771 pTable' (line 640) conceivably not initialized
-   pTable->pSegment->LastUsed = pTable->LastUsed;  // Update LastUsed here, in order not to remove the required data from cache
 
    CHK (AewfLoadEwfTable (pAewf, pTable))
-   CHK (AewfOpenSegment  (pAewf, pTable));
    if ((AbsoluteChunk - pTable->ChunkFrom) > UINT_MAX)
       CHK (AEWF_ERROR_IN_CHUNK_NUMBER)
    TableChunk = AbsoluteChunk - pTable->ChunkFrom;
 //   LOG ("table %d / entry %" PRIu64 " (%s)", TableNr, TableChunk, pTable->pSegment->pName)
-   CHK (AewfReadChunkLegacy0 (pAewf, pTable, AbsoluteChunk, TableChunk))
+   CHK (AewfOpenSegment (pAewf, pTable->pSegment))
+   rc = AewfReadChunkLegacy0 (pAewf, pTable, AbsoluteChunk, TableChunk);
+   AewfReleaseSegment (pAewf, pTable->pSegment);
+   CHK (rc)
    *pLen = pAewf->ChunkBuffUncompressedDataLen;
 
    return AEWF_OK;
@@ -840,26 +980,31 @@ static int AewfReadLegacy (t_pAewf pAewf, char *pBuf, uint64_t Seek64, size_t Co
 static void* AewfThreadUncompress (void *pArg)
 {
    t_pAewfThread pThread = (t_pAewfThread) pArg;
-   uLongf         DstLen0;
-   int            zrc;
-
-   pThread->ReturnCode = AEWF_OK;
-   DstLen0 = pThread->pAewf->ChunkBuffSize;
-   zrc = uncompress ((unsigned char*)pThread->pChunkBuffUncompressed, &DstLen0,
-                       (const Bytef*)pThread->pChunkBuffCompressed  ,
-                                     pThread->ChunkBuffCompressedDataLen);
-   if (zrc != Z_OK)
-      pThread->ReturnCode = AEWF_UNCOMPRESS_FAILED;
-   else if (DstLen0 != pThread->ChunkBuffUncompressedDataLen)
+   uint64_t       DstLen0;
+
+   if (pThread->ZeroCopy)
+        pThread->ReturnCode = AewfUncompress (pThread->pDecompressor, pThread->pBuf, pThread->Len, &DstLen0,
+                                              pThread->pChunkBuffCompressed, pThread->ChunkBuffCompressedDataLen);
+   else pThread->ReturnCode = AewfUncompress (pThread->pDecompressor, pThread->pChunkBuffUncompressed, pThread->pAewf->ChunkBuffSize, &DstLen0,
+                                              pThread->pChunkBuffCompressed, pThread->ChunkBuffCompressedDataLen);
+   if (pThread->ReturnCode != AEWF_OK)
+      return NULL;
+   if (DstLen0 != pThread->ChunkBuffUncompressedDataLen)
+   {
       pThread->ReturnCode = AEWF_BAD_UNCOMPRESSED_LENGTH;
-   else
+      return NULL;
+   }
+
+   if (!pThread->ZeroCopy)
       memcpy (pThread->pBuf, pThread->pChunkBuffUncompressed+pThread->Ofs, pThread->Len);
+   else if (pThread->CacheChunk)
+      memcpy (pThread->pChunkBuffUncompressed, pThread->pBuf, pThread->Len);
 
    return NULL;
 }
 
 // AewfThreadCRC is called for uncompressed data chunks. It verifies the CRC and
-// copies the data to the correct destination.
+// copies the data to the correct destination (unless it has been read there directly).
 static void* AewfThreadCRC (void *pArg)
 {
    t_pAewfThread  pThread = (t_pAewfThread) pArg;
@@ -867,7 +1012,16 @@ static void* AewfThreadCRC (void *pArg)
    uint            CalcCRC;
 
    pThread->ReturnCode = AEWF_OK;
-   CalcCRC    =  adler32 (1, (const Bytef *) pThread->pChunkBuffUncompressed, pThread->ChunkBuffUncompressedDataLen);
+   if (pThread->ZeroCopy)
+   {
+      CalcCRC = AewfAdler32 (pThread->pBuf, pThread->ChunkBuffUncompressedDataLen);
+      if (CalcCRC != pThread->StoredCRC)
+         pThread->ReturnCode = AEWF_CHUNK_CRC_ERROR;
+      else if (pThread->CacheChunk)
+         memcpy (pThread->pChunkBuffUncompressed, pThread->pBuf, pThread->Len);
+      return NULL;
+   }
+   CalcCRC    =  AewfAdler32 (pThread->pChunkBuffUncompressed, pThread->ChunkBuffUncompressedDataLen);
    pStoredCRC = (uint *) (pThread->pChunkBuffUncompressed + pThread->ChunkBuffUncompressedDataLen);  //lint !e826 Suspicious pointer-to-pointer conversion (area too small)
    if (CalcCRC != *pStoredCRC)
       pThread->ReturnCode = AEWF_CHUNK_CRC_ERROR;
@@ -889,113 +1043,103 @@ static void* AewfThreadCopy (void *pArg)
 }
 
 
-// AewfReadChunkMT0 reads exactly one chunk. It expects the EWF table be present
-// in memory and the required segment be opened.
-static int AewfReadChunkMT0 (t_pAewf pAewf, t_pTable pTable, uint64_t AbsoluteChunk, unsigned TableChunk, char *pBuf, unsigned int Ofs, unsigned int Len)
+// AewfClaimThread looks for an idle thread slot and reserves it for the caller. A slot already
+// holding the requested chunk is preferred. If all slots are busy, the function either waits for
+// one becoming idle (Wait) or returns NULL. Only callers which have not claimed any slot yet
+// may wait, as the others still must join their own threads before slots become free again.
+// Must be called with ReadMutex locked.
+static t_pAewfThread AewfClaimThread (t_pAewf pAewf, uint64_t AbsoluteChunk, int Wait)
 {
-   int                  Compressed;
-   uint64_t             SeekPos;
-   t_pAewfSectionTable pEwfTable;
-   unsigned int         Offset;
-   unsigned int         ReadLen;
-   int                  prc;
-   uint64_t             ChunkSize;
-   int                  Ret = AEWF_OK;
-
-//   LOG ("Called - AbsoluteChunk=%'" PRIu64, AbsoluteChunk);
-
-   pEwfTable = pTable->pEwfTable;
-   if (pEwfTable == NULL)
-      return AEWF_ERROR_EWF_TABLE_NOT_READY;
-   if (pTable->pSegment->pFile == NULL)
-      return AEWF_ERROR_EWF_SEGMENT_NOT_READY;
-
-   Compressed = pEwfTable->OffsetArray[TableChunk] &  AEWF_COMPRESSED;
-   Offset     = pEwfTable->OffsetArray[TableChunk] & ~AEWF_COMPRESSED;
-   SeekPos    = pEwfTable->TableBaseOffset + Offset;
-
-   if (TableChunk < (pEwfTable->ChunkCount-1))
-        ReadLen = (pEwfTable->OffsetArray[TableChunk+1] & ~AEWF_COMPRESSED) - Offset;
-   else ReadLen = (pTable->SectionSectorsSize - sizeof(t_AewfSection)) - (Offset - (pEwfTable->OffsetArray[0] & ~AEWF_COMPRESSED));
-//   else ReadLen = pAewf->ChunkBuffSize;  // This also  works! It looks as if uncompress is able to find out by itself the real size of the input data.
-
-   if (ReadLen > pAewf->ChunkBuffSize)
-   {
-      LOG ("Chunk too big %u / %u", ReadLen, pAewf->ChunkBuffSize);
-      CHK (AEWF_CHUNK_TOO_BIG)
-   }
-
-   ChunkSize = pAewf->ChunkSize;
-   if (AbsoluteChunk == (pAewf->Chunks-1))   // The very last chunk of the image may be smaller than the default
-   {                                         // chunk size if the image isn't a multiple of the chunk size.
-      ChunkSize = pAewf->ImageSize % pAewf->ChunkSize;
-      if (ChunkSize == 0)
-         ChunkSize = pAewf->ChunkSize;
-   }
+   t_pAewfThread pIdle;
 
-   for (int i=0; i<pAewf->Threads; i++)
+   for (;;)
    {
-      t_pAewfThread pThread = &(pAewf->pThreadArr[i]);
-      if (pThread->State == AEWF_IDLE)
+      pIdle = NULL;
+      for (int i=0; i<pAewf->Threads; i++)
       {
-         pThread->State                        = AEWF_LAUNCHED;
-         pThread->ChunkBuffCompressedDataLen   = ReadLen;
-         pThread->ChunkBuffUncompressedDataLen = ChunkSize;  // uncompress should return this size (if it's a compressed chunk)
-         pThread->ChunkInBuff                  = AbsoluteChunk;
-
-         pThread->pBuf                         = pBuf; // These 3 parameters specify which part
-         pThread->Ofs                          = Ofs;  // of the resulting chunk data should be
-         pThread->Len                          = Len;  // copied to which location.
-         if (Compressed)
-         {
-            CHK (ReadFilePos (pAewf, pTable->pSegment->pFile, pThread->pChunkBuffCompressed, ReadLen, SeekPos))
-            prc = pthread_create (&pThread->ID, NULL, AewfThreadUncompress, pThread);
-         }
-         else
+         t_pAewfThread pThread = &(pAewf->pThreadArr[i]);
+         if (pThread->State != AEWF_IDLE)  // A busy thread may be working on a zero copy job for another chunk
+            continue;
+         if (pThread->ChunkInBuff == AbsoluteChunk)
          {
-            CHK (ReadFilePos (pAewf, pTable->pSegment->pFile, pThread->pChunkBuffUncompressed, ReadLen, SeekPos))
-            prc = pthread_create (&pThread->ID, NULL, AewfThreadCRC, pThread);
+            pIdle = pThread;
+            break;
          }
-         if (prc != 0)
-            Ret = AEWF_ERROR_PTHREAD;
-         break;
+         if (pIdle == NULL)
+            pIdle = pThread;
       }
+      if ((pIdle != NULL) || !Wait)
+         break;
+      pthread_cond_wait (&pAewf->ThreadIdle, &pAewf->ReadMutex);
    }
+   if (pIdle != NULL)
+      pIdle->State = AEWF_CLAIMED;
 
-   pAewf->DataReadFromImage    += ReadLen;
-   pAewf->DataReadFromImageRaw += ChunkSize;
+   return pIdle;
+}
 
-   return Ret;
+// AewfReleaseThread gives a claimed slot back. Must be called with ReadMutex locked.
+static void AewfReleaseThread (t_pAewf pAewf, t_pAewfThread pThread, int Valid)
+{
+   pThread->State = AEWF_IDLE;
+   if (!Valid)
+      pThread->ChunkInBuff = AEWF_NONE;
+   pthread_cond_broadcast (&pAewf->ThreadIdle);
 }
 
-static int AewfReadChunkMT (t_pAewf pAewf, uint64_t AbsoluteChunk, char *pBuf, unsigned int Ofs, unsigned int Len)
+// AewfReadChunkMT reads exactly one chunk and launches the thread that uncompresses, checks
+// and copies it. The thread slot, the table cache and the statistics are handled with ReadMutex
+// locked, the segment file is read without it, so that concurrent AewfRead calls don't wait
+// for each other's I/O. *ppThread is the launched thread, which the caller must join, or NULL
+// if no slot was idle and Wait wasn't set.
+static int AewfReadChunkMT (t_pAewf pAewf, uint64_t AbsoluteChunk, char *pBuf, unsigned int Ofs, unsigned int Len, int Wait, t_pAewfThread *ppThread)
 {
-   t_pTable  pTable;
-   int        Found=FALSE;
-   unsigned   TableChunk;
-   unsigned   TableNr;
-   int        rc;
+   t_pAewfThread pThread;
+   t_pTable      pTable;
+   int            Found=FALSE;
+   unsigned       TableChunk;
+   unsigned       TableNr;
+   int            Compressed;
+   uint64_t       SeekPos;
+   unsigned int   ReadLen;
+   uint64_t       ChunkSize;
+   int            ZeroCopy;
+   int            CacheHit;
+   int            prc = 0;
+   int            Ret = AEWF_OK;
 
 //   LOG ("Called - AbsoluteChunk=%'" PRIu64, AbsoluteChunk);
 
+   *ppThread = NULL;
+   pthread_mutex_lock (&pAewf->ReadMutex);
+   pThread = AewfClaimThread (pAewf, AbsoluteChunk, Wait);
+   if (pThread == NULL)
+   {
+      pthread_mutex_unlock (&pAewf->ReadMutex);
+      return AEWF_OK;
+   }
+   pThread->pBuf = pBuf; // These 3 parameters specify which part
+   pThread->Ofs  = Ofs;  // of the resulting chunk data should be
+   pThread->Len  = Len;  // copied to which location.
+
    // Check if chunk already is in cache
    // ----------------------------------
-   for (int i=0; i<pAewf->Threads; i++)
+   CacheHit = (pThread->ChunkInBuff == AbsoluteChunk);
+   if (CacheHit)
    {
-      t_pAewfThread pThread = &(pAewf->pThreadArr[i]);
-      if (pThread->ChunkInBuff == AbsoluteChunk)
-      {
-         pThread->State = AEWF_LAUNCHED;
-         pThread->pBuf  = pBuf;
-         pThread->Ofs   = Ofs;
-         pThread->Len   = Len;
-         rc = pthread_create (&pThread->ID, NULL, AewfThreadCopy, pThread);
-         if (rc != 0)
-            return AEWF_ERROR_PTHREAD;
-         pAewf->ChunkCacheHits++;
+      pAewf->ChunkCacheHits++;
+      pthread_mutex_unlock (&pAewf->ReadMutex);
 
+      prc = pthread_create (&pThread->ID, NULL, AewfThreadCopy, pThread);
+      if (prc == 0)
+      {
+         *ppThread = pThread;
          return AEWF_OK;
       }
+      pthread_mutex_lock (&pAewf->ReadMutex);
+      AewfReleaseThread (pAewf, pThread, TRUE);
+      pthread_mutex_unlock (&pAewf->ReadMutex);
+      CHK (AEWF_ERROR_PTHREAD)
    }
    pAewf->ChunkCacheMisses++;
 
@@ -1010,42 +1154,119 @@ static int AewfReadChunkMT (t_pAewf pAewf, uint64_t AbsoluteChunk, char *pBuf, u
          break;
    }
    if (!Found)
-      CHK (AEWF_CHUNK_NOT_FOUND)
+      Ret = AEWF_CHUNK_NOT_FOUND;
 
-   // Load corresponding table and get chunk
-   // --------------------------------------
-   pTable->LastUsed = time(NULL);                  //lint !e771 pTable' (line 640) conceivably not initialized
-   pTable->pSegment->LastUsed = pTable->LastUsed;  // Update LastUsed here, in order not to remove the required data from cache
+   // Load corresponding table and get chunk location
+   // -----------------------------------------------
+   if (Ret == AEWF_OK)
+   {
+      pTable->LastUsed = time(NULL);                  //lint !e771 pTable' (line 640) conceivably not initialized
+      Ret = AewfLoadEwfTable (pAewf, pTable);
+   }
+   if ((Ret == AEWF_OK) && ((AbsoluteChunk - pTable->ChunkFrom) > UINT_MAX))
+      Ret = AEWF_ERROR_IN_CHUNK_NUMBER;
+   if (Ret == AEWF_OK)
+   {
+      TableChunk = AbsoluteChunk - pTable->ChunkFrom;
+//      LOG ("table %d / entry %" PRIu64 " (%s)", TableNr, TableChunk, pTable->pSegment->pName)
+      Ret = AewfChunkLocation (pAewf, pTable, AbsoluteChunk, TableChunk, &Compressed, &SeekPos, &ReadLen, &ChunkSize);
+   }
+   if (Ret != AEWF_OK)
+   {
+      AewfReleaseThread (pAewf, pThread, TRUE);
+      pthread_mutex_unlock (&pAewf->ReadMutex);
+      CHK (Ret)
+   }
 
-   CHK (AewfLoadEwfTable (pAewf, pTable))
-   CHK (AewfOpenSegment  (pAewf, pTable));
-   if ((AbsoluteChunk - pTable->ChunkFrom) > UINT_MAX)
-      CHK (AEWF_ERROR_IN_CHUNK_NUMBER)
-   TableChunk = AbsoluteChunk - pTable->ChunkFrom;
-//   LOG ("table %d / entry %" PRIu64 " (%s)", TableNr, TableChunk, pTable->pSegment->pName)
-   CHK (AewfReadChunkMT0 (pAewf, pTable, AbsoluteChunk, TableChunk, pBuf, Ofs, Len))
+   // A chunk requested completely is uncompressed directly into the caller's buffer. As the thread's uncompressed
+   // buffer is not touched then, it still caches the chunk it contained before (unless CacheFullChunks is set).
+   ZeroCopy = (Ofs == 0) && (Len == ChunkSize);
+   if (ZeroCopy && !Compressed && (ReadLen != ChunkSize + sizeof (uint32_t)))
+      ZeroCopy = FALSE;
+
+   pThread->ChunkBuffCompressedDataLen   = ReadLen;
+   pThread->ChunkBuffUncompressedDataLen = ChunkSize;  // uncompress should return this size (if it's a compressed chunk)
+   pThread->ZeroCopy                     = ZeroCopy;
+   pThread->CacheChunk                   = !ZeroCopy || pAewf->CacheFullChunks;
+   if (pThread->CacheChunk)
+      pThread->ChunkInBuff               = AbsoluteChunk;
+   if (ZeroCopy)
+      pAewf->ChunksZeroCopy++;
+   pAewf->DataReadFromImage    += ReadLen;
+   pAewf->DataReadFromImageRaw += ChunkSize;
+   pthread_mutex_unlock (&pAewf->ReadMutex);
+
+   // Read the chunk and launch the thread
+   // ------------------------------------
+   // The slot is ours now and the segment cache has its own mutex, so no lock is needed here.
+   Ret = AewfOpenSegment (pAewf, pTable->pSegment);
+   if (Ret == AEWF_OK)
+   {
+      if (Compressed)
+      {
+         Ret = ReadFilePos (pAewf, pTable->pSegment->File, pThread->pChunkBuffCompressed, ReadLen, SeekPos);
+         if (Ret == AEWF_OK)
+            prc = pthread_create (&pThread->ID, NULL, AewfThreadUncompress, pThread);
+      }
+      else if (ZeroCopy)
+      {
+         Ret = ReadFilePos (pAewf, pTable->pSegment->File, pBuf, ChunkSize, SeekPos);
+         if (Ret == AEWF_OK)
+            Ret = ReadFilePos (pAewf, pTable->pSegment->File, &pThread->StoredCRC, sizeof (uint32_t), SeekPos + ChunkSize);
+         if (Ret == AEWF_OK)
+            prc = pthread_create (&pThread->ID, NULL, AewfThreadCRC, pThread);
+      }
+      else
+      {
+         Ret = ReadFilePos (pAewf, pTable->pSegment->File, pThread->pChunkBuffUncompressed, ReadLen, SeekPos);
+         if (Ret == AEWF_OK)
+            prc = pthread_create (&pThread->ID, NULL, AewfThreadCRC, pThread);
+      }
+      AewfReleaseSegment (pAewf, pTable->pSegment);
+   }
+   if ((Ret == AEWF_OK) && (prc != 0))
+      Ret = AEWF_ERROR_PTHREAD;
+
+   // If reading or starting the thread failed, the slot's buffers no longer hold a valid chunk.
+   if (Ret != AEWF_OK)
+   {
+      pthread_mutex_lock (&pAewf->ReadMutex);
+      AewfReleaseThread (pAewf, pThread, FALSE);
+      pthread_mutex_unlock (&pAewf->ReadMutex);
+      CHK (Ret)
+   }
+   *ppThread = pThread;
 
    return AEWF_OK;
 }
 
-static int AewfReadMT0 (t_pAewf pAewf, char *pBuf, uint64_t Seek64, size_t Count, size_t *pRead, int *pErrno)
+// AewfReadMT0 launches jobs for as many chunks as it gets thread slots for (at least one) and
+// joins them. *pRead tells the caller how far it got. pLaunchedArr has room for pAewf->Threads
+// entries and is private to the calling AewfRead.
+static int AewfReadMT0 (t_pAewf pAewf, char *pBuf, uint64_t Seek64, size_t Count, size_t *pRead, t_pAewfThread *pLaunchedArr)
 {
    uint64_t       AbsoluteChunk;
    uint64_t       Remaining;
    uint64_t       Len, Ofs;
    t_pAewfThread pThread;
+   int            Launched = 0;
+   int            Failed   = FALSE;
+   int            rc = AEWF_OK;
 
    Ofs           = Seek64 % pAewf->ChunkSize;
    AbsoluteChunk = Seek64 / pAewf->ChunkSize;
    Remaining     = Count;
    *pRead        = 0;
 
-   // Launch all read/decompress jobs
-   // -------------------------------
-   while (Remaining)
+   // Launch read/decompress jobs
+   // ---------------------------
+   while (Remaining && (Launched < pAewf->Threads))
    {
       Len = GETMIN (pAewf->ChunkSize - Ofs, Remaining);
-      CHK (AewfReadChunkMT (pAewf, AbsoluteChunk, pBuf, Ofs, Len))
+      rc  = AewfReadChunkMT (pAewf, AbsoluteChunk, pBuf, Ofs, Len, (Launched == 0), &pThread);
+      if ((rc != AEWF_OK) || (pThread == NULL))
+         break;           // Don't return before the threads already launched have finished
+      pLaunchedArr[Launched++] = pThread;
       Remaining -= Len;
       pBuf      += Len;
       Ofs        = 0;
@@ -1054,44 +1275,58 @@ static int AewfReadMT0 (t_pAewf pAewf, char *pBuf, uint64_t Seek64, size_t Count
 
    // Wait for threads
    // ----------------
-   for (int i=0; i<pAewf->Threads; i++)
+   // All our threads must be joined, even if one of them failed, as they write to pBuf. *pRead
+   // only counts the chunks in front of the first failed one.
+   for (int i=0; i<Launched; i++)
+      pthread_join (pLaunchedArr[i]->ID, NULL);
+
+   pthread_mutex_lock (&pAewf->ReadMutex);
+   for (int i=0; i<Launched; i++)
    {
-      pThread = &(pAewf->pThreadArr[i]);
-//      LOG ("Checking thread %d -> %d", i, pThread->State);
-      if (pThread->State == AEWF_LAUNCHED)
+      pThread = pLaunchedArr[i];
+      if (pThread->ReturnCode != AEWF_OK)
       {
-         pthread_join (pThread->ID, NULL);
-         pThread->State = AEWF_IDLE;
-         CHK (pThread->ReturnCode)
-         *pRead += pThread->Len;
+         if (rc == AEWF_OK)
+            rc = pThread->ReturnCode;
+         Failed = TRUE;
       }
+      if (!Failed)
+         *pRead += pThread->Len;
+      AewfReleaseThread (pAewf, pThread, (pThread->ReturnCode == AEWF_OK));
    }
+   pthread_mutex_unlock (&pAewf->ReadMutex);
+   CHK (rc)
 
    return AEWF_OK;
 }
 
 static int AewfReadMT (t_pAewf pAewf, char *pBuf, uint64_t Seek64, size_t Count, size_t *pRead, int *pErrno)
 {
-   uint64_t ToRead;
-   uint64_t MaxPerLoop;
-   size_t   Read;
+   t_pAewfThread *pLaunchedArr;
+   size_t          Read;
+   int             rc = AEWF_OK;
+
+   pLaunchedArr = (t_pAewfThread *) malloc (pAewf->Threads * sizeof (t_pAewfThread));
+   if (pLaunchedArr == NULL)
+      CHK (AEWF_MEMALLOC_FAILED)
 
-   MaxPerLoop = pAewf->Threads * pAewf->ChunkSize;
    while (Count)
    {
-      ToRead = GETMIN (MaxPerLoop, Count);
-      Read   = 0;
-      CHK (AewfReadMT0 (pAewf, pBuf, Seek64, ToRead, &Read, pErrno))
+      Read = 0;
+      rc   = AewfReadMT0 (pAewf, pBuf, Seek64, Count, &Read, pLaunchedArr);
       *pRead += Read;
+      if (rc != AEWF_OK)
+         break;
       pBuf   += Read;
       Seek64 += Read;
       Count  -= Read;
    }
+   free (pLaunchedArr);
+   CHK (rc)
 
    return AEWF_OK;
 }
 
-
 // ---------------
 //  API functions
 // ---------------
@@ -1124,6 +1359,7 @@ static int AewfCreateHandle (void **ppHandle, const char *pFormat, uint8_t Debug
    pAewf->DataRequestedByCaller = 0;
    pAewf->TablesReadFromImage   = 0;
    pAewf->ChunksRead            = 0;
+   pAewf->ChunksZeroCopy        = 0;
    pAewf->BytesRead             = 0;
    memset (pAewf->ReadSizesArr, 0, sizeof (pAewf->ReadSizesArr));
    pAewf->Errors                = 0;
@@ -1133,6 +1369,7 @@ static int AewfCreateHandle (void **ppHandle, const char *pFormat, uint8_t Debug
    pAewf->pStatsPath            = NULL;
    pAewf->StatsRefresh          = 0;
    pAewf->pLogPath              = NULL;
+   pAewf->pIndexPath            = NULL;
    pAewf->LogStdout             = Debug;
    pAewf->pThreadArr            = NULL;
 
@@ -1140,6 +1377,15 @@ static int AewfCreateHandle (void **ppHandle, const char *pFormat, uint8_t Debug
    pAewf->MaxOpenSegments = AEWF_DEFAULT_MAXOPENSEGMENTS;
    pAewf->StatsRefresh    = AEWF_DEFAULT_STATSREFRESH;
    pAewf->Threads         = AEWF_DEFAULT_THREADS;
+   pAewf->CacheFullChunks = FALSE;
+
+   if (pthread_mutex_init (&pAewf->SegmentMutex, NULL) ||
+       pthread_mutex_init (&pAewf->ReadMutex   , NULL) ||
+       pthread_cond_init  (&pAewf->ThreadIdle  , NULL))
+   {
+      free (pAewf);
+      return AEWF_ERROR_PTHREAD;
+   }
 
    *ppHandle = (void*) pAewf;
 
@@ -1155,6 +1401,11 @@ int AewfDestroyHandle(void **ppHandle)
 
    if (pAewf->pLogPath  )   free(pAewf->pLogPath  );
    if (pAewf->pStatsPath)   free(pAewf->pStatsPath);
+   if (pAewf->pIndexPath)   free(pAewf->pIndexPath);
+
+   pthread_mutex_destroy (&pAewf->SegmentMutex);
+   pthread_mutex_destroy (&pAewf->ReadMutex   );
+   pthread_cond_destroy  (&pAewf->ThreadIdle  );
 
    memset (pAewf, 0, sizeof(t_Aewf));
    free (pAewf);
@@ -1163,186 +1414,703 @@ int AewfDestroyHandle(void **ppHandle)
    return AEWF_OK;
 }
 
-int AewfOpen (void *pHandle, const char **ppFilenameArr, uint64_t FilenameArrLen)
+// AewfScanSegment0 reads the file header of a segment and walks through all its sections in
+// order to find the tables and the data needed for the image geometry and the info file.
+
+static int AewfScanSegment0 (t_pAewf pAewf, t_pAewfScan pScan, int File)
 {
-   t_pAewf                 pAewf = (t_pAewf) pHandle;
-   t_AewfFileHeader         FileHeader;
-   t_AewfSection            Section;
-   FILE                   *pFile;
-   t_pSegment              pSegment;
-   t_pSegment              pPrevSegment;
-   t_pTable                pTable;
-   uint64_t                 Pos;
-   t_pAewfSectionTable     pEwfTable   = NULL;
-   t_pAewfSectionVolume    pVolume     = NULL;
-   t_pAewfSectionHash      pMD5        = NULL;
-   char                   *pHeader     = NULL;
-   char                   *pHeader2    = NULL;
-   int                      LastSection;
-   unsigned int             SectionSectorsSize;
-   unsigned                 HeaderLen  = 0;
-   unsigned                 Header2Len = 0;
+   t_AewfFileHeader    FileHeader;
+   t_AewfSection       Section;
+   t_AewfSectionTable  EwfTable;
+   t_pAewfScanTable   pTable;
+   uint64_t            Pos;
+   int                 LastSection;
+   unsigned int        SectionSectorsSize = 0;
+
+   pScan->HeaderRc = ReadFilePos (pAewf, File, &FileHeader, sizeof(FileHeader), 0);
+   CHK (pScan->HeaderRc)
+   pScan->Segment.Number = FileHeader.SegmentNumber;
+
+   Pos = sizeof (FileHeader);
+   do
+   {
+      CHK (ReadFilePos (pAewf, File, &Section, sizeof (t_AewfSection), Pos))
 
-   LOG ("Called - Files=%" PRIu64, FilenameArrLen);
+      if (strcasecmp ((char *)Section.Type, "sectors") == 0)
+      {
+         SectionSectorsSize = Section.Size;
+         pScan->SectorsSeen = TRUE;
+      }
+      else if (strcasecmp ((char *)Section.Type, "table") == 0)
+      {
+         CHK (ReadFilePos (pAewf, File, &EwfTable, sizeof(t_AewfSectionTable), Pos + sizeof (t_AewfSection))) // No need to read the actual offset table
+         pTable = (t_pAewfScanTable) realloc (pScan->pTableArr, (pScan->Tables+1) * sizeof (t_AewfScanTable));
+         if (pTable == NULL)
+            return AEWF_MEMALLOC_FAILED;
+         pScan->pTableArr = pTable;
+         pTable = &pScan->pTableArr[pScan->Tables++];
+         pTable->Offset             = Pos + sizeof (t_AewfSection);
+         pTable->Size               = Section.Size;
+         pTable->ChunkCount         = EwfTable.ChunkCount;
+         pTable->SectionSectorsSize = SectionSectorsSize;
+         pTable->VolumeBefore       = (pScan->pVolume != NULL);
+         SectionSectorsSize = 0;
+         pScan->SectorsSeen = TRUE;
+      }
+      else if ((strcasecmp ((char *)Section.Type, "header") == 0) && (pScan->pHeader==NULL))
+      {
+         pScan->HeaderLen = Section.Size - sizeof(t_AewfSection);
+         CHK (ReadFileAllocPos (pAewf, File, (void**) &pScan->pHeader, pScan->HeaderLen, Pos + sizeof (t_AewfSection)))
+      }
+      else if ((strcasecmp ((char *)Section.Type, "header2") == 0) && (pScan->pHeader2==NULL))
+      {
+         pScan->Header2Len = Section.Size - sizeof(t_AewfSection);
+         CHK (ReadFileAllocPos (pAewf, File, (void**) &pScan->pHeader2, pScan->Header2Len, Pos + sizeof (t_AewfSection)))
+      }
+      else if ( ((strcasecmp ((char *)Section.Type, "volume") == 0) || // Guymager works with the volume section. Others use different names
+                 (strcasecmp ((char *)Section.Type, "disk"  ) == 0) || // for it, but it all is the same. See Joachim Metz' EWF documentation
+                 (strcasecmp ((char *)Section.Type, "data"  ) == 0))
+              && (pScan->pVolume==NULL))
+      {
+         CHK (ReadFileAllocPos (pAewf, File, (void**) &pScan->pVolume, sizeof(t_AewfSectionVolume), Pos + sizeof (t_AewfSection)))
+      }
+      if (strcasecmp ((char *)Section.Type, "hash") == 0)
+      {
+         free (pScan->pMD5);
+         pScan->pMD5 = NULL;
+         CHK (ReadFileAllocPos (pAewf, File, (void**) &pScan->pMD5, sizeof(t_AewfSectionHash), Pos + sizeof (t_AewfSection)))
+      }
+//      LOG ("Section %s", Section.Type)
 
-   // Create pSegmentArr and put the segment files in it
-   // --------------------------------------------------
-   int SegmentArrLen  = FilenameArrLen * sizeof(t_Segment);
-   pAewf->pSegmentArr = (t_pSegment) malloc (SegmentArrLen);
-   pAewf->Segments    = FilenameArrLen;
-   if (pAewf->pSegmentArr == NULL)
-      return AEWF_MEMALLOC_FAILED;
-   memset (pAewf->pSegmentArr, 0, SegmentArrLen);
+      LastSection = (Pos == Section.OffsetNextSection);
+      Pos = Section.OffsetNextSection;
+   } while (!LastSection);
+   pScan->SectionSectorsSize = SectionSectorsSize;
+
+   return AEWF_OK;
+}
 
-   for (unsigned i=0; i<FilenameArrLen; i++)
+static int AewfScanSegment (t_pAewf pAewf, t_pAewfScan pScan)
+{
+   int File;
+   int rc;
+
+   pScan->Segment.pName = realpath (pScan->pFilename, NULL); // realpath allocates a buffer of the necessary length
+   if (pScan->Segment.pName == NULL)
    {
-      pSegment = &pAewf->pSegmentArr[i];
-      pSegment->pName = realpath (ppFilenameArr[i], NULL); // realpath allocates a buffer of the necessary length
+      LOG ("Segment file %s not found", pScan->pFilename);
+      pScan->HeaderRc = AEWF_FILE_OPEN_FAILED;
+      return pScan->HeaderRc;
+   }
+   LOG ("Scanning segment %s", pScan->Segment.pName);
+   pScan->HeaderRc = OpenFile (&File, pScan->Segment.pName);
+   CHK (pScan->HeaderRc)
 
-      LOG ("Opening segment %s", ppFilenameArr[i]);
-      CHK (OpenFile (&pFile, pSegment->pName))
-      CHK (ReadFilePos (pAewf, pFile, (void*)&FileHeader, sizeof(FileHeader), 0))
+   rc = AewfScanSegment0 (pAewf, pScan, File);
+   if (rc == AEWF_OK)
+        rc = CloseFile (&File);
+   else (void) CloseFile (&File);
 
-      pSegment->Number   = FileHeader.SegmentNumber;
-      pSegment->LastUsed = 0;
-      pSegment->pFile    = NULL;
+   return rc;
+}
 
-      CHK (CloseFile (&pFile))
+static void* AewfThreadScan (void *pArg)
+{
+   t_pAewfScanPool pPool = (t_pAewfScanPool) pArg;
+   t_pAewfScan     pScan;
+
+   for (;;)
+   {
+      pthread_mutex_lock (&pPool->Mutex);
+      pScan = (pPool->Next < pPool->Count) ? &pPool->pScanArr[pPool->Next++] : NULL;
+      pthread_mutex_unlock (&pPool->Mutex);
+      if (pScan == NULL)
+         break;
+      pScan->WalkRc = AewfScanSegment (pPool->pAewf, pScan);
+   }
+
+   return NULL;
+}
+
+// AewfScanSegments scans all segment files and sets up pSegmentArr, pTableArr, the image geometry and
+// the info text. Segments are scanned in parallel by up to MaxOpenSegments threads (each thread only
+// has one segment file open at a time), which mainly helps on storage with high access latency. The
+// results are merged in segment number order, doing the same checks as a sequential scan would do.
+
+static int AewfScanSegments (t_pAewf pAewf, const char **ppFilenameArr, uint64_t FilenameArrLen)
+{
+   t_AewfScanPool         Pool;
+   t_pAewfScan           pScan;
+   t_pAewfScan           pPrevScan;
+   t_pAewfScanTable      pScanTable;
+   t_pTable              pTable;
+   pthread_t            *pThreadArr   = NULL;
+   uint64_t               Workers;
+   uint64_t               Started      = 0;
+   t_pAewfSectionVolume  pVolume      = NULL;
+   t_pAewfSectionHash    pMD5         = NULL;
+   t_pAewfScan           pHeaderScan  = NULL;
+   t_pAewfScan           pHeader2Scan = NULL;
+   unsigned int           SectionSectorsSize = 0;
+   unsigned int           Size;
+   int                    rc = AEWF_OK;
+
+   #define RET_ERR(ErrCode)  \
+   {                         \
+      rc = ErrCode;          \
+      goto CleanUp;          \
    }
 
-   // Put segment array into correct sequence and check if segment numbers are correct
-   // --------------------------------------------------------------------------------
-   qsort (pAewf->pSegmentArr, pAewf->Segments, sizeof (t_Segment), &QsortCompareSegments);
-   pPrevSegment = NULL;
-   for (unsigned i=0; i<pAewf->Segments; i++)
+   // Scan all segment files
+   // ----------------------
+   memset (&Pool, 0, sizeof (Pool));
+   Pool.pAewf    = pAewf;
+   Pool.Count    = FilenameArrLen;
+   Pool.Next     = 0;
+   Pool.pScanArr = (t_pAewfScan) calloc (FilenameArrLen, sizeof (t_AewfScan));
+   if (Pool.pScanArr == NULL)
+      return AEWF_MEMALLOC_FAILED;
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+   {
+      pScan = &Pool.pScanArr[i];
+      pScan->pFilename    = ppFilenameArr[i];
+      pScan->Segment.File = -1;
+      pScan->HeaderRc     = AEWF_OK;
+      pScan->WalkRc       = AEWF_OK;
+   }
+   if (pthread_mutex_init (&Pool.Mutex, NULL))
    {
-      pSegment = &(pAewf->pSegmentArr[i]);
-      if (pPrevSegment)
+      free (Pool.pScanArr);
+      return AEWF_ERROR_PTHREAD;
+   }
+
+   Workers = GETMIN (pAewf->MaxOpenSegments, FilenameArrLen);
+   LOG ("Scanning %" PRIu64 " segments with %" PRIu64 " threads", FilenameArrLen, GETMAX (Workers, 1));
+   if (Workers > 1)
+   {
+      pThreadArr = (pthread_t *) malloc (Workers * sizeof (pthread_t));
+      if (pThreadArr)
       {
-         if (pSegment->Number == pPrevSegment->Number)
+         for (Started=0; Started<Workers; Started++)
+            if (pthread_create (&pThreadArr[Started], NULL, AewfThreadScan, &Pool))
+               break;
+      }
+   }
+   if (Started == 0)
+      (void) AewfThreadScan (&Pool); // Single threaded scan (or thread creation failed)
+   for (uint64_t i=0; i<Started; i++)
+      (void) pthread_join (pThreadArr[i], NULL);
+   pthread_mutex_destroy (&Pool.Mutex);
+
+   // Put segments into correct sequence and check if segment numbers are correct
+   // ----------------------------------------------------------------------------
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+      if (Pool.pScanArr[i].HeaderRc != AEWF_OK)
+         RET_ERR (Pool.pScanArr[i].HeaderRc)
+
+   qsort (Pool.pScanArr, FilenameArrLen, sizeof (t_AewfScan), &QsortCompareScans);
+   pPrevScan = NULL;
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+   {
+      pScan = &Pool.pScanArr[i];
+      if (pPrevScan)
+      {
+         if (pScan->Segment.Number == pPrevScan->Segment.Number)
          {
             LOG ("Error: Duplicate segment numbers");
-            LOG ("Segment files %s and %s have both segment number %u", pPrevSegment->pName, pSegment->pName, pSegment->Number);
-            return AEWF_DUPLICATE_SEGMENT_NUMBER;
+            LOG ("Segment files %s and %s have both segment number %u", pPrevScan->Segment.pName, pScan->Segment.pName, pScan->Segment.Number);
+            RET_ERR (AEWF_DUPLICATE_SEGMENT_NUMBER)
          }
       }
-      if (pSegment->Number != (i+1))
+      if (pScan->Segment.Number != (i+1))
       {
          LOG ("Error: Missing segment number(s)");
-         LOG ("Previous  segment file %s has segment number %u", pPrevSegment->pName, pPrevSegment->Number);
-         LOG ("Following segment file %s has segment number %u", pSegment->pName    , pSegment->Number    );
-         return AEWF_MISSING_SEGMENT_NUMBER;
+         if (pPrevScan)
+            LOG ("Previous  segment file %s has segment number %u", pPrevScan->Segment.pName, pPrevScan->Segment.Number);
+         LOG ("Following segment file %s has segment number %u", pScan->Segment.pName    , pScan->Segment.Number    );
+         RET_ERR (AEWF_MISSING_SEGMENT_NUMBER)
       }
-      pPrevSegment = pSegment;
+      pPrevScan = pScan;
    }
 
-   // Find all tables in the segment files
-   // ------------------------------------
+   pAewf->pSegmentArr = (t_pSegment) calloc (FilenameArrLen, sizeof (t_Segment));
+   if (pAewf->pSegmentArr == NULL)
+      RET_ERR (AEWF_MEMALLOC_FAILED)
+   pAewf->Segments = FilenameArrLen;
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+   {
+      pAewf->pSegmentArr[i] = Pool.pScanArr[i].Segment;
+      Pool.pScanArr[i].Segment.pName = NULL; // pName now belongs to pSegmentArr
+   }
+
+   // Merge the tables found in the segment files
+   // -------------------------------------------
    pAewf->pTableArr      = NULL;
    pAewf->Tables         = 0;
    pAewf->Chunks         = 0;
    pAewf->TotalTableSize = 0;
-   SectionSectorsSize    = 0;
 
-   LOG ("Reading tables");
-   for (unsigned i=0; i<pAewf->Segments; i++)
+   for (uint64_t i=0; i<FilenameArrLen; i++)
    {
-      pSegment = &pAewf->pSegmentArr[i];
-      CHK (OpenFile (&pFile, pSegment->pName))
-      CHK (ReadFilePos (pAewf, pFile, &FileHeader, sizeof(FileHeader), 0))
-      Pos = sizeof (FileHeader);
-      LOG ("Segment %s ", pSegment->pName);
-      // Search for the important sections
-      do
+      pScan = &Pool.pScanArr[i];
+      if (pScan->WalkRc != AEWF_OK)
+         RET_ERR (pScan->WalkRc)
+      if (pScan->Tables)
       {
-         CHK (ReadFilePos (pAewf, pFile, &Section, sizeof (t_AewfSection), Pos))
-
-         if (strcasecmp ((char *)Section.Type, "sectors") == 0)
-         {
-            SectionSectorsSize = Section.Size;
-         }
-         else if (strcasecmp ((char *)Section.Type, "table") == 0)
-         {
-            if (pVolume == NULL)
-               return AEWF_VOLUME_MUST_PRECEDE_TABLES;
-            if (SectionSectorsSize == 0)
-               return AEWF_SECTORS_MUST_PRECEDE_TABLES;
-            pAewf->Tables++;
-            pAewf->pTableArr = (t_pTable) realloc (pAewf->pTableArr, pAewf->Tables * sizeof (t_Table));
-            CHK (ReadFileAlloc (pAewf, pFile, (void**) &pEwfTable, sizeof(t_AewfSectionTable))) // No need to read the actual offset table
-            pTable = &pAewf->pTableArr[pAewf->Tables-1];
-            pTable->Nr                 = pAewf->Tables-1;
-            pTable->pSegment           = pSegment;
-            pTable->Offset             = Pos + sizeof (t_AewfSection);
-            pTable->Size               = Section.Size;
-            pTable->ChunkCount         = pEwfTable->ChunkCount;
-            pTable->LastUsed           = 0;
-            pTable->pEwfTable          = NULL;
-            pTable->ChunkFrom          = pAewf->Chunks;
-            pTable->SectionSectorsSize = SectionSectorsSize;
-            pAewf->TotalTableSize     += pTable->Size;
-            pAewf->Chunks             += pTable->ChunkCount;
-            pTable->ChunkTo            = pAewf->Chunks-1;
-            free (pEwfTable);
-            pEwfTable = NULL;
-            SectionSectorsSize = 0;
-         }
-         else if ((strcasecmp ((char *)Section.Type, "header") == 0) && (pHeader==NULL))
-         {
-            HeaderLen = Section.Size - sizeof(t_AewfSection);
-            CHK (ReadFileAlloc (pAewf, pFile, (void**) &pHeader, HeaderLen))
-         }
-         else if ((strcasecmp ((char *)Section.Type, "header2") == 0) && (pHeader2==NULL))
-         {
-            Header2Len = Section.Size - sizeof(t_AewfSection);
-            CHK (ReadFileAlloc (pAewf, pFile, (void**) &pHeader2, Header2Len))
-         }
-         else if ( ((strcasecmp ((char *)Section.Type, "volume") == 0) || // Guymager works with the volume section. Others use different names
-                    (strcasecmp ((char *)Section.Type, "disk"  ) == 0) || // for it, but it all is the same. See Joachim Metz' EWF documentation
-                    (strcasecmp ((char *)Section.Type, "data"  ) == 0))
-                 && (pVolume==NULL))
-         {
-            CHK (ReadFileAlloc (pAewf, pFile, (void**) &pVolume, sizeof(t_AewfSectionVolume)))
-            pAewf->Sectors    = pVolume->SectorCount;
-            pAewf->SectorSize = pVolume->BytesPerSector;
-            pAewf->ChunkSize  = pVolume->SectorsPerChunk * pVolume->BytesPerSector; //lint !e647 Suspicious truncation
-            pAewf->ImageSize  = pAewf->Sectors * pAewf->SectorSize;
-         }
-         if (strcasecmp ((char *)Section.Type, "hash") == 0)
-         {
-            CHK (ReadFileAlloc (pAewf, pFile, (void**) &pMD5, sizeof(t_AewfSectionHash)))
-         }
-//         LOG ("Section %s", Section.Type)
-
-         LastSection = (Pos == Section.OffsetNextSection);
-         Pos = Section.OffsetNextSection;
-      } while (!LastSection);
-      CHK (CloseFile (&pFile))
+         pTable = (t_pTable) realloc (pAewf->pTableArr, (pAewf->Tables + pScan->Tables) * sizeof (t_Table));
+         if (pTable == NULL)
+            RET_ERR (AEWF_MEMALLOC_FAILED)
+         pAewf->pTableArr = pTable;
+      }
+      for (uint64_t j=0; j<pScan->Tables; j++)
+      {
+         pScanTable = &pScan->pTableArr[j];
+         if ((pVolume == NULL) && !pScanTable->VolumeBefore)
+            RET_ERR (AEWF_VOLUME_MUST_PRECEDE_TABLES)
+         Size = pScanTable->SectionSectorsSize;
+         if ((Size == 0) && (j == 0))  // The sectors section may reside in the previous segment
+            Size = SectionSectorsSize;
+         if (Size == 0)
+            RET_ERR (AEWF_SECTORS_MUST_PRECEDE_TABLES)
+
+         pTable = &pAewf->pTableArr[pAewf->Tables];
+         pTable->Nr                 = pAewf->Tables++;
+         pTable->pSegment           = &pAewf->pSegmentArr[i];
+         pTable->Offset             = pScanTable->Offset;
+         pTable->Size               = pScanTable->Size;
+         pTable->ChunkCount         = pScanTable->ChunkCount;
+         pTable->LastUsed           = 0;
+         pTable->pEwfTable          = NULL;
+         pTable->ChunkFrom          = pAewf->Chunks;
+         pTable->SectionSectorsSize = Size;
+         pAewf->TotalTableSize     += pTable->Size;
+         pAewf->Chunks             += pTable->ChunkCount;
+         pTable->ChunkTo            = pAewf->Chunks-1;
+      }
+      if (pScan->SectorsSeen)
+         SectionSectorsSize = pScan->SectionSectorsSize;
+      if ((pVolume      == NULL) && pScan->pVolume ) pVolume      = pScan->pVolume;
+      if ((pHeaderScan  == NULL) && pScan->pHeader ) pHeaderScan  = pScan;
+      if ((pHeader2Scan == NULL) && pScan->pHeader2) pHeader2Scan = pScan;
+      if (pScan->pMD5) pMD5 = pScan->pMD5;
    }
+
    if (pVolume == NULL)
-      return AEWF_VOLUME_MISSING;
+      RET_ERR (AEWF_VOLUME_MISSING)
+
+   pAewf->Sectors    = pVolume->SectorCount;
+   pAewf->SectorSize = pVolume->BytesPerSector;
+   pAewf->ChunkSize  = pVolume->SectorsPerChunk * pVolume->BytesPerSector; //lint !e647 Suspicious truncation
+   pAewf->ImageSize  = pAewf->Sectors * pAewf->SectorSize;
 
    if (pAewf->Chunks != pVolume->ChunkCount)
    {
       LOG ("Error: Wrong chunk count: %"PRIu64" / %"PRIu64, pAewf->Chunks, pVolume->ChunkCount);
       LOG ("Maybe some segment files are missing. Perhaps you specified E01 instead of E?? or the segments continue beyond extension .EZZ.");
-      return AEWF_WRONG_CHUNK_COUNT;
+      RET_ERR (AEWF_WRONG_CHUNK_COUNT)
+   }
+
+   rc = CreateInfoData (pAewf, pVolume, pHeaderScan  ? pHeaderScan ->pHeader    : NULL,
+                                        pHeaderScan  ? pHeaderScan ->HeaderLen  : 0,
+                                        pHeader2Scan ? pHeader2Scan->pHeader2   : NULL,
+                                        pHeader2Scan ? pHeader2Scan->Header2Len : 0, pMD5);
+   #undef RET_ERR
+
+CleanUp:
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+   {
+      pScan = &Pool.pScanArr[i];
+      free (pScan->Segment.pName);
+      free (pScan->pTableArr);
+      free (pScan->pVolume);
+      free (pScan->pHeader);
+      free (pScan->pHeader2);
+      free (pScan->pMD5);
+   }
+   free (Pool.pScanArr);
+   free (pThreadArr);
+   if (rc != AEWF_OK)
+   {
+      const char *pErr = AewfGetErrorMessage (rc);
+      LOG ("Error %d (%s) occured", rc, pErr);
+   }
+
+   return rc;
+}
+
+// ------------------------------------
+//     Index file (option aewfindex)
+// ------------------------------------
+
+static int AewfIndexStat (const char *pName, uint64_t *pFileSize, int64_t *pMTimeSec, int64_t *pMTimeNSec)
+{
+   struct stat Stat;
+
+   if (stat (pName, &Stat))
+      return AEWF_FILE_OPEN_FAILED;
+   *pFileSize  = (uint64_t) Stat.st_size;
+#ifdef __APPLE__
+   *pMTimeSec  = Stat.st_mtimespec.tv_sec;
+   *pMTimeNSec = Stat.st_mtimespec.tv_nsec;
+#else
+   *pMTimeSec  = Stat.st_mtim.tv_sec;
+   *pMTimeNSec = Stat.st_mtim.tv_nsec;
+#endif
+   return AEWF_OK;
+}
+
+// AewfIndexLoad sets up pSegmentArr, pTableArr, the image geometry and the info text from the index
+// file instead of scanning the segment files. It only succeeds if the index describes exactly the
+// given segment files and none of them changed in size or modification time since the index has
+// been written. On failure, nothing is left allocated and the caller falls back to the scan.
+
+static int AewfIndexLoad (t_pAewf pAewf, const char **ppFilenameArr, uint64_t FilenameArrLen)
+{
+   FILE               *pFile;
+   char               *pData     = NULL;
+   char               *pCur;
+   char               *pEnd;
+   char              **ppNameArr = NULL;
+   char               *pFound    = NULL;
+   off_t                DataLen;
+   uint32_t             Adler;
+   t_pAewfIndexHeader  pHeader;
+   t_pAewfIndexSegment pIdxSegment;
+   t_pAewfIndexTable   pIdxTable;
+   t_pSegment          pSegment;
+   t_pTable            pTable;
+   uint64_t             FileSize;
+   int64_t              MTimeSec;
+   int64_t              MTimeNSec;
+   int                  rc = AEWF_OK;
+
+   #define RET_ERR(ErrCode)  \
+   {                         \
+      rc = ErrCode;          \
+      goto CleanUp;          \
+   }
+
+   #define GET(pDest, Len)                            \
+   {                                                  \
+      if ((uint64_t)(pEnd - pCur) < (uint64_t)(Len))  \
+         RET_ERR (AEWF_INDEX_INVALID)                 \
+      pDest = (void *) pCur;                          \
+      pCur += (Len);                                  \
+   }
+
+   // Read the whole index and check it
+   // ---------------------------------
+   pFile = fopen (pAewf->pIndexPath, "r");
+   if (pFile == NULL)
+      return AEWF_FILE_OPEN_FAILED;
+   if ((fseeko (pFile, 0, SEEK_END) != 0) || ((DataLen = ftello (pFile)) < 0) ||
+       (fseeko (pFile, 0, SEEK_SET) != 0))
+   {
+      (void) fclose (pFile);
+      return AEWF_FILE_SEEK_FAILED;
+   }
+   if (DataLen < (off_t)(sizeof (t_AewfIndexHeader) + sizeof (Adler)))
+   {
+      (void) fclose (pFile);
+      return AEWF_INDEX_INVALID;
+   }
+   pData = (char *) malloc (DataLen);
+   if (pData == NULL)
+   {
+      (void) fclose (pFile);
+      return AEWF_MEMALLOC_FAILED;
+   }
+   if (fread (pData, DataLen, 1, pFile) != 1)
+   {
+      (void) fclose (pFile);
+      RET_ERR (AEWF_FILE_READ_FAILED)
+   }
+   (void) fclose (pFile);
+
+   DataLen -= sizeof (Adler);
+   memcpy (&Adler, &pData[DataLen], sizeof (Adler));
+   if (Adler != adler32 (1, (Bytef *) pData, DataLen))
+      RET_ERR (AEWF_INDEX_INVALID)
+
+   pCur = pData;
+   pEnd = pData + DataLen;
+   GET (pHeader, sizeof (t_AewfIndexHeader))
+   if ((memcmp (pHeader->Magic, AEWF_INDEX_MAGIC, sizeof (pHeader->Magic)) != 0) ||
+       (pHeader->Version    != AEWF_INDEX_VERSION) ||
+       (pHeader->HeaderSize != sizeof (t_AewfIndexHeader)))
+      RET_ERR (AEWF_INDEX_INVALID)
+   if (pHeader->Segments != FilenameArrLen)
+      RET_ERR (AEWF_INDEX_OUTDATED)
+
+   // Check that the index describes the given, unchanged segment files
+   // ------------------------------------------------------------------
+   ppNameArr = (char **) malloc (FilenameArrLen * sizeof (char *));
+   pFound    = (char  *) calloc (FilenameArrLen,  sizeof (char));
+   if ((ppNameArr == NULL) || (pFound == NULL))
+      RET_ERR (AEWF_MEMALLOC_FAILED)
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+   {
+      ppNameArr[i] = realpath (ppFilenameArr[i], NULL);
+      if (ppNameArr[i] == NULL)
+      {
+         for (uint64_t j=0; j<i; j++)
+            free (ppNameArr[j]);
+         free (ppNameArr);
+         ppNameArr = NULL;
+         RET_ERR (AEWF_FILE_OPEN_FAILED)
+      }
+   }
+
+   pAewf->pSegmentArr = (t_pSegment) calloc (FilenameArrLen, sizeof (t_Segment));
+   if (pAewf->pSegmentArr == NULL)
+      RET_ERR (AEWF_MEMALLOC_FAILED)
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+      pAewf->pSegmentArr[i].File = -1;
+   pAewf->Segments = FilenameArrLen;
+
+   for (uint64_t i=0; i<FilenameArrLen; i++)
+   {
+      char    *pName;
+      uint64_t  j;
+
+      GET (pIdxSegment, sizeof (t_AewfIndexSegment))
+      GET (pName, pIdxSegment->NameLen)
+      for (j=0; j<FilenameArrLen; j++)
+      {
+         if (!pFound[j] && (strlen (ppNameArr[j]) == pIdxSegment->NameLen) &&
+             (memcmp (ppNameArr[j], pName, pIdxSegment->NameLen) == 0))
+            break;
+      }
+      if (j == FilenameArrLen)
+         RET_ERR (AEWF_INDEX_OUTDATED)
+      pFound[j] = TRUE;
+      if (AewfIndexStat (ppNameArr[j], &FileSize, &MTimeSec, &MTimeNSec) != AEWF_OK)
+         RET_ERR (AEWF_INDEX_OUTDATED)
+      if ((FileSize  != pIdxSegment->FileSize) ||
+          (MTimeSec  != pIdxSegment->MTimeSec) ||
+          (MTimeNSec != pIdxSegment->MTimeNSec))
+         RET_ERR (AEWF_INDEX_OUTDATED)
+
+      pSegment = &pAewf->pSegmentArr[i];
+      pSegment->pName  = ppNameArr[j];
+      pSegment->Number = pIdxSegment->Number;
+      ppNameArr[j] = NULL;
+   }
+
+   // Tables, geometry and info text
+   // ------------------------------
+   if (pHeader->Tables)
+   {
+      pAewf->pTableArr = (t_pTable) calloc (pHeader->Tables, sizeof (t_Table));
+      if (pAewf->pTableArr == NULL)
+         RET_ERR (AEWF_MEMALLOC_FAILED)
    }
+   pAewf->Chunks = 0;
+   for (uint64_t i=0; i<pHeader->Tables; i++)
+   {
+      GET (pIdxTable, sizeof (t_AewfIndexTable))
+      if (pIdxTable->Segment >= pAewf->Segments)
+         RET_ERR (AEWF_INDEX_INVALID)
+      pTable = &pAewf->pTableArr[i];
+      pTable->Nr                 = i;
+      pTable->pSegment           = &pAewf->pSegmentArr[pIdxTable->Segment];
+      pTable->Offset             = pIdxTable->Offset;
+      pTable->Size               = pIdxTable->Size;
+      pTable->ChunkCount         = pIdxTable->ChunkCount;
+      pTable->SectionSectorsSize = pIdxTable->SectionSectorsSize;
+      pTable->LastUsed           = 0;
+      pTable->pEwfTable          = NULL;
+      pTable->ChunkFrom          = pAewf->Chunks;
+      pAewf->Chunks             += pTable->ChunkCount;
+      pTable->ChunkTo            = pAewf->Chunks-1;
+   }
+   pAewf->Tables = pHeader->Tables;
+   if (pAewf->Chunks != pHeader->Chunks)
+      RET_ERR (AEWF_INDEX_INVALID)
+   pAewf->TotalTableSize = pHeader->TotalTableSize;
+   pAewf->SectorSize     = pHeader->SectorSize;
+   pAewf->Sectors        = pHeader->Sectors;
+   pAewf->ChunkSize      = pHeader->ChunkSize;
+   pAewf->ImageSize      = pAewf->Sectors * pAewf->SectorSize;
+
+   if ((uint64_t)(pEnd - pCur) != pHeader->InfoLen)
+      RET_ERR (AEWF_INDEX_INVALID)
+   pAewf->pInfo = strndup (pCur, pHeader->InfoLen);
+   if (pAewf->pInfo == NULL)
+      RET_ERR (AEWF_MEMALLOC_FAILED)
+
+   #undef RET_ERR
+   #undef GET
+
+CleanUp:
+   if (ppNameArr)
+   {
+      for (uint64_t i=0; i<FilenameArrLen; i++)
+         free (ppNameArr[i]);
+      free (ppNameArr);
+   }
+   free (pFound);
+   free (pData);
+   if (rc != AEWF_OK)
+   {
+      if (pAewf->pSegmentArr)
+      {
+         for (uint64_t i=0; i<pAewf->Segments; i++)
+            free (pAewf->pSegmentArr[i].pName);
+         free (pAewf->pSegmentArr);
+      }
+      free (pAewf->pTableArr);
+      free (pAewf->pInfo);
+      pAewf->pSegmentArr = NULL;
+      pAewf->pTableArr   = NULL;
+      pAewf->pInfo       = NULL;
+      pAewf->Segments    = 0;
+      pAewf->Tables      = 0;
+      pAewf->Chunks      = 0;
+   }
+   return rc;
+}
+
+// AewfIndexSave writes the layout found by AewfScanSegments to the index file. The index first is
+// written to a temporary file which then is renamed, so concurrent mounts never see a partial index.
+
+static int AewfIndexSave (t_pAewf pAewf)
+{
+   t_AewfIndexHeader   Header;
+   t_AewfIndexSegment  IdxSegment;
+   t_AewfIndexTable    IdxTable;
+   t_pSegment         pSegment;
+   t_pTable           pTable;
+   FILE              *pFile;
+   char              *pTmpPath = NULL;
+   uint64_t            FileSize;
+   int64_t             MTimeSec;
+   int64_t             MTimeNSec;
+   uint32_t            Adler   = adler32 (0, Z_NULL, 0);
+   int                 rc      = AEWF_OK;
+
+   #define WRITE(pSrc, Len)                                   \
+   {                                                          \
+      if (fwrite ((pSrc), (Len), 1, pFile) != 1)              \
+      {                                                       \
+         rc = AEWF_FILE_WRITE_FAILED;                         \
+         goto CleanUp;                                        \
+      }                                                       \
+      Adler = adler32 (Adler, (const Bytef *) (pSrc), (Len)); \
+   }
+
+   if (asprintf (&pTmpPath, "%s.tmp_%d", pAewf->pIndexPath, getpid()) < 0)
+      return AEWF_ASPRINTF_FAILED;
+   pFile = fopen (pTmpPath, "w");
+   if (pFile == NULL)
+   {
+      free (pTmpPath);
+      return AEWF_FILE_OPEN_FAILED;
+   }
+
+   memset (&Header, 0, sizeof (Header));
+   memcpy (Header.Magic, AEWF_INDEX_MAGIC, sizeof (Header.Magic));
+   Header.Version        = AEWF_INDEX_VERSION;
+   Header.HeaderSize     = sizeof (t_AewfIndexHeader);
+   Header.Segments       = pAewf->Segments;
+   Header.Tables         = pAewf->Tables;
+   Header.Chunks         = pAewf->Chunks;
+   Header.TotalTableSize = pAewf->TotalTableSize;
+   Header.SectorSize     = pAewf->SectorSize;
+   Header.Sectors        = pAewf->Sectors;
+   Header.ChunkSize      = pAewf->ChunkSize;
+   Header.InfoLen        = strlen (pAewf->pInfo);
+   WRITE (&Header, sizeof (Header))
+
+   for (uint64_t i=0; i<pAewf->Segments; i++)
+   {
+      pSegment = &pAewf->pSegmentArr[i];
+      memset (&IdxSegment, 0, sizeof (IdxSegment));
+      IdxSegment.Number  = pSegment->Number;
+      IdxSegment.NameLen = strlen (pSegment->pName);
+      if (AewfIndexStat (pSegment->pName, &FileSize, &MTimeSec, &MTimeNSec) != AEWF_OK)
+      {
+         rc = AEWF_FILE_OPEN_FAILED;
+         goto CleanUp;
+      }
+      IdxSegment.FileSize  = FileSize;
+      IdxSegment.MTimeSec  = MTimeSec;
+      IdxSegment.MTimeNSec = MTimeNSec;
+      WRITE (&IdxSegment, sizeof (IdxSegment))
+      WRITE (pSegment->pName, IdxSegment.NameLen)
+   }
+
+   for (uint64_t i=0; i<pAewf->Tables; i++)
+   {
+      pTable = &pAewf->pTableArr[i];
+      memset (&IdxTable, 0, sizeof (IdxTable));
+      IdxTable.Segment            = pTable->pSegment - pAewf->pSegmentArr;
+      IdxTable.Offset             = pTable->Offset;
+      IdxTable.Size               = pTable->Size;
+      IdxTable.ChunkCount         = pTable->ChunkCount;
+      IdxTable.SectionSectorsSize = pTable->SectionSectorsSize;
+      WRITE (&IdxTable, sizeof (IdxTable))
+   }
+
+   WRITE (pAewf->pInfo, Header.InfoLen)
+   if (fwrite (&Adler, sizeof (Adler), 1, pFile) != 1)
+      rc = AEWF_FILE_WRITE_FAILED;
+
+   #undef WRITE
+
+CleanUp:
+   if (fclose (pFile) && (rc == AEWF_OK))
+      rc = AEWF_FILE_WRITE_FAILED;
+   if ((rc == AEWF_OK) && rename (pTmpPath, pAewf->pIndexPath))
+      rc = AEWF_FILE_WRITE_FAILED;
+   if (rc != AEWF_OK)
+      (void) unlink (pTmpPath);
+   else
+      LOG ("Index file %s written", pAewf->pIndexPath)
+   free (pTmpPath);
+
+   return rc;
+}
+
+int AewfOpen (void *pHandle, const char **ppFilenameArr, uint64_t FilenameArrLen)
+{
+   t_pAewf pAewf = (t_pAewf) pHandle;
+   int      rc    = AEWF_OK;
+
+   LOG ("Called - Files=%" PRIu64, FilenameArrLen);
+
+   // Get the image layout, either from the index file or by scanning the segment files
+   // ----------------------------------------------------------------------------------
+   if (pAewf->pIndexPath)
+   {
+      rc = AewfIndexLoad (pAewf, ppFilenameArr, FilenameArrLen);
+      if (rc == AEWF_OK)
+           LOG ("Image layout read from index file %s, segment scan skipped", pAewf->pIndexPath)
+      else LOG ("Index file %s not usable (%s), scanning segment files", pAewf->pIndexPath, AewfGetErrorMessage (rc))
+   }
+   if ((pAewf->pIndexPath == NULL) || (rc != AEWF_OK))
+   {
+      CHK (AewfScanSegments (pAewf, ppFilenameArr, FilenameArrLen))
+      if (pAewf->pIndexPath)
+      {
+         rc = AewfIndexSave (pAewf);
+         if (rc != AEWF_OK)
+            LOG ("Writing index file %s failed (%s), continuing without it", pAewf->pIndexPath, AewfGetErrorMessage (rc))
+      }
+   }
+
    pAewf->ChunkBuffSize = pAewf->ChunkSize + 4096; // reserve some extra space (for CRC and as compressed data might be slightly larger than uncompressed data with some imagers)
    pAewf->pChunkBuffCompressed   = (char *) malloc (pAewf->ChunkBuffSize);
    pAewf->pChunkBuffUncompressed = (char *) malloc (pAewf->ChunkBuffSize);
    if ((pAewf->pChunkBuffCompressed   == NULL) ||
        (pAewf->pChunkBuffUncompressed == NULL))
       return AEWF_MEMALLOC_FAILED;
+   CHK (AewfDecompressorAlloc (&pAewf->pDecompressor))
+   LOG ("Using %s for uncompressing chunks", AEWF_DECOMPRESSOR);
 
    pAewf->TableCache      = 0;
    pAewf->OpenSegments    = 0;
 
-   CHK (CreateInfoData (pAewf, pVolume, pHeader, HeaderLen, pHeader2, Header2Len, pMD5))
-   free (pVolume);
-   free (pHeader);
-   free (pHeader2);
-
    // Allocate thread structures
    // --------------------------
    if (pAewf->Threads > 1)
@@ -1357,6 +2125,7 @@ int AewfOpen (void *pHandle, const char **ppFilenameArr, uint64_t FilenameArrLen
          pThread->pChunkBuffUncompressed = (char *) malloc (pAewf->ChunkBuffSize);
          pThread->ChunkInBuff            = AEWF_NONE;
          pThread->State                  = AEWF_IDLE;
+         CHK (AewfDecompressorAlloc (&pThread->pDecompressor))
       }
    }
 
@@ -1383,15 +2152,18 @@ static int AewfClose (void *pHandle)
    for (unsigned i=0;i<pAewf->Segments;i++)
    {
       pSegment = &pAewf->pSegmentArr[i];
-      if (pSegment->pFile)
-         CHK (CloseFile (&pSegment->pFile));
+      if (pSegment->File >= 0)
+         CHK (CloseFile (&pSegment->File));
       free (pSegment->pName);
    }
 
    free (pAewf->pTableArr);
    free (pAewf->pSegmentArr);
+   free (pAewf->pInfo);
    free (pAewf->pChunkBuffCompressed);
    free (pAewf->pChunkBuffUncompressed);
+   AewfDecompressorFree (pAewf->pDecompressor);
+   pAewf->pDecompressor = NULL;
 
    // Free thread structures
    // ----------------------
@@ -1402,6 +2174,7 @@ static int AewfClose (void *pHandle)
          t_pAewfThread pThread = &pAewf->pThreadArr[i];
          free (pThread->pChunkBuffCompressed);
          free (pThread->pChunkBuffUncompressed);
+         AewfDecompressorFree (pThread->pDecompressor);
       }
       free (pAewf->pThreadArr);
       pAewf->pThreadArr = NULL;
@@ -1427,11 +2200,14 @@ static int AewfRead (void *pHandle, char *pBuf, off_t Seek, size_t Count, size_t
    t_pAewf       pAewf = (t_pAewf) pHandle;
    uint64_t       Seek64;
    int            Ret = AEWF_OK;
+   int            StatsRc;
 
    LOG ("Called - Seek=%'" PRIu64 ",Count=%'" PRIu64, Seek, Count);
    *pRead  = 0;
    *pErrno = 0;
 
+   pthread_mutex_lock (&pAewf->ReadMutex);
+
    if (Seek < 0)
    {
       Ret = AEWF_NEGATIVE_SEEK;
@@ -1454,13 +2230,24 @@ static int AewfRead (void *pHandle, char *pBuf, off_t Seek, size_t Count, size_t
    if ((Seek64+Count) > pAewf->ImageSize) // image simply return what
       Count = pAewf->ImageSize - Seek64;  // is possible.
 
+   // The legacy read works on the handle's single chunk buffer and keeps ReadMutex for the whole
+   // read. AewfReadMT only locks it while handling thread slots, tables and statistics.
    if (pAewf->Threads == 1)
-        Ret = AewfReadLegacy (pAewf, pBuf, Seek64, Count, pRead, pErrno);
-   else Ret = AewfReadMT     (pAewf, pBuf, Seek64, Count, pRead, pErrno);
+   {
+      Ret = AewfReadLegacy (pAewf, pBuf, Seek64, Count, pRead, pErrno);
+   }
+   else
+   {
+      pthread_mutex_unlock (&pAewf->ReadMutex);
+      Ret = AewfReadMT (pAewf, pBuf, Seek64, Count, pRead, pErrno);
+      pthread_mutex_lock (&pAewf->ReadMutex);
+   }
 
 Leave:
    AewfCheckError (pAewf, Ret, pErrno);
-   CHK (UpdateStats (pAewf, (Ret != AEWF_OK)))
+   StatsRc = UpdateStats (pAewf, (Ret != AEWF_OK));
+   pthread_mutex_unlock (&pAewf->ReadMutex);
+   CHK (StatsRc)
    LOG ("Ret %d - Read=%" PRIu32, Ret, *pRead);
    return Ret;
 }
@@ -1485,19 +2272,28 @@ static int AewfOptionsHelp (const char **ppHelp)
 
    wr = asprintf (&pHelp, "    %-12s : Maximum amount of RAM cache, in MiB, for image offset tables. Default: %"PRIu64" MiB\n"
                           "    %-12s : Maximum number of concurrently opened image segment files. Default: %"PRIu64"\n"
+                          "                   This also is the max. number of threads scanning the segment files when opening the image.\n"
                           "    %-12s : Output statistics at regular intervals to this directory (must exist).\n"
                           "                   The files created in this directory will be named stats_<pid>.\n"
                           "    %-12s : The update interval, in seconds, for the statistics (%s must be set). Default: %"PRIu64"s.\n"
                           "    %-12s : Path for writing log file (must exist).\n"
                           "                   The files created in this directory will be named log_<pid>.\n"
                           "    %-12s : Max. number of threads for parallelized decompression. Default: %"PRIu64"\n"
-                          "                   A value of 1 switches back to old, single-threaded legacy functions.\n",
+                          "                   A value of 1 switches back to old, single-threaded legacy functions.\n"
+                          "    %-12s : Index file for the segment layout. If it exists and matches the segment files (sizes and\n"
+                          "                   modification times), the scan of the segment files is skipped when opening the image.\n"
+                          "                   Otherwise, the segment files are scanned and the index file is (re)written.\n"
+                          "    %-12s : Set to 1 for keeping chunks requested completely in the chunk cache as well. Default: 0\n"
+                          "                   Such chunks are uncompressed directly into the destination buffer. Caching them costs\n"
+                          "                   an additional copy and only pays if the same chunks are read again and again.\n",
                           AEWF_OPTION_TABLECACHE,      AEWF_DEFAULT_TABLECACHE,
                           AEWF_OPTION_MAXOPENSEGMENTS, AEWF_DEFAULT_MAXOPENSEGMENTS,
                           AEWF_OPTION_STATS,
                           AEWF_OPTION_STATSREFRESH, AEWF_OPTION_STATS, AEWF_DEFAULT_STATSREFRESH,
                           AEWF_OPTION_LOG,
-                          AEWF_OPTION_THREADS, AEWF_DEFAULT_THREADS);
+                          AEWF_OPTION_THREADS, AEWF_DEFAULT_THREADS,
+                          AEWF_OPTION_INDEX,
+                          AEWF_OPTION_CACHEFULLCHUNKS);
    if ((pHelp == NULL) || (wr<=0))
       return AEWF_MEMALLOC_FAILED;
 
@@ -1561,11 +2357,35 @@ static int AewfOptionsParse (void *pHandle, uint32_t OptionCount, const pts_LibX
          pOption->valid = TRUE;
          LOG ("Option %s set to %s (full path %s)", AEWF_OPTION_STATS, pOption->p_value, pAewf->pLogPath);
       }
+      else if (strcmp (pOption->p_key, AEWF_OPTION_INDEX) == 0)
+      {
+         if (pAewf->pIndexPath)
+            free (pAewf->pIndexPath);
+         pAewf->pIndexPath = strdup (pOption->p_value);
+         if (pAewf->pIndexPath == NULL)
+         {
+            pError = "Memory allocation failed";
+            break;
+         }
+         pOption->valid = TRUE;
+         LOG ("Option %s set to %s", AEWF_OPTION_INDEX, pAewf->pIndexPath);
+      }
 
       else TEST_OPTION_UINT64 (AEWF_OPTION_MAXOPENSEGMENTS, MaxOpenSegments)
       else TEST_OPTION_UINT64 (AEWF_OPTION_TABLECACHE     , MaxTableCache)
       else TEST_OPTION_UINT64 (AEWF_OPTION_STATSREFRESH   , StatsRefresh)
       else TEST_OPTION_UINT64 (AEWF_OPTION_THREADS        , Threads)
+      else if (strcmp (pOption->p_key, AEWF_OPTION_CACHEFULLCHUNKS) == 0)
+      {
+         pAewf->CacheFullChunks = (StrToUint64 (pOption->p_value, &Ok) != 0);
+         if (!Ok)
+         {
+            pError = "Error in option %s: Invalid value";
+            break;
+         }
+         pOption->valid = TRUE;
+         LOG ("Option %s set to %u", AEWF_OPTION_CACHEFULLCHUNKS, pAewf->CacheFullChunks);
+      }
    }
    #undef TEST_OPTION_UINT64
 
@@ -1648,6 +2468,8 @@ static const char* AewfGetErrorMessage (int ErrNum)
       ADD_ERR (AEWF_ASPRINTF_FAILED)
       ADD_ERR (AEWF_CHUNK_LENGTH_ZERO)
       ADD_ERR (AEWF_NEGATIVE_SEEK)
+      ADD_ERR (AEWF_INDEX_INVALID)
+      ADD_ERR (AEWF_INDEX_OUTDATED)
       ADD_ERR (AEWF_ERROR_EIO_END)
       ADD_ERR (AEWF_ERROR_PTHREAD)
       ADD_ERR (AEWF_WRONG_CHUNK_CALCULATION)
@@ -1785,6 +2607,99 @@ int ParseOptions (t_pAewf pAewf, char *pOptions)
    return AEWF_OK;
 }
 
+static double BenchTime (void)
+{
+   struct timespec Now;
+
+   clock_gettime (CLOCK_MONOTONIC, &Now);
+   return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+// Benchmark reads all chunks of the image and measures how fast they are uncompressed (or CRC
+// checked, for chunks stored uncompressed) on a single core, with the decompression backend the
+// library was built with and with zlib. The order of both is alternated in order not to favour
+// one of them with warm CPU caches.
+
+int Benchmark (t_pAewf pAewf)
+{
+   t_pTable            pTable;
+   t_pAewfDecompressor pDecompressor;
+   int                  Compressed;
+   uint64_t             SeekPos;
+   unsigned int         ReadLen;
+   uint64_t             ChunkSize;
+   uint64_t             DstLen0            = 0;
+   uint64_t             ChunksCompressed   = 0;
+   uint64_t             ChunksUncompressed = 0;
+   uint64_t             BytesCompressed    = 0;  // Size after uncompression
+   uint64_t             BytesUncompressed  = 0;
+   double               TimeInflate[2]     = {0.0, 0.0};  // [0]: backend, [1]: zlib
+   double               TimeAdler  [2]     = {0.0, 0.0};
+   double               Start;
+   volatile uint32_t    CRC                = 0;
+   int                  First;
+
+   #define GBPS(Bytes,Time) ((Time) > 0.0 ? (Bytes) / (Time) / 1e9 : 0.0)
+
+   CHK (AewfDecompressorAlloc (&pDecompressor))
+   for (uint64_t i=0; i<pAewf->Tables; i++)
+   {
+      pTable = &pAewf->pTableArr[i];
+      CHK (AewfLoadEwfTable (pAewf, pTable))
+      CHK (AewfOpenSegment  (pAewf, pTable->pSegment))
+      for (unsigned j=0; j<pTable->ChunkCount; j++)
+      {
+         CHK (AewfChunkLocation (pAewf, pTable, pTable->ChunkFrom+j, j, &Compressed, &SeekPos, &ReadLen, &ChunkSize))
+         CHK (ReadFilePos (pAewf, pTable->pSegment->File, pAewf->pChunkBuffCompressed, ReadLen, SeekPos))
+         First = j % 2;
+         for (int k=0; k<2; k++)
+         {
+            int Zlib = (k != First);
+
+            Start = BenchTime ();
+            if (Compressed)
+            {
+               if (Zlib)
+                    CHK (AewfUncompressZlib (                pAewf->pChunkBuffUncompressed, pAewf->ChunkBuffSize, &DstLen0, pAewf->pChunkBuffCompressed, ReadLen))
+               else CHK (AewfUncompress     (pDecompressor, pAewf->pChunkBuffUncompressed, pAewf->ChunkBuffSize, &DstLen0, pAewf->pChunkBuffCompressed, ReadLen))
+               TimeInflate[Zlib] += BenchTime () - Start;
+            }
+            else
+            {
+               if (Zlib)
+                    CRC = adler32     (1, (const Bytef *) pAewf->pChunkBuffCompressed, ChunkSize);
+               else CRC = AewfAdler32 (pAewf->pChunkBuffCompressed, ChunkSize);
+               TimeAdler[Zlib] += BenchTime () - Start;
+            }
+         }
+         if (Compressed)
+         {
+            ChunksCompressed++;
+            BytesCompressed += DstLen0;
+         }
+         else
+         {
+            ChunksUncompressed++;
+            BytesUncompressed += ChunkSize;
+         }
+      }
+      AewfReleaseSegment (pAewf, pTable->pSegment);
+   }
+   AewfDecompressorFree (pDecompressor);
+   (void) CRC;
+
+   printf ("Benchmark, single core, backend %s\n", AEWF_DECOMPRESSOR);
+   printf ("   Compressed chunks:   %8" PRIu64 " (%" PRIu64 " bytes uncompressed)  inflate %s: %6.2f GB/s  zlib: %6.2f GB/s\n",
+           ChunksCompressed, BytesCompressed, AEWF_DECOMPRESSOR,
+           GBPS (BytesCompressed, TimeInflate[0]), GBPS (BytesCompressed, TimeInflate[1]));
+   printf ("   Uncompressed chunks: %8" PRIu64 " (%" PRIu64 " bytes)               Adler-32 %s: %6.2f GB/s  zlib: %6.2f GB/s\n",
+           ChunksUncompressed, BytesUncompressed, AEWF_DECOMPRESSOR,
+           GBPS (BytesUncompressed, TimeAdler[0]), GBPS (BytesUncompressed, TimeAdler[1]));
+   #undef GBPS
+
+   return AEWF_OK;
+}
+
 int main(int argc, const char *argv[])
 {
    t_pAewf       pAewf=NULL;
@@ -1803,6 +2718,7 @@ int main(int argc, const char *argv[])
    char         *pOptions = NULL;
    const char   *pHelp;
    const char   *pInfoBuff;
+   int            Bench = FALSE;
 
    #ifdef CREATE_REVERSE_FILE
       FILE      *pFileRev;
@@ -1831,12 +2747,20 @@ int main(int argc, const char *argv[])
    printf ("\n");
 
 
+   if ((argc > 1) && (strcmp (argv[1], "--benchmark") == 0))
+   {
+      Bench = TRUE;
+      argv++;
+      argc--;
+   }
+
    if (argc < 2)
    {
       (void) AewfOptionsHelp (&pHelp);
-      printf ("Usage: %s <EWF segment file 1> <EWF segment file 2> <...> [-comma_separated_options]\n", argv[0]);
+      printf ("Usage: %s [--benchmark] <EWF segment file 1> <EWF segment file 2> <...> [-comma_separated_options]\n", argv[0]);
       printf ("Possible options:\n%s\n", pHelp);
       printf ("The output file will be named dd.\n");
+      printf ("With --benchmark, no output file is written; the uncompression speed is measured instead.\n");
       CHK (AewfFreeBuffer ((void*) pHelp))
       exit (1);
    }
@@ -1875,6 +2799,16 @@ int main(int argc, const char *argv[])
    CHK (AewfSize (pAewf, &TotalSize))
    printf ("Total size: %" PRIu64 " bytes\n", TotalSize);
 
+   if (Bench)
+   {
+      CHK (Benchmark (pAewf))
+      if (AewfClose (pAewf))
+         PRINT_ERROR_AND_EXIT("Error while closing AEWF files\n");
+      if (AewfDestroyHandle ((void**)&pAewf))
+         PRINT_ERROR_AND_EXIT("Error while destroying AEWF handle\n");
+      return 0;
+   }
+
    pFile = fopen ("dd", "w");
    if (pFile == NULL)
       PRINT_ERROR_AND_EXIT("Cannot open destination file\n");
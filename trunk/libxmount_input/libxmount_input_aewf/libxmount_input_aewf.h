@@ -123,7 +123,8 @@ typedef struct
 {
    char     *pName;
    unsigned   Number;
-   FILE     *pFile;         // NULL if file is not opened (never read or kicked out form cache)
+   int        File;          // -1 if file is not opened (never read or kicked out form cache)
+   unsigned   Users;         // Number of readers currently using File; a segment is never closed while in use
    time_t     LastUsed;
 } t_Segment, *t_pSegment;
 
@@ -141,6 +142,89 @@ typedef struct
    t_pAewfSectionTable pEwfTable;           // Contains the original EWF table section or NULL, if never read or kicked out from cache
 } t_Table, *t_pTable;
 
+// Segment scan in AewfOpen: Every segment file is scanned independently (and possibly in
+// parallel) into a t_AewfScan. The results then are merged in segment number order.
+
+typedef struct
+{
+   uint64_t             Offset;             // Same as in t_Table
+   uint64_t             Size;
+   uint32_t             ChunkCount;
+   uint32_t             SectionSectorsSize; // 0 if no sectors section preceded the table inside this segment
+   int                  VolumeBefore;       // TRUE if a volume section preceded the table inside this segment
+} t_AewfScanTable, *t_pAewfScanTable;
+
+typedef struct
+{
+   const char          *pFilename;          // As given by the caller
+   t_Segment             Segment;
+   int                   HeaderRc;           // Result of opening the file and reading its file header
+   int                   WalkRc;             // Result of the whole scan
+   t_pAewfScanTable     pTableArr;
+   uint64_t              Tables;
+   int                   SectorsSeen;        // TRUE if the segment contains sectors or table sections, i.e. if SectionSectorsSize
+   uint32_t              SectionSectorsSize; // is to be handed on to the next segment
+   t_pAewfSectionVolume pVolume;             // The first volume section of the segment
+   char                *pHeader;             // The first header section of the segment
+   unsigned              HeaderLen;
+   char                *pHeader2;            // The first header2 section of the segment
+   unsigned              Header2Len;
+   t_pAewfSectionHash   pMD5;                // The last hash section of the segment
+} t_AewfScan, *t_pAewfScan;
+
+typedef struct
+{
+   t_pAewf              pAewf;
+   t_pAewfScan          pScanArr;
+   uint64_t              Count;
+   uint64_t              Next;               // Next entry in pScanArr to be scanned, protected by Mutex
+   pthread_mutex_t       Mutex;
+} t_AewfScanPool, *t_pAewfScanPool;
+
+// Layout of the index file written and read with option aewfindex:
+//    t_AewfIndexHeader
+//    t_AewfIndexSegment, followed by the segment file name (NameLen bytes, no terminating 0), for each segment
+//    t_AewfIndexTable for each table
+//    info text (InfoLen bytes, no terminating 0)
+//    Adler-32 of all the preceding bytes (uint32_t)
+// The index is written in host byte order; it only is meant to be reused on the machine that wrote it.
+
+#define AEWF_INDEX_MAGIC   "AEWFIDX"
+#define AEWF_INDEX_VERSION 1
+
+typedef struct
+{
+   char               Magic[8];
+   uint32_t           Version;
+   uint32_t           HeaderSize;     // sizeof (t_AewfIndexHeader), for detecting layout changes
+   uint64_t           Segments;
+   uint64_t           Tables;
+   uint64_t           Chunks;
+   uint64_t           TotalTableSize;
+   uint64_t           SectorSize;
+   uint64_t           Sectors;
+   uint64_t           ChunkSize;
+   uint64_t           InfoLen;
+} __attribute__ ((packed)) t_AewfIndexHeader, *t_pAewfIndexHeader;
+
+typedef struct
+{
+   uint32_t           Number;
+   uint32_t           NameLen;
+   uint64_t           FileSize;       // FileSize and the modification time are compared against the segment
+   int64_t            MTimeSec;       // files when loading the index. The index is discarded if anything changed.
+   int64_t            MTimeNSec;
+} __attribute__ ((packed)) t_AewfIndexSegment, *t_pAewfIndexSegment;
+
+typedef struct
+{
+   uint64_t           Segment;        // Position of the table's segment in pAewf->pSegmentArr
+   uint64_t           Offset;
+   uint64_t           Size;
+   uint32_t           ChunkCount;
+   uint32_t           SectionSectorsSize;
+} __attribute__ ((packed)) t_AewfIndexTable, *t_pAewfIndexTable;
+
 #define AEWF_NONE UINT64_MAX
 
 enum
@@ -155,10 +239,16 @@ enum
    READSIZE_ARRLEN
 };
 
+#ifdef HAVE_LIBDEFLATE
+   typedef struct libdeflate_decompressor *t_pAewfDecompressor;
+#else
+   typedef void                           *t_pAewfDecompressor;  // zlib needs no decompressor object
+#endif
+
 typedef enum
 {
    AEWF_IDLE = 0,
-   AEWF_LAUNCHED
+   AEWF_CLAIMED     // Reserved by an AewfRead call, which reads the chunk, launches the thread and joins it
 } t_AewfThreadState;
 
 typedef struct _t_AewfThread
@@ -171,10 +261,14 @@ typedef struct _t_AewfThread
    char             *pChunkBuffUncompressed;         // This buffer serves as cache as well. ChunkInBuff contains the absolute chunk number whose data is stored here
    uint64_t           ChunkBuffUncompressedDataLen;  // This normally always is equal to the chunk size (32K), except maybe for the last chunk, if the image's total size is not a multiple of the chunk size
    uint64_t           ChunkInBuff;
+   t_pAewfDecompressor pDecompressor;
 
    char              *pBuf;        // Job arguments to the thread: Copy the uncompressed
    uint64_t            Ofs;        // chunk data starting at chunk offset Ofs to pBuf, Len
    uint64_t            Len;        // bytes in total.
+   int                 ZeroCopy;   // TRUE if the whole chunk is requested: The data then is uncompressed (or read) directly into pBuf
+   int                 CacheChunk; // TRUE if the chunk data must be kept in pChunkBuffUncompressed (only relevant with ZeroCopy)
+   uint32_t            StoredCRC;  // The CRC of uncompressed chunks read with ZeroCopy
 
    int                ReturnCode;
 } t_AewfThread, *t_pAewfThread;
@@ -189,6 +283,9 @@ typedef struct _t_Aewf
    uint64_t       TotalTableSize;  // Total size of all tables
    uint64_t       TableCache;      // Current amount RAM used by tables, in bytes
    uint64_t       OpenSegments;    // Current number of open segment files
+   pthread_mutex_t SegmentMutex;   // Protects File, Users and LastUsed of all segments as well as OpenSegments and the segment cache statistics
+   pthread_mutex_t ReadMutex;      // Protects the legacy chunk buffer, the State and ChunkInBuff of pThreadArr, the table cache and the statistics; not held during segment I/O of multi-threaded reads
+   pthread_cond_t  ThreadIdle;     // Signalled with ReadMutex whenever an entry of pThreadArr becomes idle
    uint64_t       SectorSize;
    uint64_t       Sectors;
    uint64_t       ChunkSize;
@@ -198,6 +295,7 @@ typedef struct _t_Aewf
    uint64_t       ChunkBuffUncompressedDataLen;  // This normally always is equal to the chunk size (32K), except maybe for the last chunk, if the image's total size is not a multiple of the chunk size
    uint32_t       ChunkBuffSize;
    uint64_t       ChunkInBuff;     // Chunk currently residing in pChunkBuffUncompressed (AEWF_NONE if none)
+   t_pAewfDecompressor pDecompressor; // Used by the legacy functions
    char         *pErrorText;       // Used for assembling error text during option parsing
    time_t         LastStatsUpdate;
    char         *pInfo;
@@ -216,6 +314,7 @@ typedef struct _t_Aewf
    uint64_t   DataRequestedByCaller; // How much data was given back to the caller
    uint64_t   TablesReadFromImage;   // The overhead of the table read operations (in bytes)
    uint64_t   ChunksRead;
+   uint64_t   ChunksZeroCopy;        // Chunks uncompressed (or read) directly into the caller's buffer
    uint64_t   BytesRead;
    uint64_t   ReadSizesArr[READSIZE_ARRLEN];  // Distribution of the requested block sites to be read
    uint64_t   Errors;
@@ -227,8 +326,10 @@ typedef struct _t_Aewf
    char     *pStatsPath;        // Statistics path
    uint64_t   StatsRefresh;     // The time in seconds between update of the stats file
    char     *pLogPath;          // Path for log file
+   char     *pIndexPath;        // Index file for skipping the segment scan in AewfOpen (NULL if not used)
    uint8_t    LogStdout;
    uint64_t   Threads;          // Max. number of threads to be used in parallel actions. Currently only used for uncompression
+   uint8_t    CacheFullChunks;  // Keep chunks requested completely in the chunk cache, too (costs an extra copy)
 } t_Aewf;
 
 // ----------------
@@ -283,6 +384,8 @@ enum
    AEWF_ASPRINTF_FAILED,
    AEWF_CHUNK_LENGTH_ZERO,
    AEWF_NEGATIVE_SEEK,
+   AEWF_INDEX_INVALID,
+   AEWF_INDEX_OUTDATED,
    AEWF_ERROR_EIO_END,
    AEWF_ERROR_PTHREAD,
    AEWF_WRONG_CHUNK_CALCULATION,
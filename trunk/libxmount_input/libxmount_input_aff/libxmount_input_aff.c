@@ -18,8 +18,10 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <fcntl.h> // For O_RDONLY
+#include <pthread.h>
 
 #include "../libxmount_input.h"
 
@@ -31,6 +33,13 @@
 
 #include "libxmount_input_aff.h"
 
+#define AFF_OPTION_HANDLES "affhandles"
+#define AFF_OPTION_CACHE "affcache"
+
+// afflib only reads its cache size from the environment when opening an
+// image, so images are opened one by one
+static pthread_mutex_t aff_open_mutex=PTHREAD_MUTEX_INITIALIZER;
+
 /*******************************************************************************
  * LibXmount_Input API implementation
  ******************************************************************************/
@@ -69,6 +78,79 @@ void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
 /*******************************************************************************
  * Private
  ******************************************************************************/
+/*
+ * AffOpenPoolHandle
+ *
+ * Must be called with aff_open_mutex held.
+ */
+static int AffOpenPoolHandle(const char *p_filename,
+                             pts_AffPoolHandle p_pool_handle)
+{
+  p_pool_handle->h_aff=af_open(p_filename,O_RDONLY,0);
+
+  if(p_pool_handle->h_aff==NULL) {
+    // LOG_ERROR("Couldn't open AFF file!\n")
+    return AFF_OPEN_FAILED;
+  }
+
+  // Encrypted images aren't supported for now
+  // TODO: Add support trough lib params, f. ex. aff_password=xxxx
+  if(af_cannot_decrypt(p_pool_handle->h_aff)) {
+    af_close(p_pool_handle->h_aff);
+    p_pool_handle->h_aff=NULL;
+    return AFF_ENCRYPTION_UNSUPPORTED;
+  }
+
+  p_pool_handle->pos=0;
+  return AFF_OK;
+}
+
+/*
+ * AffAcquirePoolHandle
+ *
+ * Returns an AFF handle not used by any other thread, preferably one already
+ * positioned at offset, which continues sequential reads without af_seek and
+ * on the handle that has the pages of the stream cached. If all handles are
+ * busy, the function waits for one to be released.
+ */
+static pts_AffPoolHandle AffAcquirePoolHandle(pts_AffHandle p_aff_handle,
+                                              uint64_t offset)
+{
+  pts_AffPoolHandle p_free;
+  pts_AffPoolHandle p_pool_handle;
+
+  pthread_mutex_lock(&(p_aff_handle->mutex));
+  for(;;) {
+    p_free=NULL;
+    for(uint32_t i=0;i<p_aff_handle->open_handles;i++) {
+      p_pool_handle=&(p_aff_handle->p_pool[i]);
+      if(p_pool_handle->busy) continue;
+      if(p_free==NULL || p_pool_handle->pos==offset) p_free=p_pool_handle;
+      if(p_pool_handle->pos==offset) break;
+    }
+    if(p_free!=NULL) break;
+
+    p_aff_handle->handle_waits++;
+    pthread_cond_wait(&(p_aff_handle->handle_freed),&(p_aff_handle->mutex));
+  }
+  p_free->busy=1;
+  pthread_mutex_unlock(&(p_aff_handle->mutex));
+
+  return p_free;
+}
+
+/*
+ * AffReleasePoolHandle
+ */
+static void AffReleasePoolHandle(pts_AffHandle p_aff_handle,
+                                 pts_AffPoolHandle p_pool_handle)
+{
+  pthread_mutex_lock(&(p_aff_handle->mutex));
+  p_pool_handle->busy=0;
+  pthread_cond_signal(&(p_aff_handle->handle_freed));
+  pthread_mutex_unlock(&(p_aff_handle->mutex));
+}
+
 /*
  * AffCreateHandle
  */
@@ -80,11 +162,14 @@ static int AffCreateHandle(void **pp_handle,
   pts_AffHandle p_aff_handle;
 
   // Alloc new lib handle
-  p_aff_handle=(pts_AffHandle)malloc(sizeof(ts_AffHandle));
+  p_aff_handle=(pts_AffHandle)calloc(1,sizeof(ts_AffHandle));
   if(p_aff_handle==NULL) return AFF_MEMALLOC_FAILED;
 
-  // Init lib handle  
-  p_aff_handle->h_aff=NULL;
+  // Init lib handle
+  p_aff_handle->max_handles=AFF_DEFAULT_HANDLES;
+  p_aff_handle->debug=debug;
+  pthread_mutex_init(&(p_aff_handle->mutex),NULL);
+  pthread_cond_init(&(p_aff_handle->handle_freed),NULL);
 
   *pp_handle=p_aff_handle;
   return AFF_OK;
@@ -97,7 +182,11 @@ static int AffDestroyHandle(void **pp_handle) {
   pts_AffHandle p_aff_handle=(pts_AffHandle)*pp_handle;
 
   // Free lib handle
-  if(p_aff_handle!=NULL) free(p_aff_handle);
+  if(p_aff_handle!=NULL) {
+    pthread_cond_destroy(&(p_aff_handle->handle_freed));
+    pthread_mutex_destroy(&(p_aff_handle->mutex));
+    free(p_aff_handle);
+  }
 
   *pp_handle=NULL;
   return AFF_OK;
@@ -111,25 +200,73 @@ static int AffOpen(void *p_handle,
                    uint64_t filename_arr_len)
 {
   pts_AffHandle p_aff_handle=(pts_AffHandle)p_handle;
+  char *p_old_cache_pages=NULL;
+  char cache_pages[16];
+  int cache_pages_used=0;
+  int64_t image_size;
+  int ret=AFF_OK;
 
   // We need exactly one file
   if(filename_arr_len==0) return AFF_NO_INPUT_FILES;
   if(filename_arr_len>1) return AFF_TOO_MANY_INPUT_FILES;
 
-  // Open AFF file
-  p_aff_handle->h_aff=af_open(pp_filename_arr[0],O_RDONLY,0);
-  if(p_aff_handle->h_aff==NULL) {
-    // LOG_ERROR("Couldn't open AFF file!\n")
-    return AFF_OPEN_FAILED;
+  // All AFF handles are opened here, before any read may call getenv in
+  // another thread. There is no API for setting the size of afflib's page
+  // cache, so the environment is changed while opening them and restored
+  // afterwards.
+  pthread_mutex_lock(&aff_open_mutex);
+  if(getenv(AFFLIB_CACHE_PAGES)!=NULL) {
+    p_old_cache_pages=strdup(getenv(AFFLIB_CACHE_PAGES));
+    if(p_old_cache_pages==NULL) {
+      pthread_mutex_unlock(&aff_open_mutex);
+      return AFF_MEMALLOC_FAILED;
+    }
+  }
+  if(p_aff_handle->cache_pages!=0) {
+    snprintf(cache_pages,sizeof(cache_pages),"%" PRIu32,
+             p_aff_handle->cache_pages);
+    setenv(AFFLIB_CACHE_PAGES,cache_pages,1);
   }
 
-  // Encrypted images aren't supported for now
-  // TODO: Add support trough lib params, f. ex. aff_password=xxxx
-  if(af_cannot_decrypt(p_aff_handle->h_aff)) {
-    af_close(p_aff_handle->h_aff);
-    return AFF_ENCRYPTION_UNSUPPORTED;
+  // Remember the cache size in effect, determined the same way af_open does
+  if(getenv(AFFLIB_CACHE_PAGES)!=NULL) {
+    cache_pages_used=atoi(getenv(AFFLIB_CACHE_PAGES));
+  }
+  if(cache_pages_used<1) cache_pages_used=AFFLIB_CACHE_PAGES_DEFAULT;
+  p_aff_handle->cache_pages_used=(uint32_t)cache_pages_used;
+
+  // Open AFF file. Only the first handle is required, reads are just less
+  // concurrent without the others.
+  for(uint32_t i=0;i<p_aff_handle->max_handles;i++) {
+    ret=AffOpenPoolHandle(pp_filename_arr[0],&(p_aff_handle->p_pool[i]));
+    if(ret!=AFF_OK) {
+      if(i!=0) {
+        LIBXMOUNT_LOG_WARNING("Unable to open AFF handle %" PRIu32 ": %s. "
+                                "Continuing with %" PRIu32 " handles.\n",
+                              i,
+                              AffGetErrorMessage(ret),
+                              i);
+        ret=AFF_OK;
+      }
+      break;
+    }
+    p_aff_handle->open_handles++;
   }
 
+  if(p_old_cache_pages!=NULL) {
+    setenv(AFFLIB_CACHE_PAGES,p_old_cache_pages,1);
+    free(p_old_cache_pages);
+  } else unsetenv(AFFLIB_CACHE_PAGES);
+  pthread_mutex_unlock(&aff_open_mutex);
+  if(ret!=AFF_OK) return ret;
+
+  image_size=af_get_imagesize(p_aff_handle->p_pool[0].h_aff);
+  if(image_size<0) {
+    AffClose(p_aff_handle);
+    return AFF_OPEN_FAILED;
+  }
+  p_aff_handle->image_size=(uint64_t)image_size;
+
   return AFF_OK;
 }
 
@@ -138,11 +275,22 @@ static int AffOpen(void *p_handle,
  */
 static int AffClose(void *p_handle) {
   pts_AffHandle p_aff_handle=(pts_AffHandle)p_handle;
+  int ret=AFF_OK;
+
+  // Close AFF handles
+  for(uint32_t i=0;i<p_aff_handle->open_handles;i++) {
+    LIBXMOUNT_LOG_DEBUG(p_aff_handle->debug,
+                        "AFF handle %" PRIu32 ": %" PRIu64 " reads, %" PRIu64
+                          " seeks\n",
+                        i,
+                        p_aff_handle->p_pool[i].reads,
+                        p_aff_handle->p_pool[i].seeks);
+    if(af_close(p_aff_handle->p_pool[i].h_aff)!=0) ret=AFF_CLOSE_FAILED;
+    p_aff_handle->p_pool[i].h_aff=NULL;
+  }
+  p_aff_handle->open_handles=0;
 
-  // Close AFF handle
-  if(af_close(p_aff_handle->h_aff)!=0) return AFF_CLOSE_FAILED;
-
-  return AFF_OK;
+  return ret;
 }
 
 /*
@@ -151,8 +299,7 @@ static int AffClose(void *p_handle) {
 static int AffSize(void *p_handle, uint64_t *p_size) {
   pts_AffHandle p_aff_handle=(pts_AffHandle)p_handle;
 
-  // TODO: Check for error. Unfortunately, I don't know how :(
-  *p_size=af_seek(p_aff_handle->h_aff,0,SEEK_END);
+  *p_size=p_aff_handle->image_size;
 
   return AFF_OK;
 }
@@ -168,20 +315,48 @@ static int AffRead(void *p_handle,
                    int *p_errno)
 {
   pts_AffHandle p_aff_handle=(pts_AffHandle)p_handle;
-  size_t bytes_read;
+  pts_AffPoolHandle p_pool_handle;
+  int bytes_read;
+  int ret=AFF_OK;
+
+  if(offset<0 || (uint64_t)offset>p_aff_handle->image_size ||
+     count>p_aff_handle->image_size-(uint64_t)offset)
+  {
+    return AFF_READ_FAILED;
+  }
 
-  // Seek to requested position
-  if(af_seek(p_aff_handle->h_aff,offset,SEEK_SET)!=offset) {
-    return AFF_SEEK_FAILED;
+  *p_read=0;
+  p_pool_handle=AffAcquirePoolHandle(p_aff_handle,offset);
+  p_pool_handle->reads++;
+
+  // Seek to requested position, unless the handle already is there
+  if(p_pool_handle->pos!=(uint64_t)offset) {
+    p_pool_handle->seeks++;
+    if(af_seek(p_pool_handle->h_aff,offset,SEEK_SET)!=(uint64_t)offset) {
+      // Position is unknown now
+      p_pool_handle->pos=UINT64_MAX;
+      ret=AFF_SEEK_FAILED;
+    } else p_pool_handle->pos=(uint64_t)offset;
   }
 
-  // Read data
-  // TODO: Check for errors
-  bytes_read=af_read(p_aff_handle->h_aff,(unsigned char*)p_buf,count);
-  if(bytes_read!=count) return AFF_READ_FAILED;
+  // Read data. af_read takes an int as count, larger requests are split.
+  while(ret==AFF_OK && count>0) {
+    size_t to_read=count>(1<<30) ? (1<<30) : count;
+    bytes_read=af_read(p_pool_handle->h_aff,(unsigned char*)p_buf,to_read);
+    if(bytes_read<0 || (size_t)bytes_read!=to_read) {
+      // Position is unknown now
+      p_pool_handle->pos=UINT64_MAX;
+      ret=AFF_READ_FAILED;
+      break;
+    }
+    p_pool_handle->pos+=bytes_read;
+    p_buf+=bytes_read;
+    count-=bytes_read;
+    *p_read+=bytes_read;
+  }
 
-  *p_read=bytes_read;
-  return AFF_OK;
+  AffReleasePoolHandle(p_aff_handle,p_pool_handle);
+  return ret;
 }
 
 /*
@@ -201,7 +376,19 @@ static int AffWrite(void *p_handle,
  * AffOptionsHelp
  */
 static int AffOptionsHelp(const char **pp_help) {
-  *pp_help=NULL;
+  char *p_help=NULL;
+  int ret;
+
+  ret=asprintf(&p_help,
+               "    %-12s : Max. number of AFF handles for reading "
+                 "concurrently. Default: %d\n"
+               "    %-12s : Number of pages cached by each AFF handle. "
+                 "Default: %d\n",
+               AFF_OPTION_HANDLES,AFF_DEFAULT_HANDLES,
+               AFF_OPTION_CACHE,AFFLIB_CACHE_PAGES_DEFAULT);
+  if(ret<0 || p_help==NULL) return AFF_MEMALLOC_FAILED;
+
+  *pp_help=p_help;
   return AFF_OK;
 }
 
@@ -213,6 +400,35 @@ static int AffOptionsParse(void *p_handle,
                            const pts_LibXmountOptions *pp_options,
                            const char **pp_error)
 {
+  pts_AffHandle p_aff_handle=(pts_AffHandle)p_handle;
+  pts_LibXmountOptions p_option;
+  uint64_t value;
+  int ok;
+
+  *pp_error=NULL;
+  for(uint32_t i=0;i<options_count;i++) {
+    p_option=pp_options[i];
+    if(strcmp(p_option->p_key,AFF_OPTION_HANDLES)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value==0 || value>AFF_MAX_HANDLES) {
+        *pp_error=strdup("Error in option " AFF_OPTION_HANDLES
+                           ": Invalid value");
+        return AFF_INVALID_OPTION_VALUE;
+      }
+      p_aff_handle->max_handles=(uint32_t)value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,AFF_OPTION_CACHE)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value==0 || value>INT32_MAX) {
+        *pp_error=strdup("Error in option " AFF_OPTION_CACHE
+                           ": Invalid value");
+        return AFF_INVALID_OPTION_VALUE;
+      }
+      p_aff_handle->cache_pages=(uint32_t)value;
+      p_option->valid=1;
+    }
+  }
+
   return AFF_OK;
 }
 
@@ -220,8 +436,22 @@ static int AffOptionsParse(void *p_handle,
  * AffGetInfofileContent
  */
 static int AffGetInfofileContent(void *p_handle, const char **pp_info_buf) {
-  // TODO
-  *pp_info_buf=NULL;
+  pts_AffHandle p_aff_handle=(pts_AffHandle)p_handle;
+  char *p_info_buf=NULL;
+  int ret;
+
+  ret=asprintf(&p_info_buf,
+               "Image size: %" PRIu64 " bytes\n"
+               "Page size: %d bytes\n"
+               "AFF handles: %" PRIu32 "\n"
+               "Cached pages per handle: %" PRIu32 "\n",
+               p_aff_handle->image_size,
+               af_get_pagesize(p_aff_handle->p_pool[0].h_aff),
+               p_aff_handle->open_handles,
+               p_aff_handle->cache_pages_used);
+  if(ret<0 || p_info_buf==NULL) return AFF_MEMALLOC_FAILED;
+
+  *pp_info_buf=p_info_buf;
   return AFF_OK;
 }
 
@@ -257,6 +487,9 @@ static const char* AffGetErrorMessage(int err_num) {
     case AFF_WRITE_FAILED:
       return "Write is not supported in AFF input module.";
       break;
+    case AFF_INVALID_OPTION_VALUE:
+      return "Invalid option value";
+      break;
     default:
       return "Unknown error";
   }
@@ -275,5 +508,9 @@ static int AffFreeBuffer(void *p_buf) {
   20140724: * Initial version implementing AffOpen, AffSize, AffRead, AffClose,
               AffOptionsHelp, AffOptionsParse and AffFreeBuffer
   20140804: * Added error handling and AffGetErrorMessage
+  20261019: * Reads may be called concurrently, using a pool of AFF handles.
+            * af_seek is skipped when a handle already is at the read offset.
+            * Added options affhandles and affcache.
+            * All AFF handles are opened in AffOpen.
 */
 
@@ -32,13 +32,54 @@ enum {
   AFF_ENCRYPTION_UNSUPPORTED,
   AFF_SEEK_FAILED,
   AFF_READ_FAILED,
-  AFF_WRITE_FAILED
+  AFF_WRITE_FAILED,
+  AFF_INVALID_OPTION_VALUE
 };
 
-//! Library handle
-typedef struct s_AffHandle {
+//! Max. number of AFF handles used for concurrent reads
+#define AFF_MAX_HANDLES 16
+//! Default number of AFF handles
+#define AFF_DEFAULT_HANDLES 2
+
+//! One of the AFF handles used for reading
+typedef struct s_AffPoolHandle {
   //! AFF handle
   AFFILE *h_aff;
+  //! Set while a read uses this handle
+  uint8_t busy;
+  //! Current read position of h_aff, af_seek is skipped if it matches
+  uint64_t pos;
+  //! Statistics
+  uint64_t reads;
+  uint64_t seeks;
+} ts_AffPoolHandle, *pts_AffPoolHandle;
+
+//! Library handle
+/*!
+ * Reads may be called concurrently. Every read takes one of the AFF handles in
+ * p_pool, preferably one positioned where the read starts. All handles are
+ * opened in AffOpen. The mutex protects everything but the AFF handles
+ * themselves.
+ */
+typedef struct s_AffHandle {
+  //! AFF handles, the first open_handles of them are open
+  ts_AffPoolHandle p_pool[AFF_MAX_HANDLES];
+  uint32_t open_handles;
+  //! Number of AFF handles to open at most
+  uint32_t max_handles;
+  //! Image size
+  uint64_t image_size;
+  //! Number of pages cached by afflib per handle, 0 for afflib's default
+  uint32_t cache_pages;
+  //! Number of pages cached in effect, which might be set by the environment
+  uint32_t cache_pages_used;
+  //! Statistics
+  uint64_t handle_waits;
+  //! Protects the pool
+  pthread_mutex_t mutex;
+  pthread_cond_t handle_freed;
+  //! Debug settings
+  uint8_t debug;
 } ts_AffHandle, *pts_AffHandle;
 
 /*******************************************************************************
@@ -18,7 +18,12 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "../libxmount_input.h"
 
@@ -35,6 +40,15 @@
 
 #include "libxmount_input_ewf.h"
 
+#define EWF_OPTION_HANDLES "ewfhandles"
+#define EWF_OPTION_MAXOPEN "ewfmaxopen"
+#define EWF_OPTION_CACHE "ewfcache"
+#define EWF_OPTION_STATS "ewfstats"
+#define EWF_OPTION_STATSREFRESH "ewfrefresh"
+
+// libewf's header parsing isn't thread safe, so handles are opened one by one
+static pthread_mutex_t ewf_open_mutex=PTHREAD_MUTEX_INITIALIZER;
+
 /*******************************************************************************
  * LibXmount_Input API implementation
  ******************************************************************************/
@@ -73,6 +87,325 @@ void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
 /*******************************************************************************
  * Private
  ******************************************************************************/
+/*
+ * EwfOpenPoolHandle0
+ */
+static int EwfOpenPoolHandle0(pts_EwfHandle p_ewf_handle,
+                              pts_EwfPoolHandle p_pool_handle)
+{
+#ifdef HAVE_LIBEWF_V2_API
+  if(p_pool_handle->h_ewf==NULL &&
+     libewf_handle_initialize(&(p_pool_handle->h_ewf),NULL)!=1)
+  {
+    return EWF_HANDLE_CREATION_FAILED;
+  }
+  if(p_ewf_handle->max_open_segments!=0 &&
+     libewf_handle_set_maximum_number_of_open_handles(
+       p_pool_handle->h_ewf,
+       p_ewf_handle->max_open_segments,
+       NULL)!=1)
+  {
+    return EWF_OPEN_FAILED;
+  }
+  if(libewf_handle_open(p_pool_handle->h_ewf,
+                        p_ewf_handle->pp_filenames,
+                        p_ewf_handle->filenames_count,
+                        libewf_get_access_flags_read(),
+                        NULL)!=1)
+#else
+  p_pool_handle->h_ewf=libewf_open(p_ewf_handle->pp_filenames,
+                                   p_ewf_handle->filenames_count,
+                                   libewf_get_flags_read());
+  if(p_pool_handle->h_ewf==NULL)
+#endif
+  {
+    return EWF_OPEN_FAILED;
+  }
+
+  return EWF_OK;
+}
+
+/*
+ * EwfOpenPoolHandle
+ *
+ * Opens the image with the given handle. The caller has to set the handle's
+ * opened flag (with the mutex locked if other threads may be reading).
+ */
+static int EwfOpenPoolHandle(pts_EwfHandle p_ewf_handle,
+                             pts_EwfPoolHandle p_pool_handle)
+{
+  int ret;
+
+  pthread_mutex_lock(&ewf_open_mutex);
+  ret=EwfOpenPoolHandle0(p_ewf_handle,p_pool_handle);
+  pthread_mutex_unlock(&ewf_open_mutex);
+
+  return ret;
+}
+
+/*
+ * EwfClosePoolHandle
+ */
+static int EwfClosePoolHandle(pts_EwfPoolHandle p_pool_handle) {
+  int ret=EWF_OK;
+
+  if(p_pool_handle->opened) {
+#ifdef HAVE_LIBEWF_V2_API
+    if(libewf_handle_close(p_pool_handle->h_ewf,NULL)!=0)
+#else
+    if(libewf_close(p_pool_handle->h_ewf)!=0)
+#endif
+    {
+      ret=EWF_CLOSE_FAILED;
+    }
+    p_pool_handle->opened=0;
+  }
+  free(p_pool_handle->p_chunk_buf);
+  p_pool_handle->p_chunk_buf=NULL;
+
+  return ret;
+}
+
+/*
+ * EwfAcquirePoolHandle
+ *
+ * Returns a libewf handle not used by any other thread. If all open handles are
+ * busy, another one is opened or, if max_handles are open already, the
+ * function waits for one to be released.
+ */
+static pts_EwfPoolHandle EwfAcquirePoolHandle(pts_EwfHandle p_ewf_handle) {
+  pts_EwfPoolHandle p_free;
+  pts_EwfPoolHandle p_unopened;
+  int ret;
+
+  pthread_mutex_lock(&(p_ewf_handle->mutex));
+  for(;;) {
+    p_free=NULL;
+    p_unopened=NULL;
+    for(uint32_t i=0;i<p_ewf_handle->max_handles;i++) {
+      if(p_ewf_handle->p_pool[i].busy) continue;
+      if(p_ewf_handle->p_pool[i].opened) {
+        p_free=&(p_ewf_handle->p_pool[i]);
+        break;
+      }
+      if(p_unopened==NULL) p_unopened=&(p_ewf_handle->p_pool[i]);
+    }
+    if(p_free!=NULL) break;
+
+    if(p_unopened!=NULL && !p_ewf_handle->pool_exhausted) {
+      // Open another handle, without blocking reads using the others
+      p_unopened->busy=1;
+      pthread_mutex_unlock(&(p_ewf_handle->mutex));
+      ret=EwfOpenPoolHandle(p_ewf_handle,p_unopened);
+      pthread_mutex_lock(&(p_ewf_handle->mutex));
+      p_unopened->busy=0;
+      if(ret==EWF_OK) {
+        p_unopened->opened=1;
+        LIBXMOUNT_LOG_DEBUG(p_ewf_handle->debug,
+                            "Opened additional EWF handle %u\n",
+                            (unsigned)(p_unopened-p_ewf_handle->p_pool));
+        p_free=p_unopened;
+        break;
+      }
+      LIBXMOUNT_LOG_WARNING("Unable to open an additional EWF handle: %s. "
+                              "Continuing with the ones already open.\n",
+                            EwfGetErrorMessage(ret));
+      p_ewf_handle->pool_exhausted=1;
+      continue;
+    }
+
+    // p_pool[0] always is open, so some read will release its handle
+    p_ewf_handle->handle_waits++;
+    pthread_cond_wait(&(p_ewf_handle->handle_freed),&(p_ewf_handle->mutex));
+  }
+  p_free->busy=1;
+  pthread_mutex_unlock(&(p_ewf_handle->mutex));
+
+  return p_free;
+}
+
+/*
+ * EwfReleasePoolHandle
+ */
+static void EwfReleasePoolHandle(pts_EwfHandle p_ewf_handle,
+                                 pts_EwfPoolHandle p_pool_handle,
+                                 size_t count,
+                                 int read_ret)
+{
+  pthread_mutex_lock(&(p_ewf_handle->mutex));
+  p_pool_handle->busy=0;
+  p_pool_handle->reads++;
+  if(read_ret==EWF_OK) p_pool_handle->bytes_read+=count;
+  else p_pool_handle->read_errors++;
+  pthread_cond_signal(&(p_ewf_handle->handle_freed));
+  pthread_mutex_unlock(&(p_ewf_handle->mutex));
+}
+
+/*
+ * EwfReadPoolHandle
+ */
+static int EwfReadPoolHandle(pts_EwfPoolHandle p_pool_handle,
+                             char *p_buf,
+                             uint64_t offset,
+                             size_t count)
+{
+  ssize_t bytes_read;
+
+#ifdef HAVE_LIBEWF_V2_API
+  // Reading at an offset doesn't depend on a previous seek
+  bytes_read=libewf_handle_read_random(p_pool_handle->h_ewf,
+                                       p_buf,
+                                       count,
+                                       offset,
+                                       NULL);
+#else
+  if(libewf_seek_offset(p_pool_handle->h_ewf,offset)==-1) {
+    return EWF_SEEK_FAILED;
+  }
+  bytes_read=libewf_read_buffer(p_pool_handle->h_ewf,p_buf,count);
+#endif
+  if(bytes_read<0 || (size_t)bytes_read!=count) return EWF_READ_FAILED;
+
+  return EWF_OK;
+}
+
+/*
+ * EwfReadCached
+ *
+ * Reads chunk by chunk, looking up every chunk in the chunk cache first.
+ * Missing chunks are read completely and added to the cache.
+ */
+static int EwfReadCached(pts_EwfHandle p_ewf_handle,
+                         char *p_buf,
+                         uint64_t offset,
+                         size_t count)
+{
+  pts_EwfPoolHandle p_pool_handle;
+  pts_EwfCacheEntry p_entry;
+  uint64_t chunk;
+  uint64_t chunk_offset;
+  size_t chunk_len;
+  size_t to_copy;
+  int ret;
+
+  while(count>0) {
+    chunk=offset/p_ewf_handle->chunk_size;
+    chunk_offset=offset%p_ewf_handle->chunk_size;
+    to_copy=p_ewf_handle->chunk_size-chunk_offset;
+    if(to_copy>count) to_copy=count;
+    p_entry=&(p_ewf_handle->p_cache[chunk%p_ewf_handle->cache_entries]);
+
+    pthread_mutex_lock(&(p_ewf_handle->mutex));
+    if(p_entry->size!=0 && p_entry->chunk==chunk) {
+      memcpy(p_buf,p_entry->p_buf+chunk_offset,to_copy);
+      p_ewf_handle->cache_hits++;
+      pthread_mutex_unlock(&(p_ewf_handle->mutex));
+    } else {
+      p_ewf_handle->cache_misses++;
+      pthread_mutex_unlock(&(p_ewf_handle->mutex));
+
+      chunk_len=p_ewf_handle->chunk_size;
+      if(chunk*p_ewf_handle->chunk_size+chunk_len>p_ewf_handle->image_size) {
+        chunk_len=p_ewf_handle->image_size-chunk*p_ewf_handle->chunk_size;
+      }
+      p_pool_handle=EwfAcquirePoolHandle(p_ewf_handle);
+      if(p_pool_handle->p_chunk_buf==NULL) {
+        p_pool_handle->p_chunk_buf=(char*)malloc(p_ewf_handle->chunk_size);
+      }
+      if(p_pool_handle->p_chunk_buf==NULL) ret=EWF_MEMALLOC_FAILED;
+      else ret=EwfReadPoolHandle(p_pool_handle,
+                                 p_pool_handle->p_chunk_buf,
+                                 chunk*p_ewf_handle->chunk_size,
+                                 chunk_len);
+      if(ret==EWF_OK) {
+        memcpy(p_buf,p_pool_handle->p_chunk_buf+chunk_offset,to_copy);
+        pthread_mutex_lock(&(p_ewf_handle->mutex));
+        memcpy(p_entry->p_buf,p_pool_handle->p_chunk_buf,chunk_len);
+        p_entry->chunk=chunk;
+        p_entry->size=chunk_len;
+        pthread_mutex_unlock(&(p_ewf_handle->mutex));
+      }
+      EwfReleasePoolHandle(p_ewf_handle,p_pool_handle,chunk_len,ret);
+      if(ret!=EWF_OK) return ret;
+    }
+
+    p_buf+=to_copy;
+    offset+=to_copy;
+    count-=to_copy;
+  }
+
+  return EWF_OK;
+}
+
+/*
+ * EwfUpdateStats
+ *
+ * Writes the statistics file, if one was requested, every stats_refresh
+ * seconds. Must be called with the mutex locked.
+ */
+static void EwfUpdateStats(pts_EwfHandle p_ewf_handle, uint8_t force) {
+  time_t now;
+  char *p_filename=NULL;
+  FILE *p_file;
+  pts_EwfPoolHandle p_pool_handle;
+  uint64_t lookups;
+
+  if(p_ewf_handle->p_stats_path==NULL) return;
+  time(&now);
+  if(!force && now-p_ewf_handle->last_stats_update<
+                 (time_t)p_ewf_handle->stats_refresh)
+  {
+    return;
+  }
+  p_ewf_handle->last_stats_update=now;
+
+  if(asprintf(&p_filename,
+              "%s/stats_%d",
+              p_ewf_handle->p_stats_path,
+              (int)getpid())<0)
+  {
+    return;
+  }
+  p_file=fopen(p_filename,"w");
+  free(p_filename);
+  if(p_file==NULL) return;
+
+  lookups=p_ewf_handle->cache_hits+p_ewf_handle->cache_misses;
+  fprintf(p_file,"Read operations          %10" PRIu64 "\n",
+          p_ewf_handle->read_operations);
+  fprintf(p_file,"Data requested by caller %10.1f MiB\n",
+          p_ewf_handle->data_requested/(1024.0*1024.0));
+  fprintf(p_file,"Waits for a free handle  %10" PRIu64 "\n",
+          p_ewf_handle->handle_waits);
+  fprintf(p_file,"\n");
+  fprintf(p_file,"Cache         hits      misses  ratio\n");
+  fprintf(p_file,"--------------------------------------\n");
+  fprintf(p_file,"Chunk   %10" PRIu64 "  %10" PRIu64 "  %5.1f%%\n",
+          p_ewf_handle->cache_hits,
+          p_ewf_handle->cache_misses,
+          lookups!=0 ? (100.0*p_ewf_handle->cache_hits)/lookups : 0.0);
+  fprintf(p_file,"(%" PRIu64 " MiB, %" PRIu64 " entries of %" PRIu32
+                 " bytes)\n",
+          p_ewf_handle->cache_size,
+          p_ewf_handle->cache_entries,
+          p_ewf_handle->chunk_size);
+  fprintf(p_file,"\n");
+  fprintf(p_file,"Handle  state         reads    MiB read    errors\n");
+  fprintf(p_file,"-------------------------------------------------\n");
+  for(uint32_t i=0;i<p_ewf_handle->max_handles;i++) {
+    p_pool_handle=&(p_ewf_handle->p_pool[i]);
+    if(!p_pool_handle->opened) continue;
+    fprintf(p_file,"%6" PRIu32 "  %-6s %11" PRIu64 " %11.1f %9" PRIu64 "\n",
+            i,
+            p_pool_handle->busy ? "busy" : "idle",
+            p_pool_handle->reads,
+            p_pool_handle->bytes_read/(1024.0*1024.0),
+            p_pool_handle->read_errors);
+  }
+
+  (void)fclose(p_file);
+}
+
 /*
  * EwfCreateHandle
  */
@@ -84,16 +417,19 @@ static int EwfCreateHandle(void **pp_handle,
   pts_EwfHandle p_ewf_handle;
 
   // Alloc new lib handle
-  p_ewf_handle=(pts_EwfHandle)malloc(sizeof(ts_EwfHandle));
+  p_ewf_handle=(pts_EwfHandle)calloc(1,sizeof(ts_EwfHandle));
   if(p_ewf_handle==NULL) return EWF_MEMALLOC_FAILED;
 
   // Init handle values
-  p_ewf_handle->h_ewf=NULL;
+  p_ewf_handle->max_handles=EWF_DEFAULT_HANDLES;
+  p_ewf_handle->stats_refresh=EWF_DEFAULT_STATS_REFRESH;
   p_ewf_handle->debug=debug;
+  pthread_mutex_init(&(p_ewf_handle->mutex),NULL);
+  pthread_cond_init(&(p_ewf_handle->handle_freed),NULL);
 
   // Init lib handle
 #ifdef HAVE_LIBEWF_V2_API
-  if(libewf_handle_initialize(&(p_ewf_handle->h_ewf),NULL)!=1) {
+  if(libewf_handle_initialize(&(p_ewf_handle->p_pool[0].h_ewf),NULL)!=1) {
     return EWF_HANDLE_CREATION_FAILED;
   }
 #endif
@@ -110,12 +446,18 @@ static int EwfDestroyHandle(void **pp_handle) {
   int ret=EWF_OK;
 
   if(p_ewf_handle!=NULL) {
-    // Free EWF handle
+    // Free EWF handles
 #ifdef HAVE_LIBEWF_V2_API
-    if(libewf_handle_free(&(p_ewf_handle->h_ewf),NULL)!=1) {
-      ret=EWF_HANDLE_DESTRUCTION_FAILED;
+    for(uint32_t i=0;i<EWF_MAX_HANDLES;i++) {
+      if(p_ewf_handle->p_pool[i].h_ewf==NULL) continue;
+      if(libewf_handle_free(&(p_ewf_handle->p_pool[i].h_ewf),NULL)!=1) {
+        ret=EWF_HANDLE_DESTRUCTION_FAILED;
+      }
     }
 #endif
+    pthread_cond_destroy(&(p_ewf_handle->handle_freed));
+    pthread_mutex_destroy(&(p_ewf_handle->mutex));
+    free(p_ewf_handle->p_stats_path);
     // Free lib handle
     free(p_ewf_handle);
     p_ewf_handle=NULL;
@@ -133,6 +475,8 @@ static int EwfOpen(void *p_handle,
                    uint64_t filename_arr_len)
 {
   pts_EwfHandle p_ewf_handle=(pts_EwfHandle)p_handle;
+  pts_EwfPoolHandle p_pool_handle=&(p_ewf_handle->p_pool[0]);
+  int ret;
 
   // We need at least one file
   if(filename_arr_len==0) return EWF_NO_INPUT_FILES;
@@ -149,59 +493,89 @@ static int EwfOpen(void *p_handle,
     }
   }
 
+  // Keep a copy of the file names for opening additional handles later
+  p_ewf_handle->pp_filenames=(char**)calloc(filename_arr_len,sizeof(char*));
+  if(p_ewf_handle->pp_filenames==NULL) return EWF_MEMALLOC_FAILED;
+  p_ewf_handle->filenames_count=filename_arr_len;
+  for(uint64_t i=0;i<filename_arr_len;i++) {
+    p_ewf_handle->pp_filenames[i]=strdup(pp_filename_arr[i]);
+    if(p_ewf_handle->pp_filenames[i]==NULL) return EWF_MEMALLOC_FAILED;
+  }
+
   // Open EWF file
+  ret=EwfOpenPoolHandle(p_ewf_handle,p_pool_handle);
+  if(ret!=EWF_OK) return ret;
+  p_pool_handle->opened=1;
+
 #ifdef HAVE_LIBEWF_V2_API
-  if(libewf_handle_open(p_ewf_handle->h_ewf,
-                        (char* const*)pp_filename_arr,
-                        filename_arr_len,
-                        libewf_get_access_flags_read(),
-                        NULL)!=1)
-#else
-  p_ewf_handle->h_ewf=libewf_open((char* const*)pp_filename_arr,
-                                  filename_arr_len,
-                                  libewf_get_flags_read());
-  if(p_ewf_handle->h_ewf==NULL)
-#endif
+  if(libewf_handle_get_media_size(p_pool_handle->h_ewf,
+                                  &(p_ewf_handle->image_size),
+                                  NULL)!=1)
   {
-    return EWF_OPEN_FAILED;
+    return EWF_GET_SIZE_FAILED;
+  }
+  size32_t chunk_size=0;
+  if(libewf_handle_get_chunk_size(p_pool_handle->h_ewf,&chunk_size,NULL)==1 &&
+     chunk_size!=0)
+  {
+    p_ewf_handle->chunk_size=chunk_size;
+  } else {
+    p_ewf_handle->chunk_size=EWF_DEFAULT_CHUNK_SIZE;
   }
 
-#ifdef HAVE_LIBEWF_V2_API
   // Try to read 1 byte from the image end to verify that all segments were
   // specified (Only needed because libewf_handle_open() won't fail even if not
   // all segments were specified!)
-  uint64_t image_size=0;
   char buf;
-  if(libewf_handle_get_media_size(p_ewf_handle->h_ewf,&image_size,NULL)!=1) {
-    return EWF_GET_SIZE_FAILED;
+  if(p_ewf_handle->image_size!=0) {
+    LIBXMOUNT_LOG_DEBUG(p_ewf_handle->debug,
+                        "Trying to read last byte of image at offset %"
+                          PRIu64 " (image size = %" PRIu64 " bytes)\n",
+                        p_ewf_handle->image_size-1,
+                        p_ewf_handle->image_size);
+    if(EwfReadPoolHandle(p_pool_handle,
+                         &buf,
+                         p_ewf_handle->image_size-1,
+                         1)!=EWF_OK)
+    {
+      return EWF_OPEN_FAILED_READ;
+    }
   }
-  if(image_size==0) return EWF_OK;
-  LIBXMOUNT_LOG_DEBUG(p_ewf_handle->debug,
-                      "Trying to read last byte of image at offset %"
-                        PRIu64 " (image size = %" PRIu64 " bytes)\n",
-                      image_size-1,
-                      image_size);
-  if(libewf_handle_seek_offset(p_ewf_handle->h_ewf,
-                               image_size-1,
-                               SEEK_SET,
-                               NULL)==-1)
+#else
+  if(libewf_get_media_size(p_pool_handle->h_ewf,
+                           &(p_ewf_handle->image_size))!=1)
   {
-    return EWF_OPEN_FAILED_SEEK;
-  }
-  if(libewf_handle_read_buffer(p_ewf_handle->h_ewf,&buf,1,NULL)!=1) {
-    return EWF_OPEN_FAILED_READ;
+    return EWF_GET_SIZE_FAILED;
   }
-#endif
+  p_ewf_handle->chunk_size=EWF_DEFAULT_CHUNK_SIZE;
 
-#ifndef HAVE_LIBEWF_V2_API
   // Parse EWF header
-  if(libewf_parse_header_values(p_ewf_handle->h_ewf,
+  if(libewf_parse_header_values(p_pool_handle->h_ewf,
                                 LIBEWF_DATE_FORMAT_ISO8601)!=1)
   {
     return EWF_HEADER_PARSING_FAILED;
   }
 #endif
 
+  // Set up chunk cache
+  if(p_ewf_handle->cache_size!=0) {
+    p_ewf_handle->cache_entries=
+      (p_ewf_handle->cache_size*1024*1024)/p_ewf_handle->chunk_size;
+    if(p_ewf_handle->cache_entries==0) p_ewf_handle->cache_entries=1;
+    p_ewf_handle->p_cache=
+      (pts_EwfCacheEntry)calloc(p_ewf_handle->cache_entries,
+                                sizeof(ts_EwfCacheEntry));
+    p_ewf_handle->p_cache_buf=
+      (char*)malloc(p_ewf_handle->cache_entries*p_ewf_handle->chunk_size);
+    if(p_ewf_handle->p_cache==NULL || p_ewf_handle->p_cache_buf==NULL) {
+      return EWF_MEMALLOC_FAILED;
+    }
+    for(uint64_t i=0;i<p_ewf_handle->cache_entries;i++) {
+      p_ewf_handle->p_cache[i].p_buf=
+        p_ewf_handle->p_cache_buf+i*p_ewf_handle->chunk_size;
+    }
+  }
+
   return EWF_OK;
 }
 
@@ -210,18 +584,34 @@ static int EwfOpen(void *p_handle,
  */
 static int EwfClose(void *p_handle) {
   pts_EwfHandle p_ewf_handle=(pts_EwfHandle)p_handle;
+  int ret=EWF_OK;
 
-  // Close EWF handle
-#ifdef HAVE_LIBEWF_V2_API
-  if(libewf_handle_close(p_ewf_handle->h_ewf,NULL)!=0)
-#else
-  if(libewf_close(p_ewf_handle->h_ewf)!=0)
-#endif
-  {
-    return EWF_CLOSE_FAILED;
+  pthread_mutex_lock(&(p_ewf_handle->mutex));
+  EwfUpdateStats(p_ewf_handle,1);
+  pthread_mutex_unlock(&(p_ewf_handle->mutex));
+
+  // Close EWF handles
+  for(uint32_t i=0;i<EWF_MAX_HANDLES;i++) {
+    if(EwfClosePoolHandle(&(p_ewf_handle->p_pool[i]))!=EWF_OK) {
+      ret=EWF_CLOSE_FAILED;
+    }
   }
 
-  return EWF_OK;
+  // Free chunk cache and file names
+  free(p_ewf_handle->p_cache);
+  free(p_ewf_handle->p_cache_buf);
+  p_ewf_handle->p_cache=NULL;
+  p_ewf_handle->p_cache_buf=NULL;
+  p_ewf_handle->cache_entries=0;
+  if(p_ewf_handle->pp_filenames!=NULL) {
+    for(uint64_t i=0;i<p_ewf_handle->filenames_count;i++) {
+      free(p_ewf_handle->pp_filenames[i]);
+    }
+    free(p_ewf_handle->pp_filenames);
+    p_ewf_handle->pp_filenames=NULL;
+  }
+
+  return ret;
 }
 
 /*
@@ -230,14 +620,7 @@ static int EwfClose(void *p_handle) {
 static int EwfSize(void *p_handle, uint64_t *p_size) {
   pts_EwfHandle p_ewf_handle=(pts_EwfHandle)p_handle;
 
-#ifdef HAVE_LIBEWF_V2_API
-  if(libewf_handle_get_media_size(p_ewf_handle->h_ewf,p_size,NULL)!=1) {
-#else
-  if(libewf_get_media_size(p_ewf_handle->h_ewf,p_size)!=1) {
-#endif
-    return EWF_GET_SIZE_FAILED;
-  }
-
+  *p_size=p_ewf_handle->image_size;
   return EWF_OK;
 }
 
@@ -252,32 +635,31 @@ static int EwfRead(void *p_handle,
                    int *p_errno)
 {
   pts_EwfHandle p_ewf_handle=(pts_EwfHandle)p_handle;
-  // TODO: Return value of libewf_handle_read_buffer is ssize_t with -1 on error
-  size_t bytes_read;
+  pts_EwfPoolHandle p_pool_handle;
+  int ret;
 
-#ifdef HAVE_LIBEWF_V2_API
-  if(libewf_handle_seek_offset(p_ewf_handle->h_ewf,
-                               offset,
-                               SEEK_SET,
-                               NULL)!=-1)
-#else
-  if(libewf_seek_offset(p_ewf_handle->h_ewf,offset)!=-1)
-#endif
+  if(offset<0 || (uint64_t)offset>p_ewf_handle->image_size ||
+     count>p_ewf_handle->image_size-(uint64_t)offset)
   {
-#ifdef HAVE_LIBEWF_V2_API
-    bytes_read=libewf_handle_read_buffer(p_ewf_handle->h_ewf,
-                                         p_buf,
-                                         count,
-                                         NULL);
-#else
-    bytes_read=libewf_read_buffer(p_ewf_handle->h_ewf,p_buf,count);
-#endif
-    if(bytes_read!=count) return EWF_READ_FAILED;
+    return EWF_READ_FAILED;
+  }
+
+  if(p_ewf_handle->cache_entries!=0) {
+    ret=EwfReadCached(p_ewf_handle,p_buf,offset,count);
   } else {
-    return EWF_SEEK_FAILED;
+    p_pool_handle=EwfAcquirePoolHandle(p_ewf_handle);
+    ret=EwfReadPoolHandle(p_pool_handle,p_buf,offset,count);
+    EwfReleasePoolHandle(p_ewf_handle,p_pool_handle,count,ret);
   }
 
-  *p_read=bytes_read;
+  pthread_mutex_lock(&(p_ewf_handle->mutex));
+  p_ewf_handle->read_operations++;
+  p_ewf_handle->data_requested+=count;
+  EwfUpdateStats(p_ewf_handle,0);
+  pthread_mutex_unlock(&(p_ewf_handle->mutex));
+
+  if(ret!=EWF_OK) return ret;
+  *p_read=count;
   return EWF_OK;
 }
 
@@ -298,7 +680,31 @@ static int EwfWrite(void *p_handle,
  * EwfOptionsHelp
  */
 static int EwfOptionsHelp(const char **pp_help) {
-  *pp_help=NULL;
+  char *p_help=NULL;
+  int ret;
+
+  ret=asprintf(&p_help,
+               "    %-12s : Max. number of libewf handles for reading "
+                 "concurrently. Default: %d\n"
+               "    %-12s : Max. number of open segment files per libewf "
+                 "handle (min. 2). Default: libewf's default\n"
+               "    %-12s : Size of the chunk cache in MiB, shared by all "
+                 "handles. Default: 0 (disabled)\n"
+               "    %-12s : Output statistics at regular intervals to this "
+                 "directory (must exist).\n"
+               "                   The files created in this directory will be "
+                 "named stats_<pid>.\n"
+               "    %-12s : The update interval, in seconds, for the "
+                 "statistics (%s must be set). Default: %ds.\n",
+               EWF_OPTION_HANDLES,EWF_DEFAULT_HANDLES,
+               EWF_OPTION_MAXOPEN,
+               EWF_OPTION_CACHE,
+               EWF_OPTION_STATS,
+               EWF_OPTION_STATSREFRESH,EWF_OPTION_STATS,
+               EWF_DEFAULT_STATS_REFRESH);
+  if(ret<0 || p_help==NULL) return EWF_MEMALLOC_FAILED;
+
+  *pp_help=p_help;
   return EWF_OK;
 }
 
@@ -310,6 +716,58 @@ static int EwfOptionsParse(void *p_handle,
                            const pts_LibXmountOptions *pp_options,
                            const char **pp_error)
 {
+  pts_EwfHandle p_ewf_handle=(pts_EwfHandle)p_handle;
+  pts_LibXmountOptions p_option;
+  uint64_t value;
+  int ok;
+
+#define EWF_OPTION_ERROR(option) {                                \
+  *pp_error=strdup("Error in option " option ": Invalid value");  \
+  return EWF_INVALID_OPTION_VALUE;                                \
+}
+
+  *pp_error=NULL;
+  for(uint32_t i=0;i<options_count;i++) {
+    p_option=pp_options[i];
+    if(strcmp(p_option->p_key,EWF_OPTION_HANDLES)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value==0 || value>EWF_MAX_HANDLES) {
+        EWF_OPTION_ERROR(EWF_OPTION_HANDLES);
+      }
+      p_ewf_handle->max_handles=(uint32_t)value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,EWF_OPTION_MAXOPEN)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      // libewf needs at least 2 open segment files when opening an image
+      if(!ok || value<2 || value>INT32_MAX) {
+        EWF_OPTION_ERROR(EWF_OPTION_MAXOPEN);
+      }
+      p_ewf_handle->max_open_segments=(uint32_t)value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,EWF_OPTION_CACHE)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>UINT32_MAX) EWF_OPTION_ERROR(EWF_OPTION_CACHE);
+      p_ewf_handle->cache_size=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,EWF_OPTION_STATS)==0) {
+      free(p_ewf_handle->p_stats_path);
+      p_ewf_handle->p_stats_path=realpath(p_option->p_value,NULL);
+      if(p_ewf_handle->p_stats_path==NULL) {
+        *pp_error=strdup("Error in option " EWF_OPTION_STATS
+                           ": The given stats path does not exist");
+        return EWF_INVALID_OPTION_VALUE;
+      }
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,EWF_OPTION_STATSREFRESH)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok) EWF_OPTION_ERROR(EWF_OPTION_STATSREFRESH);
+      p_ewf_handle->stats_refresh=value;
+      p_option->valid=1;
+    }
+  }
+
+#undef EWF_OPTION_ERROR
+
   return EWF_OK;
 }
 
@@ -324,6 +782,11 @@ static int EwfGetInfofileContent(void *p_handle, const char **pp_info_buf) {
   uint8_t uint8value;
   uint32_t uint32value;
   uint64_t uint64value;
+#ifdef HAVE_LIBEWF_V2_API
+  libewf_handle_t *h_ewf=p_ewf_handle->p_pool[0].h_ewf;
+#else
+  LIBEWF_HANDLE *h_ewf=p_ewf_handle->p_pool[0].h_ewf;
+#endif
 
 #define EWF_INFOBUF_REALLOC(size) {               \
   p_infobuf=(char*)realloc(p_infobuf,size);       \
@@ -350,7 +813,7 @@ static int EwfGetInfofileContent(void *p_handle, const char **pp_info_buf) {
 
 #ifdef HAVE_LIBEWF_V2_API
   #define EWF_GET_HEADER_VALUE(fun) {                            \
-    ret=fun(p_ewf_handle->h_ewf,(uint8_t*)buf,sizeof(buf),NULL); \
+    ret=fun(h_ewf,(uint8_t*)buf,sizeof(buf),NULL);               \
   }
 
   EWF_GET_HEADER_VALUE(libewf_handle_get_utf8_header_value_case_number);
@@ -383,7 +846,7 @@ static int EwfGetInfofileContent(void *p_handle, const char **pp_info_buf) {
   #undef EWF_GET_HEADER_VALUE
 #else
   #define EWF_GET_HEADER_VALUE(fun) {             \
-    ret=fun(p_ewf_handle->h_ewf,buf,sizeof(buf)); \
+    ret=fun(h_ewf,buf,sizeof(buf));               \
   }
 
   EWF_GET_HEADER_VALUE(libewf_get_header_value_case_number);
@@ -419,9 +882,9 @@ static int EwfGetInfofileContent(void *p_handle, const char **pp_info_buf) {
   EWF_INFOBUF_APPEND_STR("\n_Media information_\n");
 
 #ifdef HAVE_LIBEWF_V2_API
-  ret=libewf_handle_get_media_type(p_ewf_handle->h_ewf,&uint8value,NULL);
+  ret=libewf_handle_get_media_type(h_ewf,&uint8value,NULL);
 #else
-  ret=libewf_get_media_type(p_ewf_handle->h_ewf,&uint8value);
+  ret=libewf_get_media_type(h_ewf,&uint8value);
 #endif
   if(ret==1) {
     EWF_INFOBUF_APPEND_STR("Media type: ");
@@ -447,17 +910,17 @@ static int EwfGetInfofileContent(void *p_handle, const char **pp_info_buf) {
   }
 
 #ifdef HAVE_LIBEWF_V2_API
-  ret=libewf_handle_get_bytes_per_sector(p_ewf_handle->h_ewf,&uint32value,NULL);
+  ret=libewf_handle_get_bytes_per_sector(h_ewf,&uint32value,NULL);
   sprintf(buf,"%" PRIu32,uint32value);
   EWF_INFOBUF_APPEND_VALUE("Bytes per sector: ");
-  ret=libewf_handle_get_number_of_sectors(p_ewf_handle->h_ewf,&uint64value,NULL);
+  ret=libewf_handle_get_number_of_sectors(h_ewf,&uint64value,NULL);
   sprintf(buf,"%" PRIu64,uint64value);
   EWF_INFOBUF_APPEND_VALUE("Number of sectors: ");
 #else
-  ret=libewf_get_bytes_per_sector(p_ewf_handle->h_ewf,&uint32value);
+  ret=libewf_get_bytes_per_sector(h_ewf,&uint32value);
   sprintf(buf,"%" PRIu32,uint32value);
   EWF_INFOBUF_APPEND_VALUE("Bytes per sector: ");
-  ret=libewf_handle_get_amount_of_sectors(p_ewf_handle->h_ewf,&uint64value);
+  ret=libewf_handle_get_amount_of_sectors(h_ewf,&uint64value);
   sprintf(buf,"%" PRIu64,uint64value);
   EWF_INFOBUF_APPEND_VALUE("Number of sectors: ");
 #endif
@@ -517,6 +980,9 @@ static const char* EwfGetErrorMessage(int err_num) {
     case EWF_WRITE_FAILED:
       return "Write is not supported in EWF input module.";
       break;
+    case EWF_INVALID_OPTION_VALUE:
+      return "Invalid option value";
+      break;
     default:
       return "Unknown error";
   }
@@ -539,5 +1005,8 @@ static int EwfFreeBuffer(void *p_buf) {
   20150819: * Added debug value to handle.
             * Added v2 API check in EwfOpen to make sure user specified all EWF
               segments.
+  20261019: * Reads may be called concurrently, using a pool of libewf handles.
+            * Added options ewfhandles, ewfmaxopen, ewfcache, ewfstats and
+              ewfrefresh.
 */
 
@@ -37,11 +37,21 @@ enum {
   EWF_GET_SIZE_FAILED,
   EWF_SEEK_FAILED,
   EWF_READ_FAILED,
-  EWF_WRITE_FAILED
+  EWF_WRITE_FAILED,
+  EWF_INVALID_OPTION_VALUE
 };
 
-//! Library handle
-typedef struct s_EwfHandle {
+//! Max. number of libewf handles used for concurrent reads
+#define EWF_MAX_HANDLES 64
+//! Default number of libewf handles
+#define EWF_DEFAULT_HANDLES 4
+//! Chunk size assumed if libewf can't tell (64 sectors of 512 bytes)
+#define EWF_DEFAULT_CHUNK_SIZE 32768
+//! Default update interval of the statistics file in seconds
+#define EWF_DEFAULT_STATS_REFRESH 10
+
+//! One of the libewf handles used for reading
+typedef struct s_EwfPoolHandle {
 #ifdef HAVE_LIBEWF_V2_API
   //! EWF handle
   libewf_handle_t *h_ewf;
@@ -49,6 +59,69 @@ typedef struct s_EwfHandle {
   //! EWF handle
   LIBEWF_HANDLE *h_ewf;
 #endif
+  //! Set if the image has been opened with this handle
+  uint8_t opened;
+  //! Set while a read uses this handle
+  uint8_t busy;
+  //! Buffer for reading whole chunks into the chunk cache
+  char *p_chunk_buf;
+  //! Statistics
+  uint64_t reads;
+  uint64_t bytes_read;
+  uint64_t read_errors;
+} ts_EwfPoolHandle, *pts_EwfPoolHandle;
+
+//! Entry of the chunk cache
+typedef struct s_EwfCacheEntry {
+  //! Number of the cached chunk
+  uint64_t chunk;
+  //! Number of valid bytes in p_buf, 0 if the entry is empty
+  uint32_t size;
+  //! Chunk data
+  char *p_buf;
+} ts_EwfCacheEntry, *pts_EwfCacheEntry;
+
+//! Library handle
+/*!
+ * Reads may be called concurrently. Every read takes one of the libewf handles
+ * in p_pool, as a libewf handle can't be used by several threads at the same
+ * time. Handles other than the first one are opened when all open handles are
+ * busy. The mutex protects everything but the libewf handles themselves.
+ */
+typedef struct s_EwfHandle {
+  //! libewf handles, p_pool[0] is opened in EwfOpen
+  ts_EwfPoolHandle p_pool[EWF_MAX_HANDLES];
+  //! Number of libewf handles to use at most
+  uint32_t max_handles;
+  //! Set if opening an additional handle failed, no more are tried then
+  uint8_t pool_exhausted;
+  //! Max. open segment files per libewf handle, 0 for libewf's default
+  uint32_t max_open_segments;
+  //! Segment files, needed for opening additional handles
+  char **pp_filenames;
+  uint64_t filenames_count;
+  //! Image size and chunk size
+  uint64_t image_size;
+  uint32_t chunk_size;
+  //! Chunk cache size in MiB, 0 if disabled
+  uint64_t cache_size;
+  //! Direct-mapped chunk cache, chunk n is found in entry n % cache_entries
+  pts_EwfCacheEntry p_cache;
+  uint64_t cache_entries;
+  char *p_cache_buf;
+  //! Statistics
+  uint64_t read_operations;
+  uint64_t data_requested;
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+  uint64_t handle_waits;
+  //! Directory for the statistics file, NULL if none is written
+  char *p_stats_path;
+  uint64_t stats_refresh;
+  time_t last_stats_update;
+  //! Protects the pool and the cache
+  pthread_mutex_t mutex;
+  pthread_cond_t handle_freed;
   //! Debug settings
   uint8_t debug;
 } ts_EwfHandle, *pts_EwfHandle;
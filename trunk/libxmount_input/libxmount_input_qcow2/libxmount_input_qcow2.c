@@ -0,0 +1,1219 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+#ifdef HAVE_LIBZSTD
+  #include <zstd.h>
+#endif
+
+#include "../libxmount_input.h"
+#include "libxmount/libxmount_cache.h"
+#include "libxmount_input_qcow2.h"
+
+#define QCOW2_OPTION_L2CACHE "qcow2l2cache"
+#define QCOW2_OPTION_CLUSTERCACHE "qcow2ccache"
+
+/*******************************************************************************
+ * LibXmount_Input API implementation
+ ******************************************************************************/
+/*
+ * LibXmount_Input_GetApiVersion
+ */
+uint8_t LibXmount_Input_GetApiVersion() {
+  return LIBXMOUNT_INPUT_API_VERSION;
+}
+
+/*
+ * LibXmount_Input_GetSupportedFormats
+ */
+const char* LibXmount_Input_GetSupportedFormats() {
+  return "qcow2\0\0";
+}
+
+/*
+ * LibXmount_Input_GetFunctions
+ */
+void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
+  p_functions->CreateHandle=&Qcow2CreateHandle;
+  p_functions->DestroyHandle=&Qcow2DestroyHandle;
+  p_functions->Open=&Qcow2Open;
+  p_functions->Size=&Qcow2Size;
+  p_functions->Read=&Qcow2Read;
+  p_functions->Write=&Qcow2Write;
+  p_functions->Close=&Qcow2Close;
+  p_functions->OptionsHelp=&Qcow2OptionsHelp;
+  p_functions->OptionsParse=&Qcow2OptionsParse;
+  p_functions->GetInfofileContent=&Qcow2GetInfofileContent;
+  p_functions->GetErrorMessage=&Qcow2GetErrorMessage;
+  p_functions->FreeBuffer=&Qcow2FreeBuffer;
+}
+
+/*******************************************************************************
+ * Private
+ ******************************************************************************/
+/*
+ * Qcow2Be32
+ */
+static uint32_t Qcow2Be32(const unsigned char *p_buf) {
+  return ((uint32_t)p_buf[0]<<24) | ((uint32_t)p_buf[1]<<16) |
+         ((uint32_t)p_buf[2]<<8) | (uint32_t)p_buf[3];
+}
+
+/*
+ * Qcow2Be64
+ */
+static uint64_t Qcow2Be64(const unsigned char *p_buf) {
+  return ((uint64_t)Qcow2Be32(p_buf)<<32) | (uint64_t)Qcow2Be32(p_buf+4);
+}
+
+/*
+ * Qcow2Pread
+ *
+ * Reads count bytes at offset, retrying short reads. *p_read is set to the
+ * number of bytes read, which is less than count only at the end of the file.
+ */
+static int Qcow2Pread(int fd,
+                      char *p_buf,
+                      uint64_t offset,
+                      uint64_t count,
+                      uint64_t *p_read,
+                      int *p_errno)
+{
+  ssize_t ret;
+  uint64_t done=0;
+
+  while(done<count) {
+    ret=pread(fd,p_buf+done,count-done,(off_t)(offset+done));
+    if(ret<0) {
+      if(errno==EINTR) continue;
+      if(p_errno!=NULL) *p_errno=errno;
+      return QCOW2_READ_FAILED;
+    }
+    if(ret==0) break;
+    done+=(uint64_t)ret;
+  }
+
+  *p_read=done;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2PreadFull
+ *
+ * Like Qcow2Pread, but hitting the end of the file is an error.
+ */
+static int Qcow2PreadFull(int fd,
+                          char *p_buf,
+                          uint64_t offset,
+                          uint64_t count,
+                          int *p_errno)
+{
+  uint64_t read;
+  int ret;
+
+  ret=Qcow2Pread(fd,p_buf,offset,count,&read,p_errno);
+  if(ret!=QCOW2_OK) return ret;
+  if(read!=count) {
+    if(p_errno!=NULL) *p_errno=EIO;
+    return QCOW2_CORRUPT_IMAGE;
+  }
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2GetL2Entry
+ *
+ * Gets the L2 entry (and the subcluster bitmap with extended L2 entries) of
+ * the given L2 table, reading the table into the L2 cache on a miss.
+ */
+static int Qcow2GetL2Entry(pts_Qcow2Handle p_qcow2_handle,
+                           pts_Qcow2Image p_image,
+                           uint64_t l2_offset,
+                           uint64_t l2_index,
+                           uint64_t *p_entry,
+                           uint64_t *p_bitmap,
+                           int *p_errno)
+{
+  unsigned char entry[16];
+  uint64_t entry_size=p_image->extended_l2 ? 16 : 8;
+  char *p_table;
+  int hit;
+  int ret;
+
+  pthread_mutex_lock(&(p_qcow2_handle->mutex));
+  hit=LibXmountCacheGet(&(p_qcow2_handle->l2_cache),
+                        p_image,
+                        l2_offset,
+                        l2_index*entry_size,
+                        entry_size,
+                        entry);
+  pthread_mutex_unlock(&(p_qcow2_handle->mutex));
+
+  if(!hit) {
+    // Read the whole table without holding the mutex
+    p_table=(char*)malloc(p_image->cluster_size);
+    if(p_table==NULL) return QCOW2_MEMALLOC_FAILED;
+    ret=Qcow2PreadFull(p_image->fd,
+                       p_table,
+                       l2_offset,
+                       p_image->cluster_size,
+                       p_errno);
+    if(ret!=QCOW2_OK) {
+      free(p_table);
+      return ret;
+    }
+    memcpy(entry,p_table+l2_index*entry_size,entry_size);
+
+    pthread_mutex_lock(&(p_qcow2_handle->mutex));
+    LibXmountCachePut(&(p_qcow2_handle->l2_cache),
+                      p_image,
+                      l2_offset,
+                      &p_table);
+    pthread_mutex_unlock(&(p_qcow2_handle->mutex));
+    free(p_table);
+  }
+
+  *p_entry=Qcow2Be64(entry);
+  *p_bitmap=p_image->extended_l2 ? Qcow2Be64(entry+8) : 0;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2MapOffset
+ *
+ * Finds out how the data at the given virtual offset is stored. *p_end is set
+ * to the virtual offset up to which the same applies (the end of the cluster
+ * or subcluster, or the end of the area covered by the L2 table if there is
+ * none). For normal clusters, *p_host_offset is the position of the data in
+ * the image file, for compressed clusters it is the cluster's L2 entry.
+ */
+static int Qcow2MapOffset(pts_Qcow2Handle p_qcow2_handle,
+                          pts_Qcow2Image p_image,
+                          uint64_t offset,
+                          int *p_kind,
+                          uint64_t *p_host_offset,
+                          uint64_t *p_end,
+                          int *p_errno)
+{
+  uint64_t l1_index;
+  uint64_t l2_index;
+  uint64_t l2_offset;
+  uint64_t l2_entry;
+  uint64_t bitmap;
+  uint64_t cluster_offset;
+  uint64_t unit;
+  int ret;
+
+  l1_index=offset>>(p_image->cluster_bits+p_image->l2_bits);
+  l2_index=(offset>>p_image->cluster_bits)&(p_image->l2_entries-1);
+  cluster_offset=offset&(p_image->cluster_size-1);
+
+  *p_host_offset=0;
+  if(l1_index>=p_image->l1_size ||
+     (p_image->p_l1_table[l1_index]&QCOW2_L1E_OFFSET_MASK)==0)
+  {
+    // No L2 table, the whole area covered by it is unallocated
+    *p_kind=QCOW2_DATA_UNALLOCATED;
+    *p_end=(l1_index+1)<<(p_image->cluster_bits+p_image->l2_bits);
+    return QCOW2_OK;
+  }
+
+  l2_offset=p_image->p_l1_table[l1_index]&QCOW2_L1E_OFFSET_MASK;
+  if((l2_offset&(p_image->cluster_size-1))!=0) return QCOW2_CORRUPT_IMAGE;
+  ret=Qcow2GetL2Entry(p_qcow2_handle,
+                      p_image,
+                      l2_offset,
+                      l2_index,
+                      &l2_entry,
+                      &bitmap,
+                      p_errno);
+  if(ret!=QCOW2_OK) return ret;
+
+  *p_end=(offset|(p_image->cluster_size-1))+1;
+  if((l2_entry&QCOW2_OFLAG_COMPRESSED)!=0) {
+    // Compressed clusters ignore the subcluster bitmap
+    *p_kind=QCOW2_DATA_COMPRESSED;
+    *p_host_offset=l2_entry;
+    return QCOW2_OK;
+  }
+
+  if(p_image->extended_l2) {
+    unit=cluster_offset/p_image->unit_size;
+    *p_end=(offset|(p_image->unit_size-1))+1;
+    if((bitmap&(1ULL<<(32+unit)))!=0) {
+      *p_kind=QCOW2_DATA_ZERO;
+    } else if((bitmap&(1ULL<<unit))!=0) {
+      *p_kind=QCOW2_DATA_NORMAL;
+    } else {
+      *p_kind=QCOW2_DATA_UNALLOCATED;
+      return QCOW2_OK;
+    }
+  } else if(p_image->version>=3 && (l2_entry&QCOW2_OFLAG_ZERO)!=0) {
+    *p_kind=QCOW2_DATA_ZERO;
+  } else if((l2_entry&QCOW2_L2E_OFFSET_MASK)==0) {
+    *p_kind=QCOW2_DATA_UNALLOCATED;
+    return QCOW2_OK;
+  } else {
+    *p_kind=QCOW2_DATA_NORMAL;
+  }
+
+  if(*p_kind==QCOW2_DATA_NORMAL) {
+    if((l2_entry&QCOW2_L2E_OFFSET_MASK&(p_image->cluster_size-1))!=0) {
+      return QCOW2_CORRUPT_IMAGE;
+    }
+    *p_host_offset=(l2_entry&QCOW2_L2E_OFFSET_MASK)+cluster_offset;
+  }
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2Uncompress
+ */
+static int Qcow2Uncompress(pts_Qcow2Image p_image,
+                           char *p_in,
+                           uint64_t in_size,
+                           char *p_out)
+{
+  if(p_image->compression_type==QCOW2_COMPRESSION_ZLIB) {
+    // zlib compressed clusters are raw deflate streams without header
+    z_stream zstream;
+    int zret;
+
+    memset(&zstream,0,sizeof(zstream));
+    if(inflateInit2(&zstream,-12)!=Z_OK) return QCOW2_UNCOMPRESS_FAILED;
+    zstream.next_in=(Bytef*)p_in;
+    zstream.avail_in=(uInt)in_size;
+    zstream.next_out=(Bytef*)p_out;
+    zstream.avail_out=(uInt)p_image->cluster_size;
+    zret=inflate(&zstream,Z_FINISH);
+    inflateEnd(&zstream);
+    // The compressed data is padded to whole sectors, so Z_BUF_ERROR is fine
+    // as long as the cluster has been filled completely
+    if((zret!=Z_STREAM_END && zret!=Z_BUF_ERROR) || zstream.avail_out!=0) {
+      return QCOW2_UNCOMPRESS_FAILED;
+    }
+    return QCOW2_OK;
+  }
+
+#ifdef HAVE_LIBZSTD
+  if(p_image->compression_type==QCOW2_COMPRESSION_ZSTD) {
+    // zstd compressed clusters may consist of several frames and are padded
+    // as well, so the data is uncompressed until the cluster is complete
+    ZSTD_DCtx *p_dctx;
+    ZSTD_inBuffer in;
+    ZSTD_outBuffer out;
+    size_t zret;
+    size_t last_in_pos;
+    size_t last_out_pos;
+    int ret=QCOW2_OK;
+
+    p_dctx=ZSTD_createDCtx();
+    if(p_dctx==NULL) return QCOW2_MEMALLOC_FAILED;
+    in.src=p_in;
+    in.size=(size_t)in_size;
+    in.pos=0;
+    out.dst=p_out;
+    out.size=(size_t)p_image->cluster_size;
+    out.pos=0;
+    while(out.pos<out.size) {
+      last_in_pos=in.pos;
+      last_out_pos=out.pos;
+      zret=ZSTD_decompressStream(p_dctx,&out,&in);
+      if(ZSTD_isError(zret) ||
+         (in.pos==last_in_pos && out.pos==last_out_pos))
+      {
+        ret=QCOW2_UNCOMPRESS_FAILED;
+        break;
+      }
+    }
+    ZSTD_freeDCtx(p_dctx);
+    return ret;
+  }
+#endif
+
+  return QCOW2_UNSUPPORTED_COMPRESSION;
+}
+
+/*
+ * Qcow2ReadCompressed
+ *
+ * Reads count bytes at pos of a compressed cluster, using the cluster cache.
+ */
+static int Qcow2ReadCompressed(pts_Qcow2Handle p_qcow2_handle,
+                               pts_Qcow2Image p_image,
+                               uint64_t l2_entry,
+                               char *p_buf,
+                               uint64_t pos,
+                               uint64_t count,
+                               int *p_errno)
+{
+  uint32_t offset_bits=62-(p_image->cluster_bits-8);
+  uint64_t host_offset;
+  uint64_t sectors;
+  uint64_t in_size;
+  uint64_t read;
+  char *p_in;
+  char *p_cluster;
+  int hit;
+  int ret;
+
+  host_offset=l2_entry&((1ULL<<offset_bits)-1);
+  sectors=((l2_entry&~QCOW2_OFLAG_COPIED&~QCOW2_OFLAG_COMPRESSED)>>
+           offset_bits)+1;
+  in_size=sectors*512-(host_offset&511);
+
+  pthread_mutex_lock(&(p_qcow2_handle->mutex));
+  hit=LibXmountCacheGet(&(p_qcow2_handle->cluster_cache),
+                        p_image,
+                        host_offset,
+                        pos,
+                        count,
+                        p_buf);
+  pthread_mutex_unlock(&(p_qcow2_handle->mutex));
+  if(hit) return QCOW2_OK;
+
+  p_in=(char*)malloc(in_size);
+  p_cluster=(char*)malloc(p_image->cluster_size);
+  if(p_in==NULL || p_cluster==NULL) {
+    free(p_in);
+    free(p_cluster);
+    return QCOW2_MEMALLOC_FAILED;
+  }
+
+  // The last compressed cluster may end before the sector does
+  ret=Qcow2Pread(p_image->fd,p_in,host_offset,in_size,&read,p_errno);
+  if(ret==QCOW2_OK && read==0) ret=QCOW2_CORRUPT_IMAGE;
+  if(ret==QCOW2_OK) ret=Qcow2Uncompress(p_image,p_in,read,p_cluster);
+  free(p_in);
+  if(ret!=QCOW2_OK) {
+    free(p_cluster);
+    if(p_errno!=NULL) *p_errno=EIO;
+    return ret;
+  }
+  memcpy(p_buf,p_cluster+pos,count);
+
+  pthread_mutex_lock(&(p_qcow2_handle->mutex));
+  p_qcow2_handle->clusters_uncompressed++;
+  LibXmountCachePut(&(p_qcow2_handle->cluster_cache),
+                    p_image,
+                    host_offset,
+                    &p_cluster);
+  pthread_mutex_unlock(&(p_qcow2_handle->mutex));
+  free(p_cluster);
+
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2ReadImage
+ *
+ * Reads count bytes at offset from the given image of the backing file chain.
+ * Consecutive parts of the same kind are handled at once: adjacent clusters
+ * are read with a single pread and runs of unallocated clusters are read from
+ * the backing file with a single call. Zero and unallocated clusters without a
+ * backing file don't cause any I/O.
+ */
+static int Qcow2ReadImage(pts_Qcow2Handle p_qcow2_handle,
+                          pts_Qcow2Image p_image,
+                          char *p_buf,
+                          uint64_t offset,
+                          uint64_t count,
+                          int *p_errno)
+{
+  int run_kind=QCOW2_DATA_ZERO;
+  uint64_t run_host_offset=0;
+  uint64_t run_offset=0;
+  uint64_t run_len=0;
+  uint64_t pos;
+  int kind;
+  uint64_t host_offset;
+  uint64_t end;
+  uint64_t len;
+  uint64_t read;
+  uint64_t bytes_read=0;
+  uint64_t bytes_zero=0;
+  uint64_t bytes_backing=0;
+  int ret=QCOW2_OK;
+
+  if(p_image->raw) {
+    // Raw backing file, which might be smaller than the image on top of it
+    if(offset<p_image->size) {
+      ret=Qcow2Pread(p_image->fd,
+                     p_buf,
+                     offset,
+                     GETMIN(count,p_image->size-offset),
+                     &read,
+                     p_errno);
+      if(ret!=QCOW2_OK) return ret;
+    } else read=0;
+    memset(p_buf+read,0,count-read);
+    return QCOW2_OK;
+  }
+
+  // Backing files may be smaller than the images on top of them as well
+  if(offset+count>p_image->size) {
+    len=offset<p_image->size ? p_image->size-offset : 0;
+    memset(p_buf+len,0,count-len);
+    count=len;
+  }
+
+#define QCOW2_FLUSH_RUN() {                                               \
+  char *p_run_buf=p_buf+(run_offset-offset);                              \
+  if(run_kind==QCOW2_DATA_NORMAL) {                                       \
+    ret=Qcow2PreadFull(p_image->fd,                                       \
+                       p_run_buf,                                         \
+                       run_host_offset,                                   \
+                       run_len,                                           \
+                       p_errno);                                          \
+    bytes_read+=run_len;                                                  \
+  } else if(run_kind==QCOW2_DATA_UNALLOCATED && p_image->p_backing!=NULL) \
+  {                                                                       \
+    ret=Qcow2ReadImage(p_qcow2_handle,                                    \
+                       p_image->p_backing,                                \
+                       p_run_buf,                                         \
+                       run_offset,                                        \
+                       run_len,                                           \
+                       p_errno);                                          \
+    bytes_backing+=run_len;                                               \
+  } else {                                                                \
+    memset(p_run_buf,0,run_len);                                          \
+    bytes_zero+=run_len;                                                  \
+  }                                                                       \
+}
+
+  pos=offset;
+  while(count>0) {
+    ret=Qcow2MapOffset(p_qcow2_handle,
+                       p_image,
+                       pos,
+                       &kind,
+                       &host_offset,
+                       &end,
+                       p_errno);
+    if(ret!=QCOW2_OK) break;
+    len=GETMIN(end-pos,count);
+
+    if(run_len!=0 &&
+       (kind!=run_kind || kind==QCOW2_DATA_COMPRESSED ||
+        (kind==QCOW2_DATA_NORMAL && host_offset!=run_host_offset+run_len)))
+    {
+      // Can't be merged with the current run
+      QCOW2_FLUSH_RUN();
+      if(ret!=QCOW2_OK) break;
+      run_len=0;
+    }
+
+    if(kind==QCOW2_DATA_COMPRESSED) {
+      ret=Qcow2ReadCompressed(p_qcow2_handle,
+                              p_image,
+                              host_offset,
+                              p_buf+(pos-offset),
+                              pos&(p_image->cluster_size-1),
+                              len,
+                              p_errno);
+      if(ret!=QCOW2_OK) break;
+      bytes_read+=len;
+    } else {
+      if(run_len==0) {
+        run_kind=kind;
+        run_offset=pos;
+        run_host_offset=host_offset;
+      }
+      run_len+=len;
+    }
+    pos+=len;
+    count-=len;
+  }
+  if(ret==QCOW2_OK && run_len!=0) QCOW2_FLUSH_RUN();
+
+#undef QCOW2_FLUSH_RUN
+
+  pthread_mutex_lock(&(p_qcow2_handle->mutex));
+  p_qcow2_handle->bytes_read+=bytes_read;
+  p_qcow2_handle->bytes_zero+=bytes_zero;
+  p_qcow2_handle->bytes_backing+=bytes_backing;
+  pthread_mutex_unlock(&(p_qcow2_handle->mutex));
+
+  return ret;
+}
+
+/*
+ * Qcow2CloseImage
+ *
+ * Closes the given image and all images of its backing file chain.
+ */
+static int Qcow2CloseImage(pts_Qcow2Image p_image) {
+  pts_Qcow2Image p_backing;
+  int ret=QCOW2_OK;
+
+  while(p_image!=NULL) {
+    p_backing=p_image->p_backing;
+    if(p_image->fd!=-1 && close(p_image->fd)!=0) ret=QCOW2_CLOSE_FAILED;
+    free(p_image->p_filename);
+    free(p_image->p_l1_table);
+    free(p_image->p_backing_name);
+    free(p_image->p_backing_format);
+    free(p_image);
+    p_image=p_backing;
+  }
+  return ret;
+}
+
+/*
+ * Qcow2ReadHeaderExtensions
+ */
+static int Qcow2ReadHeaderExtensions(pts_Qcow2Image p_image,
+                                     uint64_t offset,
+                                     uint64_t end)
+{
+  unsigned char ext_header[8];
+  uint32_t ext_type;
+  uint32_t ext_len;
+  int ret;
+
+  while(offset+8<=end) {
+    ret=Qcow2PreadFull(p_image->fd,(char*)ext_header,offset,8,NULL);
+    if(ret!=QCOW2_OK) return ret;
+    ext_type=Qcow2Be32(ext_header);
+    ext_len=Qcow2Be32(ext_header+4);
+    offset+=8;
+    if(ext_type==QCOW2_EXT_END) break;
+    if(ext_len>end-offset) return QCOW2_INVALID_HEADER;
+
+    if(ext_type==QCOW2_EXT_BACKING_FORMAT && p_image->p_backing_format==NULL) {
+      p_image->p_backing_format=(char*)calloc(1,ext_len+1);
+      if(p_image->p_backing_format==NULL) return QCOW2_MEMALLOC_FAILED;
+      ret=Qcow2PreadFull(p_image->fd,
+                         p_image->p_backing_format,
+                         offset,
+                         ext_len,
+                         NULL);
+      if(ret!=QCOW2_OK) return ret;
+    }
+    offset+=((uint64_t)ext_len+7)&~7ULL;
+  }
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2GetBackingPath
+ *
+ * Relative backing file names are relative to the image referencing them.
+ */
+static char* Qcow2GetBackingPath(pts_Qcow2Image p_image) {
+  const char *p_slash;
+  char *p_path;
+  int dir_len;
+
+  p_slash=strrchr(p_image->p_filename,'/');
+  if(p_image->p_backing_name[0]=='/' || p_slash==NULL) {
+    return strdup(p_image->p_backing_name);
+  }
+  dir_len=(int)(p_slash-p_image->p_filename);
+  if(asprintf(&p_path,
+              "%.*s/%s",
+              dir_len,
+              p_image->p_filename,
+              p_image->p_backing_name)<0)
+  {
+    return NULL;
+  }
+  return p_path;
+}
+
+/*
+ * Qcow2OpenImage
+ *
+ * Opens the given image and, recursively, its backing file chain. p_format is
+ * the format given by the referencing image ("raw" or "qcow2") or NULL if the
+ * format is unknown and has to be probed.
+ */
+static int Qcow2OpenImage(pts_Qcow2Handle p_qcow2_handle,
+                          const char *p_filename,
+                          const char *p_format,
+                          uint32_t depth,
+                          pts_Qcow2Image *pp_image)
+{
+  pts_Qcow2Image p_image;
+  unsigned char header[QCOW2_V3_HEADER_SIZE+8];
+  uint64_t header_read;
+  uint64_t header_length;
+  uint64_t backing_offset;
+  uint32_t backing_size;
+  uint64_t l1_offset;
+  unsigned char *p_l1_buf;
+  struct stat file_stat;
+  char *p_backing_path;
+  int ret;
+
+  if(depth>=QCOW2_MAX_BACKING_DEPTH) return QCOW2_BACKING_CHAIN_TOO_LONG;
+
+  p_image=(pts_Qcow2Image)calloc(1,sizeof(ts_Qcow2Image));
+  if(p_image==NULL) return QCOW2_MEMALLOC_FAILED;
+  p_image->fd=-1;
+
+#define QCOW2_OPEN_ERROR(err) { \
+  Qcow2CloseImage(p_image);     \
+  return (err);                 \
+}
+
+  p_image->p_filename=strdup(p_filename);
+  if(p_image->p_filename==NULL) QCOW2_OPEN_ERROR(QCOW2_MEMALLOC_FAILED);
+  p_image->fd=open(p_filename,O_RDONLY);
+  if(p_image->fd==-1) {
+    QCOW2_OPEN_ERROR(depth==0 ? QCOW2_OPEN_FAILED :
+                                QCOW2_BACKING_FILE_NOT_FOUND);
+  }
+
+  memset(header,0,sizeof(header));
+  ret=Qcow2Pread(p_image->fd,
+                 (char*)header,
+                 0,
+                 sizeof(header),
+                 &header_read,
+                 NULL);
+  if(ret!=QCOW2_OK) QCOW2_OPEN_ERROR(ret);
+
+  if(header_read<QCOW2_V2_HEADER_SIZE || Qcow2Be32(header)!=QCOW2_MAGIC) {
+    if(depth==0 || (p_format!=NULL && strcmp(p_format,"raw")!=0)) {
+      QCOW2_OPEN_ERROR(QCOW2_INVALID_SIGNATURE);
+    }
+    p_format="raw";
+  }
+  if(p_format!=NULL && strcmp(p_format,"raw")==0) {
+    // Raw backing file
+    if(fstat(p_image->fd,&file_stat)!=0) QCOW2_OPEN_ERROR(QCOW2_OPEN_FAILED);
+    p_image->raw=1;
+    p_image->size=(uint64_t)file_stat.st_size;
+    LIBXMOUNT_LOG_DEBUG(p_qcow2_handle->debug,
+                        "Opened raw backing file '%s'\n",
+                        p_filename);
+    *pp_image=p_image;
+    return QCOW2_OK;
+  }
+  if(p_format!=NULL && strcmp(p_format,"qcow2")!=0) {
+    QCOW2_OPEN_ERROR(QCOW2_UNSUPPORTED_FEATURE);
+  }
+
+  // Parse header
+  p_image->version=Qcow2Be32(header+4);
+  if(p_image->version!=2 && p_image->version!=3) {
+    QCOW2_OPEN_ERROR(QCOW2_UNSUPPORTED_VERSION);
+  }
+  backing_offset=Qcow2Be64(header+8);
+  backing_size=Qcow2Be32(header+16);
+  p_image->cluster_bits=Qcow2Be32(header+20);
+  p_image->size=Qcow2Be64(header+24);
+  if(Qcow2Be32(header+32)!=0) QCOW2_OPEN_ERROR(QCOW2_ENCRYPTED_IMAGE);
+  p_image->l1_size=Qcow2Be32(header+36);
+  l1_offset=Qcow2Be64(header+40);
+  header_length=QCOW2_V2_HEADER_SIZE;
+  if(p_image->version>=3) {
+    if(header_read<QCOW2_V3_HEADER_SIZE) QCOW2_OPEN_ERROR(QCOW2_INVALID_HEADER);
+    p_image->incompatible_features=Qcow2Be64(header+72);
+    header_length=Qcow2Be32(header+100);
+    if(header_length<QCOW2_V3_HEADER_SIZE) {
+      QCOW2_OPEN_ERROR(QCOW2_INVALID_HEADER);
+    }
+    if((p_image->incompatible_features&~QCOW2_INCOMPAT_SUPPORTED)!=0) {
+      QCOW2_OPEN_ERROR(QCOW2_UNSUPPORTED_FEATURE);
+    }
+    if((p_image->incompatible_features&QCOW2_INCOMPAT_COMPRESSION)!=0) {
+      if(header_length<=QCOW2_V3_HEADER_SIZE) {
+        QCOW2_OPEN_ERROR(QCOW2_INVALID_HEADER);
+      }
+      p_image->compression_type=header[QCOW2_V3_HEADER_SIZE];
+    }
+    p_image->extended_l2=
+      (p_image->incompatible_features&QCOW2_INCOMPAT_EXTL2)!=0;
+  }
+
+  if(p_image->cluster_bits<QCOW2_MIN_CLUSTER_BITS ||
+     p_image->cluster_bits>QCOW2_MAX_CLUSTER_BITS)
+  {
+    QCOW2_OPEN_ERROR(QCOW2_INVALID_HEADER);
+  }
+  switch(p_image->compression_type) {
+    case QCOW2_COMPRESSION_ZLIB:
+#ifdef HAVE_LIBZSTD
+    case QCOW2_COMPRESSION_ZSTD:
+#endif
+      break;
+    default:
+      QCOW2_OPEN_ERROR(QCOW2_UNSUPPORTED_COMPRESSION);
+  }
+  p_image->cluster_size=1ULL<<p_image->cluster_bits;
+  if(p_image->extended_l2) {
+    p_image->l2_bits=p_image->cluster_bits-4;
+    p_image->unit_size=p_image->cluster_size/QCOW2_SUBCLUSTERS;
+  } else {
+    p_image->l2_bits=p_image->cluster_bits-3;
+    p_image->unit_size=p_image->cluster_size;
+  }
+  p_image->l2_entries=1ULL<<p_image->l2_bits;
+  if(p_image->incompatible_features&QCOW2_INCOMPAT_CORRUPT) {
+    LIBXMOUNT_LOG_WARNING("Image '%s' is marked as corrupt, data read from "
+                            "it might be wrong\n",
+                          p_filename);
+  }
+
+  // Read L1 table
+  if((uint64_t)p_image->l1_size*8>QCOW2_MAX_L1_SIZE) {
+    QCOW2_OPEN_ERROR(QCOW2_INVALID_HEADER);
+  }
+  if(p_image->l1_size!=0) {
+    p_image->p_l1_table=(uint64_t*)malloc(p_image->l1_size*sizeof(uint64_t));
+    if(p_image->p_l1_table==NULL) QCOW2_OPEN_ERROR(QCOW2_MEMALLOC_FAILED);
+    p_l1_buf=(unsigned char*)p_image->p_l1_table;
+    ret=Qcow2PreadFull(p_image->fd,
+                       (char*)p_l1_buf,
+                       l1_offset,
+                       (uint64_t)p_image->l1_size*8,
+                       NULL);
+    if(ret!=QCOW2_OK) QCOW2_OPEN_ERROR(ret);
+    for(uint32_t i=0;i<p_image->l1_size;i++) {
+      p_image->p_l1_table[i]=Qcow2Be64(p_l1_buf+i*8);
+    }
+  }
+
+  // Header extensions follow the header and end before the backing file name
+  // or at the end of the first cluster
+  ret=Qcow2ReadHeaderExtensions(p_image,
+                                header_length,
+                                backing_offset!=0 ?
+                                  GETMIN(backing_offset,
+                                         p_image->cluster_size) :
+                                  p_image->cluster_size);
+  if(ret!=QCOW2_OK) QCOW2_OPEN_ERROR(ret);
+
+  LIBXMOUNT_LOG_DEBUG(p_qcow2_handle->debug,
+                      "Opened qcow2 image '%s' (version %" PRIu32
+                        ", cluster size %" PRIu64 ", size %" PRIu64 ")\n",
+                      p_filename,
+                      p_image->version,
+                      p_image->cluster_size,
+                      p_image->size);
+
+  // Open backing file
+  if(backing_offset!=0 && backing_size!=0) {
+    if(backing_size>1023) QCOW2_OPEN_ERROR(QCOW2_INVALID_HEADER);
+    p_image->p_backing_name=(char*)calloc(1,backing_size+1);
+    if(p_image->p_backing_name==NULL) QCOW2_OPEN_ERROR(QCOW2_MEMALLOC_FAILED);
+    ret=Qcow2PreadFull(p_image->fd,
+                       p_image->p_backing_name,
+                       backing_offset,
+                       backing_size,
+                       NULL);
+    if(ret!=QCOW2_OK) QCOW2_OPEN_ERROR(ret);
+
+    p_backing_path=Qcow2GetBackingPath(p_image);
+    if(p_backing_path==NULL) QCOW2_OPEN_ERROR(QCOW2_MEMALLOC_FAILED);
+    ret=Qcow2OpenImage(p_qcow2_handle,
+                       p_backing_path,
+                       p_image->p_backing_format,
+                       depth+1,
+                       &(p_image->p_backing));
+    if(ret!=QCOW2_OK) {
+      LIBXMOUNT_LOG_ERROR("Unable to open backing file '%s' of image '%s'\n",
+                          p_backing_path,
+                          p_filename);
+    }
+    free(p_backing_path);
+    if(ret!=QCOW2_OK) QCOW2_OPEN_ERROR(ret);
+  }
+
+#undef QCOW2_OPEN_ERROR
+
+  *pp_image=p_image;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2CreateHandle
+ */
+static int Qcow2CreateHandle(void **pp_handle,
+                             const char *p_format,
+                             uint8_t debug)
+{
+  (void)p_format;
+  pts_Qcow2Handle p_qcow2_handle;
+
+  // Alloc new lib handle
+  p_qcow2_handle=(pts_Qcow2Handle)calloc(1,sizeof(ts_Qcow2Handle));
+  if(p_qcow2_handle==NULL) return QCOW2_MEMALLOC_FAILED;
+
+  // Init handle values
+  p_qcow2_handle->l2_cache_size=QCOW2_DEFAULT_L2_CACHE_SIZE;
+  p_qcow2_handle->cluster_cache_entries=QCOW2_DEFAULT_CLUSTER_CACHE_ENTRIES;
+  p_qcow2_handle->debug=debug;
+  pthread_mutex_init(&(p_qcow2_handle->mutex),NULL);
+
+  *pp_handle=p_qcow2_handle;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2DestroyHandle
+ */
+static int Qcow2DestroyHandle(void **pp_handle) {
+  pts_Qcow2Handle p_qcow2_handle=(pts_Qcow2Handle)*pp_handle;
+
+  if(p_qcow2_handle!=NULL) {
+    pthread_mutex_destroy(&(p_qcow2_handle->mutex));
+    free(p_qcow2_handle);
+  }
+
+  *pp_handle=NULL;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2Open
+ */
+static int Qcow2Open(void *p_handle,
+                     const char **pp_filename_arr,
+                     uint64_t filename_arr_len)
+{
+  pts_Qcow2Handle p_qcow2_handle=(pts_Qcow2Handle)p_handle;
+  pts_Qcow2Image p_image;
+  uint64_t l2_cache_entries;
+  int ret;
+
+  if(filename_arr_len==0) return QCOW2_NO_INPUT_FILES;
+  if(filename_arr_len>1) return QCOW2_TOO_MANY_INPUT_FILES;
+
+  ret=Qcow2OpenImage(p_qcow2_handle,
+                     pp_filename_arr[0],
+                     NULL,
+                     0,
+                     &(p_qcow2_handle->p_image));
+  if(ret!=QCOW2_OK) return ret;
+  p_qcow2_handle->chain_length=0;
+  for(p_image=p_qcow2_handle->p_image;
+      p_image!=NULL;
+      p_image=p_image->p_backing)
+  {
+    p_qcow2_handle->chain_length++;
+  }
+
+  // Size the L2 cache by the cluster size of the top image
+  l2_cache_entries=(p_qcow2_handle->l2_cache_size*1024*1024)>>
+                   p_qcow2_handle->p_image->cluster_bits;
+  l2_cache_entries=GETMAX(l2_cache_entries,QCOW2_MIN_L2_CACHE_ENTRIES);
+  if(LibXmountCacheInit(&(p_qcow2_handle->l2_cache),l2_cache_entries)!=0 ||
+     LibXmountCacheInit(&(p_qcow2_handle->cluster_cache),
+                        p_qcow2_handle->cluster_cache_entries)!=0)
+  {
+    Qcow2Close(p_handle);
+    return QCOW2_MEMALLOC_FAILED;
+  }
+
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2Close
+ */
+static int Qcow2Close(void *p_handle) {
+  pts_Qcow2Handle p_qcow2_handle=(pts_Qcow2Handle)p_handle;
+  int ret;
+
+  LIBXMOUNT_LOG_DEBUG(p_qcow2_handle->debug,
+                      "Read %" PRIu64 " bytes from image files, %" PRIu64
+                        " bytes from backing files, %" PRIu64
+                        " zero bytes without I/O\n",
+                      p_qcow2_handle->bytes_read,
+                      p_qcow2_handle->bytes_backing,
+                      p_qcow2_handle->bytes_zero);
+  LIBXMOUNT_LOG_DEBUG(p_qcow2_handle->debug,
+                      "L2 cache: %" PRIu64 " hits, %" PRIu64 " misses; "
+                        "%" PRIu64 " clusters uncompressed\n",
+                      p_qcow2_handle->l2_cache.hits,
+                      p_qcow2_handle->l2_cache.misses,
+                      p_qcow2_handle->clusters_uncompressed);
+
+  ret=Qcow2CloseImage(p_qcow2_handle->p_image);
+  p_qcow2_handle->p_image=NULL;
+  LibXmountCacheFree(&(p_qcow2_handle->l2_cache));
+  LibXmountCacheFree(&(p_qcow2_handle->cluster_cache));
+
+  return ret;
+}
+
+/*
+ * Qcow2Size
+ */
+static int Qcow2Size(void *p_handle, uint64_t *p_size) {
+  pts_Qcow2Handle p_qcow2_handle=(pts_Qcow2Handle)p_handle;
+
+  *p_size=p_qcow2_handle->p_image->size;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2Read
+ */
+static int Qcow2Read(void *p_handle,
+                     char *p_buf,
+                     off_t offset,
+                     size_t count,
+                     size_t *p_read,
+                     int *p_errno)
+{
+  pts_Qcow2Handle p_qcow2_handle=(pts_Qcow2Handle)p_handle;
+  uint64_t size=p_qcow2_handle->p_image->size;
+  int ret;
+
+  *p_read=0;
+  if(offset<0 || (uint64_t)offset>size || count>size-(uint64_t)offset) {
+    return QCOW2_READ_BEYOND_END_OF_IMAGE;
+  }
+
+  ret=Qcow2ReadImage(p_qcow2_handle,
+                     p_qcow2_handle->p_image,
+                     p_buf,
+                     (uint64_t)offset,
+                     count,
+                     p_errno);
+  if(ret!=QCOW2_OK) return ret;
+
+  *p_read=count;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2Write
+ */
+static int Qcow2Write(void *p_handle,
+                      const char *p_buf,
+                      off_t seek,
+                      size_t count,
+                      size_t *p_written,
+                      int *p_errno)
+{
+  return QCOW2_WRITE_FAILED;
+}
+
+/*
+ * Qcow2OptionsHelp
+ */
+static int Qcow2OptionsHelp(const char **pp_help) {
+  char *p_help=NULL;
+  int ret;
+
+  ret=asprintf(&p_help,
+               "    %-12s : Size of the L2 table cache in MiB, shared by all "
+                 "images of the backing file chain. Default: %d\n"
+               "    %-12s : Number of uncompressed clusters to cache. "
+                 "Default: %d\n",
+               QCOW2_OPTION_L2CACHE,QCOW2_DEFAULT_L2_CACHE_SIZE,
+               QCOW2_OPTION_CLUSTERCACHE,QCOW2_DEFAULT_CLUSTER_CACHE_ENTRIES);
+  if(ret<0 || p_help==NULL) return QCOW2_MEMALLOC_FAILED;
+
+  *pp_help=p_help;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2OptionsParse
+ */
+static int Qcow2OptionsParse(void *p_handle,
+                             uint32_t options_count,
+                             const pts_LibXmountOptions *pp_options,
+                             const char **pp_error)
+{
+  pts_Qcow2Handle p_qcow2_handle=(pts_Qcow2Handle)p_handle;
+  pts_LibXmountOptions p_option;
+  uint64_t value;
+  int ok;
+
+#define QCOW2_OPTION_ERROR(option) {                              \
+  *pp_error=strdup("Error in option " option ": Invalid value");  \
+  return QCOW2_INVALID_OPTION_VALUE;                              \
+}
+
+  *pp_error=NULL;
+  for(uint32_t i=0;i<options_count;i++) {
+    p_option=pp_options[i];
+    if(strcmp(p_option->p_key,QCOW2_OPTION_L2CACHE)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>UINT32_MAX) QCOW2_OPTION_ERROR(QCOW2_OPTION_L2CACHE);
+      p_qcow2_handle->l2_cache_size=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,QCOW2_OPTION_CLUSTERCACHE)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>UINT32_MAX) {
+        QCOW2_OPTION_ERROR(QCOW2_OPTION_CLUSTERCACHE);
+      }
+      p_qcow2_handle->cluster_cache_entries=value;
+      p_option->valid=1;
+    }
+  }
+
+#undef QCOW2_OPTION_ERROR
+
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2GetInfofileContent
+ */
+static int Qcow2GetInfofileContent(void *p_handle, const char **pp_info_buf) {
+  pts_Qcow2Handle p_qcow2_handle=(pts_Qcow2Handle)p_handle;
+  pts_Qcow2Image p_image=p_qcow2_handle->p_image;
+  char *p_infobuf=NULL;
+  char *p_line;
+  size_t infobuf_len=0;
+  size_t line_len;
+  uint32_t level=0;
+  int ret;
+
+#define QCOW2_INFOBUF_APPEND(...) {                                   \
+  ret=asprintf(&p_line,__VA_ARGS__);                                  \
+  if(ret<0) {                                                         \
+    free(p_infobuf);                                                  \
+    return QCOW2_MEMALLOC_FAILED;                                     \
+  }                                                                   \
+  line_len=strlen(p_line);                                            \
+  p_infobuf=(char*)realloc(p_infobuf,infobuf_len+line_len+1);         \
+  if(p_infobuf==NULL) {                                               \
+    free(p_line);                                                     \
+    return QCOW2_MEMALLOC_FAILED;                                     \
+  }                                                                   \
+  memcpy(p_infobuf+infobuf_len,p_line,line_len+1);                    \
+  infobuf_len+=line_len;                                              \
+  free(p_line);                                                       \
+}
+
+  QCOW2_INFOBUF_APPEND("qcow2 version: %" PRIu32 "\n"
+                         "Virtual size: %" PRIu64 " bytes\n"
+                         "Cluster size: %" PRIu64 " bytes%s\n"
+                         "Compression type: %s\n"
+                         "L2 cache: %" PRIu64 " tables\n",
+                       p_image->version,
+                       p_image->size,
+                       p_image->cluster_size,
+                       p_image->extended_l2 ? " (with subclusters)" : "",
+                       p_image->compression_type==QCOW2_COMPRESSION_ZSTD ?
+                         "zstd" : "zlib",
+                       p_qcow2_handle->l2_cache.entries);
+  for(p_image=p_image->p_backing;p_image!=NULL;p_image=p_image->p_backing) {
+    level++;
+    QCOW2_INFOBUF_APPEND("Backing file %" PRIu32 ": %s (%s)\n",
+                         level,
+                         p_image->p_filename,
+                         p_image->raw ? "raw" : "qcow2");
+  }
+
+#undef QCOW2_INFOBUF_APPEND
+
+  *pp_info_buf=p_infobuf;
+  return QCOW2_OK;
+}
+
+/*
+ * Qcow2GetErrorMessage
+ */
+static const char* Qcow2GetErrorMessage(int err_num) {
+  switch(err_num) {
+    case QCOW2_MEMALLOC_FAILED:
+      return "Unable to allocate memory";
+      break;
+    case QCOW2_NO_INPUT_FILES:
+      return "No input file specified";
+      break;
+    case QCOW2_TOO_MANY_INPUT_FILES:
+      return "Only a single qcow2 file may be specified";
+      break;
+    case QCOW2_OPEN_FAILED:
+      return "Unable to open qcow2 file";
+      break;
+    case QCOW2_READ_FAILED:
+      return "Unable to read qcow2 data";
+      break;
+    case QCOW2_CLOSE_FAILED:
+      return "Unable to close qcow2 file(s)";
+      break;
+    case QCOW2_INVALID_SIGNATURE:
+      return "The specified file is not a qcow2 image";
+      break;
+    case QCOW2_UNSUPPORTED_VERSION:
+      return "Unsupported qcow2 version (only versions 2 and 3 are supported)";
+      break;
+    case QCOW2_INVALID_HEADER:
+      return "Invalid qcow2 header";
+      break;
+    case QCOW2_UNSUPPORTED_FEATURE:
+      return "The image uses an unsupported qcow2 feature or backing file "
+               "format";
+      break;
+    case QCOW2_ENCRYPTED_IMAGE:
+      return "Encrypted qcow2 images are not supported";
+      break;
+    case QCOW2_UNSUPPORTED_COMPRESSION:
+      return "Unsupported compression type (zstd requires xmount to be built "
+               "with libzstd)";
+      break;
+    case QCOW2_BACKING_FILE_NOT_FOUND:
+      return "Unable to open backing file";
+      break;
+    case QCOW2_BACKING_CHAIN_TOO_LONG:
+      return "Backing file chain is too long (or contains a loop)";
+      break;
+    case QCOW2_CORRUPT_IMAGE:
+      return "The qcow2 image is corrupt";
+      break;
+    case QCOW2_UNCOMPRESS_FAILED:
+      return "Unable to uncompress cluster";
+      break;
+    case QCOW2_READ_BEYOND_END_OF_IMAGE:
+      return "Unable to read beyond end of image";
+      break;
+    case QCOW2_WRITE_FAILED:
+      return "Write is not supported in qcow2 input module.";
+      break;
+    case QCOW2_INVALID_OPTION_VALUE:
+      return "Invalid option value";
+      break;
+    default:
+      return "Unknown error";
+  }
+}
+
+/*
+ * Qcow2FreeBuffer
+ */
+static int Qcow2FreeBuffer(void *p_buf) {
+  free(p_buf);
+  return QCOW2_OK;
+}
+
+/*
+  ----- Change log -----
+  20261019: * Initial version, reading qcow2 v2 / v3 images including
+              compressed clusters, extended L2 entries and backing files.
+*/
@@ -0,0 +1,203 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#ifndef LIBXMOUNT_INPUT_QCOW2_H
+#define LIBXMOUNT_INPUT_QCOW2_H
+
+/*******************************************************************************
+ * Enums, Typedefs, etc...
+ ******************************************************************************/
+//! Possible error return codes
+enum {
+  QCOW2_OK=0,
+  QCOW2_MEMALLOC_FAILED,
+  QCOW2_NO_INPUT_FILES,
+  QCOW2_TOO_MANY_INPUT_FILES,
+  QCOW2_OPEN_FAILED,
+  QCOW2_READ_FAILED,
+  QCOW2_CLOSE_FAILED,
+  QCOW2_INVALID_SIGNATURE,
+  QCOW2_UNSUPPORTED_VERSION,
+  QCOW2_INVALID_HEADER,
+  QCOW2_UNSUPPORTED_FEATURE,
+  QCOW2_ENCRYPTED_IMAGE,
+  QCOW2_UNSUPPORTED_COMPRESSION,
+  QCOW2_BACKING_FILE_NOT_FOUND,
+  QCOW2_BACKING_CHAIN_TOO_LONG,
+  QCOW2_CORRUPT_IMAGE,
+  QCOW2_UNCOMPRESS_FAILED,
+  QCOW2_READ_BEYOND_END_OF_IMAGE,
+  QCOW2_WRITE_FAILED,
+  QCOW2_INVALID_OPTION_VALUE
+};
+
+#define GETMAX(a,b) ((a)>(b)?(a):(b))
+#define GETMIN(a,b) ((a)<(b)?(a):(b))
+
+//! qcow2 header magic ("QFI\xfb")
+#define QCOW2_MAGIC 0x514649fbUL
+//! Size of the version 2 header, version 3 headers tell their size
+#define QCOW2_V2_HEADER_SIZE 72
+//! Min. size of a version 3 header
+#define QCOW2_V3_HEADER_SIZE 104
+//! Smallest and biggest supported cluster size (512 bytes to 2 MiB)
+#define QCOW2_MIN_CLUSTER_BITS 9
+#define QCOW2_MAX_CLUSTER_BITS 21
+//! Max. size of the L1 table (same limit as used by qemu)
+#define QCOW2_MAX_L1_SIZE (32*1024*1024)
+//! Max. number of images in a backing file chain
+#define QCOW2_MAX_BACKING_DEPTH 16
+//! Number of subclusters per cluster in images with extended L2 entries
+#define QCOW2_SUBCLUSTERS 32
+//! Default size of the L2 table cache in MiB
+#define QCOW2_DEFAULT_L2_CACHE_SIZE 4
+//! Min. number of cached L2 tables
+#define QCOW2_MIN_L2_CACHE_ENTRIES 4
+//! Default number of cached uncompressed clusters
+#define QCOW2_DEFAULT_CLUSTER_CACHE_ENTRIES 16
+
+//! Incompatible feature bits
+#define QCOW2_INCOMPAT_DIRTY         (1ULL<<0)
+#define QCOW2_INCOMPAT_CORRUPT       (1ULL<<1)
+#define QCOW2_INCOMPAT_DATA_FILE     (1ULL<<2)
+#define QCOW2_INCOMPAT_COMPRESSION   (1ULL<<3)
+#define QCOW2_INCOMPAT_EXTL2         (1ULL<<4)
+#define QCOW2_INCOMPAT_SUPPORTED     (QCOW2_INCOMPAT_DIRTY |       \
+                                      QCOW2_INCOMPAT_CORRUPT |     \
+                                      QCOW2_INCOMPAT_COMPRESSION | \
+                                      QCOW2_INCOMPAT_EXTL2)
+
+//! Header extension types
+#define QCOW2_EXT_END             0x00000000UL
+#define QCOW2_EXT_BACKING_FORMAT  0xe2792acaUL
+
+//! Bits of L1 and L2 table entries
+#define QCOW2_OFLAG_COPIED     (1ULL<<63)
+#define QCOW2_OFLAG_COMPRESSED (1ULL<<62)
+#define QCOW2_OFLAG_ZERO       (1ULL<<0)
+#define QCOW2_L1E_OFFSET_MASK  0x00fffffffffffe00ULL
+#define QCOW2_L2E_OFFSET_MASK  0x00fffffffffffe00ULL
+
+//! Compression types
+enum {
+  QCOW2_COMPRESSION_ZLIB=0,
+  QCOW2_COMPRESSION_ZSTD=1
+};
+
+//! Kind of data backing a part of the virtual disk
+enum {
+  QCOW2_DATA_UNALLOCATED=0, //!< Comes from the backing file or reads as zeros
+  QCOW2_DATA_ZERO,          //!< Reads as zeros
+  QCOW2_DATA_NORMAL,        //!< Stored uncompressed in the image file
+  QCOW2_DATA_COMPRESSED     //!< Stored compressed in the image file
+};
+
+//! One image of a backing file chain
+typedef struct s_Qcow2Image {
+  //! Image file name and descriptor
+  char *p_filename;
+  int fd;
+  //! Set if this is a raw backing file, all other members but size are unused
+  uint8_t raw;
+  //! Header values
+  uint32_t version;
+  uint32_t cluster_bits;
+  uint64_t cluster_size;
+  uint64_t size;
+  uint64_t incompatible_features;
+  uint8_t compression_type;
+  //! Set if L2 entries have a subcluster bitmap (extended L2 entries)
+  uint8_t extended_l2;
+  //! Number of entries in an L2 table and log2 of it
+  uint64_t l2_entries;
+  uint32_t l2_bits;
+  //! Size of the units (clusters or subclusters) the allocation is tracked in
+  uint64_t unit_size;
+  //! L1 table, converted to host byte order
+  uint64_t *p_l1_table;
+  uint32_t l1_size;
+  //! Backing file name as found in the header and its format, if given
+  char *p_backing_name;
+  char *p_backing_format;
+  //! Next image of the backing file chain, NULL if none
+  struct s_Qcow2Image *p_backing;
+} ts_Qcow2Image, *pts_Qcow2Image;
+
+//! Library handle
+/*!
+ * Reads may be called concurrently. Image data is read with pread, the mutex
+ * only protects the caches and the statistics.
+ */
+typedef struct s_Qcow2Handle {
+  //! Top image of the backing file chain
+  pts_Qcow2Image p_image;
+  //! Number of images in the backing file chain
+  uint32_t chain_length;
+  //! L2 table cache size in MiB
+  uint64_t l2_cache_size;
+  //! Number of cached uncompressed clusters
+  uint64_t cluster_cache_entries;
+  //! Caches shared by all images of the chain
+  ts_LibXmountCache l2_cache;
+  ts_LibXmountCache cluster_cache;
+  //! Statistics
+  uint64_t bytes_read;
+  uint64_t bytes_zero;
+  uint64_t bytes_backing;
+  uint64_t clusters_uncompressed;
+  //! Protects the caches and the statistics
+  pthread_mutex_t mutex;
+  //! Debug settings
+  uint8_t debug;
+} ts_Qcow2Handle, *pts_Qcow2Handle;
+
+/*******************************************************************************
+ * Forward declarations
+ ******************************************************************************/
+static int Qcow2CreateHandle(void **pp_handle,
+                             const char *p_format,
+                             uint8_t debug);
+static int Qcow2DestroyHandle(void **pp_handle);
+static int Qcow2Open(void *p_handle,
+                     const char **pp_filename_arr,
+                     uint64_t filename_arr_len);
+static int Qcow2Close(void *p_handle);
+static int Qcow2Size(void *p_handle,
+                     uint64_t *p_size);
+static int Qcow2Read(void *p_handle,
+                     char *p_buf,
+                     off_t seek,
+                     size_t count,
+                     size_t *p_read,
+                     int *p_errno);
+static int Qcow2Write(void *p_handle,
+                      const char *p_buf,
+                      off_t seek,
+                      size_t count,
+                      size_t *p_written,
+                      int *p_errno);
+static int Qcow2OptionsHelp(const char **pp_help);
+static int Qcow2OptionsParse(void *p_handle,
+                             uint32_t options_count,
+                             const pts_LibXmountOptions *pp_options,
+                             const char **pp_error);
+static int Qcow2GetInfofileContent(void *p_handle,
+                                   const char **pp_info_buf);
+static const char* Qcow2GetErrorMessage(int err_num);
+static int Qcow2FreeBuffer(void *p_buf);
+
+#endif // LIBXMOUNT_INPUT_QCOW2_H
@@ -21,6 +21,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "../libxmount_input.h"
 #include "libxmount_input_raw.h"
@@ -31,6 +39,15 @@
 
 #define RAW_OPTION_WRITABLE "rawwritable"
 #define RAW_OPTION_DEFAULT_WRITABLE "false"
+#define RAW_OPTION_MAXOPEN "rawmaxopen"
+#define RAW_OPTION_DIRECT "rawdirect"
+#define RAW_OPTION_DEFAULT_DIRECT "false"
+#define RAW_OPTION_MMAP "rawmmap"
+#define RAW_OPTION_DEFAULT_MMAP "false"
+#define RAW_OPTION_FADVISE "rawfadvise"
+#define RAW_OPTION_DEFAULT_FADVISE "true"
+#define RAW_OPTION_DROPBEHIND "rawdropbehind"
+#define RAW_OPTION_DEFAULT_DROPBEHIND "false"
 
 /*******************************************************************************
  * LibXmount_Input API implementation
@@ -75,76 +92,574 @@ void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
 //  Internal static functions
 // ---------------------------
 
-static inline uint64_t RawGetCurrentSeekPos(t_pPiece pPiece) {
-  return ftello(pPiece->pFile);
+// RawGetPieceSize determines the size of a piece without keeping it open. Only
+// for devices, the size isn't known by stat and the piece must be opened.
+static int RawGetPieceSize(t_praw praw, t_pPiece pPiece)
+{
+  struct stat Stat;
+  off_t       Size;
+  int         File;
+
+  if (stat (pPiece->pFilename, &Stat) != 0) return RAW_FILE_OPEN_FAILED;
+  if (access (pPiece->pFilename, praw->Writable ? (R_OK | W_OK) : R_OK) != 0)
+    return RAW_FILE_OPEN_FAILED;
+
+  if (S_ISREG (Stat.st_mode))
+  {
+    pPiece->FileSize = Stat.st_size;
+    return RAW_OK;
+  }
+
+  File = open (pPiece->pFilename, O_RDONLY);
+  if (File < 0) return RAW_FILE_OPEN_FAILED;
+  Size = lseek (File, 0, SEEK_END);
+  close (File);
+  if (Size < 0) return RAW_CANNOT_SEEK;
+  pPiece->FileSize = Size;
+
+  return RAW_OK;
+}
+
+// RawFindPiece returns the piece containing the given image offset, which must
+// lie below TotalSize. The pieces are searched binary by their offsets; empty
+// pieces share their offset with the next one and thus are skipped.
+static t_pPiece RawFindPiece(t_praw praw, uint64_t Seek)
+{
+  uint64_t Lo = 0;
+  uint64_t Hi = praw->Pieces - 1;
+  uint64_t Mid;
+
+  while (Lo < Hi)
+  {
+    Mid = Lo + (Hi - Lo + 1) / 2;
+    if (praw->pPieceArr[Mid].Offset <= Seek) Lo = Mid;
+    else                                     Hi = Mid - 1;
+  }
+  return &praw->pPieceArr[Lo];
+}
+
+static void RawUnmapPiece(t_pPiece pPiece)
+{
+  if (pPiece->pMap == NULL) return;
+  munmap (pPiece->pMap, pPiece->MapLen);
+  pPiece->pMap      = NULL;
+  pPiece->MapOffset = 0;
+  pPiece->MapLen    = 0;
+}
+
+// RawOpenPiece makes sure the given piece is open and returns its file
+// descriptor. If MaxOpenPieces are open already, the least recently used one
+// is closed first. Pieces in use by other threads never are closed, so every
+// call must be followed by RawReleasePiece.
+static int RawOpenPiece(t_praw praw, t_pPiece pPiece, int *pFile)
+{
+  t_pPiece pOldest;
+  int      Flags;
+  int      ret = RAW_OK;
+
+  pthread_mutex_lock (&praw->Mutex);
+  pPiece->LastUsed = ++praw->UseCounter;
+  pPiece->Users++;
+  if (pPiece->File >= 0)
+  {
+    *pFile = pPiece->File;
+    pthread_mutex_unlock (&praw->Mutex);
+    return RAW_OK;
+  }
+
+  while (praw->OpenPieces >= praw->MaxOpenPieces)
+  {
+    pOldest = NULL;
+    for (uint64_t i=0; i<praw->Pieces; i++)
+    {
+      if ((praw->pPieceArr[i].File < 0) || praw->pPieceArr[i].Users) continue;
+      if ((pOldest == NULL) || (praw->pPieceArr[i].LastUsed < pOldest->LastUsed))
+        pOldest = &praw->pPieceArr[i];
+    }
+    if (pOldest == NULL) break;  // All open pieces in use, exceed MaxOpenPieces temporarily
+    RawUnmapPiece (pOldest);
+    if (close (pOldest->File)) ret = RAW_CANNOT_CLOSE_FILE;
+    pOldest->File = -1;
+    // Advice given to the kernel was bound to the closed descriptor
+    pOldest->Pattern     = RAW_PATTERN_UNKNOWN;
+    pOldest->SeqRun      = 0;
+    pOldest->RandomRun   = 0;
+    pOldest->WillNeedEnd = 0;
+    praw->OpenPieces--;
+    praw->PieceCloses++;
+    if (ret != RAW_OK) break;
+  }
+
+  if (ret == RAW_OK)
+  {
+    Flags = praw->Writable ? O_RDWR : O_RDONLY;
+#ifdef O_DIRECT
+    if (praw->Direct) Flags |= O_DIRECT;
+#endif
+    pPiece->File = open (pPiece->pFilename, Flags);
+#ifdef O_DIRECT
+    if ((pPiece->File < 0) && praw->Direct && (errno == EINVAL))
+    {
+      // Some file systems (tmpfs for instance) don't support O_DIRECT
+      LOG_WARNING("Unable to open '%s' with O_DIRECT, using buffered I/O for "
+                    "it.\n", pPiece->pFilename);
+      pPiece->File = open (pPiece->pFilename, Flags & ~O_DIRECT);
+      pPiece->Buffered = 1;
+    }
+#endif
+    if (pPiece->File < 0)
+    {
+      ret = RAW_FILE_OPEN_FAILED;
+    }
+    else
+    {
+      praw->OpenPieces++;
+      praw->PieceOpens++;
+    }
+  }
+  if (ret == RAW_OK) *pFile = pPiece->File;
+  else               pPiece->Users--;
+  pthread_mutex_unlock (&praw->Mutex);
+
+  return ret;
+}
+
+static void RawReleasePiece(t_praw praw, t_pPiece pPiece)
+{
+  pthread_mutex_lock (&praw->Mutex);
+  pPiece->Users--;
+  pthread_mutex_unlock (&praw->Mutex);
 }
 
-static inline int RawSetCurrentSeekPos(t_pPiece pPiece,
-                                       uint64_t Val,
-                                       int Whence)
+// RawPread reads exactly Count bytes, retrying on short reads
+static int RawPread(int File, char *pBuffer, uint64_t Seek, uint64_t Count, int *pErrno)
 {
-  if (fseeko (pPiece->pFile, Val, Whence) != 0) return RAW_CANNOT_SEEK;
+  ssize_t rd;
+
+  while (Count)
+  {
+    rd = pread (File, pBuffer, GETMIN (Count, RAW_MAX_IO_SIZE), Seek);
+    if (rd < 0)
+    {
+      if (errno == EINTR) continue;
+      *pErrno = errno;
+      return RAW_CANNOT_READ_DATA;
+    }
+    if (rd == 0)  // Piece shrunk since opening the image
+    {
+      *pErrno = EIO;
+      return RAW_CANNOT_READ_DATA;
+    }
+    pBuffer += rd;
+    Seek    += rd;
+    Count   -= rd;
+  }
   return RAW_OK;
 }
 
-static int RawRead0(t_praw praw, char *pBuffer, uint64_t Seek, uint32_t *pCount)
+// RawPreadDirect reads from a piece opened with O_DIRECT, where offset, length
+// and buffer must be aligned to RAW_DIRECT_ALIGN. Unaligned requests are read
+// through an aligned bounce buffer.
+static int RawPreadDirect(int File, char *pBuffer, uint64_t Seek, uint64_t Count, int *pErrno)
 {
-  t_pPiece pPiece;
-  uint64_t  i;
+  char     *pBounce;
+  uint64_t   BounceSize;
+  uint64_t   AlignedSeek;
+  uint64_t   Skip;
+  uint64_t   ToRead;
+  uint64_t   Copy;
+  ssize_t    rd;
+  int        ret = RAW_OK;
+
+  if ((((uintptr_t)pBuffer % RAW_DIRECT_ALIGN) == 0) &&
+      ((Seek  % RAW_DIRECT_ALIGN) == 0) &&
+      ((Count % RAW_DIRECT_ALIGN) == 0))
+    return RawPread (File, pBuffer, Seek, Count, pErrno);
+
+  AlignedSeek = Seek - (Seek % RAW_DIRECT_ALIGN);
+  BounceSize  = RAW_DIRECT_ROUNDUP (Seek + Count) - AlignedSeek;
+  BounceSize  = GETMIN (BounceSize, RAW_DIRECT_BUFF_SIZE);
+  if (posix_memalign ((void **) &pBounce, RAW_DIRECT_ALIGN, BounceSize) != 0)
+    return RAW_MEMALLOC_FAILED;
+
+  while (Count)
+  {
+    AlignedSeek = Seek - (Seek % RAW_DIRECT_ALIGN);
+    Skip        = Seek - AlignedSeek;
+    ToRead      = GETMIN (RAW_DIRECT_ROUNDUP (Skip + Count), BounceSize);
+    rd = pread (File, pBounce, ToRead, AlignedSeek);
+    if (rd < 0)
+    {
+      if (errno == EINTR) continue;
+      *pErrno = errno;
+      ret = RAW_CANNOT_READ_DATA;
+      break;
+    }
+    if ((uint64_t) rd <= Skip)  // The end of a piece is reached with a short read
+    {
+      *pErrno = EIO;
+      ret = RAW_CANNOT_READ_DATA;
+      break;
+    }
+    Copy = GETMIN ((uint64_t) rd - Skip, Count);
+    memcpy (pBuffer, pBounce + Skip, Copy);
+    pBuffer += Copy;
+    Seek    += Copy;
+    Count   -= Copy;
+  }
+  free (pBounce);
 
-  // Find correct piece to read from
-  // -------------------------------
+  return ret;
+}
+
+static int RawPwrite(int File, const char *pBuffer, uint64_t Seek, uint64_t Count, int *pErrno)
+{
+  ssize_t wr;
 
-  for (i=0; i<praw->Pieces; i++)
+  while (Count)
   {
-    pPiece = &praw->pPieceArr[i];
-    if (Seek < pPiece->FileSize) break;
-    Seek -= pPiece->FileSize;
+    wr = pwrite (File, pBuffer, GETMIN (Count, RAW_MAX_IO_SIZE), Seek);
+    if (wr < 0)
+    {
+      if (errno == EINTR) continue;
+      *pErrno = errno;
+      return RAW_CANNOT_WRITE_DATA;
+    }
+    pBuffer += wr;
+    Seek    += wr;
+    Count   -= wr;
   }
-  if (i >= praw->Pieces) return RAW_READ_BEYOND_END_OF_IMAGE;
+  return RAW_OK;
+}
 
-  // Read from this piece
-  // --------------------
-  CHK (RawSetCurrentSeekPos (pPiece, Seek, SEEK_SET))
+// ---------------------------
+//  Memory mapped reads
+// ---------------------------
 
-  *pCount = GETMIN (*pCount, pPiece->FileSize - Seek);
+// Reading from a mapping fails with SIGBUS if the piece has been truncated
+// after it was mapped. While copying from a mapping, the handler below jumps
+// back into RawCopyMapped, which then reports a read error. SIGBUS not caused
+// by us is handed over to the previous handler.
+
+static __thread sigjmp_buf            RawSigBusJmpBuf;
+static __thread volatile sig_atomic_t RawSigBusArmed = 0;
+static struct sigaction               RawSigBusOldAction;
+static int                            RawSigBusUsers = 0;
+static pthread_mutex_t                RawSigBusMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void RawSigBusHandler(int Sig, siginfo_t *pInfo, void *pContext)
+{
+  (void)Sig; (void)pInfo; (void)pContext;
+
+  if (RawSigBusArmed)
+  {
+    RawSigBusArmed = 0;
+    siglongjmp (RawSigBusJmpBuf, 1);
+  }
+  // Restore the previous handler, it gets the signal when the faulting
+  // instruction is executed again
+  sigaction (SIGBUS, &RawSigBusOldAction, NULL);
+}
+
+static int RawSigBusInstall(void)
+{
+  struct sigaction Action;
+  int              ret = RAW_OK;
 
-  if (fread (pBuffer, *pCount, 1, pPiece->pFile) != 1)
+  pthread_mutex_lock (&RawSigBusMutex);
+  if (RawSigBusUsers == 0)
   {
-    return RAW_CANNOT_READ_DATA;
+    memset (&Action, 0, sizeof(Action));
+    Action.sa_sigaction = RawSigBusHandler;
+    Action.sa_flags     = SA_SIGINFO;
+    sigemptyset (&Action.sa_mask);
+    if (sigaction (SIGBUS, &Action, &RawSigBusOldAction) != 0) ret = RAW_MMAP_FAILED;
   }
+  if (ret == RAW_OK) RawSigBusUsers++;
+  pthread_mutex_unlock (&RawSigBusMutex);
 
+  return ret;
+}
+
+static void RawSigBusRemove(void)
+{
+  pthread_mutex_lock (&RawSigBusMutex);
+  if (--RawSigBusUsers == 0) sigaction (SIGBUS, &RawSigBusOldAction, NULL);
+  pthread_mutex_unlock (&RawSigBusMutex);
+}
+
+static int RawCopyMapped(char *pDst, const char *pSrc, uint64_t Count)
+{
+  if (sigsetjmp (RawSigBusJmpBuf, 1) != 0) return RAW_CANNOT_READ_DATA;
+  RawSigBusArmed = 1;
+  memcpy (pDst, pSrc, Count);
+  RawSigBusArmed = 0;
   return RAW_OK;
 }
 
-static int RawWrite0(t_praw praw, const char *pBuffer, uint64_t Seek, uint32_t *pCount)
+// RawTrackAccess classifies the accesses to a piece. A read starting where the
+// previous one ended (or shortly behind, as concurrent readers may overtake
+// each other) is sequential, any other one random. The pattern changes after
+// RAW_PATTERN_THRESHOLD reads of the same kind in a row. Returns 1 if the
+// pattern changed. Must be called with the mutex locked.
+static int RawTrackAccess(t_pPiece pPiece, uint64_t Seek, uint64_t Count)
 {
-  t_pPiece pPiece;
-  uint64_t  i;
+  int OldPattern = pPiece->Pattern;
 
-  // Find correct piece to write to
-  // -------------------------------
+  if ((Seek >= pPiece->NextSeek) && (Seek - pPiece->NextSeek <= RAW_PATTERN_SEQ_GAP))
+  {
+    pPiece->SeqRun++;
+    pPiece->RandomRun = 0;
+    if (pPiece->SeqRun >= RAW_PATTERN_THRESHOLD) pPiece->Pattern = RAW_PATTERN_SEQUENTIAL;
+  }
+  else
+  {
+    pPiece->RandomRun++;
+    pPiece->SeqRun = 0;
+    if (pPiece->RandomRun >= RAW_PATTERN_THRESHOLD) pPiece->Pattern = RAW_PATTERN_RANDOM;
+  }
+  pPiece->NextSeek = Seek + Count;
+
+  return pPiece->Pattern != OldPattern;
+}
 
-  for (i=0; i<praw->Pieces; i++)
+// RawMapWindow makes sure the mapped window of the piece contains Seek, if
+// possible. The window only is moved if no other thread uses the piece. The
+// kernel is told about the access pattern with madvise. Returns the address
+// of Seek in the window or NULL, in which case the caller must use pread.
+// The mutex only is held while looking at the piece; mmap, munmap and madvise
+// are called without it. This is safe as long as the caller uses the piece:
+// nobody else moves the window then, and the piece isn't closed.
+static char *RawMapWindow(t_praw praw, t_pPiece pPiece, int File, uint64_t Seek, uint64_t *pCount)
+{
+  uint64_t Start;
+  uint64_t End;
+  int      Changed;
+  int      Advice;
+  char    *pOldMap       = NULL;
+  uint64_t OldMapLen     = 0;
+  char    *pWindow;
+  uint64_t WindowLen;
+  uint64_t WillNeedStart = 0;
+  uint64_t WillNeedEnd   = 0;
+  void    *pMap;
+  char    *pSrc;
+
+  pthread_mutex_lock (&praw->Mutex);
+  Changed = RawTrackAccess (pPiece, Seek, *pCount);
+  if ((pPiece->pMap == NULL) || (Seek < pPiece->MapOffset) || (Seek >= pPiece->MapOffset + pPiece->MapLen))
   {
-    pPiece = &praw->pPieceArr[i];
-    if (Seek < pPiece->FileSize) break;
-    Seek -= pPiece->FileSize;
+    if (pPiece->Users > 1)  // Others might still be copying from the current window
+    {
+      praw->MmapFallbacks++;
+      pthread_mutex_unlock (&praw->Mutex);
+      return NULL;
+    }
+    // Detach the window while replacing it, other threads use pread meanwhile
+    pOldMap           = pPiece->pMap;
+    OldMapLen         = pPiece->MapLen;
+    pPiece->pMap      = NULL;
+    pPiece->MapOffset = 0;
+    pPiece->MapLen    = 0;
+    pthread_mutex_unlock (&praw->Mutex);
+
+    if (pOldMap) munmap (pOldMap, OldMapLen);
+    Start = Seek - (Seek % RAW_MMAP_WINDOW_SIZE);
+    End   = GETMIN (Start + RAW_MMAP_WINDOW_SIZE, pPiece->FileSize);
+    pMap  = mmap (NULL, End - Start, PROT_READ, MAP_SHARED, File, Start);
+
+    pthread_mutex_lock (&praw->Mutex);
+    if (pMap == MAP_FAILED)
+    {
+      praw->MmapFallbacks++;
+      pthread_mutex_unlock (&praw->Mutex);
+      return NULL;
+    }
+    pPiece->pMap        = (char *) pMap;
+    pPiece->MapOffset   = Start;
+    pPiece->MapLen      = End - Start;
+    pPiece->WillNeedEnd = 0;
+    Changed = 1;
   }
-  if (i >= praw->Pieces) return RAW_READ_BEYOND_END_OF_IMAGE;
 
-  // Read from this piece
-  // --------------------
-  CHK (RawSetCurrentSeekPos (pPiece, Seek, SEEK_SET))
+  if      (pPiece->Pattern == RAW_PATTERN_SEQUENTIAL) Advice = MADV_SEQUENTIAL;
+  else if (pPiece->Pattern == RAW_PATTERN_RANDOM    ) Advice = MADV_RANDOM;
+  else                                                Advice = MADV_NORMAL;
+  pWindow   = pPiece->pMap;
+  WindowLen = pPiece->MapLen;
+
+  *pCount = GETMIN (*pCount, pPiece->MapOffset + pPiece->MapLen - Seek);
+
+  // Announce the data following a sequential read
+  if ((pPiece->Pattern == RAW_PATTERN_SEQUENTIAL) &&
+      (Seek + *pCount + RAW_MMAP_READAHEAD/2 > pPiece->WillNeedEnd))
+  {
+    Start = Seek + *pCount - pPiece->MapOffset;
+    Start = GETMAX (Start, pPiece->WillNeedEnd > pPiece->MapOffset ? pPiece->WillNeedEnd - pPiece->MapOffset : 0);
+    Start = Start - (Start % RAW_DIRECT_ALIGN);
+    End   = GETMIN (Start + RAW_MMAP_READAHEAD, pPiece->MapLen);
+    WillNeedStart = Start;
+    WillNeedEnd   = End;
+    pPiece->WillNeedEnd = pPiece->MapOffset + End;
+  }
+
+  pSrc = pPiece->pMap + (Seek - pPiece->MapOffset);
+  praw->MmapReads++;
+  pthread_mutex_unlock (&praw->Mutex);
+
+  // MADV_WILLNEED may block while the kernel queues the reads
+  if (Changed) (void)madvise (pWindow, WindowLen, Advice);
+  if (WillNeedStart < WillNeedEnd)
+    (void)madvise (pWindow + WillNeedStart, WillNeedEnd - WillNeedStart, MADV_WILLNEED);
+
+  return pSrc;
+}
+
+// RawReadMmap copies as much data as possible from the mapped window of the
+// piece, *pCount is reduced if the window ends before.
+static int RawReadMmap(t_praw praw, t_pPiece pPiece, int File, char *pBuffer, uint64_t Seek, uint64_t *pCount, int *pErrno)
+{
+  char *pSrc;
+  int   ret;
+
+  pSrc = RawMapWindow (praw, pPiece, File, Seek, pCount);
+  if (pSrc == NULL) return RawPread (File, pBuffer, Seek, *pCount, pErrno);
+
+  ret = RawCopyMapped (pBuffer, pSrc, *pCount);
+  if (ret != RAW_OK)
+  {
+    *pErrno = EIO;
+    pthread_mutex_lock (&praw->Mutex);
+    praw->MmapSigBus++;
+    pthread_mutex_unlock (&praw->Mutex);
+  }
+  return ret;
+}
+
+// ---------------------------
+//  Page cache hints
+// ---------------------------
+
+// RawAdvise tells the kernel about the access pattern of pread based reads.
+// Sequential streams get POSIX_FADV_SEQUENTIAL and the data ahead of them is
+// announced with POSIX_FADV_WILLNEED; seek-heavy access gets
+// POSIX_FADV_RANDOM, which stops useless readahead. With rawdropbehind, data
+// read by a sequential stream is dropped from the page cache once the stream
+// is RAW_FADV_DROP_DISTANCE ahead, so streaming a huge image doesn't evict
+// everything else.
+static void RawAdvise(t_praw praw, t_pPiece pPiece, int File, uint64_t Seek, uint64_t Count)
+{
+#ifdef POSIX_FADV_WILLNEED
+  int      Changed;
+  int      Advice;
+  uint64_t WillNeedStart = 0;
+  uint64_t WillNeedEnd   = 0;
+  uint64_t DropStart     = 0;
+  uint64_t DropEnd       = 0;
+
+  pthread_mutex_lock (&praw->Mutex);
+  Changed = RawTrackAccess (pPiece, Seek, Count);
+  if      (pPiece->Pattern == RAW_PATTERN_SEQUENTIAL) Advice = POSIX_FADV_SEQUENTIAL;
+  else if (pPiece->Pattern == RAW_PATTERN_RANDOM    ) Advice = POSIX_FADV_RANDOM;
+  else                                                Advice = POSIX_FADV_NORMAL;
+
+  if (pPiece->Pattern == RAW_PATTERN_SEQUENTIAL)
+  {
+    if (Seek + Count + RAW_FADV_READAHEAD/2 > pPiece->WillNeedEnd)
+    {
+      WillNeedStart = GETMAX (Seek + Count, pPiece->WillNeedEnd);
+      WillNeedEnd   = GETMIN (Seek + Count + RAW_FADV_READAHEAD, pPiece->FileSize);
+      if (WillNeedStart < WillNeedEnd)
+      {
+        pPiece->WillNeedEnd = WillNeedEnd;
+        praw->FadvWillNeed++;
+      }
+    }
+    if (praw->DropBehind)
+    {
+      // A read not continuing the stream starts a new one
+      if (pPiece->SeqRun == 0) pPiece->DropEnd = Seek;
+      if (Seek > pPiece->DropEnd + RAW_FADV_DROP_DISTANCE + RAW_FADV_DROP_CHUNK)
+      {
+        DropStart       = pPiece->DropEnd;
+        DropEnd         = Seek - RAW_FADV_DROP_DISTANCE;
+        pPiece->DropEnd = DropEnd;
+        praw->FadvDropped += DropEnd - DropStart;
+      }
+    }
+  }
+  else
+  {
+    pPiece->DropEnd = Seek;
+  }
+  pthread_mutex_unlock (&praw->Mutex);
+
+  // The hints are given without holding the mutex, POSIX_FADV_WILLNEED may
+  // block while the kernel queues the reads
+  if (Changed) (void)posix_fadvise (File, 0, 0, Advice);
+  if (WillNeedStart < WillNeedEnd)
+    (void)posix_fadvise (File, WillNeedStart, WillNeedEnd - WillNeedStart, POSIX_FADV_WILLNEED);
+  if (DropStart < DropEnd)
+    (void)posix_fadvise (File, DropStart, DropEnd - DropStart, POSIX_FADV_DONTNEED);
+#else
+  (void)praw; (void)pPiece; (void)File; (void)Seek; (void)Count;
+#endif
+}
+
+// RawRead0 reads as much data as possible from the piece containing Seek.
+// *pCount is set to the number of bytes read.
+static int RawRead0(t_praw praw, char *pBuffer, uint64_t Seek, uint64_t *pCount, int *pErrno)
+{
+  t_pPiece pPiece;
+  int      File;
+  int      ret;
+
+  if (Seek >= praw->TotalSize) return RAW_READ_BEYOND_END_OF_IMAGE;
 
+  // Find correct piece to read from
+  // -------------------------------
+  pPiece = RawFindPiece (praw, Seek);
+  Seek  -= pPiece->Offset;
   *pCount = GETMIN (*pCount, pPiece->FileSize - Seek);
 
-  if (fwrite(pBuffer, *pCount, 1, pPiece->pFile) != 1)
+  // Read from this piece
+  // --------------------
+  CHK (RawOpenPiece (praw, pPiece, &File))
+  if (praw->Mmap)
+    ret = RawReadMmap    (praw, pPiece, File, pBuffer, Seek, pCount, pErrno);
+  else if (praw->Direct && !pPiece->Buffered)
+    ret = RawPreadDirect (File, pBuffer, Seek, *pCount, pErrno);
+  else
   {
-    return RAW_CANNOT_WRITE_DATA;
+    if (praw->Fadvise) RawAdvise (praw, pPiece, File, Seek, *pCount);
+    ret = RawPread       (File, pBuffer, Seek, *pCount, pErrno);
   }
+  RawReleasePiece (praw, pPiece);
 
-  return RAW_OK;
+  return ret;
+}
+
+static int RawWrite0(t_praw praw, const char *pBuffer, uint64_t Seek, uint64_t *pCount, int *pErrno)
+{
+  t_pPiece pPiece;
+  int      File;
+  int      ret;
+
+  if (Seek >= praw->TotalSize) return RAW_WRITE_BEYOND_END_OF_IMAGE;
+
+  // Find correct piece to write to
+  // -------------------------------
+  pPiece = RawFindPiece (praw, Seek);
+  Seek  -= pPiece->Offset;
+  *pCount = GETMIN (*pCount, pPiece->FileSize - Seek);
+
+  // Write to this piece
+  // -------------------
+  CHK (RawOpenPiece (praw, pPiece, &File))
+  ret = RawPwrite (File, pBuffer, Seek, *pCount, pErrno);
+  RawReleasePiece (praw, pPiece);
+
+  return ret;
 }
 
 // ---------------
@@ -165,6 +680,9 @@ static int RawCreateHandle(void **pp_handle,
   if(p_raw==NULL) return RAW_MEMALLOC_FAILED;
 
   memset(p_raw,0,sizeof(t_raw));
+  p_raw->MaxOpenPieces=RAW_DEFAULT_MAX_OPEN_PIECES;
+  p_raw->Fadvise=1;
+  pthread_mutex_init(&p_raw->Mutex,NULL);
 
   if(strcmp(p_format,"dd")==0) {
     LOG_WARNING("Using '--in dd' is deprecated and will be removed in the next "
@@ -179,6 +697,9 @@ static int RawCreateHandle(void **pp_handle,
  * RawDestroyHandle
  */
 static int RawDestroyHandle(void **pp_handle) {
+  t_praw p_raw=(t_praw)*pp_handle;
+
+  pthread_mutex_destroy(&p_raw->Mutex);
   free(*pp_handle);
   *pp_handle=NULL;
   return RAW_OK;
@@ -193,7 +714,11 @@ static int RawOpen(void *p_handle,
 {
   t_praw praw=(t_praw)p_handle;
   t_pPiece pPiece;
+  int ret;
 
+  if (filename_arr_len == 0) return RAW_FILE_OPEN_FAILED;
+  if (praw->Direct && praw->Writable) return RAW_DIRECT_NOT_WRITABLE;
+  if (praw->Direct && praw->Mmap) return RAW_MMAP_AND_DIRECT;
   praw->Pieces    = filename_arr_len;
   praw->pPieceArr = (t_pPiece) malloc (praw->Pieces * sizeof(t_Piece));
   if (praw->pPieceArr == NULL) return RAW_MEMALLOC_FAILED;
@@ -205,6 +730,7 @@ static int RawOpen(void *p_handle,
   for (uint64_t i=0; i < praw->Pieces; i++) 
   {
     pPiece = &praw->pPieceArr[i];
+    pPiece->File = -1;
     pPiece->pFilename = strdup (pp_filename_arr[i]);
     if (pPiece->pFilename == NULL)
     {
@@ -212,20 +738,27 @@ static int RawOpen(void *p_handle,
       return RAW_MEMALLOC_FAILED;
     }
 
-    if (praw->Writable) {
-      pPiece->pFile = fopen (pPiece->pFilename, "r+");
-    } else {
-      pPiece->pFile = fopen (pPiece->pFilename, "r");
+    // Pieces are opened when they are accessed for the first time
+    ret = RawGetPieceSize (praw, pPiece);
+    if (ret != RAW_OK)
+    {
+      RawClose(p_handle);
+      return ret;
     }
+    pPiece->Offset    = praw->TotalSize;
+    praw->TotalSize  += pPiece->FileSize;
+  }
+  if (praw->MaxOpenPieces == 0) praw->MaxOpenPieces = 1;
 
-    if (pPiece->pFile == NULL)
+  if (praw->Mmap)
+  {
+    ret = RawSigBusInstall ();
+    if (ret != RAW_OK)
     {
       RawClose(p_handle);
-      return RAW_FILE_OPEN_FAILED;
+      return ret;
     }
-    CHK(RawSetCurrentSeekPos(pPiece, 0, SEEK_END))
-    pPiece->FileSize = RawGetCurrentSeekPos (pPiece);
-    praw->TotalSize  += pPiece->FileSize;
+    praw->SigBusHandler = 1;
   }
 
   return RAW_OK;
@@ -244,12 +777,20 @@ static int RawClose(void *p_handle) {
     for (uint64_t i=0; i < praw->Pieces; i++)
     {
       pPiece = &praw->pPieceArr[i];
-      if (pPiece->pFile) {
-        if (fclose (pPiece->pFile)) CloseErrors=1;
+      RawUnmapPiece (pPiece);
+      if (pPiece->File >= 0) {
+        if (close (pPiece->File)) CloseErrors=1;
       }
       if (pPiece->pFilename) free (pPiece->pFilename);
     }
     free (praw->pPieceArr);
+    praw->pPieceArr = NULL;
+  }
+  praw->OpenPieces = 0;
+  if (praw->SigBusHandler)
+  {
+    RawSigBusRemove ();
+    praw->SigBusHandler = 0;
   }
 
   if (CloseErrors) return RAW_CANNOT_CLOSE_FILE;
@@ -278,22 +819,24 @@ static int RawRead(void *p_handle,
                    int *p_errno)
 {
   t_praw p_raw_handle=(t_praw)p_handle;
-  uint32_t remaining=count;
-  uint32_t to_read;
+  uint64_t remaining=count;
+  uint64_t to_read;
 
-  if((seek+count)>p_raw_handle->TotalSize) {
+  *p_read=0;
+  *p_errno=0;
+  if(seek<0 || ((uint64_t)seek+count)>p_raw_handle->TotalSize) {
     return RAW_READ_BEYOND_END_OF_IMAGE;
   }
 
-  do {
+  while(remaining) {
     to_read=remaining;
-    CHK(RawRead0(p_raw_handle,p_buf,seek,&to_read))
+    CHK(RawRead0(p_raw_handle,p_buf,seek,&to_read,p_errno))
     remaining-=to_read;
     p_buf+=to_read;
     seek+=to_read;
-  } while(remaining);
+    *p_read+=to_read;
+  }
 
-  *p_read=count;
   return RAW_OK;
 }
 
@@ -308,22 +851,24 @@ static int RawWrite(void *p_handle,
                     int *p_errno)
 {
   t_praw p_raw_handle=(t_praw)p_handle;
-  uint32_t remaining=count;
-  uint32_t to_write;
+  uint64_t remaining=count;
+  uint64_t to_write;
 
-  if((seek+count)>p_raw_handle->TotalSize) {
+  *p_written=0;
+  *p_errno=0;
+  if(seek<0 || ((uint64_t)seek+count)>p_raw_handle->TotalSize) {
     return RAW_WRITE_BEYOND_END_OF_IMAGE;
   }
 
-  do {
+  while(remaining) {
     to_write=remaining;
-    CHK(RawWrite0(p_raw_handle,p_buf,seek,&to_write))
+    CHK(RawWrite0(p_raw_handle,p_buf,seek,&to_write,p_errno))
     remaining-=to_write;
     p_buf+=to_write;
     seek+=to_write;
-  } while(remaining);
+    *p_written+=to_write;
+  }
 
-  *p_written=count;
   return RAW_OK;
 }
 /*
@@ -334,8 +879,24 @@ static int RawOptionsHelp(const char **pp_help) {
   int wr;
 
   wr = asprintf(&pHelp, "    %-12s : Specifies if write operations are to be allowed on "
-                        "the source image. Default: %s\n",
-                        RAW_OPTION_WRITABLE, RAW_OPTION_DEFAULT_WRITABLE);
+                        "the source image. Default: %s\n"
+                        "    %-12s : Max. number of image pieces kept open at the same "
+                        "time. Default: %d\n"
+                        "    %-12s : Read with O_DIRECT, bypassing the page cache. Can't "
+                        "be combined with %s. Default: %s\n"
+                        "    %-12s : Read by copying from memory mapped windows of the "
+                        "pieces. Default: %s\n"
+                        "    %-12s : Tell the kernel about sequential / random access "
+                        "and read ahead on sequential access. Default: %s\n"
+                        "    %-12s : Drop data read sequentially from the page cache, "
+                        "useful when streaming huge images. Default: %s\n",
+                        RAW_OPTION_WRITABLE, RAW_OPTION_DEFAULT_WRITABLE,
+                        RAW_OPTION_MAXOPEN, RAW_DEFAULT_MAX_OPEN_PIECES,
+                        RAW_OPTION_DIRECT, RAW_OPTION_WRITABLE,
+                        RAW_OPTION_DEFAULT_DIRECT,
+                        RAW_OPTION_MMAP, RAW_OPTION_DEFAULT_MMAP,
+                        RAW_OPTION_FADVISE, RAW_OPTION_DEFAULT_FADVISE,
+                        RAW_OPTION_DROPBEHIND, RAW_OPTION_DEFAULT_DROPBEHIND);
 
   if ((pHelp == NULL) || (wr<=0))
      return RAW_MEMALLOC_FAILED;
@@ -344,6 +905,27 @@ static int RawOptionsHelp(const char **pp_help) {
   return RAW_OK;
 }
 
+/*
+ * RawParseBool
+ */
+static int RawParseBool(const char *p_value, char *p_bool) {
+  char *pValue = (char *)calloc(strlen(p_value)+1, sizeof(char));
+  if (!pValue) {
+    return RAW_MEMALLOC_FAILED;
+  }
+  for (size_t l = 0; l < strlen(p_value); ++l) {
+    pValue[l] = tolower(p_value[l]);
+  }
+
+  if (strcmp(pValue, "true") == 0 || strcmp(pValue, "1") == 0) {
+    *p_bool = 1;
+  } else {
+    *p_bool = 0;
+  }
+  free(pValue);
+  return RAW_OK;
+}
+
 /*
  * RawOptionsParse
  */
@@ -354,23 +936,42 @@ static int RawOptionsParse(void *p_handle,
 {
   t_praw p_raw_handle=(t_praw)p_handle;
 
+  *pp_error=NULL;
   for (uint32_t i = 0; i < options_count; ++i) {
     pts_LibXmountOptions pOption = pp_options[i];
 
     if (strcmp(pOption->p_key, RAW_OPTION_WRITABLE) == 0) {
-      char *pValue = (char *)calloc(strlen(pOption->p_value)+1, sizeof(char));
-      if (!pValue) {
-        return RAW_MEMALLOC_FAILED;
+      CHK(RawParseBool(pOption->p_value, &p_raw_handle->Writable))
+      pOption->valid = 1;
+    } else if (strcmp(pOption->p_key, RAW_OPTION_DIRECT) == 0) {
+      CHK(RawParseBool(pOption->p_value, &p_raw_handle->Direct))
+#ifndef O_DIRECT
+      if (p_raw_handle->Direct) {
+        LOG_WARNING("O_DIRECT isn't supported on this system, option '%s' is "
+                      "ignored.\n", RAW_OPTION_DIRECT);
+        p_raw_handle->Direct = 0;
       }
-      for (size_t l = 0; l < strlen(pOption->p_value); ++l) {
-        pValue[l] = tolower(pOption->p_value[l]);
-      }
-
-      if (strcmp(pValue, "true") == 0 || strcmp(pValue, "1") == 0) {
-        p_raw_handle->Writable = 1;
-      } else {
-        p_raw_handle->Writable = 0;
+#endif
+      pOption->valid = 1;
+    } else if (strcmp(pOption->p_key, RAW_OPTION_MMAP) == 0) {
+      CHK(RawParseBool(pOption->p_value, &p_raw_handle->Mmap))
+      pOption->valid = 1;
+    } else if (strcmp(pOption->p_key, RAW_OPTION_FADVISE) == 0) {
+      CHK(RawParseBool(pOption->p_value, &p_raw_handle->Fadvise))
+      pOption->valid = 1;
+    } else if (strcmp(pOption->p_key, RAW_OPTION_DROPBEHIND) == 0) {
+      CHK(RawParseBool(pOption->p_value, &p_raw_handle->DropBehind))
+      pOption->valid = 1;
+    } else if (strcmp(pOption->p_key, RAW_OPTION_MAXOPEN) == 0) {
+      int ok;
+      uint64_t value = StrToUint64(pOption->p_value, &ok);
+      if (!ok || value == 0) {
+        *pp_error = strdup("Error in option " RAW_OPTION_MAXOPEN
+                           ": Invalid value");
+        return RAW_INVALID_OPTION_VALUE;
       }
+      p_raw_handle->MaxOpenPieces = value;
+      pOption->valid = 1;
     }
   }
   return RAW_OK;
@@ -384,13 +985,34 @@ static int RawGetInfofileContent(void *p_handle, const char **pp_info_buf) {
   int ret;
   char *p_info_buf;
 
+  pthread_mutex_lock(&p_raw_handle->Mutex);
   ret=asprintf(&p_info_buf,
                "RAW image assembled of %" PRIu64 " piece(s)\n"
-                 "%" PRIu64 " bytes in total (%0.3f GiB)\n",
+                 "%" PRIu64 " bytes in total (%0.3f GiB)\n"
+                 "%" PRIu64 " piece(s) open (max. %" PRIu64 "), "
+                 "%" PRIu64 " opened and %" PRIu64 " closed so far\n"
+                 "Direct I/O: %s\n"
+                 "Memory mapped: %s, %" PRIu64 " reads from mappings, %" PRIu64
+                   " with pread, %" PRIu64 " failed on truncated pieces\n"
+                 "Page cache hints: %s, %" PRIu64 " readahead hints, %" PRIu64
+                   " bytes dropped behind sequential reads\n",
                p_raw_handle->Pieces,
                p_raw_handle->TotalSize,
-               p_raw_handle->TotalSize/(1024.0*1024.0*1024.0));
-  if(ret<0 || *pp_info_buf==NULL) return RAW_MEMALLOC_FAILED;
+               p_raw_handle->TotalSize/(1024.0*1024.0*1024.0),
+               p_raw_handle->OpenPieces,
+               p_raw_handle->MaxOpenPieces,
+               p_raw_handle->PieceOpens,
+               p_raw_handle->PieceCloses,
+               p_raw_handle->Direct ? "on" : "off",
+               p_raw_handle->Mmap ? "on" : "off",
+               p_raw_handle->MmapReads,
+               p_raw_handle->MmapFallbacks,
+               p_raw_handle->MmapSigBus,
+               p_raw_handle->Fadvise ? (p_raw_handle->DropBehind ? "on, drop behind" : "on") : "off",
+               p_raw_handle->FadvWillNeed,
+               p_raw_handle->FadvDropped);
+  pthread_mutex_unlock(&p_raw_handle->Mutex);
+  if(ret<0 || p_info_buf==NULL) return RAW_MEMALLOC_FAILED;
 
   *pp_info_buf=p_info_buf;
   return RAW_OK;
@@ -425,6 +1047,18 @@ static const char* RawGetErrorMessage(int err_num) {
     case RAW_WRITE_BEYOND_END_OF_IMAGE:
       return "Unable to write raw data: Attempt to write past EOF";
       break;
+    case RAW_INVALID_OPTION_VALUE:
+      return "Invalid option value";
+      break;
+    case RAW_DIRECT_NOT_WRITABLE:
+      return "Direct I/O can't be used for writable images";
+      break;
+    case RAW_MMAP_AND_DIRECT:
+      return "Memory mapping and direct I/O can't be used at the same time";
+      break;
+    case RAW_MMAP_FAILED:
+      return "Unable to set up memory mapped reading";
+      break;
     default:
       return "Unknown error";
   }
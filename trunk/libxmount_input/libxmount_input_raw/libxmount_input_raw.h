@@ -33,6 +33,10 @@ enum {
   RAW_CANNOT_SEEK,
   RAW_READ_BEYOND_END_OF_IMAGE,
   RAW_WRITE_BEYOND_END_OF_IMAGE,
+  RAW_INVALID_OPTION_VALUE,
+  RAW_DIRECT_NOT_WRITABLE,
+  RAW_MMAP_AND_DIRECT,
+  RAW_MMAP_FAILED,
 };
 
 // ----------------------
@@ -42,6 +46,26 @@ enum {
 #define GETMAX(a,b) ((a)>(b)?(a):(b))
 #define GETMIN(a,b) ((a)<(b)?(a):(b))
 
+#define RAW_DEFAULT_MAX_OPEN_PIECES 64  // Max. number of pieces kept open at the same time
+#define RAW_MAX_IO_SIZE     (1024*1024*1024)  // Max. size of a single pread/pwrite call
+#define RAW_DIRECT_ALIGN    4096              // Alignment of offsets, lengths and buffers for O_DIRECT
+#define RAW_DIRECT_BUFF_SIZE (4*1024*1024)    // Max. size of the bounce buffer for O_DIRECT
+#define RAW_DIRECT_ROUNDUP(x) ((((x)+RAW_DIRECT_ALIGN-1)/RAW_DIRECT_ALIGN)*RAW_DIRECT_ALIGN)
+#define RAW_MMAP_WINDOW_SIZE ((uint64_t)(sizeof(void*) >= 8 ? 1024*1024*1024 : 64*1024*1024)) // Max. size of a piece's mapping
+#define RAW_MMAP_READAHEAD  (8*1024*1024)     // Range announced with MADV_WILLNEED on sequential reads
+#define RAW_PATTERN_THRESHOLD 4               // Number of reads needed to recognise an access pattern
+#define RAW_PATTERN_SEQ_GAP (128*1024)        // Reads starting that close behind the previous one still are sequential
+#define RAW_FADV_READAHEAD  (16*1024*1024)    // Range announced with POSIX_FADV_WILLNEED on sequential reads
+#define RAW_FADV_DROP_DISTANCE (32*1024*1024) // With rawdropbehind, data that far behind a sequential stream is dropped from the page cache
+#define RAW_FADV_DROP_CHUNK (8*1024*1024)     // Min. size of the ranges dropped at once
+
+// Access patterns
+enum {
+  RAW_PATTERN_UNKNOWN=0,
+  RAW_PATTERN_SEQUENTIAL,
+  RAW_PATTERN_RANDOM
+};
+
 // ---------------------
 //  Types and strutures
 // ---------------------
@@ -49,14 +73,45 @@ enum {
 typedef struct {
   char     *pFilename;
   uint64_t   FileSize;
-  FILE     *pFile;
+  uint64_t   Offset;        // Offset of the piece in the image (sum of all previous FileSizes)
+  int        File;          // -1 as long as the piece isn't open
+  uint64_t   Users;         // Number of reads / writes currently using File
+  uint64_t   LastUsed;
+  char       Buffered;      // Set if O_DIRECT was requested but isn't supported for this piece
+  char      *pMap;          // Window mapped with rawmmap, NULL if none
+  uint64_t   MapOffset;
+  uint64_t   MapLen;
+  uint64_t   WillNeedEnd;   // End of the range announced with MADV_WILLNEED / POSIX_FADV_WILLNEED
+  uint64_t   DropEnd;       // End of the range dropped from the page cache with rawdropbehind
+  uint64_t   NextSeek;      // Access pattern tracking, see RawTrackAccess
+  uint64_t   SeqRun;
+  uint64_t   RandomRun;
+  int        Pattern;
 } t_Piece, *t_pPiece;
 
+// All reads and writes may be called concurrently. The mutex protects the
+// open pieces and the statistics.
 typedef struct {
   t_pPiece  pPieceArr;
   uint64_t   Pieces;
   uint64_t   TotalSize;
   char       Writable;
+  char       Direct;
+  char       Mmap;
+  char       SigBusHandler; // Set if the SIGBUS handler has been installed for this handle
+  char       Fadvise;
+  char       DropBehind;
+  uint64_t   MaxOpenPieces;
+  uint64_t   OpenPieces;
+  uint64_t   UseCounter;
+  uint64_t   PieceOpens;    // Statistics
+  uint64_t   PieceCloses;
+  uint64_t   MmapReads;
+  uint64_t   MmapFallbacks; // Reads done with pread as the window was in use by another thread
+  uint64_t   MmapSigBus;    // Reads failed because a mapped piece has been truncated
+  uint64_t   FadvWillNeed;  // Number of POSIX_FADV_WILLNEED hints given
+  uint64_t   FadvDropped;   // Bytes dropped from the page cache with POSIX_FADV_DONTNEED
+  pthread_mutex_t Mutex;
 } t_raw, *t_praw;
 
 // ----------------
@@ -0,0 +1,679 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../libxmount_input.h"
+#include "libxmount_input_synthetic.h"
+
+#define SYNTH_OPTION_SIZE "synthsize"
+#define SYNTH_OPTION_PATTERN "synthpattern"
+#define SYNTH_OPTION_SEED "synthseed"
+#define SYNTH_OPTION_BLOCK_SIZE "synthblock"
+#define SYNTH_OPTION_REPEAT "synthrepeat"
+#define SYNTH_OPTION_LATENCY "synthlatency"
+#define SYNTH_OPTION_SEEK_TIME "synthseek"
+#define SYNTH_OPTION_BANDWIDTH "synthbw"
+
+//! Names of the data patterns, in the order of the SYNTH_PATTERN_* values
+static const char *synth_pattern_names[]={
+  "zeros","random","text","repeat",NULL
+};
+
+//! Words the text pattern is made of, zero padded so they can be copied with a
+//! fixed size
+static const char synth_words[][SYNTH_MAX_WORD_SIZE]={
+  "the","of","and","a","to","in","is","you","that","it","he","was","for",
+  "on","are","as","with","his","they","at","be","this","have","from","or",
+  "one","had","by","word","but","not","what","all","were","we","when","your",
+  "can","said","there","use","an","each","which","she","do","how","their",
+  "if","will","up","other","about","out","many","then","them","these","so",
+  "some","her","would","make","like","him","into","time","has","look","two",
+  "more","write","go","see","number","no","way","could","people","my","than",
+  "first","water","been","call","who","oil","its","now","find","long","down",
+  "day","did","get","come","made","may","part","image","evidence","file",
+  "disk","sector","partition","volume","cluster","offset","block","mount"
+};
+#define SYNTH_WORDS_COUNT (sizeof(synth_words)/sizeof(synth_words[0]))
+//! Lengths of the above words, set up once by SynthInitWords
+static uint8_t synth_word_lengths[SYNTH_WORDS_COUNT];
+static pthread_once_t synth_words_once=PTHREAD_ONCE_INIT;
+
+/*******************************************************************************
+ * LibXmount_Input API implementation
+ ******************************************************************************/
+/*
+ * LibXmount_Input_GetApiVersion
+ */
+uint8_t LibXmount_Input_GetApiVersion() {
+  return LIBXMOUNT_INPUT_API_VERSION;
+}
+
+/*
+ * LibXmount_Input_GetSupportedFormats
+ */
+const char* LibXmount_Input_GetSupportedFormats() {
+  return "synthetic\0\0";
+}
+
+/*
+ * LibXmount_Input_GetFunctions
+ */
+void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
+  p_functions->CreateHandle=&SynthCreateHandle;
+  p_functions->DestroyHandle=&SynthDestroyHandle;
+  p_functions->Open=&SynthOpen;
+  p_functions->Size=&SynthSize;
+  p_functions->Read=&SynthRead;
+  p_functions->Write=&SynthWrite;
+  p_functions->Close=&SynthClose;
+  p_functions->OptionsHelp=&SynthOptionsHelp;
+  p_functions->OptionsParse=&SynthOptionsParse;
+  p_functions->GetInfofileContent=&SynthGetInfofileContent;
+  p_functions->GetErrorMessage=&SynthGetErrorMessage;
+  p_functions->FreeBuffer=&SynthFreeBuffer;
+}
+
+/*******************************************************************************
+ * Private
+ ******************************************************************************/
+/*
+ * SynthMix
+ *
+ * splitmix64 finalizer, used to derive independent generator states from the
+ * seed and a block number.
+ */
+static inline uint64_t SynthMix(uint64_t x) {
+  x=(x^(x>>30))*0xbf58476d1ce4e5b9ULL;
+  x=(x^(x>>27))*0x94d049bb133111ebULL;
+  return x^(x>>31);
+}
+
+/*
+ * SynthNext
+ *
+ * splitmix64 generator step.
+ */
+static inline uint64_t SynthNext(uint64_t *p_state) {
+  *p_state+=0x9e3779b97f4a7c15ULL;
+  return SynthMix(*p_state);
+}
+
+/*
+ * SynthGenRandom
+ *
+ * Fills a generation block with pseudo random data. The data is stored in
+ * little endian byte order so images are identical on all hosts.
+ */
+static void SynthGenRandom(unsigned char *p_buf,
+                           uint64_t seed,
+                           uint64_t block)
+{
+  uint64_t state=SynthMix(seed^SynthMix(block));
+  uint64_t value;
+
+  for(uint32_t i=0;i<SYNTH_GEN_BLOCK_SIZE;i+=8) {
+    value=SynthNext(&state);
+    for(uint32_t j=0;j<8;j++) p_buf[i+j]=(unsigned char)(value>>(j*8));
+  }
+}
+
+/*
+ * SynthInitWords
+ */
+static void SynthInitWords() {
+  for(uint32_t i=0;i<SYNTH_WORDS_COUNT;i++) {
+    synth_word_lengths[i]=(uint8_t)strlen(synth_words[i]);
+  }
+}
+
+/*
+ * SynthGenText
+ *
+ * Fills a generation block with random words, which compresses about as well
+ * as ordinary text files do. Every 64 bit random value selects 4 words, words
+ * are copied with a fixed size as long as they fit into the block.
+ */
+static void SynthGenText(unsigned char *p_buf, uint64_t seed, uint64_t block) {
+  uint64_t state=SynthMix(~seed^SynthMix(block));
+  uint64_t value;
+  uint32_t word;
+  uint32_t pos=0;
+  uint32_t len;
+
+  while(pos<SYNTH_GEN_BLOCK_SIZE) {
+    value=SynthNext(&state);
+    for(uint32_t i=0;i<4 && pos<SYNTH_GEN_BLOCK_SIZE;i++,value>>=16) {
+      word=(uint32_t)((value&0xfff)%SYNTH_WORDS_COUNT);
+      len=synth_word_lengths[word];
+      if(pos+SYNTH_MAX_WORD_SIZE<=SYNTH_GEN_BLOCK_SIZE) {
+        memcpy(p_buf+pos,synth_words[word],SYNTH_MAX_WORD_SIZE);
+      } else {
+        len=GETMIN(len,SYNTH_GEN_BLOCK_SIZE-pos);
+        memcpy(p_buf+pos,synth_words[word],len);
+      }
+      pos+=len;
+      // Roughly every 16th word ends a line
+      if(pos<SYNTH_GEN_BLOCK_SIZE) {
+        p_buf[pos++]=((value>>12)&0xf)==0 ? '\n' : ' ';
+      }
+    }
+  }
+}
+
+/*
+ * SynthGenBlock
+ *
+ * Generates generation block number block of the image.
+ */
+static void SynthGenBlock(pts_SynthHandle p_synth_handle,
+                          unsigned char *p_buf,
+                          uint64_t block)
+{
+  uint64_t gen_blocks;
+
+  switch(p_synth_handle->pattern) {
+    case SYNTH_PATTERN_RANDOM:
+      SynthGenRandom(p_buf,p_synth_handle->seed,block);
+      break;
+    case SYNTH_PATTERN_TEXT:
+      SynthGenText(p_buf,p_synth_handle->seed,block);
+      break;
+    case SYNTH_PATTERN_REPEAT:
+      // Map the block to the same block of the first repeat blocks
+      gen_blocks=p_synth_handle->block_size/SYNTH_GEN_BLOCK_SIZE;
+      block=((block/gen_blocks)%p_synth_handle->repeat)*gen_blocks+
+            block%gen_blocks;
+      SynthGenRandom(p_buf,p_synth_handle->seed,block);
+      break;
+    default:
+      memset(p_buf,0,SYNTH_GEN_BLOCK_SIZE);
+  }
+}
+
+/*
+ * SynthNow
+ *
+ * Returns the current CLOCK_MONOTONIC time in ns.
+ */
+static uint64_t SynthNow() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (uint64_t)now.tv_sec*1000000000ULL+(uint64_t)now.tv_nsec;
+}
+
+/*
+ * SynthSleepUntil
+ */
+static void SynthSleepUntil(uint64_t deadline) {
+  struct timespec delay;
+  uint64_t now;
+
+  while((now=SynthNow())<deadline) {
+    delay.tv_sec=(deadline-now)/1000000000ULL;
+    delay.tv_nsec=(deadline-now)%1000000000ULL;
+    nanosleep(&delay,NULL);
+  }
+}
+
+/*
+ * SynthThrottle
+ *
+ * Delays a read the way the simulated device would. Seek time and transfer
+ * time occupy the device, so concurrent reads queue up behind each other,
+ * while the latency (e.g. a network round trip) of concurrent reads overlaps.
+ */
+static void SynthThrottle(pts_SynthHandle p_synth_handle,
+                          uint64_t offset,
+                          uint64_t count)
+{
+  uint64_t deadline;
+
+  if(p_synth_handle->latency==0 &&
+     p_synth_handle->seek_time==0 &&
+     p_synth_handle->bandwidth==0)
+  {
+    return;
+  }
+
+  deadline=SynthNow();
+  if(p_synth_handle->seek_time!=0 || p_synth_handle->bandwidth!=0) {
+    pthread_mutex_lock(&(p_synth_handle->mutex));
+    if(p_synth_handle->busy_until>deadline) {
+      deadline=p_synth_handle->busy_until;
+    }
+    if(offset!=p_synth_handle->next_offset) {
+      deadline+=p_synth_handle->seek_time*1000;
+    }
+    if(p_synth_handle->bandwidth!=0) {
+      deadline+=(uint64_t)((double)count*1000000000.0/
+                           (double)p_synth_handle->bandwidth);
+    }
+    p_synth_handle->busy_until=deadline;
+    p_synth_handle->next_offset=offset+count;
+    pthread_mutex_unlock(&(p_synth_handle->mutex));
+  }
+  deadline+=p_synth_handle->latency*1000;
+
+  SynthSleepUntil(deadline);
+}
+
+/*
+ * SynthStrToSize
+ *
+ * Converts a size with an optional K, M, G or T suffix (powers of 1024).
+ */
+static uint64_t SynthStrToSize(const char *p_value, int *p_ok) {
+  char *p_end;
+  uint64_t value;
+  uint32_t shift=0;
+
+  *p_ok=0;
+  if(*p_value<'0' || *p_value>'9') return 0;
+  errno=0;
+  value=strtoull(p_value,&p_end,10);
+  if(errno!=0) return 0;
+  switch(*p_end) {
+    case '\0': break;
+    case 'k': case 'K': shift=10; p_end++; break;
+    case 'm': case 'M': shift=20; p_end++; break;
+    case 'g': case 'G': shift=30; p_end++; break;
+    case 't': case 'T': shift=40; p_end++; break;
+    default: return 0;
+  }
+  if(*p_end!='\0' || value>(UINT64_MAX>>shift)) return 0;
+
+  *p_ok=1;
+  return value<<shift;
+}
+
+/*
+ * SynthCreateHandle
+ */
+static int SynthCreateHandle(void **pp_handle,
+                             const char *p_format,
+                             uint8_t debug)
+{
+  (void)p_format;
+  pts_SynthHandle p_synth_handle;
+
+  // Alloc new lib handle
+  p_synth_handle=(pts_SynthHandle)calloc(1,sizeof(ts_SynthHandle));
+  if(p_synth_handle==NULL) return SYNTH_MEMALLOC_FAILED;
+
+  // Init handle values
+  p_synth_handle->size=SYNTH_DEFAULT_SIZE;
+  p_synth_handle->pattern=SYNTH_PATTERN_RANDOM;
+  p_synth_handle->block_size=SYNTH_DEFAULT_BLOCK_SIZE;
+  p_synth_handle->repeat=SYNTH_DEFAULT_REPEAT;
+  p_synth_handle->debug=debug;
+  pthread_mutex_init(&(p_synth_handle->mutex),NULL);
+  pthread_once(&synth_words_once,SynthInitWords);
+
+  *pp_handle=p_synth_handle;
+  return SYNTH_OK;
+}
+
+/*
+ * SynthDestroyHandle
+ */
+static int SynthDestroyHandle(void **pp_handle) {
+  pts_SynthHandle p_synth_handle=(pts_SynthHandle)*pp_handle;
+
+  if(p_synth_handle!=NULL) {
+    pthread_mutex_destroy(&(p_synth_handle->mutex));
+    free(p_synth_handle->p_name);
+    free(p_synth_handle);
+  }
+
+  *pp_handle=NULL;
+  return SYNTH_OK;
+}
+
+/*
+ * SynthOpen
+ *
+ * The input file name only names the image, nothing is opened.
+ */
+static int SynthOpen(void *p_handle,
+                     const char **pp_filename_arr,
+                     uint64_t filename_arr_len)
+{
+  pts_SynthHandle p_synth_handle=(pts_SynthHandle)p_handle;
+
+  if(filename_arr_len==0) return SYNTH_NO_INPUT_FILES;
+  if(filename_arr_len>1) return SYNTH_TOO_MANY_INPUT_FILES;
+
+  p_synth_handle->p_name=strdup(pp_filename_arr[0]);
+  if(p_synth_handle->p_name==NULL) return SYNTH_MEMALLOC_FAILED;
+  p_synth_handle->busy_until=0;
+  p_synth_handle->next_offset=0;
+
+  LIBXMOUNT_LOG_DEBUG(p_synth_handle->debug,
+                      "Opened synthetic image '%s' (size %" PRIu64
+                        ", pattern %s)\n",
+                      p_synth_handle->p_name,
+                      p_synth_handle->size,
+                      synth_pattern_names[p_synth_handle->pattern]);
+  return SYNTH_OK;
+}
+
+/*
+ * SynthClose
+ */
+static int SynthClose(void *p_handle) {
+  pts_SynthHandle p_synth_handle=(pts_SynthHandle)p_handle;
+
+  free(p_synth_handle->p_name);
+  p_synth_handle->p_name=NULL;
+
+  return SYNTH_OK;
+}
+
+/*
+ * SynthSize
+ */
+static int SynthSize(void *p_handle, uint64_t *p_size) {
+  pts_SynthHandle p_synth_handle=(pts_SynthHandle)p_handle;
+
+  *p_size=p_synth_handle->size;
+  return SYNTH_OK;
+}
+
+/*
+ * SynthRead
+ *
+ * Whole generation blocks are generated directly into the read buffer, only
+ * partial blocks at the start and end of a read go through a bounce buffer.
+ */
+static int SynthRead(void *p_handle,
+                     char *p_buf,
+                     off_t offset,
+                     size_t count,
+                     size_t *p_read,
+                     int *p_errno)
+{
+  pts_SynthHandle p_synth_handle=(pts_SynthHandle)p_handle;
+  unsigned char block_buf[SYNTH_GEN_BLOCK_SIZE];
+  uint64_t pos=(uint64_t)offset;
+  uint64_t remaining=count;
+  uint64_t block_pos;
+  uint64_t len;
+
+  *p_read=0;
+  if(offset<0 ||
+     pos>p_synth_handle->size ||
+     count>p_synth_handle->size-pos)
+  {
+    return SYNTH_READ_BEYOND_END_OF_IMAGE;
+  }
+
+  SynthThrottle(p_synth_handle,pos,count);
+
+  if(p_synth_handle->pattern==SYNTH_PATTERN_ZEROS) {
+    memset(p_buf,0,count);
+    *p_read=count;
+    return SYNTH_OK;
+  }
+
+  while(remaining>0) {
+    block_pos=pos%SYNTH_GEN_BLOCK_SIZE;
+    len=GETMIN(SYNTH_GEN_BLOCK_SIZE-block_pos,remaining);
+    if(len==SYNTH_GEN_BLOCK_SIZE) {
+      SynthGenBlock(p_synth_handle,
+                    (unsigned char*)p_buf,
+                    pos/SYNTH_GEN_BLOCK_SIZE);
+    } else {
+      SynthGenBlock(p_synth_handle,block_buf,pos/SYNTH_GEN_BLOCK_SIZE);
+      memcpy(p_buf,block_buf+block_pos,len);
+    }
+    p_buf+=len;
+    pos+=len;
+    remaining-=len;
+  }
+
+  *p_read=count;
+  return SYNTH_OK;
+}
+
+/*
+ * SynthWrite
+ */
+static int SynthWrite(void *p_handle,
+                      const char *p_buf,
+                      off_t seek,
+                      size_t count,
+                      size_t *p_written,
+                      int *p_errno)
+{
+  return SYNTH_WRITE_FAILED;
+}
+
+/*
+ * SynthOptionsHelp
+ */
+static int SynthOptionsHelp(const char **pp_help) {
+  char *p_help=NULL;
+  int ret;
+
+  ret=asprintf(&p_help,
+               "    %-12s : Image size in bytes, K, M, G or T may be "
+                 "appended. Default: 1G\n"
+               "    %-12s : Image data, one of zeros, random, text "
+                 "(compressible) or repeat (the same blocks over and over "
+                 "again). Default: random\n"
+               "    %-12s : Seed of the generated data. Default: 0\n"
+               "    %-12s : Block size of the repeat pattern, a multiple of "
+                 "4K. Default: 64K\n"
+               "    %-12s : Number of distinct blocks of the repeat pattern. "
+                 "Default: %d\n"
+               "    %-12s : Latency of every read in microseconds. "
+                 "Default: 0\n"
+               "    %-12s : Additional delay of non-sequential reads in "
+                 "microseconds. Default: 0\n"
+               "    %-12s : Max. bandwidth in bytes per second, K, M or G "
+                 "may be appended. Default: unlimited\n",
+               SYNTH_OPTION_SIZE,
+               SYNTH_OPTION_PATTERN,
+               SYNTH_OPTION_SEED,
+               SYNTH_OPTION_BLOCK_SIZE,
+               SYNTH_OPTION_REPEAT,SYNTH_DEFAULT_REPEAT,
+               SYNTH_OPTION_LATENCY,
+               SYNTH_OPTION_SEEK_TIME,
+               SYNTH_OPTION_BANDWIDTH);
+  if(ret<0 || p_help==NULL) return SYNTH_MEMALLOC_FAILED;
+
+  *pp_help=p_help;
+  return SYNTH_OK;
+}
+
+/*
+ * SynthOptionsParse
+ */
+static int SynthOptionsParse(void *p_handle,
+                             uint32_t options_count,
+                             const pts_LibXmountOptions *pp_options,
+                             const char **pp_error)
+{
+  pts_SynthHandle p_synth_handle=(pts_SynthHandle)p_handle;
+  pts_LibXmountOptions p_option;
+  uint64_t value;
+  uint8_t pattern;
+  int ok;
+
+#define SYNTH_OPTION_ERROR(option) {                              \
+  *pp_error=strdup("Error in option " option ": Invalid value");  \
+  return SYNTH_INVALID_OPTION_VALUE;                              \
+}
+
+  *pp_error=NULL;
+  for(uint32_t i=0;i<options_count;i++) {
+    p_option=pp_options[i];
+    if(strcmp(p_option->p_key,SYNTH_OPTION_SIZE)==0) {
+      value=SynthStrToSize(p_option->p_value,&ok);
+      if(!ok || value>INT64_MAX) SYNTH_OPTION_ERROR(SYNTH_OPTION_SIZE);
+      p_synth_handle->size=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SYNTH_OPTION_PATTERN)==0) {
+      for(pattern=0;synth_pattern_names[pattern]!=NULL;pattern++) {
+        if(strcmp(p_option->p_value,synth_pattern_names[pattern])==0) break;
+      }
+      if(synth_pattern_names[pattern]==NULL) {
+        SYNTH_OPTION_ERROR(SYNTH_OPTION_PATTERN);
+      }
+      p_synth_handle->pattern=pattern;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SYNTH_OPTION_SEED)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok) SYNTH_OPTION_ERROR(SYNTH_OPTION_SEED);
+      p_synth_handle->seed=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SYNTH_OPTION_BLOCK_SIZE)==0) {
+      value=SynthStrToSize(p_option->p_value,&ok);
+      if(!ok ||
+         value==0 ||
+         value>SYNTH_MAX_BLOCK_SIZE ||
+         value%SYNTH_GEN_BLOCK_SIZE!=0)
+      {
+        SYNTH_OPTION_ERROR(SYNTH_OPTION_BLOCK_SIZE);
+      }
+      p_synth_handle->block_size=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SYNTH_OPTION_REPEAT)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value==0 || value>UINT32_MAX) {
+        SYNTH_OPTION_ERROR(SYNTH_OPTION_REPEAT);
+      }
+      p_synth_handle->repeat=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SYNTH_OPTION_LATENCY)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>SYNTH_MAX_LATENCY) {
+        SYNTH_OPTION_ERROR(SYNTH_OPTION_LATENCY);
+      }
+      p_synth_handle->latency=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SYNTH_OPTION_SEEK_TIME)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>SYNTH_MAX_LATENCY) {
+        SYNTH_OPTION_ERROR(SYNTH_OPTION_SEEK_TIME);
+      }
+      p_synth_handle->seek_time=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SYNTH_OPTION_BANDWIDTH)==0) {
+      value=SynthStrToSize(p_option->p_value,&ok);
+      if(!ok) SYNTH_OPTION_ERROR(SYNTH_OPTION_BANDWIDTH);
+      p_synth_handle->bandwidth=value;
+      p_option->valid=1;
+    }
+  }
+
+#undef SYNTH_OPTION_ERROR
+
+  return SYNTH_OK;
+}
+
+/*
+ * SynthGetInfofileContent
+ */
+static int SynthGetInfofileContent(void *p_handle, const char **pp_info_buf) {
+  pts_SynthHandle p_synth_handle=(pts_SynthHandle)p_handle;
+  char *p_infobuf=NULL;
+  char *p_bandwidth=NULL;
+  int ret;
+
+  if(p_synth_handle->bandwidth!=0) {
+    ret=asprintf(&p_bandwidth,
+                 "%" PRIu64 " bytes/s",
+                 p_synth_handle->bandwidth);
+  } else {
+    ret=asprintf(&p_bandwidth,"unlimited");
+  }
+  if(ret<0 || p_bandwidth==NULL) return SYNTH_MEMALLOC_FAILED;
+
+  ret=asprintf(&p_infobuf,
+               "Synthetic image\n"
+                 "Size: %" PRIu64 " bytes\n"
+                 "Pattern: %s\n"
+                 "Seed: %" PRIu64 "\n"
+                 "Repeat pattern: %" PRIu64 " blocks of %" PRIu64 " bytes\n"
+                 "Latency: %" PRIu64 " us\n"
+                 "Seek time: %" PRIu64 " us\n"
+                 "Bandwidth: %s\n",
+               p_synth_handle->size,
+               synth_pattern_names[p_synth_handle->pattern],
+               p_synth_handle->seed,
+               p_synth_handle->repeat,
+               p_synth_handle->block_size,
+               p_synth_handle->latency,
+               p_synth_handle->seek_time,
+               p_bandwidth);
+  free(p_bandwidth);
+  if(ret<0 || p_infobuf==NULL) return SYNTH_MEMALLOC_FAILED;
+
+  *pp_info_buf=p_infobuf;
+  return SYNTH_OK;
+}
+
+/*
+ * SynthGetErrorMessage
+ */
+static const char* SynthGetErrorMessage(int err_num) {
+  switch(err_num) {
+    case SYNTH_MEMALLOC_FAILED:
+      return "Unable to allocate memory";
+      break;
+    case SYNTH_NO_INPUT_FILES:
+      return "No image name specified";
+      break;
+    case SYNTH_TOO_MANY_INPUT_FILES:
+      return "Only a single image name may be specified";
+      break;
+    case SYNTH_INVALID_OPTION_VALUE:
+      return "Invalid option value";
+      break;
+    case SYNTH_READ_BEYOND_END_OF_IMAGE:
+      return "Unable to read beyond end of image";
+      break;
+    case SYNTH_WRITE_FAILED:
+      return "Write is not supported in synthetic input module.";
+      break;
+    default:
+      return "Unknown error";
+  }
+}
+
+/*
+ * SynthFreeBuffer
+ */
+static int SynthFreeBuffer(void *p_buf) {
+  free(p_buf);
+  return SYNTH_OK;
+}
+
+/*
+  ----- Change log -----
+  20261019: * Initial version, generating zeros, random, text and repeating
+              data with optional latency, seek time and bandwidth limits.
+*/
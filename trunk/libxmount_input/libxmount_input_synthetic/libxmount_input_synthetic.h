@@ -0,0 +1,126 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#ifndef LIBXMOUNT_INPUT_SYNTHETIC_H
+#define LIBXMOUNT_INPUT_SYNTHETIC_H
+
+/*******************************************************************************
+ * Enums, Typedefs, etc...
+ ******************************************************************************/
+//! Possible error return codes
+enum {
+  SYNTH_OK=0,
+  SYNTH_MEMALLOC_FAILED,
+  SYNTH_NO_INPUT_FILES,
+  SYNTH_TOO_MANY_INPUT_FILES,
+  SYNTH_INVALID_OPTION_VALUE,
+  SYNTH_READ_BEYOND_END_OF_IMAGE,
+  SYNTH_WRITE_FAILED
+};
+
+//! Data patterns
+enum {
+  SYNTH_PATTERN_ZEROS=0,
+  SYNTH_PATTERN_RANDOM,
+  SYNTH_PATTERN_TEXT,
+  SYNTH_PATTERN_REPEAT
+};
+
+#define GETMIN(a,b) ((a)<(b)?(a):(b))
+
+//! Image data is generated in units of this size
+#define SYNTH_GEN_BLOCK_SIZE 4096
+//! Max. length of the words of the text pattern, including the terminator
+#define SYNTH_MAX_WORD_SIZE 16
+//! Default image size
+#define SYNTH_DEFAULT_SIZE (1024ULL*1024*1024)
+//! Default size and number of distinct blocks of the repeat pattern
+#define SYNTH_DEFAULT_BLOCK_SIZE (64*1024)
+#define SYNTH_DEFAULT_REPEAT 16
+//! Max. size of a block of the repeat pattern
+#define SYNTH_MAX_BLOCK_SIZE (1024*1024*1024)
+//! Max. latency / seek time in microseconds (one minute)
+#define SYNTH_MAX_LATENCY 60000000
+
+//! Library handle
+/*!
+ * Image data is a pure function of the options and the offset, so reads never
+ * need any locking. Only the simulated device (seek time and bandwidth) has
+ * state: busy_until is the point in time (CLOCK_MONOTONIC, in ns) at which
+ * the device has finished all reads issued so far, next_offset is the offset
+ * following the last read. Both are protected by mutex.
+ */
+typedef struct s_SynthHandle {
+  //! Name of the image, given as the input file name
+  char *p_name;
+  //! Image size
+  uint64_t size;
+  //! Data pattern and seed of the pseudo random data
+  uint8_t pattern;
+  uint64_t seed;
+  //! Block size and number of distinct blocks of the repeat pattern
+  uint64_t block_size;
+  uint64_t repeat;
+  //! Latency of every read and seek time of non-sequential reads in us
+  uint64_t latency;
+  uint64_t seek_time;
+  //! Bandwidth in bytes per second, 0 for unlimited
+  uint64_t bandwidth;
+  //! Simulated device state
+  pthread_mutex_t mutex;
+  uint64_t busy_until;
+  uint64_t next_offset;
+  //! Debug settings
+  uint8_t debug;
+} ts_SynthHandle, *pts_SynthHandle;
+
+/*******************************************************************************
+ * Forward declarations
+ ******************************************************************************/
+static int SynthCreateHandle(void **pp_handle,
+                             const char *p_format,
+                             uint8_t debug);
+static int SynthDestroyHandle(void **pp_handle);
+static int SynthOpen(void *p_handle,
+                     const char **pp_filename_arr,
+                     uint64_t filename_arr_len);
+static int SynthClose(void *p_handle);
+static int SynthSize(void *p_handle,
+                     uint64_t *p_size);
+static int SynthRead(void *p_handle,
+                     char *p_buf,
+                     off_t seek,
+                     size_t count,
+                     size_t *p_read,
+                     int *p_errno);
+static int SynthWrite(void *p_handle,
+                      const char *p_buf,
+                      off_t seek,
+                      size_t count,
+                      size_t *p_written,
+                      int *p_errno);
+static int SynthOptionsHelp(const char **pp_help);
+static int SynthOptionsParse(void *p_handle,
+                             uint32_t options_count,
+                             const pts_LibXmountOptions *pp_options,
+                             const char **pp_error);
+static int SynthGetInfofileContent(void *p_handle,
+                                   const char **pp_info_buf);
+static const char* SynthGetErrorMessage(int err_num);
+static int SynthFreeBuffer(void *p_buf);
+
+#endif // LIBXMOUNT_INPUT_SYNTHETIC_H
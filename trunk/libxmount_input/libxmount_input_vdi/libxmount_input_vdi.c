@@ -0,0 +1,490 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "../libxmount_input.h"
+#include "libxmount_input_vdi.h"
+
+/*******************************************************************************
+ * LibXmount_Input API implementation
+ ******************************************************************************/
+/*
+ * LibXmount_Input_GetApiVersion
+ */
+uint8_t LibXmount_Input_GetApiVersion() {
+  return LIBXMOUNT_INPUT_API_VERSION;
+}
+
+/*
+ * LibXmount_Input_GetSupportedFormats
+ */
+const char* LibXmount_Input_GetSupportedFormats() {
+  return "vdi\0\0";
+}
+
+/*
+ * LibXmount_Input_GetFunctions
+ */
+void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
+  p_functions->CreateHandle=&VdiCreateHandle;
+  p_functions->DestroyHandle=&VdiDestroyHandle;
+  p_functions->Open=&VdiOpen;
+  p_functions->Size=&VdiSize;
+  p_functions->Read=&VdiRead;
+  p_functions->Write=&VdiWrite;
+  p_functions->Close=&VdiClose;
+  p_functions->OptionsHelp=&VdiOptionsHelp;
+  p_functions->OptionsParse=&VdiOptionsParse;
+  p_functions->GetInfofileContent=&VdiGetInfofileContent;
+  p_functions->GetErrorMessage=&VdiGetErrorMessage;
+  p_functions->FreeBuffer=&VdiFreeBuffer;
+}
+
+/*******************************************************************************
+ * Private
+ ******************************************************************************/
+/*
+ * VdiLe32
+ */
+static uint32_t VdiLe32(const unsigned char *p_buf) {
+  return (uint32_t)p_buf[0] | ((uint32_t)p_buf[1]<<8) |
+         ((uint32_t)p_buf[2]<<16) | ((uint32_t)p_buf[3]<<24);
+}
+
+/*
+ * VdiLe64
+ */
+static uint64_t VdiLe64(const unsigned char *p_buf) {
+  return (uint64_t)VdiLe32(p_buf) | ((uint64_t)VdiLe32(p_buf+4)<<32);
+}
+
+/*
+ * VdiPread
+ *
+ * Reads exactly count bytes at offset. Hitting the end of the file is an
+ * error, as the image is truncated then.
+ */
+static int VdiPread(int fd,
+                    char *p_buf,
+                    uint64_t offset,
+                    uint64_t count,
+                    int *p_errno)
+{
+  ssize_t ret;
+
+  while(count>0) {
+    ret=pread(fd,p_buf,count,(off_t)offset);
+    if(ret<0) {
+      if(errno==EINTR) continue;
+      if(p_errno!=NULL) *p_errno=errno;
+      return VDI_READ_FAILED;
+    }
+    if(ret==0) {
+      if(p_errno!=NULL) *p_errno=EIO;
+      return VDI_CORRUPT_IMAGE;
+    }
+    p_buf+=ret;
+    offset+=(uint64_t)ret;
+    count-=(uint64_t)ret;
+  }
+  return VDI_OK;
+}
+
+/*
+ * VdiReadHeader
+ */
+static int VdiReadHeader(pts_VdiHandle p_vdi_handle, uint64_t *p_map_offset) {
+  unsigned char header[VDI_HEADER_SIZE];
+  uint32_t header_size;
+  int ret;
+
+  ret=VdiPread(p_vdi_handle->fd,(char*)header,0,VDI_HEADER_SIZE,NULL);
+  if(ret==VDI_CORRUPT_IMAGE) return VDI_INVALID_SIGNATURE;
+  if(ret!=VDI_OK) return ret;
+
+  // Pre-header
+  if(VdiLe32(header+64)!=VDI_IMAGE_SIGNATURE) return VDI_INVALID_SIGNATURE;
+  p_vdi_handle->version=VdiLe32(header+68);
+  if((p_vdi_handle->version>>16)!=VDI_IMAGE_VERSION_MAJOR) {
+    return VDI_UNSUPPORTED_VERSION;
+  }
+
+  // Version 1.1 header
+  header_size=VdiLe32(header+72);
+  if(header_size<VDI_HEADER1_MIN_SIZE) {
+    return VDI_INVALID_HEADER;
+  }
+  p_vdi_handle->image_type=VdiLe32(header+76);
+  *p_map_offset=VdiLe32(header+340);
+  p_vdi_handle->data_offset=VdiLe32(header+344);
+  p_vdi_handle->size=VdiLe64(header+368);
+  p_vdi_handle->block_size=VdiLe32(header+376);
+  p_vdi_handle->block_extra=VdiLe32(header+380);
+  p_vdi_handle->blocks=VdiLe32(header+384);
+  p_vdi_handle->allocated_blocks=VdiLe32(header+388);
+
+  if(p_vdi_handle->image_type!=VDI_IMAGE_TYPE_NORMAL &&
+     p_vdi_handle->image_type!=VDI_IMAGE_TYPE_FIXED)
+  {
+    // Undo and differencing images need their parent
+    return VDI_UNSUPPORTED_IMAGE_TYPE;
+  }
+  if(p_vdi_handle->block_size==0 ||
+     p_vdi_handle->blocks>VDI_MAX_BLOCKS ||
+     p_vdi_handle->size>(uint64_t)p_vdi_handle->blocks*
+                          p_vdi_handle->block_size)
+  {
+    return VDI_INVALID_HEADER;
+  }
+  return VDI_OK;
+}
+
+/*
+ * VdiCreateHandle
+ */
+static int VdiCreateHandle(void **pp_handle,
+                           const char *p_format,
+                           uint8_t debug)
+{
+  (void)p_format;
+  pts_VdiHandle p_vdi_handle;
+
+  // Alloc new lib handle
+  p_vdi_handle=(pts_VdiHandle)calloc(1,sizeof(ts_VdiHandle));
+  if(p_vdi_handle==NULL) return VDI_MEMALLOC_FAILED;
+
+  // Init handle values
+  p_vdi_handle->fd=-1;
+  p_vdi_handle->debug=debug;
+
+  *pp_handle=p_vdi_handle;
+  return VDI_OK;
+}
+
+/*
+ * VdiDestroyHandle
+ */
+static int VdiDestroyHandle(void **pp_handle) {
+  free(*pp_handle);
+  *pp_handle=NULL;
+  return VDI_OK;
+}
+
+/*
+ * VdiOpen
+ */
+static int VdiOpen(void *p_handle,
+                   const char **pp_filename_arr,
+                   uint64_t filename_arr_len)
+{
+  pts_VdiHandle p_vdi_handle=(pts_VdiHandle)p_handle;
+  unsigned char *p_map_buf;
+  uint64_t map_offset;
+  uint32_t allocated=0;
+  int ret;
+
+  if(filename_arr_len==0) return VDI_NO_INPUT_FILES;
+  if(filename_arr_len>1) return VDI_TOO_MANY_INPUT_FILES;
+
+  p_vdi_handle->p_filename=strdup(pp_filename_arr[0]);
+  if(p_vdi_handle->p_filename==NULL) return VDI_MEMALLOC_FAILED;
+  p_vdi_handle->fd=open(pp_filename_arr[0],O_RDONLY);
+  if(p_vdi_handle->fd==-1) {
+    VdiClose(p_handle);
+    return VDI_OPEN_FAILED;
+  }
+
+#define VDI_OPEN_ERROR(err) { \
+  VdiClose(p_handle);         \
+  return (err);               \
+}
+
+  ret=VdiReadHeader(p_vdi_handle,&map_offset);
+  if(ret!=VDI_OK) VDI_OPEN_ERROR(ret);
+
+  // Read block map
+  if(p_vdi_handle->blocks!=0) {
+    p_vdi_handle->p_block_map=
+      (uint32_t*)malloc((uint64_t)p_vdi_handle->blocks*sizeof(uint32_t));
+    if(p_vdi_handle->p_block_map==NULL) VDI_OPEN_ERROR(VDI_MEMALLOC_FAILED);
+    p_map_buf=(unsigned char*)p_vdi_handle->p_block_map;
+    ret=VdiPread(p_vdi_handle->fd,
+                 (char*)p_map_buf,
+                 map_offset,
+                 (uint64_t)p_vdi_handle->blocks*4,
+                 NULL);
+    if(ret!=VDI_OK) VDI_OPEN_ERROR(ret);
+    for(uint32_t i=0;i<p_vdi_handle->blocks;i++) {
+      p_vdi_handle->p_block_map[i]=VdiLe32(p_map_buf+(uint64_t)i*4);
+      if(p_vdi_handle->p_block_map[i]<VDI_BLOCK_ZERO) allocated++;
+    }
+  }
+  if(allocated!=p_vdi_handle->allocated_blocks) {
+    LIBXMOUNT_LOG_WARNING("VDI header claims %" PRIu32 " allocated blocks, "
+                            "block map contains %" PRIu32 "\n",
+                          p_vdi_handle->allocated_blocks,
+                          allocated);
+    p_vdi_handle->allocated_blocks=allocated;
+  }
+
+#undef VDI_OPEN_ERROR
+
+  LIBXMOUNT_LOG_DEBUG(p_vdi_handle->debug,
+                      "Opened VDI image '%s' (size %" PRIu64 ", %" PRIu32
+                        " of %" PRIu32 " blocks allocated)\n",
+                      p_vdi_handle->p_filename,
+                      p_vdi_handle->size,
+                      p_vdi_handle->allocated_blocks,
+                      p_vdi_handle->blocks);
+  return VDI_OK;
+}
+
+/*
+ * VdiClose
+ */
+static int VdiClose(void *p_handle) {
+  pts_VdiHandle p_vdi_handle=(pts_VdiHandle)p_handle;
+  int ret=VDI_OK;
+
+  if(p_vdi_handle->fd!=-1 && close(p_vdi_handle->fd)!=0) ret=VDI_CLOSE_FAILED;
+  p_vdi_handle->fd=-1;
+  free(p_vdi_handle->p_filename);
+  free(p_vdi_handle->p_block_map);
+  p_vdi_handle->p_filename=NULL;
+  p_vdi_handle->p_block_map=NULL;
+  p_vdi_handle->size=0;
+  p_vdi_handle->blocks=0;
+
+  return ret;
+}
+
+/*
+ * VdiSize
+ */
+static int VdiSize(void *p_handle, uint64_t *p_size) {
+  pts_VdiHandle p_vdi_handle=(pts_VdiHandle)p_handle;
+
+  *p_size=p_vdi_handle->size;
+  return VDI_OK;
+}
+
+/*
+ * VdiRead
+ *
+ * Blocks that follow each other in the image file are read with a single
+ * pread, which is the common case for fixed images and for dynamic images
+ * written sequentially.
+ */
+static int VdiRead(void *p_handle,
+                   char *p_buf,
+                   off_t offset,
+                   size_t count,
+                   size_t *p_read,
+                   int *p_errno)
+{
+  pts_VdiHandle p_vdi_handle=(pts_VdiHandle)p_handle;
+  uint64_t pos=(uint64_t)offset;
+  uint64_t remaining=count;
+  uint64_t block_pos;
+  uint64_t len;
+  uint64_t file_offset;
+  uint64_t run_offset=0;
+  uint64_t run_len=0;
+  char *p_run_buf=p_buf;
+  uint32_t entry;
+  int ret;
+
+  *p_read=0;
+  if(offset<0 ||
+     pos>p_vdi_handle->size ||
+     count>p_vdi_handle->size-pos)
+  {
+    return VDI_READ_BEYOND_END_OF_IMAGE;
+  }
+
+  while(remaining>0) {
+    entry=p_vdi_handle->p_block_map[pos/p_vdi_handle->block_size];
+    block_pos=pos%p_vdi_handle->block_size;
+    len=GETMIN(p_vdi_handle->block_size-block_pos,remaining);
+
+    if(entry>=VDI_BLOCK_ZERO) {
+      memset(p_buf,0,len);
+      file_offset=0;
+    } else {
+      file_offset=p_vdi_handle->data_offset+
+                  (uint64_t)entry*(p_vdi_handle->block_size+
+                                   p_vdi_handle->block_extra)+
+                  p_vdi_handle->block_extra+block_pos;
+    }
+
+    // Flush the pending read if this part doesn't continue it
+    if(run_len!=0 && (file_offset==0 || file_offset!=run_offset+run_len)) {
+      ret=VdiPread(p_vdi_handle->fd,p_run_buf,run_offset,run_len,p_errno);
+      if(ret!=VDI_OK) return ret;
+      run_len=0;
+    }
+    if(file_offset!=0) {
+      if(run_len==0) {
+        run_offset=file_offset;
+        p_run_buf=p_buf;
+      }
+      run_len+=len;
+    }
+
+    p_buf+=len;
+    pos+=len;
+    remaining-=len;
+  }
+  if(run_len!=0) {
+    ret=VdiPread(p_vdi_handle->fd,p_run_buf,run_offset,run_len,p_errno);
+    if(ret!=VDI_OK) return ret;
+  }
+
+  *p_read=count;
+  return VDI_OK;
+}
+
+/*
+ * VdiWrite
+ */
+static int VdiWrite(void *p_handle,
+                    const char *p_buf,
+                    off_t seek,
+                    size_t count,
+                    size_t *p_written,
+                    int *p_errno)
+{
+  return VDI_WRITE_FAILED;
+}
+
+/*
+ * VdiOptionsHelp
+ */
+static int VdiOptionsHelp(const char **pp_help) {
+  *pp_help=NULL;
+  return VDI_OK;
+}
+
+/*
+ * VdiOptionsParse
+ */
+static int VdiOptionsParse(void *p_handle,
+                           uint32_t options_count,
+                           const pts_LibXmountOptions *pp_options,
+                           const char **pp_error)
+{
+  *pp_error=NULL;
+  return VDI_OK;
+}
+
+/*
+ * VdiGetInfofileContent
+ */
+static int VdiGetInfofileContent(void *p_handle, const char **pp_info_buf) {
+  pts_VdiHandle p_vdi_handle=(pts_VdiHandle)p_handle;
+  char *p_infobuf=NULL;
+  int ret;
+
+  ret=asprintf(&p_infobuf,
+               "VDI version: %" PRIu32 ".%" PRIu32 "\n"
+                 "VDI image type: %s\n"
+                 "Virtual size: %" PRIu64 " bytes\n"
+                 "Block size: %" PRIu64 " bytes\n"
+                 "Allocated blocks: %" PRIu32 " of %" PRIu32 "\n",
+               p_vdi_handle->version>>16,
+               p_vdi_handle->version&0xffff,
+               p_vdi_handle->image_type==VDI_IMAGE_TYPE_FIXED ?
+                 "fixed" : "dynamic",
+               p_vdi_handle->size,
+               p_vdi_handle->block_size,
+               p_vdi_handle->allocated_blocks,
+               p_vdi_handle->blocks);
+  if(ret<0 || p_infobuf==NULL) return VDI_MEMALLOC_FAILED;
+
+  *pp_info_buf=p_infobuf;
+  return VDI_OK;
+}
+
+/*
+ * VdiGetErrorMessage
+ */
+static const char* VdiGetErrorMessage(int err_num) {
+  switch(err_num) {
+    case VDI_MEMALLOC_FAILED:
+      return "Unable to allocate memory";
+      break;
+    case VDI_NO_INPUT_FILES:
+      return "No input file specified";
+      break;
+    case VDI_TOO_MANY_INPUT_FILES:
+      return "Only a single VDI file may be specified";
+      break;
+    case VDI_OPEN_FAILED:
+      return "Unable to open VDI file";
+      break;
+    case VDI_READ_FAILED:
+      return "Unable to read VDI data";
+      break;
+    case VDI_CLOSE_FAILED:
+      return "Unable to close VDI file";
+      break;
+    case VDI_INVALID_SIGNATURE:
+      return "The specified file is not a VDI image";
+      break;
+    case VDI_UNSUPPORTED_VERSION:
+      return "Unsupported VDI version (only version 1.1 is supported)";
+      break;
+    case VDI_INVALID_HEADER:
+      return "Invalid VDI header";
+      break;
+    case VDI_UNSUPPORTED_IMAGE_TYPE:
+      return "Unsupported image type (undo and differencing images are not "
+               "supported)";
+      break;
+    case VDI_CORRUPT_IMAGE:
+      return "The VDI image is corrupt or truncated";
+      break;
+    case VDI_READ_BEYOND_END_OF_IMAGE:
+      return "Unable to read beyond end of image";
+      break;
+    case VDI_WRITE_FAILED:
+      return "Write is not supported in VDI input module.";
+      break;
+    default:
+      return "Unknown error";
+  }
+}
+
+/*
+ * VdiFreeBuffer
+ */
+static int VdiFreeBuffer(void *p_buf) {
+  free(p_buf);
+  return VDI_OK;
+}
+
+/*
+  ----- Change log -----
+  20261019: * Initial version, reading normal (dynamic) and fixed VDI images.
+*/
@@ -0,0 +1,121 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#ifndef LIBXMOUNT_INPUT_VDI_H
+#define LIBXMOUNT_INPUT_VDI_H
+
+/*******************************************************************************
+ * Enums, Typedefs, etc...
+ ******************************************************************************/
+//! Possible error return codes
+enum {
+  VDI_OK=0,
+  VDI_MEMALLOC_FAILED,
+  VDI_NO_INPUT_FILES,
+  VDI_TOO_MANY_INPUT_FILES,
+  VDI_OPEN_FAILED,
+  VDI_READ_FAILED,
+  VDI_CLOSE_FAILED,
+  VDI_INVALID_SIGNATURE,
+  VDI_UNSUPPORTED_VERSION,
+  VDI_INVALID_HEADER,
+  VDI_UNSUPPORTED_IMAGE_TYPE,
+  VDI_CORRUPT_IMAGE,
+  VDI_READ_BEYOND_END_OF_IMAGE,
+  VDI_WRITE_FAILED
+};
+
+#define GETMIN(a,b) ((a)<(b)?(a):(b))
+
+//! Image signature and supported major version (1.1)
+#define VDI_IMAGE_SIGNATURE 0xbeda107fUL
+#define VDI_IMAGE_VERSION_MAJOR 1
+//! Number of bytes read from the start of the image, enough for all fields used
+#define VDI_HEADER_SIZE 400
+//! Min. size of the version 1.1 header (up to and including cBlocksAllocated)
+#define VDI_HEADER1_MIN_SIZE 320
+//! Image types
+#define VDI_IMAGE_TYPE_NORMAL 1
+#define VDI_IMAGE_TYPE_FIXED 2
+#define VDI_IMAGE_TYPE_UNDO 3
+#define VDI_IMAGE_TYPE_DIFF 4
+//! Block map entries of blocks without data
+#define VDI_BLOCK_FREE 0xffffffffUL
+#define VDI_BLOCK_ZERO 0xfffffffeUL
+//! Max. block map size
+#define VDI_MAX_BLOCKS (256*1024*1024)
+
+//! Library handle
+/*!
+ * The block map is read when opening the image and kept in memory, so reads
+ * only need a lookup and a pread and may be called concurrently.
+ */
+typedef struct s_VdiHandle {
+  //! Image file name and descriptor
+  char *p_filename;
+  int fd;
+  //! Header values
+  uint32_t version;
+  uint32_t image_type;
+  uint64_t size;
+  uint64_t block_size;
+  uint64_t block_extra;
+  uint64_t data_offset;
+  uint32_t blocks;
+  uint32_t allocated_blocks;
+  //! Block map, in host byte order
+  uint32_t *p_block_map;
+  //! Debug settings
+  uint8_t debug;
+} ts_VdiHandle, *pts_VdiHandle;
+
+/*******************************************************************************
+ * Forward declarations
+ ******************************************************************************/
+static int VdiCreateHandle(void **pp_handle,
+                           const char *p_format,
+                           uint8_t debug);
+static int VdiDestroyHandle(void **pp_handle);
+static int VdiOpen(void *p_handle,
+                   const char **pp_filename_arr,
+                   uint64_t filename_arr_len);
+static int VdiClose(void *p_handle);
+static int VdiSize(void *p_handle,
+                   uint64_t *p_size);
+static int VdiRead(void *p_handle,
+                   char *p_buf,
+                   off_t seek,
+                   size_t count,
+                   size_t *p_read,
+                   int *p_errno);
+static int VdiWrite(void *p_handle,
+                    const char *p_buf,
+                    off_t seek,
+                    size_t count,
+                    size_t *p_written,
+                    int *p_errno);
+static int VdiOptionsHelp(const char **pp_help);
+static int VdiOptionsParse(void *p_handle,
+                           uint32_t options_count,
+                           const pts_LibXmountOptions *pp_options,
+                           const char **pp_error);
+static int VdiGetInfofileContent(void *p_handle,
+                                 const char **pp_info_buf);
+static const char* VdiGetErrorMessage(int err_num);
+static int VdiFreeBuffer(void *p_buf);
+
+#endif // LIBXMOUNT_INPUT_VDI_H
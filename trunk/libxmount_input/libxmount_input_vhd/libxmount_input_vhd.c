@@ -0,0 +1,883 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "../libxmount_input.h"
+#include "libxmount_input_vhd.h"
+
+/*******************************************************************************
+ * LibXmount_Input API implementation
+ ******************************************************************************/
+/*
+ * LibXmount_Input_GetApiVersion
+ */
+uint8_t LibXmount_Input_GetApiVersion() {
+  return LIBXMOUNT_INPUT_API_VERSION;
+}
+
+/*
+ * LibXmount_Input_GetSupportedFormats
+ */
+const char* LibXmount_Input_GetSupportedFormats() {
+  return "vhd\0vhdx\0\0";
+}
+
+/*
+ * LibXmount_Input_GetFunctions
+ */
+void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
+  p_functions->CreateHandle=&VhdCreateHandle;
+  p_functions->DestroyHandle=&VhdDestroyHandle;
+  p_functions->Open=&VhdOpen;
+  p_functions->Size=&VhdSize;
+  p_functions->Read=&VhdRead;
+  p_functions->Write=&VhdWrite;
+  p_functions->Close=&VhdClose;
+  p_functions->OptionsHelp=&VhdOptionsHelp;
+  p_functions->OptionsParse=&VhdOptionsParse;
+  p_functions->GetInfofileContent=&VhdGetInfofileContent;
+  p_functions->GetErrorMessage=&VhdGetErrorMessage;
+  p_functions->FreeBuffer=&VhdFreeBuffer;
+}
+
+/*******************************************************************************
+ * Private
+ ******************************************************************************/
+/*
+ * VhdBe32
+ */
+static uint32_t VhdBe32(const unsigned char *p_buf) {
+  return ((uint32_t)p_buf[0]<<24) | ((uint32_t)p_buf[1]<<16) |
+         ((uint32_t)p_buf[2]<<8) | (uint32_t)p_buf[3];
+}
+
+/*
+ * VhdBe64
+ */
+static uint64_t VhdBe64(const unsigned char *p_buf) {
+  return ((uint64_t)VhdBe32(p_buf)<<32) | (uint64_t)VhdBe32(p_buf+4);
+}
+
+/*
+ * VhdLe16
+ */
+static uint16_t VhdLe16(const unsigned char *p_buf) {
+  return (uint16_t)(p_buf[0] | (p_buf[1]<<8));
+}
+
+/*
+ * VhdLe32
+ */
+static uint32_t VhdLe32(const unsigned char *p_buf) {
+  return (uint32_t)p_buf[0] | ((uint32_t)p_buf[1]<<8) |
+         ((uint32_t)p_buf[2]<<16) | ((uint32_t)p_buf[3]<<24);
+}
+
+/*
+ * VhdLe64
+ */
+static uint64_t VhdLe64(const unsigned char *p_buf) {
+  return (uint64_t)VhdLe32(p_buf) | ((uint64_t)VhdLe32(p_buf+4)<<32);
+}
+
+/*
+ * VhdPread
+ *
+ * Reads exactly count bytes at offset. Hitting the end of the file is an
+ * error, as the image is truncated then.
+ */
+static int VhdPread(int fd,
+                    char *p_buf,
+                    uint64_t offset,
+                    uint64_t count,
+                    int *p_errno)
+{
+  ssize_t ret;
+
+  while(count>0) {
+    ret=pread(fd,p_buf,count,(off_t)offset);
+    if(ret<0) {
+      if(errno==EINTR) continue;
+      if(p_errno!=NULL) *p_errno=errno;
+      return VHD_READ_FAILED;
+    }
+    if(ret==0) {
+      if(p_errno!=NULL) *p_errno=EIO;
+      return VHD_CORRUPT_IMAGE;
+    }
+    p_buf+=ret;
+    offset+=(uint64_t)ret;
+    count-=(uint64_t)ret;
+  }
+  return VHD_OK;
+}
+
+/*
+ * VhdChecksumOk
+ *
+ * The VHD checksum is the one's complement of the sum of all footer / header
+ * bytes, not counting the checksum itself.
+ */
+static int VhdChecksumOk(const unsigned char *p_buf,
+                         uint32_t size,
+                         uint32_t checksum_offset)
+{
+  uint32_t sum=0;
+
+  for(uint32_t i=0;i<size;i++) {
+    if(i>=checksum_offset && i<checksum_offset+4) continue;
+    sum+=p_buf[i];
+  }
+  return ~sum==VhdBe32(p_buf+checksum_offset);
+}
+
+/*
+ * VhdOpenVhd
+ */
+static int VhdOpenVhd(pts_VhdHandle p_vhd_handle, uint64_t file_size) {
+  unsigned char footer[VHD_FOOTER_SIZE];
+  unsigned char footer_copy[VHD_FOOTER_SIZE];
+  unsigned char header[VHD_DYNAMIC_HEADER_SIZE];
+  unsigned char *p_bat_buf;
+  uint64_t header_offset;
+  uint64_t bat_offset;
+  uint64_t bat_entries;
+  int ret;
+
+  // The footer is at the end of the file. Dynamic images have a copy of it at
+  // the beginning, which is used if the one at the end is damaged.
+  if(file_size<VHD_FOOTER_SIZE) return VHD_INVALID_SIGNATURE;
+  ret=VhdPread(p_vhd_handle->fd,
+               (char*)footer,
+               file_size-VHD_FOOTER_SIZE,
+               VHD_FOOTER_SIZE,
+               NULL);
+  if(ret!=VHD_OK) return ret;
+  if(memcmp(footer,"conectix",8)!=0 ||
+     !VhdChecksumOk(footer,VHD_FOOTER_SIZE,64))
+  {
+    ret=VhdPread(p_vhd_handle->fd,(char*)footer_copy,0,VHD_FOOTER_SIZE,NULL);
+    if(ret!=VHD_OK) return ret;
+    if(memcmp(footer_copy,"conectix",8)==0) {
+      memcpy(footer,footer_copy,VHD_FOOTER_SIZE);
+    } else if(memcmp(footer,"conectix",8)!=0) {
+      return VHD_INVALID_SIGNATURE;
+    }
+    if(!VhdChecksumOk(footer,VHD_FOOTER_SIZE,64)) {
+      LIBXMOUNT_LOG_WARNING("VHD footer checksum mismatch, image might be "
+                              "damaged\n");
+    }
+  }
+  if((VhdBe32(footer+12)>>16)!=1) return VHD_UNSUPPORTED_VERSION;
+
+  p_vhd_handle->disk_type=VhdBe32(footer+60);
+  p_vhd_handle->size=VhdBe64(footer+48);
+  header_offset=VhdBe64(footer+16);
+
+  if(p_vhd_handle->disk_type==VHD_DISK_TYPE_FIXED) {
+    // Data comes first, followed by the footer
+    if(p_vhd_handle->size>file_size-VHD_FOOTER_SIZE) return VHD_CORRUPT_IMAGE;
+    return VHD_OK;
+  }
+  if(p_vhd_handle->disk_type!=VHD_DISK_TYPE_DYNAMIC) {
+    return VHD_UNSUPPORTED_DISK_TYPE;
+  }
+
+  // Read dynamic disk header
+  ret=VhdPread(p_vhd_handle->fd,
+               (char*)header,
+               header_offset,
+               VHD_DYNAMIC_HEADER_SIZE,
+               NULL);
+  if(ret!=VHD_OK) return ret;
+  if(memcmp(header,"cxsparse",8)!=0) return VHD_INVALID_HEADER;
+  if(!VhdChecksumOk(header,VHD_DYNAMIC_HEADER_SIZE,36)) {
+    LIBXMOUNT_LOG_WARNING("VHD dynamic disk header checksum mismatch, image "
+                            "might be damaged\n");
+  }
+  bat_offset=VhdBe64(header+16);
+  bat_entries=VhdBe32(header+28);
+  p_vhd_handle->block_size=VhdBe32(header+32);
+  if(p_vhd_handle->block_size==0 ||
+     (p_vhd_handle->block_size%VHD_SECTOR_SIZE)!=0)
+  {
+    return VHD_INVALID_HEADER;
+  }
+  p_vhd_handle->blocks=(p_vhd_handle->size+p_vhd_handle->block_size-1)/
+                       p_vhd_handle->block_size;
+  if(p_vhd_handle->blocks>bat_entries) return VHD_INVALID_HEADER;
+  // The sector bitmap has one bit per sector and is padded to whole sectors
+  p_vhd_handle->bitmap_size=
+    ((p_vhd_handle->block_size/VHD_SECTOR_SIZE+7)/8+VHD_SECTOR_SIZE-1)/
+    VHD_SECTOR_SIZE*VHD_SECTOR_SIZE;
+
+  // Read block allocation table, entries are sector numbers in big-endian
+  if(p_vhd_handle->blocks==0) return VHD_OK;
+  p_vhd_handle->p_bat=(uint32_t*)malloc(p_vhd_handle->blocks*sizeof(uint32_t));
+  if(p_vhd_handle->p_bat==NULL) return VHD_MEMALLOC_FAILED;
+  p_bat_buf=(unsigned char*)p_vhd_handle->p_bat;
+  ret=VhdPread(p_vhd_handle->fd,
+               (char*)p_bat_buf,
+               bat_offset,
+               p_vhd_handle->blocks*4,
+               NULL);
+  if(ret!=VHD_OK) return ret;
+  for(uint64_t i=0;i<p_vhd_handle->blocks;i++) {
+    p_vhd_handle->p_bat[i]=VhdBe32(p_bat_buf+i*4);
+    if(p_vhd_handle->p_bat[i]!=VHD_BLOCK_UNALLOCATED) {
+      p_vhd_handle->allocated_blocks++;
+    }
+  }
+
+  return VHD_OK;
+}
+
+/*
+ * VhdxCrc32c
+ *
+ * CRC-32C (Castagnoli) as used by VHDX headers and region tables.
+ */
+static uint32_t VhdxCrc32c(const unsigned char *p_buf, uint64_t size) {
+  uint32_t crc=0xffffffffUL;
+
+  for(uint64_t i=0;i<size;i++) {
+    crc^=p_buf[i];
+    for(int bit=0;bit<8;bit++) {
+      crc=(crc>>1)^(0x82f63b78UL&(0-(crc&1)));
+    }
+  }
+  return ~crc;
+}
+
+/*
+ * VhdxChecksumOk
+ *
+ * The checksum is calculated with the checksum field (at offset 4) zeroed.
+ */
+static int VhdxChecksumOk(unsigned char *p_buf, uint64_t size) {
+  uint32_t checksum=VhdLe32(p_buf+4);
+  uint32_t crc;
+
+  memset(p_buf+4,0,4);
+  crc=VhdxCrc32c(p_buf,size);
+  p_buf[4]=checksum&0xff;
+  p_buf[5]=(checksum>>8)&0xff;
+  p_buf[6]=(checksum>>16)&0xff;
+  p_buf[7]=(checksum>>24)&0xff;
+  return crc==checksum;
+}
+
+/*
+ * VhdxGuidToString
+ *
+ * GUIDs are stored with their first three fields in little-endian.
+ */
+static void VhdxGuidToString(const unsigned char *p_guid, char *p_str) {
+  sprintf(p_str,
+          "%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+          VhdLe32(p_guid),
+          VhdLe16(p_guid+4),
+          VhdLe16(p_guid+6),
+          p_guid[8],p_guid[9],
+          p_guid[10],p_guid[11],p_guid[12],p_guid[13],p_guid[14],p_guid[15]);
+}
+
+/*
+ * VhdxReadHeader
+ *
+ * Of the two headers, the valid one with the higher sequence number is used.
+ */
+static int VhdxReadHeader(pts_VhdHandle p_vhd_handle) {
+  unsigned char header[VHDX_HEADER_SIZE];
+  uint64_t sequence;
+  uint64_t best_sequence=0;
+  int found=0;
+  uint16_t version;
+  uint8_t log_empty=0;
+  int ret;
+
+  for(int i=0;i<2;i++) {
+    ret=VhdPread(p_vhd_handle->fd,
+                 (char*)header,
+                 i==0 ? VHDX_HEADER1_OFFSET : VHDX_HEADER2_OFFSET,
+                 VHDX_HEADER_SIZE,
+                 NULL);
+    if(ret!=VHD_OK) return ret;
+    if(memcmp(header,"head",4)!=0 ||
+       !VhdxChecksumOk(header,VHDX_HEADER_SIZE))
+    {
+      continue;
+    }
+    sequence=VhdLe64(header+8);
+    if(found && sequence<=best_sequence) continue;
+    found=1;
+    best_sequence=sequence;
+    version=VhdLe16(header+66);
+    if(version!=1) return VHD_UNSUPPORTED_VERSION;
+    // A non-zero log GUID means the log may contain entries that still have
+    // to be applied to the image
+    log_empty=1;
+    for(int j=48;j<64;j++) if(header[j]!=0) log_empty=0;
+  }
+  if(!found) return VHD_INVALID_HEADER;
+  if(!log_empty) return VHD_LOG_NOT_EMPTY;
+  return VHD_OK;
+}
+
+/*
+ * VhdxReadMetadata
+ */
+static int VhdxReadMetadata(pts_VhdHandle p_vhd_handle,
+                            uint64_t metadata_offset,
+                            uint64_t metadata_length)
+{
+  unsigned char *p_table;
+  unsigned char *p_entry;
+  unsigned char item[8];
+  char guid[40];
+  uint16_t entries;
+  uint32_t item_offset;
+  uint32_t item_length;
+  uint32_t item_flags;
+  uint8_t have_params=0;
+  uint8_t have_size=0;
+  uint8_t have_sector_size=0;
+  int ret=VHD_OK;
+
+  if(metadata_length<VHDX_METADATA_TABLE_SIZE) return VHD_INVALID_HEADER;
+  p_table=(unsigned char*)malloc(VHDX_METADATA_TABLE_SIZE);
+  if(p_table==NULL) return VHD_MEMALLOC_FAILED;
+  ret=VhdPread(p_vhd_handle->fd,
+               (char*)p_table,
+               metadata_offset,
+               VHDX_METADATA_TABLE_SIZE,
+               NULL);
+  if(ret==VHD_OK && memcmp(p_table,"metadata",8)!=0) ret=VHD_INVALID_HEADER;
+  entries=VhdLe16(p_table+10);
+  if(ret==VHD_OK && entries>VHDX_MAX_METADATA_ENTRIES) ret=VHD_INVALID_HEADER;
+
+  for(uint16_t i=0;ret==VHD_OK && i<entries;i++) {
+    p_entry=p_table+32+i*32;
+    VhdxGuidToString(p_entry,guid);
+    item_offset=VhdLe32(p_entry+16);
+    item_length=VhdLe32(p_entry+20);
+    item_flags=VhdLe32(p_entry+24);
+    if((uint64_t)item_offset+item_length>metadata_length) {
+      ret=VHD_INVALID_HEADER;
+      break;
+    }
+    if(strcmp(guid,VHDX_GUID_FILE_PARAMETERS)==0 ||
+       strcmp(guid,VHDX_GUID_VIRTUAL_DISK_SIZE)==0 ||
+       strcmp(guid,VHDX_GUID_LOGICAL_SECTOR_SIZE)==0)
+    {
+      if(item_length<4 || item_length>sizeof(item)) {
+        ret=VHD_INVALID_HEADER;
+        break;
+      }
+      memset(item,0,sizeof(item));
+      ret=VhdPread(p_vhd_handle->fd,
+                   (char*)item,
+                   metadata_offset+item_offset,
+                   item_length,
+                   NULL);
+      if(ret!=VHD_OK) break;
+      if(strcmp(guid,VHDX_GUID_FILE_PARAMETERS)==0) {
+        p_vhd_handle->block_size=VhdLe32(item);
+        if((VhdLe32(item+4)&VHDX_PARAMS_HAS_PARENT)!=0) {
+          ret=VHD_UNSUPPORTED_DISK_TYPE;
+        }
+        have_params=1;
+      } else if(strcmp(guid,VHDX_GUID_VIRTUAL_DISK_SIZE)==0) {
+        p_vhd_handle->size=VhdLe64(item);
+        have_size=1;
+      } else {
+        p_vhd_handle->logical_sector_size=VhdLe32(item);
+        have_sector_size=1;
+      }
+    } else if(strcmp(guid,VHDX_GUID_PHYSICAL_SECTOR_SIZE)==0 ||
+              strcmp(guid,VHDX_GUID_PAGE83_DATA)==0)
+    {
+      // Required, but not needed for reading
+      continue;
+    } else if((item_flags&0x04)!=0) {
+      // Unknown required item (for ex. the parent locator)
+      LIBXMOUNT_LOG_DEBUG(p_vhd_handle->debug,
+                          "Unknown required VHDX metadata item %s\n",
+                          guid);
+      ret=VHD_UNSUPPORTED_DISK_TYPE;
+    }
+  }
+  free(p_table);
+  if(ret!=VHD_OK) return ret;
+
+  if(!have_params || !have_size || !have_sector_size) {
+    return VHD_INVALID_HEADER;
+  }
+  if(p_vhd_handle->block_size<VHDX_MIN_BLOCK_SIZE ||
+     p_vhd_handle->block_size>VHDX_MAX_BLOCK_SIZE ||
+     (p_vhd_handle->block_size&(p_vhd_handle->block_size-1))!=0 ||
+     (p_vhd_handle->logical_sector_size!=512 &&
+      p_vhd_handle->logical_sector_size!=4096))
+  {
+    return VHD_INVALID_HEADER;
+  }
+  return VHD_OK;
+}
+
+/*
+ * VhdxReadBat
+ *
+ * Every chunk_ratio payload block entries, the BAT contains a sector bitmap
+ * block entry, which is only used by differencing images and skipped here.
+ */
+static int VhdxReadBat(pts_VhdHandle p_vhd_handle,
+                       uint64_t bat_offset,
+                       uint64_t bat_length)
+{
+  unsigned char *p_bat_buf;
+  uint64_t chunk_ratio;
+  uint64_t bat_entries;
+  uint64_t entry;
+  uint64_t block_offset;
+  int ret;
+
+  chunk_ratio=((1ULL<<23)*p_vhd_handle->logical_sector_size)/
+              p_vhd_handle->block_size;
+  p_vhd_handle->blocks=(p_vhd_handle->size+p_vhd_handle->block_size-1)/
+                       p_vhd_handle->block_size;
+  if(p_vhd_handle->blocks==0) return VHD_OK;
+  bat_entries=p_vhd_handle->blocks+(p_vhd_handle->blocks-1)/chunk_ratio;
+  if(bat_entries>bat_length/8) return VHD_INVALID_HEADER;
+
+  p_bat_buf=(unsigned char*)malloc(bat_entries*8);
+  p_vhd_handle->p_bat=(uint32_t*)malloc(p_vhd_handle->blocks*sizeof(uint32_t));
+  if(p_bat_buf==NULL || p_vhd_handle->p_bat==NULL) {
+    free(p_bat_buf);
+    return VHD_MEMALLOC_FAILED;
+  }
+  ret=VhdPread(p_vhd_handle->fd,(char*)p_bat_buf,bat_offset,bat_entries*8,NULL);
+  if(ret!=VHD_OK) {
+    free(p_bat_buf);
+    return ret;
+  }
+
+  for(uint64_t i=0;i<p_vhd_handle->blocks;i++) {
+    entry=VhdLe64(p_bat_buf+(i+i/chunk_ratio)*8);
+    block_offset=entry>>20;
+    switch(entry&0x07) {
+      case VHDX_PAYLOAD_BLOCK_FULLY_PRESENT:
+        if(block_offset==0 || block_offset>=VHD_BLOCK_UNALLOCATED) {
+          free(p_bat_buf);
+          return VHD_CORRUPT_IMAGE;
+        }
+        p_vhd_handle->p_bat[i]=(uint32_t)block_offset;
+        p_vhd_handle->allocated_blocks++;
+        break;
+      case VHDX_PAYLOAD_BLOCK_NOT_PRESENT:
+      case VHDX_PAYLOAD_BLOCK_UNDEFINED:
+      case VHDX_PAYLOAD_BLOCK_ZERO:
+      case VHDX_PAYLOAD_BLOCK_UNMAPPED:
+        p_vhd_handle->p_bat[i]=VHD_BLOCK_UNALLOCATED;
+        break;
+      default:
+        // PARTIALLY_PRESENT is only valid in differencing images
+        free(p_bat_buf);
+        return VHD_CORRUPT_IMAGE;
+    }
+  }
+
+  free(p_bat_buf);
+  return VHD_OK;
+}
+
+/*
+ * VhdOpenVhdx
+ */
+static int VhdOpenVhdx(pts_VhdHandle p_vhd_handle) {
+  unsigned char *p_regions;
+  unsigned char *p_entry;
+  char guid[40];
+  uint32_t entries;
+  uint64_t bat_offset=0;
+  uint64_t bat_length=0;
+  uint64_t metadata_offset=0;
+  uint64_t metadata_length=0;
+  int ret;
+
+  ret=VhdxReadHeader(p_vhd_handle);
+  if(ret!=VHD_OK) return ret;
+
+  // Read region table, using the second copy if the first one is damaged
+  p_regions=(unsigned char*)malloc(VHDX_REGION_TABLE_SIZE);
+  if(p_regions==NULL) return VHD_MEMALLOC_FAILED;
+  for(int i=0;i<2;i++) {
+    ret=VhdPread(p_vhd_handle->fd,
+                 (char*)p_regions,
+                 i==0 ? VHDX_REGION_TABLE1_OFFSET : VHDX_REGION_TABLE2_OFFSET,
+                 VHDX_REGION_TABLE_SIZE,
+                 NULL);
+    if(ret!=VHD_OK) break;
+    if(memcmp(p_regions,"regi",4)==0 &&
+       VhdxChecksumOk(p_regions,VHDX_REGION_TABLE_SIZE))
+    {
+      break;
+    }
+    ret=VHD_INVALID_HEADER;
+  }
+  entries=VhdLe32(p_regions+8);
+  if(ret==VHD_OK && entries>VHDX_MAX_REGION_ENTRIES) ret=VHD_INVALID_HEADER;
+  for(uint32_t i=0;ret==VHD_OK && i<entries;i++) {
+    p_entry=p_regions+16+i*32;
+    VhdxGuidToString(p_entry,guid);
+    if(strcmp(guid,VHDX_GUID_BAT_REGION)==0) {
+      bat_offset=VhdLe64(p_entry+16);
+      bat_length=VhdLe32(p_entry+24);
+    } else if(strcmp(guid,VHDX_GUID_METADATA_REGION)==0) {
+      metadata_offset=VhdLe64(p_entry+16);
+      metadata_length=VhdLe32(p_entry+24);
+    } else if((VhdLe32(p_entry+28)&0x01)!=0) {
+      // Unknown required region
+      ret=VHD_UNSUPPORTED_VERSION;
+    }
+  }
+  free(p_regions);
+  if(ret!=VHD_OK) return ret;
+  if(bat_offset==0 || metadata_offset==0) return VHD_INVALID_HEADER;
+
+  ret=VhdxReadMetadata(p_vhd_handle,metadata_offset,metadata_length);
+  if(ret!=VHD_OK) return ret;
+  p_vhd_handle->disk_type=VHD_DISK_TYPE_DYNAMIC;
+  return VhdxReadBat(p_vhd_handle,bat_offset,bat_length);
+}
+
+/*
+ * VhdBlockOffset
+ *
+ * Returns the offset of the data of a block in the image file.
+ */
+static uint64_t VhdBlockOffset(pts_VhdHandle p_vhd_handle, uint32_t entry) {
+  if(p_vhd_handle->vhdx) return (uint64_t)entry<<20;
+  return (uint64_t)entry*VHD_SECTOR_SIZE+p_vhd_handle->bitmap_size;
+}
+
+/*
+ * VhdCreateHandle
+ */
+static int VhdCreateHandle(void **pp_handle,
+                           const char *p_format,
+                           uint8_t debug)
+{
+  (void)p_format;
+  pts_VhdHandle p_vhd_handle;
+
+  // Alloc new lib handle
+  p_vhd_handle=(pts_VhdHandle)calloc(1,sizeof(ts_VhdHandle));
+  if(p_vhd_handle==NULL) return VHD_MEMALLOC_FAILED;
+
+  // Init handle values
+  p_vhd_handle->fd=-1;
+  p_vhd_handle->debug=debug;
+
+  *pp_handle=p_vhd_handle;
+  return VHD_OK;
+}
+
+/*
+ * VhdDestroyHandle
+ */
+static int VhdDestroyHandle(void **pp_handle) {
+  free(*pp_handle);
+  *pp_handle=NULL;
+  return VHD_OK;
+}
+
+/*
+ * VhdOpen
+ */
+static int VhdOpen(void *p_handle,
+                   const char **pp_filename_arr,
+                   uint64_t filename_arr_len)
+{
+  pts_VhdHandle p_vhd_handle=(pts_VhdHandle)p_handle;
+  char signature[8];
+  struct stat file_stat;
+  int ret;
+
+  if(filename_arr_len==0) return VHD_NO_INPUT_FILES;
+  if(filename_arr_len>1) return VHD_TOO_MANY_INPUT_FILES;
+
+  p_vhd_handle->p_filename=strdup(pp_filename_arr[0]);
+  if(p_vhd_handle->p_filename==NULL) return VHD_MEMALLOC_FAILED;
+  p_vhd_handle->fd=open(pp_filename_arr[0],O_RDONLY);
+  if(p_vhd_handle->fd==-1 || fstat(p_vhd_handle->fd,&file_stat)!=0) {
+    VhdClose(p_handle);
+    return VHD_OPEN_FAILED;
+  }
+
+  // VHDX images start with a file type identifier, VHD images end with a
+  // footer. Both are accepted regardless of the format given with --in.
+  p_vhd_handle->vhdx=
+    (file_stat.st_size>=VHDX_REGION_TABLE2_OFFSET+VHDX_REGION_TABLE_SIZE &&
+     VhdPread(p_vhd_handle->fd,signature,0,8,NULL)==VHD_OK &&
+     memcmp(signature,"vhdxfile",8)==0);
+  if(p_vhd_handle->vhdx) {
+    ret=VhdOpenVhdx(p_vhd_handle);
+  } else {
+    ret=VhdOpenVhd(p_vhd_handle,(uint64_t)file_stat.st_size);
+  }
+  if(ret!=VHD_OK) {
+    VhdClose(p_handle);
+    return ret;
+  }
+
+  LIBXMOUNT_LOG_DEBUG(p_vhd_handle->debug,
+                      "Opened %s image '%s' (size %" PRIu64 ", %" PRIu64
+                        " of %" PRIu64 " blocks allocated)\n",
+                      p_vhd_handle->vhdx ? "VHDX" : "VHD",
+                      p_vhd_handle->p_filename,
+                      p_vhd_handle->size,
+                      p_vhd_handle->allocated_blocks,
+                      p_vhd_handle->blocks);
+  return VHD_OK;
+}
+
+/*
+ * VhdClose
+ */
+static int VhdClose(void *p_handle) {
+  pts_VhdHandle p_vhd_handle=(pts_VhdHandle)p_handle;
+  int ret=VHD_OK;
+
+  if(p_vhd_handle->fd!=-1 && close(p_vhd_handle->fd)!=0) ret=VHD_CLOSE_FAILED;
+  p_vhd_handle->fd=-1;
+  free(p_vhd_handle->p_filename);
+  free(p_vhd_handle->p_bat);
+  p_vhd_handle->p_filename=NULL;
+  p_vhd_handle->p_bat=NULL;
+  p_vhd_handle->size=0;
+  p_vhd_handle->block_size=0;
+  p_vhd_handle->blocks=0;
+  p_vhd_handle->allocated_blocks=0;
+
+  return ret;
+}
+
+/*
+ * VhdSize
+ */
+static int VhdSize(void *p_handle, uint64_t *p_size) {
+  pts_VhdHandle p_vhd_handle=(pts_VhdHandle)p_handle;
+
+  *p_size=p_vhd_handle->size;
+  return VHD_OK;
+}
+
+/*
+ * VhdRead
+ */
+static int VhdRead(void *p_handle,
+                   char *p_buf,
+                   off_t offset,
+                   size_t count,
+                   size_t *p_read,
+                   int *p_errno)
+{
+  pts_VhdHandle p_vhd_handle=(pts_VhdHandle)p_handle;
+  uint64_t pos=(uint64_t)offset;
+  uint64_t remaining=count;
+  uint64_t block;
+  uint64_t block_pos;
+  uint64_t len;
+  uint32_t entry;
+  int ret;
+
+  *p_read=0;
+  if(offset<0 ||
+     pos>p_vhd_handle->size ||
+     count>p_vhd_handle->size-pos)
+  {
+    return VHD_READ_BEYOND_END_OF_IMAGE;
+  }
+
+  if(p_vhd_handle->disk_type==VHD_DISK_TYPE_FIXED) {
+    ret=VhdPread(p_vhd_handle->fd,p_buf,pos,remaining,p_errno);
+    if(ret!=VHD_OK) return ret;
+    *p_read=count;
+    return VHD_OK;
+  }
+
+  while(remaining>0) {
+    block=pos/p_vhd_handle->block_size;
+    block_pos=pos%p_vhd_handle->block_size;
+    len=GETMIN(p_vhd_handle->block_size-block_pos,remaining);
+    entry=p_vhd_handle->p_bat[block];
+    if(entry==VHD_BLOCK_UNALLOCATED) {
+      memset(p_buf,0,len);
+    } else {
+      ret=VhdPread(p_vhd_handle->fd,
+                   p_buf,
+                   VhdBlockOffset(p_vhd_handle,entry)+block_pos,
+                   len,
+                   p_errno);
+      if(ret!=VHD_OK) return ret;
+    }
+    p_buf+=len;
+    pos+=len;
+    remaining-=len;
+  }
+
+  *p_read=count;
+  return VHD_OK;
+}
+
+/*
+ * VhdWrite
+ */
+static int VhdWrite(void *p_handle,
+                    const char *p_buf,
+                    off_t seek,
+                    size_t count,
+                    size_t *p_written,
+                    int *p_errno)
+{
+  return VHD_WRITE_FAILED;
+}
+
+/*
+ * VhdOptionsHelp
+ */
+static int VhdOptionsHelp(const char **pp_help) {
+  *pp_help=NULL;
+  return VHD_OK;
+}
+
+/*
+ * VhdOptionsParse
+ */
+static int VhdOptionsParse(void *p_handle,
+                           uint32_t options_count,
+                           const pts_LibXmountOptions *pp_options,
+                           const char **pp_error)
+{
+  *pp_error=NULL;
+  return VHD_OK;
+}
+
+/*
+ * VhdGetInfofileContent
+ */
+static int VhdGetInfofileContent(void *p_handle, const char **pp_info_buf) {
+  pts_VhdHandle p_vhd_handle=(pts_VhdHandle)p_handle;
+  char *p_infobuf=NULL;
+  int ret;
+
+  if(p_vhd_handle->disk_type==VHD_DISK_TYPE_FIXED) {
+    ret=asprintf(&p_infobuf,
+                 "VHD image type: fixed\n"
+                   "Virtual size: %" PRIu64 " bytes\n",
+                 p_vhd_handle->size);
+  } else {
+    ret=asprintf(&p_infobuf,
+                 "%s image type: dynamic\n"
+                   "Virtual size: %" PRIu64 " bytes\n"
+                   "Block size: %" PRIu64 " bytes\n"
+                   "Allocated blocks: %" PRIu64 " of %" PRIu64 "\n",
+                 p_vhd_handle->vhdx ? "VHDX" : "VHD",
+                 p_vhd_handle->size,
+                 p_vhd_handle->block_size,
+                 p_vhd_handle->allocated_blocks,
+                 p_vhd_handle->blocks);
+  }
+  if(ret<0 || p_infobuf==NULL) return VHD_MEMALLOC_FAILED;
+
+  *pp_info_buf=p_infobuf;
+  return VHD_OK;
+}
+
+/*
+ * VhdGetErrorMessage
+ */
+static const char* VhdGetErrorMessage(int err_num) {
+  switch(err_num) {
+    case VHD_MEMALLOC_FAILED:
+      return "Unable to allocate memory";
+      break;
+    case VHD_NO_INPUT_FILES:
+      return "No input file specified";
+      break;
+    case VHD_TOO_MANY_INPUT_FILES:
+      return "Only a single VHD / VHDX file may be specified";
+      break;
+    case VHD_OPEN_FAILED:
+      return "Unable to open VHD / VHDX file";
+      break;
+    case VHD_READ_FAILED:
+      return "Unable to read VHD / VHDX data";
+      break;
+    case VHD_CLOSE_FAILED:
+      return "Unable to close VHD / VHDX file";
+      break;
+    case VHD_INVALID_SIGNATURE:
+      return "The specified file is not a VHD / VHDX image";
+      break;
+    case VHD_INVALID_HEADER:
+      return "Invalid VHD / VHDX header";
+      break;
+    case VHD_UNSUPPORTED_DISK_TYPE:
+      return "Unsupported disk type (differencing images are not supported)";
+      break;
+    case VHD_UNSUPPORTED_VERSION:
+      return "Unsupported VHD / VHDX version";
+      break;
+    case VHD_LOG_NOT_EMPTY:
+      return "The VHDX log contains entries that haven't been applied yet";
+      break;
+    case VHD_CORRUPT_IMAGE:
+      return "The VHD / VHDX image is corrupt or truncated";
+      break;
+    case VHD_READ_BEYOND_END_OF_IMAGE:
+      return "Unable to read beyond end of image";
+      break;
+    case VHD_WRITE_FAILED:
+      return "Write is not supported in VHD input module.";
+      break;
+    default:
+      return "Unknown error";
+  }
+}
+
+/*
+ * VhdFreeBuffer
+ */
+static int VhdFreeBuffer(void *p_buf) {
+  free(p_buf);
+  return VHD_OK;
+}
+
+/*
+  ----- Change log -----
+  20261019: * Initial version, reading fixed and dynamic VHD images and VHDX
+              images.
+*/
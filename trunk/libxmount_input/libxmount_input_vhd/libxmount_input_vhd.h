@@ -0,0 +1,161 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#ifndef LIBXMOUNT_INPUT_VHD_H
+#define LIBXMOUNT_INPUT_VHD_H
+
+/*******************************************************************************
+ * Enums, Typedefs, etc...
+ ******************************************************************************/
+//! Possible error return codes
+enum {
+  VHD_OK=0,
+  VHD_MEMALLOC_FAILED,
+  VHD_NO_INPUT_FILES,
+  VHD_TOO_MANY_INPUT_FILES,
+  VHD_OPEN_FAILED,
+  VHD_READ_FAILED,
+  VHD_CLOSE_FAILED,
+  VHD_INVALID_SIGNATURE,
+  VHD_INVALID_HEADER,
+  VHD_UNSUPPORTED_DISK_TYPE,
+  VHD_UNSUPPORTED_VERSION,
+  VHD_LOG_NOT_EMPTY,
+  VHD_CORRUPT_IMAGE,
+  VHD_READ_BEYOND_END_OF_IMAGE,
+  VHD_WRITE_FAILED
+};
+
+#define GETMIN(a,b) ((a)<(b)?(a):(b))
+
+// ----- VHD -----
+
+//! Size of the VHD footer and the dynamic disk header
+#define VHD_FOOTER_SIZE 512
+#define VHD_DYNAMIC_HEADER_SIZE 1024
+//! VHD disk types
+#define VHD_DISK_TYPE_FIXED 2
+#define VHD_DISK_TYPE_DYNAMIC 3
+#define VHD_DISK_TYPE_DIFFERENCING 4
+//! Sector size used by the VHD block allocation table and sector bitmaps
+#define VHD_SECTOR_SIZE 512
+
+// ----- VHDX -----
+
+//! Offsets and sizes of the VHDX file structures
+#define VHDX_HEADER1_OFFSET (64*1024)
+#define VHDX_HEADER2_OFFSET (128*1024)
+#define VHDX_HEADER_SIZE (4*1024)
+#define VHDX_REGION_TABLE1_OFFSET (192*1024)
+#define VHDX_REGION_TABLE2_OFFSET (256*1024)
+#define VHDX_REGION_TABLE_SIZE (64*1024)
+#define VHDX_MAX_REGION_ENTRIES 2047
+#define VHDX_METADATA_TABLE_SIZE (64*1024)
+#define VHDX_MAX_METADATA_ENTRIES 2047
+//! Limits of the VHDX block size
+#define VHDX_MIN_BLOCK_SIZE (1024*1024)
+#define VHDX_MAX_BLOCK_SIZE (256*1024*1024)
+//! Payload block states found in the BAT
+#define VHDX_PAYLOAD_BLOCK_NOT_PRESENT 0
+#define VHDX_PAYLOAD_BLOCK_UNDEFINED 1
+#define VHDX_PAYLOAD_BLOCK_ZERO 2
+#define VHDX_PAYLOAD_BLOCK_UNMAPPED 3
+#define VHDX_PAYLOAD_BLOCK_FULLY_PRESENT 6
+#define VHDX_PAYLOAD_BLOCK_PARTIALLY_PRESENT 7
+//! File parameter flags
+#define VHDX_PARAMS_HAS_PARENT 0x02
+//! GUIDs of the known regions and metadata items
+#define VHDX_GUID_BAT_REGION "2DC27766-F623-4200-9D64-115E9BFD4A08"
+#define VHDX_GUID_METADATA_REGION "8B7CA206-4790-4B9A-B8FE-575F050F886E"
+#define VHDX_GUID_FILE_PARAMETERS "CAA16737-FA36-4D43-B3B6-33F0AA44E76B"
+#define VHDX_GUID_VIRTUAL_DISK_SIZE "2FA54224-CD1B-4876-B211-5DBED83BF4B8"
+#define VHDX_GUID_LOGICAL_SECTOR_SIZE "8141BF1D-A96F-4709-BA47-F233A8FAAB5F"
+#define VHDX_GUID_PHYSICAL_SECTOR_SIZE "CDA348C7-445D-4471-9CC9-E9885251C556"
+#define VHDX_GUID_PAGE83_DATA "BECA12AB-B2E6-4523-93EF-C309E000C746"
+
+//! Entry of the block table for blocks without data in the image file
+#define VHD_BLOCK_UNALLOCATED 0xffffffffUL
+
+//! Library handle
+/*!
+ * The block allocation table of dynamic VHD and of VHDX images is read when
+ * opening the image and kept in p_bat as a compact array of 32 bit entries:
+ * for VHD, the sector the block starts at (as found in the image), for VHDX,
+ * the offset of the block in MiB (VHDX blocks are MiB aligned). Blocks without
+ * data are VHD_BLOCK_UNALLOCATED and read as zeros. Reads only need the BAT
+ * and pread, so they may be called concurrently without locking.
+ */
+typedef struct s_VhdHandle {
+  //! Image file name and descriptor
+  char *p_filename;
+  int fd;
+  //! Set if the image is a VHDX image
+  uint8_t vhdx;
+  //! VHD disk type, VHD_DISK_TYPE_DYNAMIC for all VHDX images
+  uint32_t disk_type;
+  //! Virtual disk size
+  uint64_t size;
+  //! Block size and number of blocks, block size is 0 for fixed VHD images
+  uint64_t block_size;
+  uint64_t blocks;
+  uint64_t allocated_blocks;
+  //! Size of the sector bitmap preceding each block of a dynamic VHD image
+  uint64_t bitmap_size;
+  //! VHDX logical sector size
+  uint32_t logical_sector_size;
+  //! Block allocation table
+  uint32_t *p_bat;
+  //! Debug settings
+  uint8_t debug;
+} ts_VhdHandle, *pts_VhdHandle;
+
+/*******************************************************************************
+ * Forward declarations
+ ******************************************************************************/
+static int VhdCreateHandle(void **pp_handle,
+                           const char *p_format,
+                           uint8_t debug);
+static int VhdDestroyHandle(void **pp_handle);
+static int VhdOpen(void *p_handle,
+                   const char **pp_filename_arr,
+                   uint64_t filename_arr_len);
+static int VhdClose(void *p_handle);
+static int VhdSize(void *p_handle,
+                   uint64_t *p_size);
+static int VhdRead(void *p_handle,
+                   char *p_buf,
+                   off_t seek,
+                   size_t count,
+                   size_t *p_read,
+                   int *p_errno);
+static int VhdWrite(void *p_handle,
+                    const char *p_buf,
+                    off_t seek,
+                    size_t count,
+                    size_t *p_written,
+                    int *p_errno);
+static int VhdOptionsHelp(const char **pp_help);
+static int VhdOptionsParse(void *p_handle,
+                           uint32_t options_count,
+                           const pts_LibXmountOptions *pp_options,
+                           const char **pp_error);
+static int VhdGetInfofileContent(void *p_handle,
+                                 const char **pp_info_buf);
+static const char* VhdGetErrorMessage(int err_num);
+static int VhdFreeBuffer(void *p_buf);
+
+#endif // LIBXMOUNT_INPUT_VHD_H
@@ -0,0 +1,1533 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "../libxmount_input.h"
+#include "libxmount/libxmount_cache.h"
+#include "libxmount_input_vmdk.h"
+
+#define VMDK_OPTION_GTCACHE "vmdkgtcache"
+#define VMDK_OPTION_GRAINCACHE "vmdkgcache"
+#define VMDK_OPTION_THREADS "vmdkthreads"
+
+/*******************************************************************************
+ * LibXmount_Input API implementation
+ ******************************************************************************/
+/*
+ * LibXmount_Input_GetApiVersion
+ */
+uint8_t LibXmount_Input_GetApiVersion() {
+  return LIBXMOUNT_INPUT_API_VERSION;
+}
+
+/*
+ * LibXmount_Input_GetSupportedFormats
+ */
+const char* LibXmount_Input_GetSupportedFormats() {
+  return "vmdk\0\0";
+}
+
+/*
+ * LibXmount_Input_GetFunctions
+ */
+void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
+  p_functions->CreateHandle=&VmdkCreateHandle;
+  p_functions->DestroyHandle=&VmdkDestroyHandle;
+  p_functions->Open=&VmdkOpen;
+  p_functions->Size=&VmdkSize;
+  p_functions->Read=&VmdkRead;
+  p_functions->Write=&VmdkWrite;
+  p_functions->Close=&VmdkClose;
+  p_functions->OptionsHelp=&VmdkOptionsHelp;
+  p_functions->OptionsParse=&VmdkOptionsParse;
+  p_functions->GetInfofileContent=&VmdkGetInfofileContent;
+  p_functions->GetErrorMessage=&VmdkGetErrorMessage;
+  p_functions->FreeBuffer=&VmdkFreeBuffer;
+}
+
+/*******************************************************************************
+ * Private
+ ******************************************************************************/
+/*
+ * VmdkLe32
+ */
+static uint32_t VmdkLe32(const unsigned char *p_buf) {
+  return ((uint32_t)p_buf[3]<<24) | ((uint32_t)p_buf[2]<<16) |
+         ((uint32_t)p_buf[1]<<8) | (uint32_t)p_buf[0];
+}
+
+/*
+ * VmdkLe64
+ */
+static uint64_t VmdkLe64(const unsigned char *p_buf) {
+  return ((uint64_t)VmdkLe32(p_buf+4)<<32) | (uint64_t)VmdkLe32(p_buf);
+}
+
+/*
+ * VmdkPread
+ *
+ * Reads count bytes at offset, retrying short reads. *p_read is set to the
+ * number of bytes read, which is less than count only at the end of the file.
+ */
+static int VmdkPread(int fd,
+                     char *p_buf,
+                     uint64_t offset,
+                     uint64_t count,
+                     uint64_t *p_read,
+                     int *p_errno)
+{
+  ssize_t ret;
+  uint64_t done=0;
+
+  while(done<count) {
+    ret=pread(fd,p_buf+done,count-done,(off_t)(offset+done));
+    if(ret<0) {
+      if(errno==EINTR) continue;
+      if(p_errno!=NULL) *p_errno=errno;
+      return VMDK_READ_FAILED;
+    }
+    if(ret==0) break;
+    done+=(uint64_t)ret;
+  }
+
+  *p_read=done;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkPreadFull
+ *
+ * Like VmdkPread, but hitting the end of the file is an error.
+ */
+static int VmdkPreadFull(int fd,
+                         char *p_buf,
+                         uint64_t offset,
+                         uint64_t count,
+                         int *p_errno)
+{
+  uint64_t read;
+  int ret;
+
+  ret=VmdkPread(fd,p_buf,offset,count,&read,p_errno);
+  if(ret!=VMDK_OK) return ret;
+  if(read!=count) {
+    if(p_errno!=NULL) *p_errno=EIO;
+    return VMDK_CORRUPT_IMAGE;
+  }
+  return VMDK_OK;
+}
+
+/*
+ * VmdkGetGte
+ *
+ * Gets a grain table entry, reading the grain table into the grain table
+ * cache on a miss.
+ */
+static int VmdkGetGte(pts_VmdkHandle p_vmdk_handle,
+                      pts_VmdkExtent p_extent,
+                      uint64_t gt_sector,
+                      uint64_t gt_index,
+                      uint32_t *p_gte,
+                      int *p_errno)
+{
+  unsigned char entry[4];
+  uint64_t gt_size=p_extent->gt_entries*4;
+  char *p_table;
+  int hit;
+  int ret;
+
+  pthread_mutex_lock(&(p_vmdk_handle->mutex));
+  hit=LibXmountCacheGet(&(p_vmdk_handle->gt_cache),
+                        p_extent,
+                        gt_sector,
+                        gt_index*4,
+                        4,
+                        entry);
+  pthread_mutex_unlock(&(p_vmdk_handle->mutex));
+
+  if(!hit) {
+    // Read the whole table without holding the mutex
+    p_table=(char*)malloc(gt_size);
+    if(p_table==NULL) return VMDK_MEMALLOC_FAILED;
+    ret=VmdkPreadFull(p_extent->fd,
+                      p_table,
+                      gt_sector*VMDK_SECTOR_SIZE,
+                      gt_size,
+                      p_errno);
+    if(ret!=VMDK_OK) {
+      free(p_table);
+      return ret;
+    }
+    memcpy(entry,p_table+gt_index*4,4);
+
+    pthread_mutex_lock(&(p_vmdk_handle->mutex));
+    LibXmountCachePut(&(p_vmdk_handle->gt_cache),p_extent,gt_sector,&p_table);
+    pthread_mutex_unlock(&(p_vmdk_handle->mutex));
+    free(p_table);
+  }
+
+  *p_gte=VmdkLe32(entry);
+  return VMDK_OK;
+}
+
+/*
+ * VmdkMapOffset
+ *
+ * Finds out how the data at the given offset of an extent is stored. *p_end
+ * is set to the extent offset up to which the same applies. For normal data,
+ * *p_host_offset is the position of the data in the extent file, for
+ * compressed grains it is the grain table entry.
+ */
+static int VmdkMapOffset(pts_VmdkHandle p_vmdk_handle,
+                         pts_VmdkExtent p_extent,
+                         uint64_t offset,
+                         int *p_kind,
+                         uint64_t *p_host_offset,
+                         uint64_t *p_end,
+                         int *p_errno)
+{
+  uint64_t grain;
+  uint64_t gd_index;
+  uint32_t gte;
+  int ret;
+
+  *p_host_offset=0;
+  *p_end=p_extent->size;
+  switch(p_extent->type) {
+    case VMDK_EXTENT_ZERO:
+      *p_kind=VMDK_DATA_ZERO;
+      return VMDK_OK;
+    case VMDK_EXTENT_FLAT:
+      *p_kind=VMDK_DATA_NORMAL;
+      *p_host_offset=p_extent->file_offset+offset;
+      return VMDK_OK;
+  }
+
+  grain=offset>>p_extent->grain_bits;
+  *p_kind=VMDK_DATA_ZERO;
+  // The extent might be bigger than the capacity of its sparse file
+  if(grain>=p_extent->grains) return VMDK_OK;
+
+  gd_index=grain/p_extent->gt_entries;
+  if(p_extent->p_gd[gd_index]==0) {
+    // No grain table, the whole area covered by it is unallocated
+    *p_end=GETMIN((gd_index+1)*p_extent->gt_entries<<p_extent->grain_bits,
+                  p_extent->size);
+    return VMDK_OK;
+  }
+
+  ret=VmdkGetGte(p_vmdk_handle,
+                 p_extent,
+                 p_extent->p_gd[gd_index],
+                 grain%p_extent->gt_entries,
+                 &gte,
+                 p_errno);
+  if(ret!=VMDK_OK) return ret;
+
+  *p_end=GETMIN((grain+1)<<p_extent->grain_bits,p_extent->size);
+  if(gte==0 ||
+     (gte==VMDK_GTE_ZEROED &&
+      (p_extent->flags&VMDK_FLAG_ZEROED_GRAIN_GTE)!=0))
+  {
+    return VMDK_OK;
+  }
+  if(p_extent->compressed) {
+    *p_kind=VMDK_DATA_COMPRESSED;
+    *p_host_offset=gte;
+  } else {
+    *p_kind=VMDK_DATA_NORMAL;
+    *p_host_offset=(uint64_t)gte*VMDK_SECTOR_SIZE+
+                   (offset&(p_extent->grain_size-1));
+  }
+  return VMDK_OK;
+}
+
+/*
+ * VmdkReadCompressed
+ *
+ * Reads and uncompresses a compressed grain, using the grain cache. A
+ * compressed grain starts with a marker holding its LBA and data size,
+ * followed by the zlib compressed data.
+ */
+static int VmdkReadCompressed(pts_VmdkHandle p_vmdk_handle,
+                              pts_VmdkGrainJob p_job)
+{
+  pts_VmdkExtent p_extent=p_job->p_extent;
+  unsigned char marker[VMDK_SECTOR_SIZE];
+  uint64_t grain_offset=p_job->gte*VMDK_SECTOR_SIZE;
+  uint64_t read;
+  uint64_t lba;
+  uint64_t in_size;
+  uint64_t first;
+  char *p_in;
+  char *p_grain;
+  z_stream zstream;
+  int zret;
+  int hit;
+  int ret;
+
+  pthread_mutex_lock(&(p_vmdk_handle->mutex));
+  hit=LibXmountCacheGet(&(p_vmdk_handle->grain_cache),
+                        p_extent,
+                        p_job->gte,
+                        p_job->pos,
+                        p_job->count,
+                        p_job->p_dst);
+  pthread_mutex_unlock(&(p_vmdk_handle->mutex));
+  if(hit) return VMDK_OK;
+
+  // Reading the first sector gets the marker and, for small grains, all data
+  ret=VmdkPread(p_extent->fd,
+                (char*)marker,
+                grain_offset,
+                sizeof(marker),
+                &read,
+                &(p_job->err));
+  if(ret!=VMDK_OK) return ret;
+  if(read<VMDK_GRAIN_MARKER_SIZE) return VMDK_CORRUPT_IMAGE;
+  lba=VmdkLe64(marker);
+  in_size=VmdkLe32(marker+8);
+  if(lba!=(p_job->grain<<p_extent->grain_bits)/VMDK_SECTOR_SIZE ||
+     in_size==0 ||
+     in_size>p_extent->grain_size+p_extent->grain_size/8+1024)
+  {
+    return VMDK_CORRUPT_IMAGE;
+  }
+
+  p_in=(char*)malloc(in_size);
+  p_grain=(char*)malloc(p_extent->grain_size);
+  if(p_in==NULL || p_grain==NULL) {
+    free(p_in);
+    free(p_grain);
+    return VMDK_MEMALLOC_FAILED;
+  }
+  first=GETMIN(in_size,read-VMDK_GRAIN_MARKER_SIZE);
+  memcpy(p_in,marker+VMDK_GRAIN_MARKER_SIZE,first);
+  if(first<in_size) {
+    ret=VmdkPreadFull(p_extent->fd,
+                      p_in+first,
+                      grain_offset+VMDK_GRAIN_MARKER_SIZE+first,
+                      in_size-first,
+                      &(p_job->err));
+  }
+
+  if(ret==VMDK_OK) {
+    memset(&zstream,0,sizeof(zstream));
+    if(inflateInit(&zstream)!=Z_OK) ret=VMDK_UNCOMPRESS_FAILED;
+  }
+  if(ret==VMDK_OK) {
+    zstream.next_in=(Bytef*)p_in;
+    zstream.avail_in=(uInt)in_size;
+    zstream.next_out=(Bytef*)p_grain;
+    zstream.avail_out=(uInt)p_extent->grain_size;
+    zret=inflate(&zstream,Z_FINISH);
+    inflateEnd(&zstream);
+    if(zret!=Z_STREAM_END) {
+      ret=VMDK_UNCOMPRESS_FAILED;
+    } else {
+      // The last grain of an extent may be shorter
+      memset(p_grain+(p_extent->grain_size-zstream.avail_out),
+             0,
+             zstream.avail_out);
+    }
+  }
+  free(p_in);
+  if(ret!=VMDK_OK) {
+    free(p_grain);
+    if(p_job->err==0) p_job->err=EIO;
+    return ret;
+  }
+  memcpy(p_job->p_dst,p_grain+p_job->pos,p_job->count);
+
+  pthread_mutex_lock(&(p_vmdk_handle->mutex));
+  p_vmdk_handle->grains_uncompressed++;
+  LibXmountCachePut(&(p_vmdk_handle->grain_cache),
+                    p_extent,
+                    p_job->gte,
+                    &p_grain);
+  pthread_mutex_unlock(&(p_vmdk_handle->mutex));
+  free(p_grain);
+
+  return VMDK_OK;
+}
+
+/*
+ * VmdkNextBatch
+ *
+ * Returns the first queued batch with jobs left to be taken, dropping
+ * exhausted batches from the queue. Must be called with the pool mutex locked.
+ */
+static pts_VmdkJobBatch VmdkNextBatch(pts_VmdkHandle p_vmdk_handle) {
+  while(p_vmdk_handle->p_queue!=NULL &&
+        p_vmdk_handle->p_queue->next==p_vmdk_handle->p_queue->jobs)
+  {
+    p_vmdk_handle->p_queue=p_vmdk_handle->p_queue->p_next;
+  }
+  return p_vmdk_handle->p_queue;
+}
+
+/*
+ * VmdkRunBatchJob
+ *
+ * Takes the next job of the given batch and runs it. Must be called with the
+ * pool mutex locked, which is released while the job is running.
+ */
+static void VmdkRunBatchJob(pts_VmdkHandle p_vmdk_handle,
+                            pts_VmdkJobBatch p_batch)
+{
+  pts_VmdkGrainJob p_job=&(p_batch->p_jobs[p_batch->next++]);
+
+  pthread_mutex_unlock(&(p_vmdk_handle->pool_mutex));
+  p_job->ret=VmdkReadCompressed(p_vmdk_handle,p_job);
+  pthread_mutex_lock(&(p_vmdk_handle->pool_mutex));
+  if(++(p_batch->done)==p_batch->jobs) {
+    pthread_cond_broadcast(&(p_vmdk_handle->done_cond));
+  }
+}
+
+/*
+ * VmdkDecompressionThread
+ */
+static void* VmdkDecompressionThread(void *p_arg) {
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)p_arg;
+  pts_VmdkJobBatch p_batch;
+
+  pthread_mutex_lock(&(p_vmdk_handle->pool_mutex));
+  while(1) {
+    p_batch=VmdkNextBatch(p_vmdk_handle);
+    if(p_batch!=NULL) {
+      VmdkRunBatchJob(p_vmdk_handle,p_batch);
+    } else if(p_vmdk_handle->pool_stop) {
+      break;
+    } else {
+      pthread_cond_wait(&(p_vmdk_handle->pool_cond),
+                        &(p_vmdk_handle->pool_mutex));
+    }
+  }
+  pthread_mutex_unlock(&(p_vmdk_handle->pool_mutex));
+  return NULL;
+}
+
+/*
+ * VmdkRunJobs
+ *
+ * Reads and uncompresses the given compressed grains. If there is more than a
+ * single one, they are queued for the decompression threads and the calling
+ * thread works on them as well until all have been taken. Returns the error of
+ * the first failed job.
+ */
+static int VmdkRunJobs(pts_VmdkHandle p_vmdk_handle,
+                       pts_VmdkGrainJob p_jobs,
+                       uint32_t jobs,
+                       int *p_errno)
+{
+  ts_VmdkJobBatch batch;
+  pts_VmdkJobBatch *pp_batch;
+
+  if(jobs==0) return VMDK_OK;
+  if(p_vmdk_handle->threads_running==0 || jobs==1) {
+    for(uint32_t i=0;i<jobs;i++) {
+      p_jobs[i].ret=VmdkReadCompressed(p_vmdk_handle,&(p_jobs[i]));
+      if(p_jobs[i].ret!=VMDK_OK) break;
+    }
+  } else {
+    memset(&batch,0,sizeof(batch));
+    batch.p_jobs=p_jobs;
+    batch.jobs=jobs;
+
+    pthread_mutex_lock(&(p_vmdk_handle->pool_mutex));
+    for(pp_batch=&(p_vmdk_handle->p_queue);
+        *pp_batch!=NULL;
+        pp_batch=&((*pp_batch)->p_next));
+    *pp_batch=&batch;
+    pthread_cond_broadcast(&(p_vmdk_handle->pool_cond));
+    while(batch.next<batch.jobs) VmdkRunBatchJob(p_vmdk_handle,&batch);
+    while(batch.done<batch.jobs) {
+      pthread_cond_wait(&(p_vmdk_handle->done_cond),
+                        &(p_vmdk_handle->pool_mutex));
+    }
+    // The batch is on the stack, so make sure it is no longer queued
+    for(pp_batch=&(p_vmdk_handle->p_queue);
+        *pp_batch!=NULL;
+        pp_batch=&((*pp_batch)->p_next))
+    {
+      if(*pp_batch==&batch) {
+        *pp_batch=batch.p_next;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&(p_vmdk_handle->pool_mutex));
+  }
+
+  for(uint32_t i=0;i<jobs;i++) {
+    if(p_jobs[i].ret!=VMDK_OK) {
+      if(p_errno!=NULL) *p_errno=p_jobs[i].err;
+      return p_jobs[i].ret;
+    }
+  }
+  return VMDK_OK;
+}
+
+/*
+ * VmdkStartThreads
+ */
+static int VmdkStartThreads(pts_VmdkHandle p_vmdk_handle) {
+  p_vmdk_handle->p_threads=
+    (pthread_t*)calloc(p_vmdk_handle->threads,sizeof(pthread_t));
+  if(p_vmdk_handle->p_threads==NULL) return VMDK_MEMALLOC_FAILED;
+  p_vmdk_handle->pool_stop=0;
+  for(uint32_t i=0;i<p_vmdk_handle->threads;i++) {
+    if(pthread_create(&(p_vmdk_handle->p_threads[i]),
+                      NULL,
+                      VmdkDecompressionThread,
+                      p_vmdk_handle)!=0)
+    {
+      return VMDK_THREAD_CREATE_FAILED;
+    }
+    p_vmdk_handle->threads_running++;
+  }
+  return VMDK_OK;
+}
+
+/*
+ * VmdkStopThreads
+ */
+static void VmdkStopThreads(pts_VmdkHandle p_vmdk_handle) {
+  pthread_mutex_lock(&(p_vmdk_handle->pool_mutex));
+  p_vmdk_handle->pool_stop=1;
+  pthread_cond_broadcast(&(p_vmdk_handle->pool_cond));
+  pthread_mutex_unlock(&(p_vmdk_handle->pool_mutex));
+  for(uint32_t i=0;i<p_vmdk_handle->threads_running;i++) {
+    pthread_join(p_vmdk_handle->p_threads[i],NULL);
+  }
+  p_vmdk_handle->threads_running=0;
+  free(p_vmdk_handle->p_threads);
+  p_vmdk_handle->p_threads=NULL;
+}
+
+/*
+ * VmdkAddJob
+ */
+static int VmdkAddJob(pts_VmdkGrainJob *pp_jobs,
+                      uint32_t *p_jobs,
+                      uint32_t *p_jobs_size,
+                      pts_VmdkGrainJob p_job)
+{
+  pts_VmdkGrainJob p_new_jobs;
+
+  if(*p_jobs==*p_jobs_size) {
+    p_new_jobs=(pts_VmdkGrainJob)realloc(*pp_jobs,
+                                         (*p_jobs_size+16)*
+                                           sizeof(ts_VmdkGrainJob));
+    if(p_new_jobs==NULL) return VMDK_MEMALLOC_FAILED;
+    *pp_jobs=p_new_jobs;
+    *p_jobs_size+=16;
+  }
+  (*pp_jobs)[(*p_jobs)++]=*p_job;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkReadExtent
+ *
+ * Reads count bytes at offset from the given extent. Adjacent normal data is
+ * read with a single pread and zero / unallocated grains don't cause any I/O.
+ * Compressed grains are only added to the job list, they are read and
+ * uncompressed by the caller once all parts of the read have been mapped.
+ */
+static int VmdkReadExtent(pts_VmdkHandle p_vmdk_handle,
+                          pts_VmdkExtent p_extent,
+                          char *p_buf,
+                          uint64_t offset,
+                          uint64_t count,
+                          pts_VmdkGrainJob *pp_jobs,
+                          uint32_t *p_jobs,
+                          uint32_t *p_jobs_size,
+                          int *p_errno)
+{
+  int run_kind=VMDK_DATA_ZERO;
+  uint64_t run_host_offset=0;
+  uint64_t run_offset=0;
+  uint64_t run_len=0;
+  uint64_t pos;
+  int kind;
+  uint64_t host_offset;
+  uint64_t end;
+  uint64_t len;
+  uint64_t bytes_read=0;
+  uint64_t bytes_zero=0;
+  ts_VmdkGrainJob job;
+  int ret=VMDK_OK;
+
+#define VMDK_FLUSH_RUN() {                                         \
+  char *p_run_buf=p_buf+(run_offset-offset);                       \
+  if(run_kind==VMDK_DATA_NORMAL) {                                 \
+    ret=VmdkPreadFull(p_extent->fd,                                \
+                      p_run_buf,                                   \
+                      run_host_offset,                             \
+                      run_len,                                     \
+                      p_errno);                                    \
+    bytes_read+=run_len;                                           \
+  } else {                                                         \
+    memset(p_run_buf,0,run_len);                                   \
+    bytes_zero+=run_len;                                           \
+  }                                                                \
+}
+
+  pos=offset;
+  while(count>0) {
+    ret=VmdkMapOffset(p_vmdk_handle,
+                      p_extent,
+                      pos,
+                      &kind,
+                      &host_offset,
+                      &end,
+                      p_errno);
+    if(ret!=VMDK_OK) break;
+    len=GETMIN(end-pos,count);
+
+    if(run_len!=0 &&
+       (kind!=run_kind || kind==VMDK_DATA_COMPRESSED ||
+        (kind==VMDK_DATA_NORMAL && host_offset!=run_host_offset+run_len)))
+    {
+      // Can't be merged with the current run
+      VMDK_FLUSH_RUN();
+      if(ret!=VMDK_OK) break;
+      run_len=0;
+    }
+
+    if(kind==VMDK_DATA_COMPRESSED) {
+      memset(&job,0,sizeof(job));
+      job.p_extent=p_extent;
+      job.grain=pos>>p_extent->grain_bits;
+      job.gte=host_offset;
+      job.pos=pos&(p_extent->grain_size-1);
+      job.count=len;
+      job.p_dst=p_buf+(pos-offset);
+      ret=VmdkAddJob(pp_jobs,p_jobs,p_jobs_size,&job);
+      if(ret!=VMDK_OK) break;
+      bytes_read+=len;
+    } else {
+      if(run_len==0) {
+        run_kind=kind;
+        run_offset=pos;
+        run_host_offset=host_offset;
+      }
+      run_len+=len;
+    }
+    pos+=len;
+    count-=len;
+  }
+  if(ret==VMDK_OK && run_len!=0) VMDK_FLUSH_RUN();
+
+#undef VMDK_FLUSH_RUN
+
+  pthread_mutex_lock(&(p_vmdk_handle->mutex));
+  p_vmdk_handle->bytes_read+=bytes_read;
+  p_vmdk_handle->bytes_zero+=bytes_zero;
+  pthread_mutex_unlock(&(p_vmdk_handle->mutex));
+
+  return ret;
+}
+
+/*
+ * VmdkFindExtent
+ *
+ * Returns the index of the extent containing the given offset.
+ */
+static uint32_t VmdkFindExtent(pts_VmdkHandle p_vmdk_handle, uint64_t offset) {
+  uint32_t lo=0;
+  uint32_t hi=p_vmdk_handle->extents;
+  uint32_t mid;
+
+  while(hi-lo>1) {
+    mid=lo+(hi-lo)/2;
+    if(p_vmdk_handle->p_extents[mid].start<=offset) lo=mid;
+    else hi=mid;
+  }
+  return lo;
+}
+
+/*
+ * VmdkOpenSparseExtent
+ *
+ * Reads the header and the grain directory of a sparse extent. Stream
+ * optimized extents have a copy of the header with the grain directory offset
+ * in the footer, 1024 bytes before the end of the file.
+ */
+static int VmdkOpenSparseExtent(pts_VmdkHandle p_vmdk_handle,
+                                pts_VmdkExtent p_extent)
+{
+  unsigned char header[VMDK_SPARSE_HEADER_SIZE];
+  uint64_t grain_sectors;
+  uint64_t gd_offset;
+  struct stat file_stat;
+  unsigned char *p_gd_buf;
+  int ret;
+
+  ret=VmdkPreadFull(p_extent->fd,(char*)header,0,sizeof(header),NULL);
+  if(ret!=VMDK_OK) return ret;
+  if(VmdkLe32(header)!=VMDK_SPARSE_MAGIC) {
+    if(VmdkLe32(header)==VMDK_COWD_MAGIC) return VMDK_UNSUPPORTED_EXTENT_TYPE;
+    return VMDK_INVALID_SIGNATURE;
+  }
+  if(VmdkLe64(header+56)==VMDK_GD_AT_END) {
+    if(fstat(p_extent->fd,&file_stat)!=0) return VMDK_READ_FAILED;
+    if(file_stat.st_size<3*VMDK_SPARSE_HEADER_SIZE) return VMDK_CORRUPT_IMAGE;
+    ret=VmdkPreadFull(p_extent->fd,
+                      (char*)header,
+                      (uint64_t)file_stat.st_size-2*VMDK_SPARSE_HEADER_SIZE,
+                      sizeof(header),
+                      NULL);
+    if(ret!=VMDK_OK) return ret;
+    if(VmdkLe32(header)!=VMDK_SPARSE_MAGIC) return VMDK_CORRUPT_IMAGE;
+  }
+
+  p_extent->version=VmdkLe32(header+4);
+  p_extent->flags=VmdkLe32(header+8);
+  p_extent->capacity=VmdkLe64(header+12)*VMDK_SECTOR_SIZE;
+  grain_sectors=VmdkLe64(header+20);
+  p_extent->gt_entries=VmdkLe32(header+44);
+  gd_offset=VmdkLe64(header+56);
+  if(p_extent->version==0 || p_extent->version>VMDK_MAX_SPARSE_VERSION) {
+    return VMDK_UNSUPPORTED_VERSION;
+  }
+  if(grain_sectors==0 || grain_sectors>VMDK_MAX_GRAIN_SECTORS ||
+     (grain_sectors&(grain_sectors-1))!=0 ||
+     p_extent->gt_entries==0 || p_extent->gt_entries>VMDK_MAX_GT_ENTRIES ||
+     gd_offset==0 || gd_offset==VMDK_GD_AT_END)
+  {
+    return VMDK_INVALID_HEADER;
+  }
+  if((p_extent->flags&VMDK_FLAG_COMPRESSED)!=0) {
+    if(header[77]!=VMDK_COMPRESSION_DEFLATE || header[78]!=0) {
+      return VMDK_UNSUPPORTED_EXTENT_TYPE;
+    }
+    p_extent->compressed=1;
+  }
+  if(header[72]!=0) {
+    LIBXMOUNT_LOG_WARNING("Extent '%s' was not closed cleanly, data read from "
+                            "it might be inconsistent\n",
+                          p_extent->p_filename);
+  }
+
+  p_extent->grain_size=grain_sectors*VMDK_SECTOR_SIZE;
+  p_extent->grain_bits=0;
+  while((1ULL<<p_extent->grain_bits)<p_extent->grain_size) {
+    p_extent->grain_bits++;
+  }
+  p_extent->grains=(p_extent->capacity+p_extent->grain_size-1)>>
+                   p_extent->grain_bits;
+  p_extent->gd_entries=(p_extent->grains+p_extent->gt_entries-1)/
+                       p_extent->gt_entries;
+  if(p_extent->gd_entries*4>VMDK_MAX_GD_SIZE) return VMDK_INVALID_HEADER;
+
+  // Read grain directory
+  if(p_extent->gd_entries!=0) {
+    p_extent->p_gd=(uint32_t*)malloc(p_extent->gd_entries*sizeof(uint32_t));
+    if(p_extent->p_gd==NULL) return VMDK_MEMALLOC_FAILED;
+    p_gd_buf=(unsigned char*)p_extent->p_gd;
+    ret=VmdkPreadFull(p_extent->fd,
+                      (char*)p_gd_buf,
+                      gd_offset*VMDK_SECTOR_SIZE,
+                      p_extent->gd_entries*4,
+                      NULL);
+    if(ret!=VMDK_OK) return ret;
+    for(uint64_t i=0;i<p_extent->gd_entries;i++) {
+      p_extent->p_gd[i]=VmdkLe32(p_gd_buf+i*4);
+    }
+  }
+
+  LIBXMOUNT_LOG_DEBUG(p_vmdk_handle->debug,
+                      "Opened sparse extent '%s' (version %" PRIu32
+                        ", grain size %" PRIu64 ", capacity %" PRIu64
+                        "%s)\n",
+                      p_extent->p_filename,
+                      p_extent->version,
+                      p_extent->grain_size,
+                      p_extent->capacity,
+                      p_extent->compressed ? ", compressed" : "");
+  return VMDK_OK;
+}
+
+/*
+ * VmdkGetExtentPath
+ *
+ * Relative extent file names are relative to the descriptor.
+ */
+static char* VmdkGetExtentPath(const char *p_descriptor, const char *p_name) {
+  const char *p_slash;
+  char *p_path;
+  int dir_len;
+
+  p_slash=strrchr(p_descriptor,'/');
+  if(p_name[0]=='/' || p_slash==NULL) return strdup(p_name);
+  dir_len=(int)(p_slash-p_descriptor);
+  if(asprintf(&p_path,"%.*s/%s",dir_len,p_descriptor,p_name)<0) return NULL;
+  return p_path;
+}
+
+/*
+ * VmdkParseExtentLine
+ *
+ * Parses an extent description of the form
+ *   <access> <sectors> <type> ["<file name>" [<offset>]]
+ * and appends the extent to the handle's extent array.
+ */
+static int VmdkParseExtentLine(pts_VmdkHandle p_vmdk_handle, char *p_line) {
+  pts_VmdkExtent p_extents;
+  pts_VmdkExtent p_extent;
+  char *p_access;
+  char *p_sectors;
+  char *p_type;
+  char *p_name=NULL;
+  char *p_offset=NULL;
+  char *p_end;
+  uint64_t sectors;
+  uint64_t offset=0;
+  uint8_t type;
+  int ok;
+
+  p_access=strtok_r(p_line," \t",&p_end);
+  p_sectors=strtok_r(NULL," \t",&p_end);
+  p_type=strtok_r(NULL," \t",&p_end);
+  if(p_access==NULL || p_sectors==NULL || p_type==NULL) {
+    return VMDK_INVALID_DESCRIPTOR;
+  }
+  sectors=StrToUint64(p_sectors,&ok);
+  if(!ok || sectors>UINT64_MAX/VMDK_SECTOR_SIZE) {
+    return VMDK_INVALID_DESCRIPTOR;
+  }
+
+  // The file name is quoted and may contain blanks
+  while(*p_end==' ' || *p_end=='\t') p_end++;
+  if(*p_end=='"') {
+    p_name=p_end+1;
+    p_end=strchr(p_name,'"');
+    if(p_end==NULL) return VMDK_INVALID_DESCRIPTOR;
+    *p_end++='\0';
+    p_offset=strtok_r(NULL," \t",&p_end);
+  }
+
+  if(strcmp(p_access,"NOACCESS")==0 || strcmp(p_type,"ZERO")==0) {
+    type=VMDK_EXTENT_ZERO;
+  } else if(strcmp(p_type,"SPARSE")==0) {
+    type=VMDK_EXTENT_SPARSE;
+  } else if(strcmp(p_type,"FLAT")==0 ||
+            strcmp(p_type,"VMFS")==0 ||
+            strcmp(p_type,"VMFSRAW")==0 ||
+            strcmp(p_type,"VMFSRDM")==0)
+  {
+    type=VMDK_EXTENT_FLAT;
+  } else {
+    // VMFSSPARSE and SESPARSE extents
+    LIBXMOUNT_LOG_DEBUG(p_vmdk_handle->debug,
+                        "Unsupported extent type '%s'\n",
+                        p_type);
+    return VMDK_UNSUPPORTED_EXTENT_TYPE;
+  }
+  if(type!=VMDK_EXTENT_ZERO && (p_name==NULL || *p_name=='\0')) {
+    return VMDK_INVALID_DESCRIPTOR;
+  }
+  if(type==VMDK_EXTENT_FLAT && p_offset!=NULL) {
+    offset=StrToUint64(p_offset,&ok);
+    if(!ok || offset>UINT64_MAX/VMDK_SECTOR_SIZE) {
+      return VMDK_INVALID_DESCRIPTOR;
+    }
+  }
+  if(sectors==0) return VMDK_OK;
+  if(sectors*VMDK_SECTOR_SIZE>UINT64_MAX-p_vmdk_handle->size) {
+    return VMDK_INVALID_DESCRIPTOR;
+  }
+
+  p_extents=(pts_VmdkExtent)realloc(p_vmdk_handle->p_extents,
+                                    (p_vmdk_handle->extents+1)*
+                                      sizeof(ts_VmdkExtent));
+  if(p_extents==NULL) return VMDK_MEMALLOC_FAILED;
+  p_vmdk_handle->p_extents=p_extents;
+  p_extent=&(p_extents[p_vmdk_handle->extents++]);
+  memset(p_extent,0,sizeof(ts_VmdkExtent));
+  p_extent->fd=-1;
+  p_extent->type=type;
+  p_extent->start=p_vmdk_handle->size;
+  p_extent->size=sectors*VMDK_SECTOR_SIZE;
+  p_extent->file_offset=offset*VMDK_SECTOR_SIZE;
+  p_vmdk_handle->size+=p_extent->size;
+  if(type!=VMDK_EXTENT_ZERO) {
+    p_extent->p_filename=VmdkGetExtentPath(p_vmdk_handle->p_filename,p_name);
+    if(p_extent->p_filename==NULL) return VMDK_MEMALLOC_FAILED;
+  }
+  return VMDK_OK;
+}
+
+/*
+ * VmdkParseDescriptor
+ *
+ * Parses the text descriptor, which is modified in the process. Extent lines
+ * are only parsed if with_extents is set.
+ */
+static int VmdkParseDescriptor(pts_VmdkHandle p_vmdk_handle,
+                               char *p_text,
+                               uint8_t with_extents)
+{
+  char *p_line;
+  char *p_next;
+  char *p_value;
+  char *p_end;
+  int ret;
+
+  for(p_line=p_text;p_line!=NULL;p_line=p_next) {
+    p_next=strchr(p_line,'\n');
+    if(p_next!=NULL) *p_next++='\0';
+    // Trim leading and trailing blanks
+    while(*p_line==' ' || *p_line=='\t') p_line++;
+    p_end=p_line+strlen(p_line);
+    while(p_end>p_line &&
+          (p_end[-1]=='\r' || p_end[-1]==' ' || p_end[-1]=='\t'))
+    {
+      *--p_end='\0';
+    }
+    if(*p_line=='\0' || *p_line=='#') continue;
+
+    if(strncmp(p_line,"RW ",3)==0 ||
+       strncmp(p_line,"RDONLY ",7)==0 ||
+       strncmp(p_line,"NOACCESS ",9)==0)
+    {
+      if(!with_extents) continue;
+      ret=VmdkParseExtentLine(p_vmdk_handle,p_line);
+      if(ret!=VMDK_OK) return ret;
+      continue;
+    }
+
+    // Key / value pair, the value may be quoted
+    p_value=strchr(p_line,'=');
+    if(p_value==NULL) continue;
+    p_end=p_value;
+    while(p_end>p_line && (p_end[-1]==' ' || p_end[-1]=='\t')) p_end--;
+    *p_end='\0';
+    p_value++;
+    while(*p_value==' ' || *p_value=='\t') p_value++;
+    if(*p_value=='"') {
+      p_value++;
+      p_end=strchr(p_value,'"');
+      if(p_end!=NULL) *p_end='\0';
+    }
+
+    if(strcmp(p_line,"createType")==0 &&
+       p_vmdk_handle->p_create_type==NULL)
+    {
+      p_vmdk_handle->p_create_type=strdup(p_value);
+      if(p_vmdk_handle->p_create_type==NULL) return VMDK_MEMALLOC_FAILED;
+    } else if(strcmp(p_line,"parentCID")==0 &&
+              strcasecmp(p_value,"ffffffff")!=0)
+    {
+      return VMDK_DIFFERENCING_IMAGE;
+    }
+  }
+  return VMDK_OK;
+}
+
+/*
+ * VmdkReadDescriptor
+ *
+ * Reads size bytes of descriptor text at offset of the given file into a
+ * newly allocated, NUL terminated buffer.
+ */
+static int VmdkReadDescriptor(int fd,
+                              uint64_t offset,
+                              uint64_t size,
+                              char **pp_text)
+{
+  uint64_t read;
+  char *p_text;
+  int ret;
+
+  if(size>VMDK_MAX_DESCRIPTOR_SIZE) return VMDK_INVALID_DESCRIPTOR;
+  p_text=(char*)malloc(size+1);
+  if(p_text==NULL) return VMDK_MEMALLOC_FAILED;
+  ret=VmdkPread(fd,p_text,offset,size,&read,NULL);
+  if(ret!=VMDK_OK) {
+    free(p_text);
+    return ret;
+  }
+  // Embedded descriptors are padded with NUL bytes
+  p_text[read]='\0';
+  *pp_text=p_text;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkCloseExtents
+ */
+static int VmdkCloseExtents(pts_VmdkHandle p_vmdk_handle) {
+  pts_VmdkExtent p_extent;
+  int ret=VMDK_OK;
+
+  for(uint32_t i=0;i<p_vmdk_handle->extents;i++) {
+    p_extent=&(p_vmdk_handle->p_extents[i]);
+    if(p_extent->fd!=-1 && close(p_extent->fd)!=0) ret=VMDK_CLOSE_FAILED;
+    free(p_extent->p_filename);
+    free(p_extent->p_gd);
+  }
+  free(p_vmdk_handle->p_extents);
+  p_vmdk_handle->p_extents=NULL;
+  p_vmdk_handle->extents=0;
+  p_vmdk_handle->size=0;
+  return ret;
+}
+
+/*
+ * VmdkCreateHandle
+ */
+static int VmdkCreateHandle(void **pp_handle,
+                            const char *p_format,
+                            uint8_t debug)
+{
+  (void)p_format;
+  pts_VmdkHandle p_vmdk_handle;
+  long cpus;
+
+  // Alloc new lib handle
+  p_vmdk_handle=(pts_VmdkHandle)calloc(1,sizeof(ts_VmdkHandle));
+  if(p_vmdk_handle==NULL) return VMDK_MEMALLOC_FAILED;
+
+  // Init handle values
+  p_vmdk_handle->gt_cache_size=VMDK_DEFAULT_GT_CACHE_SIZE;
+  p_vmdk_handle->grain_cache_entries=VMDK_DEFAULT_GRAIN_CACHE_ENTRIES;
+  // A single CPU is better used by uncompressing in the reading thread
+  cpus=sysconf(_SC_NPROCESSORS_ONLN);
+  if(cpus>1) p_vmdk_handle->threads=GETMIN(cpus,VMDK_MAX_DEFAULT_THREADS);
+  p_vmdk_handle->debug=debug;
+  pthread_mutex_init(&(p_vmdk_handle->mutex),NULL);
+  pthread_mutex_init(&(p_vmdk_handle->pool_mutex),NULL);
+  pthread_cond_init(&(p_vmdk_handle->pool_cond),NULL);
+  pthread_cond_init(&(p_vmdk_handle->done_cond),NULL);
+
+  *pp_handle=p_vmdk_handle;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkDestroyHandle
+ */
+static int VmdkDestroyHandle(void **pp_handle) {
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)*pp_handle;
+
+  if(p_vmdk_handle!=NULL) {
+    pthread_cond_destroy(&(p_vmdk_handle->done_cond));
+    pthread_cond_destroy(&(p_vmdk_handle->pool_cond));
+    pthread_mutex_destroy(&(p_vmdk_handle->pool_mutex));
+    pthread_mutex_destroy(&(p_vmdk_handle->mutex));
+    free(p_vmdk_handle);
+  }
+
+  *pp_handle=NULL;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkOpen
+ */
+static int VmdkOpen(void *p_handle,
+                    const char **pp_filename_arr,
+                    uint64_t filename_arr_len)
+{
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)p_handle;
+  pts_VmdkExtent p_extent;
+  unsigned char header[VMDK_SPARSE_HEADER_SIZE];
+  uint64_t header_read;
+  uint64_t gt_cache_entries;
+  uint64_t gt_size=0;
+  uint8_t compressed=0;
+  struct stat file_stat;
+  char *p_text=NULL;
+  int fd;
+  int ret;
+
+  if(filename_arr_len==0) return VMDK_NO_INPUT_FILES;
+  if(filename_arr_len>1) return VMDK_TOO_MANY_INPUT_FILES;
+
+  p_vmdk_handle->p_filename=strdup(pp_filename_arr[0]);
+  if(p_vmdk_handle->p_filename==NULL) return VMDK_MEMALLOC_FAILED;
+
+#define VMDK_OPEN_ERROR(err) { \
+  VmdkClose(p_handle);         \
+  return (err);                \
+}
+
+  fd=open(p_vmdk_handle->p_filename,O_RDONLY);
+  if(fd==-1) VMDK_OPEN_ERROR(VMDK_OPEN_FAILED);
+  memset(header,0,sizeof(header));
+  ret=VmdkPread(fd,(char*)header,0,sizeof(header),&header_read,NULL);
+  if(ret==VMDK_OK && fstat(fd,&file_stat)!=0) ret=VMDK_READ_FAILED;
+  if(ret!=VMDK_OK) {
+    close(fd);
+    VMDK_OPEN_ERROR(ret);
+  }
+
+  if(VmdkLe32(header)==VMDK_SPARSE_MAGIC) {
+    // Monolithic sparse or stream optimized image with embedded descriptor.
+    // The file itself is the only extent, whatever name the descriptor gives.
+    if(VmdkLe64(header+28)!=0 && VmdkLe64(header+36)!=0) {
+      ret=VmdkReadDescriptor(fd,
+                             VmdkLe64(header+28)*VMDK_SECTOR_SIZE,
+                             VmdkLe64(header+36)*VMDK_SECTOR_SIZE,
+                             &p_text);
+      if(ret==VMDK_OK) {
+        ret=VmdkParseDescriptor(p_vmdk_handle,p_text,0);
+        free(p_text);
+      }
+      if(ret!=VMDK_OK) {
+        close(fd);
+        VMDK_OPEN_ERROR(ret);
+      }
+    }
+    p_vmdk_handle->embedded_descriptor=1;
+    p_vmdk_handle->p_extents=(pts_VmdkExtent)calloc(1,sizeof(ts_VmdkExtent));
+    if(p_vmdk_handle->p_extents==NULL) {
+      close(fd);
+      VMDK_OPEN_ERROR(VMDK_MEMALLOC_FAILED);
+    }
+    p_vmdk_handle->extents=1;
+    p_extent=p_vmdk_handle->p_extents;
+    p_extent->fd=fd;
+    p_extent->type=VMDK_EXTENT_SPARSE;
+    p_extent->p_filename=strdup(p_vmdk_handle->p_filename);
+    if(p_extent->p_filename==NULL) VMDK_OPEN_ERROR(VMDK_MEMALLOC_FAILED);
+    ret=VmdkOpenSparseExtent(p_vmdk_handle,p_extent);
+    if(ret!=VMDK_OK) VMDK_OPEN_ERROR(ret);
+    p_extent->size=p_extent->capacity;
+    p_vmdk_handle->size=p_extent->capacity;
+  } else {
+    // Text descriptor
+    if(VmdkLe32(header)==VMDK_COWD_MAGIC) {
+      close(fd);
+      VMDK_OPEN_ERROR(VMDK_UNSUPPORTED_EXTENT_TYPE);
+    }
+    if(memchr(header,'\0',header_read)!=NULL) {
+      close(fd);
+      VMDK_OPEN_ERROR(VMDK_INVALID_SIGNATURE);
+    }
+    ret=VmdkReadDescriptor(fd,0,(uint64_t)file_stat.st_size,&p_text);
+    close(fd);
+    if(ret!=VMDK_OK) VMDK_OPEN_ERROR(ret);
+    ret=VmdkParseDescriptor(p_vmdk_handle,p_text,1);
+    free(p_text);
+    if(ret!=VMDK_OK) VMDK_OPEN_ERROR(ret);
+    if(p_vmdk_handle->extents==0) VMDK_OPEN_ERROR(VMDK_INVALID_SIGNATURE);
+
+    for(uint32_t i=0;i<p_vmdk_handle->extents;i++) {
+      p_extent=&(p_vmdk_handle->p_extents[i]);
+      if(p_extent->type==VMDK_EXTENT_ZERO) continue;
+      p_extent->fd=open(p_extent->p_filename,O_RDONLY);
+      if(p_extent->fd==-1) {
+        LIBXMOUNT_LOG_ERROR("Unable to open extent file '%s'\n",
+                            p_extent->p_filename);
+        VMDK_OPEN_ERROR(VMDK_EXTENT_OPEN_FAILED);
+      }
+      if(p_extent->type==VMDK_EXTENT_SPARSE) {
+        ret=VmdkOpenSparseExtent(p_vmdk_handle,p_extent);
+        if(ret!=VMDK_OK) VMDK_OPEN_ERROR(ret);
+      }
+    }
+  }
+
+  // Size the grain table cache by the biggest grain table
+  for(uint32_t i=0;i<p_vmdk_handle->extents;i++) {
+    p_extent=&(p_vmdk_handle->p_extents[i]);
+    if(p_extent->type!=VMDK_EXTENT_SPARSE) continue;
+    gt_size=GETMAX(gt_size,p_extent->gt_entries*4);
+    compressed|=p_extent->compressed;
+  }
+  if(gt_size!=0) {
+    gt_cache_entries=(p_vmdk_handle->gt_cache_size*1024*1024)/gt_size;
+    gt_cache_entries=GETMAX(gt_cache_entries,VMDK_MIN_GT_CACHE_ENTRIES);
+    if(LibXmountCacheInit(&(p_vmdk_handle->gt_cache),gt_cache_entries)!=0) {
+      VMDK_OPEN_ERROR(VMDK_MEMALLOC_FAILED);
+    }
+  }
+  if(compressed) {
+    if(LibXmountCacheInit(&(p_vmdk_handle->grain_cache),
+                          p_vmdk_handle->grain_cache_entries)!=0)
+    {
+      VMDK_OPEN_ERROR(VMDK_MEMALLOC_FAILED);
+    }
+    if(p_vmdk_handle->threads!=0) {
+      ret=VmdkStartThreads(p_vmdk_handle);
+      if(ret!=VMDK_OK) VMDK_OPEN_ERROR(ret);
+    }
+  }
+
+#undef VMDK_OPEN_ERROR
+
+  LIBXMOUNT_LOG_DEBUG(p_vmdk_handle->debug,
+                      "Opened VMDK image '%s' (%" PRIu32 " extents, size %"
+                        PRIu64 ")\n",
+                      p_vmdk_handle->p_filename,
+                      p_vmdk_handle->extents,
+                      p_vmdk_handle->size);
+  return VMDK_OK;
+}
+
+/*
+ * VmdkClose
+ */
+static int VmdkClose(void *p_handle) {
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)p_handle;
+  int ret;
+
+  LIBXMOUNT_LOG_DEBUG(p_vmdk_handle->debug,
+                      "Read %" PRIu64 " bytes from extent files, %" PRIu64
+                        " zero bytes without I/O\n",
+                      p_vmdk_handle->bytes_read,
+                      p_vmdk_handle->bytes_zero);
+  LIBXMOUNT_LOG_DEBUG(p_vmdk_handle->debug,
+                      "Grain table cache: %" PRIu64 " hits, %" PRIu64
+                        " misses; %" PRIu64 " grains uncompressed\n",
+                      p_vmdk_handle->gt_cache.hits,
+                      p_vmdk_handle->gt_cache.misses,
+                      p_vmdk_handle->grains_uncompressed);
+
+  if(p_vmdk_handle->p_threads!=NULL) VmdkStopThreads(p_vmdk_handle);
+  ret=VmdkCloseExtents(p_vmdk_handle);
+  LibXmountCacheFree(&(p_vmdk_handle->gt_cache));
+  LibXmountCacheFree(&(p_vmdk_handle->grain_cache));
+  free(p_vmdk_handle->p_create_type);
+  p_vmdk_handle->p_create_type=NULL;
+  free(p_vmdk_handle->p_filename);
+  p_vmdk_handle->p_filename=NULL;
+
+  return ret;
+}
+
+/*
+ * VmdkSize
+ */
+static int VmdkSize(void *p_handle, uint64_t *p_size) {
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)p_handle;
+
+  *p_size=p_vmdk_handle->size;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkRead
+ *
+ * All parts of the read are mapped first, reading uncompressed data on the
+ * way. The compressed grains found are then uncompressed at once, in parallel
+ * if there are several of them.
+ */
+static int VmdkRead(void *p_handle,
+                    char *p_buf,
+                    off_t offset,
+                    size_t count,
+                    size_t *p_read,
+                    int *p_errno)
+{
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)p_handle;
+  pts_VmdkExtent p_extent;
+  pts_VmdkGrainJob p_jobs=NULL;
+  uint32_t jobs=0;
+  uint32_t jobs_size=0;
+  uint64_t pos;
+  uint64_t remaining;
+  uint64_t len;
+  uint32_t i;
+  int ret=VMDK_OK;
+
+  *p_read=0;
+  if(offset<0 ||
+     (uint64_t)offset>p_vmdk_handle->size ||
+     count>p_vmdk_handle->size-(uint64_t)offset)
+  {
+    return VMDK_READ_BEYOND_END_OF_IMAGE;
+  }
+
+  pos=(uint64_t)offset;
+  remaining=count;
+  i=remaining!=0 ? VmdkFindExtent(p_vmdk_handle,pos) : 0;
+  while(remaining>0 && i<p_vmdk_handle->extents) {
+    p_extent=&(p_vmdk_handle->p_extents[i++]);
+    len=GETMIN(remaining,p_extent->start+p_extent->size-pos);
+    ret=VmdkReadExtent(p_vmdk_handle,
+                       p_extent,
+                       p_buf+(pos-(uint64_t)offset),
+                       pos-p_extent->start,
+                       len,
+                       &p_jobs,
+                       &jobs,
+                       &jobs_size,
+                       p_errno);
+    if(ret!=VMDK_OK) break;
+    pos+=len;
+    remaining-=len;
+  }
+  if(ret==VMDK_OK) ret=VmdkRunJobs(p_vmdk_handle,p_jobs,jobs,p_errno);
+  free(p_jobs);
+  if(ret!=VMDK_OK) return ret;
+
+  *p_read=count;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkWrite
+ */
+static int VmdkWrite(void *p_handle,
+                     const char *p_buf,
+                     off_t seek,
+                     size_t count,
+                     size_t *p_written,
+                     int *p_errno)
+{
+  return VMDK_WRITE_FAILED;
+}
+
+/*
+ * VmdkOptionsHelp
+ */
+static int VmdkOptionsHelp(const char **pp_help) {
+  char *p_help=NULL;
+  int ret;
+
+  ret=asprintf(&p_help,
+               "    %-12s : Size of the grain table cache in MiB. "
+                 "Default: %d\n"
+               "    %-12s : Number of uncompressed grains to cache. "
+                 "Default: %d\n"
+               "    %-12s : Number of threads uncompressing grains, 0 to "
+                 "uncompress in the reading thread. Default: number of CPUs "
+                 "(max. %d, 0 with a single CPU)\n",
+               VMDK_OPTION_GTCACHE,VMDK_DEFAULT_GT_CACHE_SIZE,
+               VMDK_OPTION_GRAINCACHE,VMDK_DEFAULT_GRAIN_CACHE_ENTRIES,
+               VMDK_OPTION_THREADS,VMDK_MAX_DEFAULT_THREADS);
+  if(ret<0 || p_help==NULL) return VMDK_MEMALLOC_FAILED;
+
+  *pp_help=p_help;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkOptionsParse
+ */
+static int VmdkOptionsParse(void *p_handle,
+                            uint32_t options_count,
+                            const pts_LibXmountOptions *pp_options,
+                            const char **pp_error)
+{
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)p_handle;
+  pts_LibXmountOptions p_option;
+  uint64_t value;
+  int ok;
+
+#define VMDK_OPTION_ERROR(option) {                               \
+  *pp_error=strdup("Error in option " option ": Invalid value");  \
+  return VMDK_INVALID_OPTION_VALUE;                               \
+}
+
+  *pp_error=NULL;
+  for(uint32_t i=0;i<options_count;i++) {
+    p_option=pp_options[i];
+    if(strcmp(p_option->p_key,VMDK_OPTION_GTCACHE)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>UINT32_MAX) VMDK_OPTION_ERROR(VMDK_OPTION_GTCACHE);
+      p_vmdk_handle->gt_cache_size=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,VMDK_OPTION_GRAINCACHE)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>UINT32_MAX) VMDK_OPTION_ERROR(VMDK_OPTION_GRAINCACHE);
+      p_vmdk_handle->grain_cache_entries=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,VMDK_OPTION_THREADS)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>VMDK_MAX_THREADS) VMDK_OPTION_ERROR(VMDK_OPTION_THREADS);
+      p_vmdk_handle->threads=(uint32_t)value;
+      p_option->valid=1;
+    }
+  }
+
+#undef VMDK_OPTION_ERROR
+
+  return VMDK_OK;
+}
+
+/*
+ * VmdkGetInfofileContent
+ */
+static int VmdkGetInfofileContent(void *p_handle, const char **pp_info_buf) {
+  pts_VmdkHandle p_vmdk_handle=(pts_VmdkHandle)p_handle;
+  pts_VmdkExtent p_extent;
+  char *p_infobuf=NULL;
+  char *p_line;
+  size_t infobuf_len=0;
+  size_t line_len;
+  int ret;
+
+#define VMDK_INFOBUF_APPEND(...) {                                    \
+  ret=asprintf(&p_line,__VA_ARGS__);                                  \
+  if(ret<0) {                                                         \
+    free(p_infobuf);                                                  \
+    return VMDK_MEMALLOC_FAILED;                                      \
+  }                                                                   \
+  line_len=strlen(p_line);                                            \
+  p_infobuf=(char*)realloc(p_infobuf,infobuf_len+line_len+1);         \
+  if(p_infobuf==NULL) {                                               \
+    free(p_line);                                                     \
+    return VMDK_MEMALLOC_FAILED;                                      \
+  }                                                                   \
+  memcpy(p_infobuf+infobuf_len,p_line,line_len+1);                    \
+  infobuf_len+=line_len;                                              \
+  free(p_line);                                                       \
+}
+
+  VMDK_INFOBUF_APPEND("VMDK create type: %s\n"
+                        "Virtual size: %" PRIu64 " bytes\n"
+                        "Extents: %" PRIu32 "%s\n",
+                      p_vmdk_handle->p_create_type!=NULL ?
+                        p_vmdk_handle->p_create_type : "unknown",
+                      p_vmdk_handle->size,
+                      p_vmdk_handle->extents,
+                      p_vmdk_handle->embedded_descriptor ?
+                        " (descriptor embedded in sparse extent)" : "");
+  for(uint32_t i=0;i<p_vmdk_handle->extents;i++) {
+    p_extent=&(p_vmdk_handle->p_extents[i]);
+    switch(p_extent->type) {
+      case VMDK_EXTENT_SPARSE:
+        VMDK_INFOBUF_APPEND("Extent %" PRIu32 ": %s, %" PRIu64 " bytes, "
+                              "sparse%s, grain size %" PRIu64 " bytes\n",
+                            i+1,
+                            p_extent->p_filename,
+                            p_extent->size,
+                            p_extent->compressed ? " (compressed)" : "",
+                            p_extent->grain_size);
+        break;
+      case VMDK_EXTENT_FLAT:
+        VMDK_INFOBUF_APPEND("Extent %" PRIu32 ": %s, %" PRIu64 " bytes, "
+                              "flat\n",
+                            i+1,
+                            p_extent->p_filename,
+                            p_extent->size);
+        break;
+      default:
+        VMDK_INFOBUF_APPEND("Extent %" PRIu32 ": %" PRIu64 " bytes, zero\n",
+                            i+1,
+                            p_extent->size);
+    }
+  }
+  if(p_vmdk_handle->grain_cache.entries!=0) {
+    VMDK_INFOBUF_APPEND("Decompression threads: %" PRIu32 "\n",
+                        p_vmdk_handle->threads_running);
+  }
+
+#undef VMDK_INFOBUF_APPEND
+
+  *pp_info_buf=p_infobuf;
+  return VMDK_OK;
+}
+
+/*
+ * VmdkGetErrorMessage
+ */
+static const char* VmdkGetErrorMessage(int err_num) {
+  switch(err_num) {
+    case VMDK_MEMALLOC_FAILED:
+      return "Unable to allocate memory";
+      break;
+    case VMDK_NO_INPUT_FILES:
+      return "No input file specified";
+      break;
+    case VMDK_TOO_MANY_INPUT_FILES:
+      return "Only a single VMDK file (the descriptor) may be specified";
+      break;
+    case VMDK_OPEN_FAILED:
+      return "Unable to open VMDK file";
+      break;
+    case VMDK_EXTENT_OPEN_FAILED:
+      return "Unable to open VMDK extent file";
+      break;
+    case VMDK_READ_FAILED:
+      return "Unable to read VMDK data";
+      break;
+    case VMDK_CLOSE_FAILED:
+      return "Unable to close VMDK file(s)";
+      break;
+    case VMDK_INVALID_SIGNATURE:
+      return "The specified file is not a VMDK image";
+      break;
+    case VMDK_INVALID_DESCRIPTOR:
+      return "Invalid VMDK descriptor";
+      break;
+    case VMDK_INVALID_HEADER:
+      return "Invalid VMDK sparse extent header";
+      break;
+    case VMDK_UNSUPPORTED_VERSION:
+      return "Unsupported VMDK sparse extent version";
+      break;
+    case VMDK_UNSUPPORTED_EXTENT_TYPE:
+      return "Unsupported VMDK extent type (ESX sparse and SE sparse extents "
+               "are not supported)";
+      break;
+    case VMDK_DIFFERENCING_IMAGE:
+      return "Differencing (snapshot) VMDK images are not supported";
+      break;
+    case VMDK_CORRUPT_IMAGE:
+      return "The VMDK image is corrupt or truncated";
+      break;
+    case VMDK_UNCOMPRESS_FAILED:
+      return "Unable to uncompress grain";
+      break;
+    case VMDK_THREAD_CREATE_FAILED:
+      return "Unable to create decompression thread";
+      break;
+    case VMDK_READ_BEYOND_END_OF_IMAGE:
+      return "Unable to read beyond end of image";
+      break;
+    case VMDK_WRITE_FAILED:
+      return "Write is not supported in VMDK input module.";
+      break;
+    case VMDK_INVALID_OPTION_VALUE:
+      return "Invalid option value";
+      break;
+    default:
+      return "Unknown error";
+  }
+}
+
+/*
+ * VmdkFreeBuffer
+ */
+static int VmdkFreeBuffer(void *p_buf) {
+  free(p_buf);
+  return VMDK_OK;
+}
+
+/*
+  ----- Change log -----
+  20261019: * Initial version, reading sparse (incl. stream optimized), flat
+              and zero extents of single and multi extent images.
+*/
@@ -0,0 +1,235 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#ifndef LIBXMOUNT_INPUT_VMDK_H
+#define LIBXMOUNT_INPUT_VMDK_H
+
+/*******************************************************************************
+ * Enums, Typedefs, etc...
+ ******************************************************************************/
+//! Possible error return codes
+enum {
+  VMDK_OK=0,
+  VMDK_MEMALLOC_FAILED,
+  VMDK_NO_INPUT_FILES,
+  VMDK_TOO_MANY_INPUT_FILES,
+  VMDK_OPEN_FAILED,
+  VMDK_EXTENT_OPEN_FAILED,
+  VMDK_READ_FAILED,
+  VMDK_CLOSE_FAILED,
+  VMDK_INVALID_SIGNATURE,
+  VMDK_INVALID_DESCRIPTOR,
+  VMDK_INVALID_HEADER,
+  VMDK_UNSUPPORTED_VERSION,
+  VMDK_UNSUPPORTED_EXTENT_TYPE,
+  VMDK_DIFFERENCING_IMAGE,
+  VMDK_CORRUPT_IMAGE,
+  VMDK_UNCOMPRESS_FAILED,
+  VMDK_THREAD_CREATE_FAILED,
+  VMDK_READ_BEYOND_END_OF_IMAGE,
+  VMDK_WRITE_FAILED,
+  VMDK_INVALID_OPTION_VALUE
+};
+
+#define GETMAX(a,b) ((a)>(b)?(a):(b))
+#define GETMIN(a,b) ((a)<(b)?(a):(b))
+
+//! Sector size used by all VMDK sizes and offsets
+#define VMDK_SECTOR_SIZE 512
+//! Sparse extent magic ("KDMV") and magic of unsupported ESX sparse extents
+#define VMDK_SPARSE_MAGIC 0x564d444bUL
+#define VMDK_COWD_MAGIC 0x44574f43UL
+//! Size of the sparse extent header
+#define VMDK_SPARSE_HEADER_SIZE 512
+//! Highest supported sparse extent version
+#define VMDK_MAX_SPARSE_VERSION 3
+//! gdOffset of stream optimized extents having their header in the footer
+#define VMDK_GD_AT_END 0xffffffffffffffffULL
+//! Sparse extent flags
+#define VMDK_FLAG_ZEROED_GRAIN_GTE (1UL<<2)
+#define VMDK_FLAG_COMPRESSED       (1UL<<16)
+#define VMDK_FLAG_MARKERS          (1UL<<17)
+//! Compression algorithm of compressed grains
+#define VMDK_COMPRESSION_DEFLATE 1
+//! Grain table entry of zeroed grains (needs VMDK_FLAG_ZEROED_GRAIN_GTE)
+#define VMDK_GTE_ZEROED 1
+//! Size of the marker preceding compressed grains (LBA and data size)
+#define VMDK_GRAIN_MARKER_SIZE 12
+//! Limits of sparse extent parameters
+#define VMDK_MAX_GRAIN_SECTORS 65536
+#define VMDK_MAX_GT_ENTRIES 65536
+#define VMDK_MAX_GD_SIZE (64*1024*1024)
+//! Max. size of a descriptor (text file or embedded in a sparse extent)
+#define VMDK_MAX_DESCRIPTOR_SIZE (1024*1024)
+//! Default size of the grain table cache in MiB
+#define VMDK_DEFAULT_GT_CACHE_SIZE 4
+//! Min. number of cached grain tables
+#define VMDK_MIN_GT_CACHE_ENTRIES 4
+//! Default number of cached uncompressed grains
+#define VMDK_DEFAULT_GRAIN_CACHE_ENTRIES 64
+//! Max. (and max. default) number of decompression threads
+#define VMDK_MAX_THREADS 64
+#define VMDK_MAX_DEFAULT_THREADS 8
+
+//! Extent types
+enum {
+  VMDK_EXTENT_SPARSE=0, //!< Hosted sparse extent (incl. stream optimized)
+  VMDK_EXTENT_FLAT,     //!< Flat extent (FLAT, VMFS, VMFSRAW, VMFSRDM)
+  VMDK_EXTENT_ZERO      //!< Zero extent (ZERO or NOACCESS)
+};
+
+//! Kind of data backing a part of an extent
+enum {
+  VMDK_DATA_ZERO=0,     //!< Unallocated or zeroed grain, reads as zeros
+  VMDK_DATA_NORMAL,     //!< Stored uncompressed in the extent file
+  VMDK_DATA_COMPRESSED  //!< Stored compressed in the extent file
+};
+
+//! One extent of the virtual disk
+typedef struct s_VmdkExtent {
+  //! Extent file name and descriptor, unused for zero extents
+  char *p_filename;
+  int fd;
+  //! Extent type
+  uint8_t type;
+  //! Offset of the extent in the virtual disk and its size
+  uint64_t start;
+  uint64_t size;
+  //! Flat extents: offset of the extent data in the extent file
+  uint64_t file_offset;
+  //! Sparse extents: header values
+  uint32_t version;
+  uint32_t flags;
+  uint64_t capacity;
+  uint64_t grain_size;
+  uint32_t grain_bits;
+  uint64_t grains;
+  uint64_t gt_entries;
+  uint8_t compressed;
+  //! Sparse extents: grain directory, in host byte order
+  uint32_t *p_gd;
+  uint64_t gd_entries;
+} ts_VmdkExtent, *pts_VmdkExtent;
+
+//! Compressed grain to be read and uncompressed
+typedef struct s_VmdkGrainJob {
+  pts_VmdkExtent p_extent;
+  //! Grain number within the extent and its grain table entry
+  uint64_t grain;
+  uint64_t gte;
+  //! Part of the grain to copy to p_dst
+  uint64_t pos;
+  uint64_t count;
+  char *p_dst;
+  //! Result
+  int ret;
+  int err;
+} ts_VmdkGrainJob, *pts_VmdkGrainJob;
+
+//! Compressed grains of a single read, queued for the decompression threads
+typedef struct s_VmdkJobBatch {
+  pts_VmdkGrainJob p_jobs;
+  uint32_t jobs;
+  //! Next job to be taken and number of finished jobs
+  uint32_t next;
+  uint32_t done;
+  struct s_VmdkJobBatch *p_next;
+} ts_VmdkJobBatch, *pts_VmdkJobBatch;
+
+//! Library handle
+/*!
+ * Reads may be called concurrently. Image data is read with pread, the mutex
+ * only protects the caches and the statistics. Compressed grains are
+ * uncompressed by a pool of threads, the reading thread helps with the grains
+ * of its own read and waits for the rest.
+ */
+typedef struct s_VmdkHandle {
+  //! Descriptor (or monolithic sparse extent) file name
+  char *p_filename;
+  //! Values from the descriptor
+  char *p_create_type;
+  uint8_t embedded_descriptor;
+  //! Extents, sorted by their offset in the virtual disk
+  pts_VmdkExtent p_extents;
+  uint32_t extents;
+  //! Virtual disk size
+  uint64_t size;
+  //! Grain table cache size in MiB
+  uint64_t gt_cache_size;
+  //! Number of cached uncompressed grains
+  uint64_t grain_cache_entries;
+  //! Number of decompression threads, 0 to uncompress in the reading thread
+  uint32_t threads;
+  //! Caches shared by all extents
+  ts_LibXmountCache gt_cache;
+  ts_LibXmountCache grain_cache;
+  //! Statistics
+  uint64_t bytes_read;
+  uint64_t bytes_zero;
+  uint64_t grains_uncompressed;
+  //! Protects the caches and the statistics
+  pthread_mutex_t mutex;
+  //! Decompression thread pool
+  pthread_t *p_threads;
+  uint32_t threads_running;
+  pts_VmdkJobBatch p_queue;
+  uint8_t pool_stop;
+  //! Protects the pool members above and the job batches
+  pthread_mutex_t pool_mutex;
+  //! Signaled when jobs are queued and when a batch has been finished
+  pthread_cond_t pool_cond;
+  pthread_cond_t done_cond;
+  //! Debug settings
+  uint8_t debug;
+} ts_VmdkHandle, *pts_VmdkHandle;
+
+/*******************************************************************************
+ * Forward declarations
+ ******************************************************************************/
+static int VmdkCreateHandle(void **pp_handle,
+                            const char *p_format,
+                            uint8_t debug);
+static int VmdkDestroyHandle(void **pp_handle);
+static int VmdkOpen(void *p_handle,
+                    const char **pp_filename_arr,
+                    uint64_t filename_arr_len);
+static int VmdkClose(void *p_handle);
+static int VmdkSize(void *p_handle,
+                    uint64_t *p_size);
+static int VmdkRead(void *p_handle,
+                    char *p_buf,
+                    off_t seek,
+                    size_t count,
+                    size_t *p_read,
+                    int *p_errno);
+static int VmdkWrite(void *p_handle,
+                     const char *p_buf,
+                     off_t seek,
+                     size_t count,
+                     size_t *p_written,
+                     int *p_errno);
+static int VmdkOptionsHelp(const char **pp_help);
+static int VmdkOptionsParse(void *p_handle,
+                            uint32_t options_count,
+                            const pts_LibXmountOptions *pp_options,
+                            const char **pp_error);
+static int VmdkGetInfofileContent(void *p_handle,
+                                  const char **pp_info_buf);
+static const char* VmdkGetErrorMessage(int err_num);
+static int VmdkFreeBuffer(void *p_buf);
+
+#endif // LIBXMOUNT_INPUT_VMDK_H
@@ -0,0 +1,1064 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <zstd.h>
+
+#include "../libxmount_input.h"
+#include "libxmount_input_zstd.h"
+
+#define SZSTD_OPTION_CACHE "zstdcache"
+#define SZSTD_OPTION_THREADS "zstdthreads"
+#define SZSTD_OPTION_PREFETCH "zstdprefetch"
+
+/*******************************************************************************
+ * LibXmount_Input API implementation
+ ******************************************************************************/
+/*
+ * LibXmount_Input_GetApiVersion
+ */
+uint8_t LibXmount_Input_GetApiVersion() {
+  return LIBXMOUNT_INPUT_API_VERSION;
+}
+
+/*
+ * LibXmount_Input_GetSupportedFormats
+ */
+const char* LibXmount_Input_GetSupportedFormats() {
+  return "zstd\0\0";
+}
+
+/*
+ * LibXmount_Input_GetFunctions
+ */
+void LibXmount_Input_GetFunctions(ts_LibXmountInputFunctions *p_functions) {
+  p_functions->CreateHandle=&SzstdCreateHandle;
+  p_functions->DestroyHandle=&SzstdDestroyHandle;
+  p_functions->Open=&SzstdOpen;
+  p_functions->Size=&SzstdSize;
+  p_functions->Read=&SzstdRead;
+  p_functions->Write=&SzstdWrite;
+  p_functions->Close=&SzstdClose;
+  p_functions->OptionsHelp=&SzstdOptionsHelp;
+  p_functions->OptionsParse=&SzstdOptionsParse;
+  p_functions->GetInfofileContent=&SzstdGetInfofileContent;
+  p_functions->GetErrorMessage=&SzstdGetErrorMessage;
+  p_functions->FreeBuffer=&SzstdFreeBuffer;
+}
+
+/*******************************************************************************
+ * Private
+ ******************************************************************************/
+/*
+ * SzstdLe32
+ */
+static uint32_t SzstdLe32(const unsigned char *p_buf) {
+  return ((uint32_t)p_buf[3]<<24) | ((uint32_t)p_buf[2]<<16) |
+         ((uint32_t)p_buf[1]<<8) | (uint32_t)p_buf[0];
+}
+
+/*
+ * SzstdLe64
+ */
+static uint64_t SzstdLe64(const unsigned char *p_buf) {
+  return ((uint64_t)SzstdLe32(p_buf+4)<<32) | (uint64_t)SzstdLe32(p_buf);
+}
+
+/*
+ * SzstdXxh64
+ *
+ * XXH64 hash with seed 0, as used by the seek table checksums (libzstd
+ * doesn't export its copy of it).
+ */
+#define SZSTD_XXH_P1 11400714785074694791ULL
+#define SZSTD_XXH_P2 14029467366897019727ULL
+#define SZSTD_XXH_P3 1609587929392839161ULL
+#define SZSTD_XXH_P4 9650029242287828579ULL
+#define SZSTD_XXH_P5 2870177450012600261ULL
+#define SZSTD_XXH_ROTL(x,r) (((x)<<(r)) | ((x)>>(64-(r))))
+#define SZSTD_XXH_ROUND(acc,input) {                \
+  (acc)+=(input)*SZSTD_XXH_P2;                      \
+  (acc)=SZSTD_XXH_ROTL((acc),31)*SZSTD_XXH_P1;      \
+}
+#define SZSTD_XXH_MERGE(hash,acc) {                 \
+  uint64_t merge_val=0;                             \
+  SZSTD_XXH_ROUND(merge_val,(acc));                 \
+  (hash)^=merge_val;                                \
+  (hash)=(hash)*SZSTD_XXH_P1+SZSTD_XXH_P4;          \
+}
+static uint64_t SzstdXxh64(const unsigned char *p_buf, uint64_t len) {
+  const unsigned char *p_end=p_buf+len;
+  uint64_t v1=SZSTD_XXH_P1+SZSTD_XXH_P2;
+  uint64_t v2=SZSTD_XXH_P2;
+  uint64_t v3=0;
+  uint64_t v4=0-SZSTD_XXH_P1;
+  uint64_t hash;
+  uint64_t k;
+
+  if(len>=32) {
+    for(;p_end-p_buf>=32;p_buf+=32) {
+      SZSTD_XXH_ROUND(v1,SzstdLe64(p_buf));
+      SZSTD_XXH_ROUND(v2,SzstdLe64(p_buf+8));
+      SZSTD_XXH_ROUND(v3,SzstdLe64(p_buf+16));
+      SZSTD_XXH_ROUND(v4,SzstdLe64(p_buf+24));
+    }
+    hash=SZSTD_XXH_ROTL(v1,1)+SZSTD_XXH_ROTL(v2,7)+
+         SZSTD_XXH_ROTL(v3,12)+SZSTD_XXH_ROTL(v4,18);
+    SZSTD_XXH_MERGE(hash,v1);
+    SZSTD_XXH_MERGE(hash,v2);
+    SZSTD_XXH_MERGE(hash,v3);
+    SZSTD_XXH_MERGE(hash,v4);
+  } else hash=SZSTD_XXH_P5;
+  hash+=len;
+
+  for(;p_end-p_buf>=8;p_buf+=8) {
+    k=0;
+    SZSTD_XXH_ROUND(k,SzstdLe64(p_buf));
+    hash^=k;
+    hash=SZSTD_XXH_ROTL(hash,27)*SZSTD_XXH_P1+SZSTD_XXH_P4;
+  }
+  if(p_end-p_buf>=4) {
+    hash^=(uint64_t)SzstdLe32(p_buf)*SZSTD_XXH_P1;
+    hash=SZSTD_XXH_ROTL(hash,23)*SZSTD_XXH_P2+SZSTD_XXH_P3;
+    p_buf+=4;
+  }
+  for(;p_buf<p_end;p_buf++) {
+    hash^=(uint64_t)*p_buf*SZSTD_XXH_P5;
+    hash=SZSTD_XXH_ROTL(hash,11)*SZSTD_XXH_P1;
+  }
+
+  hash^=hash>>33;
+  hash*=SZSTD_XXH_P2;
+  hash^=hash>>29;
+  hash*=SZSTD_XXH_P3;
+  hash^=hash>>32;
+  return hash;
+}
+#undef SZSTD_XXH_MERGE
+#undef SZSTD_XXH_ROUND
+#undef SZSTD_XXH_ROTL
+
+/*
+ * SzstdPreadFull
+ *
+ * Reads count bytes at offset, retrying short reads. Hitting the end of the
+ * file is an error.
+ */
+static int SzstdPreadFull(int fd,
+                          char *p_buf,
+                          uint64_t offset,
+                          uint64_t count,
+                          int *p_errno)
+{
+  ssize_t ret;
+  uint64_t done=0;
+
+  while(done<count) {
+    ret=pread(fd,p_buf+done,count-done,(off_t)(offset+done));
+    if(ret<0) {
+      if(errno==EINTR) continue;
+      if(p_errno!=NULL) *p_errno=errno;
+      return SZSTD_READ_FAILED;
+    }
+    if(ret==0) {
+      if(p_errno!=NULL) *p_errno=EIO;
+      return SZSTD_CORRUPT_IMAGE;
+    }
+    done+=(uint64_t)ret;
+  }
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdReadSeekTable
+ *
+ * The seek table is stored in a skippable frame at the end of the file:
+ *   Magic (4), frame size (4), one entry per frame (compressed size (4),
+ *   uncompressed size (4) and optionally a checksum (4)), number of frames
+ *   (4), descriptor (1), seekable magic (4)
+ */
+static int SzstdReadSeekTable(pts_SzstdHandle p_szstd_handle) {
+  unsigned char footer[SZSTD_FOOTER_SIZE];
+  unsigned char header[SZSTD_SKIPPABLE_HEADER_SIZE];
+  unsigned char *p_entries;
+  unsigned char *p_entry;
+  uint64_t entry_size;
+  uint64_t table_size;
+  uint64_t table_offset;
+  uint64_t c_offset=0;
+  uint64_t d_offset=0;
+  pts_SzstdFrame p_frame;
+  int ret;
+
+  if(p_szstd_handle->file_size<SZSTD_SKIPPABLE_HEADER_SIZE+SZSTD_FOOTER_SIZE) {
+    return SZSTD_NO_SEEK_TABLE;
+  }
+  ret=SzstdPreadFull(p_szstd_handle->fd,
+                     (char*)footer,
+                     p_szstd_handle->file_size-SZSTD_FOOTER_SIZE,
+                     SZSTD_FOOTER_SIZE,
+                     NULL);
+  if(ret!=SZSTD_OK) return ret;
+  if(SzstdLe32(footer+5)!=SZSTD_SEEKABLE_MAGIC) return SZSTD_NO_SEEK_TABLE;
+  if((footer[4]&SZSTD_DESCRIPTOR_RESERVED)!=0) return SZSTD_INVALID_SEEK_TABLE;
+
+  p_szstd_handle->frames=SzstdLe32(footer);
+  p_szstd_handle->checksums=(footer[4]&SZSTD_DESCRIPTOR_CHECKSUM)!=0;
+  if(p_szstd_handle->frames>SZSTD_MAX_FRAMES) return SZSTD_INVALID_SEEK_TABLE;
+  entry_size=p_szstd_handle->checksums ? 12 : 8;
+  table_size=p_szstd_handle->frames*entry_size+SZSTD_FOOTER_SIZE;
+  if(table_size+SZSTD_SKIPPABLE_HEADER_SIZE>p_szstd_handle->file_size) {
+    return SZSTD_INVALID_SEEK_TABLE;
+  }
+  table_offset=p_szstd_handle->file_size-table_size-
+               SZSTD_SKIPPABLE_HEADER_SIZE;
+  ret=SzstdPreadFull(p_szstd_handle->fd,
+                     (char*)header,
+                     table_offset,
+                     SZSTD_SKIPPABLE_HEADER_SIZE,
+                     NULL);
+  if(ret!=SZSTD_OK) return ret;
+  if(SzstdLe32(header)!=SZSTD_SKIPPABLE_MAGIC ||
+     SzstdLe32(header+4)!=table_size)
+  {
+    return SZSTD_INVALID_SEEK_TABLE;
+  }
+  if(p_szstd_handle->frames==0) return SZSTD_OK;
+
+  p_entries=(unsigned char*)malloc(table_size-SZSTD_FOOTER_SIZE);
+  p_szstd_handle->p_frames=
+    (pts_SzstdFrame)malloc(p_szstd_handle->frames*sizeof(ts_SzstdFrame));
+  if(p_entries==NULL || p_szstd_handle->p_frames==NULL) {
+    free(p_entries);
+    return SZSTD_MEMALLOC_FAILED;
+  }
+  ret=SzstdPreadFull(p_szstd_handle->fd,
+                     (char*)p_entries,
+                     table_offset+SZSTD_SKIPPABLE_HEADER_SIZE,
+                     table_size-SZSTD_FOOTER_SIZE,
+                     NULL);
+  if(ret!=SZSTD_OK) {
+    free(p_entries);
+    return ret;
+  }
+
+  for(uint64_t i=0;i<p_szstd_handle->frames;i++) {
+    p_entry=p_entries+i*entry_size;
+    p_frame=&(p_szstd_handle->p_frames[i]);
+    p_frame->c_offset=c_offset;
+    p_frame->d_offset=d_offset;
+    p_frame->c_size=SzstdLe32(p_entry);
+    p_frame->d_size=SzstdLe32(p_entry+4);
+    p_frame->checksum=p_szstd_handle->checksums ? SzstdLe32(p_entry+8) : 0;
+    if(p_frame->d_size>SZSTD_MAX_FRAME_SIZE) {
+      free(p_entries);
+      return SZSTD_FRAME_TOO_BIG;
+    }
+    if(p_frame->c_size==0 && p_frame->d_size!=0) {
+      free(p_entries);
+      return SZSTD_INVALID_SEEK_TABLE;
+    }
+    c_offset+=p_frame->c_size;
+    d_offset+=p_frame->d_size;
+    p_szstd_handle->max_frame_size=GETMAX(p_szstd_handle->max_frame_size,
+                                          p_frame->d_size);
+  }
+  free(p_entries);
+
+  if(c_offset>table_offset) return SZSTD_INVALID_SEEK_TABLE;
+  if(c_offset<table_offset) {
+    LIBXMOUNT_LOG_WARNING("%" PRIu64 " bytes of '%s' are not covered by the "
+                            "seek table\n",
+                          table_offset-c_offset,
+                          p_szstd_handle->p_filename);
+  }
+  p_szstd_handle->size=d_offset;
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdFindFrame
+ *
+ * Returns the index of the frame containing the given offset. Frames without
+ * data are skipped as the last frame starting at or before the offset wins.
+ */
+static uint64_t SzstdFindFrame(pts_SzstdHandle p_szstd_handle,
+                               uint64_t offset)
+{
+  uint64_t lo=0;
+  uint64_t hi=p_szstd_handle->frames;
+  uint64_t mid;
+
+  while(hi-lo>1) {
+    mid=lo+(hi-lo)/2;
+    if(p_szstd_handle->p_frames[mid].d_offset<=offset) lo=mid;
+    else hi=mid;
+  }
+  return lo;
+}
+
+/*
+ * SzstdDecompressFrame
+ *
+ * Reads and decompresses a frame into p_dst, verifying its checksum if the
+ * seek table has checksums. p_dctx may be NULL, in which case libzstd uses a
+ * temporary context.
+ */
+static int SzstdDecompressFrame(pts_SzstdHandle p_szstd_handle,
+                                uint64_t frame,
+                                char *p_dst,
+                                ZSTD_DCtx *p_dctx,
+                                int *p_errno)
+{
+  pts_SzstdFrame p_frame=&(p_szstd_handle->p_frames[frame]);
+  char *p_in;
+  size_t zret;
+  int ret;
+
+  p_in=(char*)malloc(p_frame->c_size);
+  if(p_in==NULL) return SZSTD_MEMALLOC_FAILED;
+  ret=SzstdPreadFull(p_szstd_handle->fd,
+                     p_in,
+                     p_frame->c_offset,
+                     p_frame->c_size,
+                     p_errno);
+  if(ret!=SZSTD_OK) {
+    free(p_in);
+    return ret;
+  }
+  if(p_dctx!=NULL) {
+    zret=ZSTD_decompressDCtx(p_dctx,
+                             p_dst,
+                             p_frame->d_size,
+                             p_in,
+                             p_frame->c_size);
+  } else {
+    zret=ZSTD_decompress(p_dst,p_frame->d_size,p_in,p_frame->c_size);
+  }
+  free(p_in);
+  if(ZSTD_isError(zret) || zret!=p_frame->d_size) {
+    LIBXMOUNT_LOG_DEBUG(p_szstd_handle->debug,
+                        "Unable to decompress frame %" PRIu64 ": %s\n",
+                        frame,
+                        ZSTD_isError(zret) ? ZSTD_getErrorName(zret) :
+                                             "Wrong size");
+    if(p_errno!=NULL) *p_errno=EIO;
+    return SZSTD_UNCOMPRESS_FAILED;
+  }
+  if(p_szstd_handle->checksums &&
+     (uint32_t)SzstdXxh64((unsigned char*)p_dst,p_frame->d_size)!=
+       p_frame->checksum)
+  {
+    LIBXMOUNT_LOG_DEBUG(p_szstd_handle->debug,
+                        "Checksum mismatch in frame %" PRIu64 "\n",
+                        frame);
+    if(p_errno!=NULL) *p_errno=EIO;
+    return SZSTD_CHECKSUM_MISMATCH;
+  }
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdLoadSlot
+ *
+ * Decompresses the frame of a slot in state SZSTD_SLOT_LOADING and updates
+ * the slot's state. Must be called with the mutex locked, which is released
+ * while decompressing.
+ */
+static void SzstdLoadSlot(pts_SzstdHandle p_szstd_handle,
+                          pts_SzstdSlot p_slot,
+                          ZSTD_DCtx *p_dctx)
+{
+  uint64_t frame=p_slot->frame;
+  int err=0;
+  int ret=SZSTD_OK;
+
+  pthread_mutex_unlock(&(p_szstd_handle->mutex));
+  // A loading slot belongs to the loading thread, so its buffer can be
+  // allocated without holding the mutex
+  if(p_slot->p_buf==NULL) {
+    p_slot->p_buf=(char*)malloc(GETMAX(p_szstd_handle->max_frame_size,1));
+    if(p_slot->p_buf==NULL) ret=SZSTD_MEMALLOC_FAILED;
+  }
+  if(ret==SZSTD_OK) {
+    ret=SzstdDecompressFrame(p_szstd_handle,frame,p_slot->p_buf,p_dctx,&err);
+  }
+  pthread_mutex_lock(&(p_szstd_handle->mutex));
+
+  p_szstd_handle->frames_decompressed++;
+  if(ret==SZSTD_OK) {
+    p_slot->state=SZSTD_SLOT_READY;
+  } else {
+    p_slot->state=SZSTD_SLOT_FAILED;
+    p_slot->ret=ret;
+    p_slot->err=err;
+  }
+  pthread_cond_broadcast(&(p_szstd_handle->slot_cond));
+}
+
+/*
+ * SzstdClaimSlot
+ *
+ * Evicts the least recently used slot that is neither loading nor being read
+ * from and assigns it to the given frame, in state SZSTD_SLOT_LOADING.
+ * Returns NULL if all slots are busy. Must be called with the mutex locked.
+ */
+static pts_SzstdSlot SzstdClaimSlot(pts_SzstdHandle p_szstd_handle,
+                                    uint64_t frame)
+{
+  pts_SzstdSlot p_slot;
+  pts_SzstdSlot p_lru=NULL;
+
+  for(uint32_t i=0;i<p_szstd_handle->slots;i++) {
+    p_slot=&(p_szstd_handle->p_slots[i]);
+    if(p_slot->state==SZSTD_SLOT_LOADING || p_slot->readers!=0) continue;
+    if(p_lru==NULL || p_slot->last_used<p_lru->last_used) p_lru=p_slot;
+    if(p_slot->state==SZSTD_SLOT_EMPTY) break;
+  }
+  if(p_lru==NULL) return NULL;
+
+  if(p_lru->state!=SZSTD_SLOT_EMPTY) {
+    p_szstd_handle->p_frame_slot[p_lru->frame]=0;
+  }
+  p_lru->frame=frame;
+  p_lru->state=SZSTD_SLOT_LOADING;
+  p_lru->prefetched=0;
+  p_lru->last_used=++(p_szstd_handle->use_counter);
+  p_szstd_handle->p_frame_slot[frame]=
+    (uint32_t)(p_lru-p_szstd_handle->p_slots)+1;
+  return p_lru;
+}
+
+/*
+ * SzstdQueueFrame
+ *
+ * Hands the given frame to the decompression threads unless it is cached
+ * already or being loaded. Must be called with the mutex locked.
+ */
+static void SzstdQueueFrame(pts_SzstdHandle p_szstd_handle,
+                            uint64_t frame,
+                            uint8_t prefetch)
+{
+  pts_SzstdSlot p_slot;
+  uint32_t pos;
+
+  if(p_szstd_handle->threads_running==0 ||
+     p_szstd_handle->p_frame_slot[frame]!=0 ||
+     p_szstd_handle->queue_len==p_szstd_handle->slots)
+  {
+    return;
+  }
+  p_slot=SzstdClaimSlot(p_szstd_handle,frame);
+  if(p_slot==NULL) return;
+  p_slot->prefetched=prefetch;
+  if(prefetch) p_szstd_handle->frames_prefetched++;
+
+  pos=(p_szstd_handle->queue_head+p_szstd_handle->queue_len)%
+      p_szstd_handle->slots;
+  p_szstd_handle->p_queue[pos]=(uint32_t)(p_slot-p_szstd_handle->p_slots);
+  p_szstd_handle->queue_len++;
+  pthread_cond_signal(&(p_szstd_handle->job_cond));
+}
+
+/*
+ * SzstdDecompressionThread
+ */
+static void* SzstdDecompressionThread(void *p_arg) {
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)p_arg;
+  ZSTD_DCtx *p_dctx;
+  pts_SzstdSlot p_slot;
+
+  // Each thread keeps its own decompression context
+  p_dctx=ZSTD_createDCtx();
+
+  pthread_mutex_lock(&(p_szstd_handle->mutex));
+  while(1) {
+    while(p_szstd_handle->queue_len==0 && !p_szstd_handle->pool_stop) {
+      pthread_cond_wait(&(p_szstd_handle->job_cond),
+                        &(p_szstd_handle->mutex));
+    }
+    if(p_szstd_handle->pool_stop) break;
+    p_slot=&(p_szstd_handle->p_slots[p_szstd_handle->p_queue[
+                                       p_szstd_handle->queue_head]]);
+    p_szstd_handle->queue_head=(p_szstd_handle->queue_head+1)%
+                               p_szstd_handle->slots;
+    p_szstd_handle->queue_len--;
+    SzstdLoadSlot(p_szstd_handle,p_slot,p_dctx);
+  }
+  pthread_mutex_unlock(&(p_szstd_handle->mutex));
+
+  if(p_dctx!=NULL) ZSTD_freeDCtx(p_dctx);
+  return NULL;
+}
+
+/*
+ * SzstdAcquireFrame
+ *
+ * Returns the cache slot holding the given frame, decompressing it in the
+ * calling thread if it is neither cached nor being loaded by another thread.
+ * The slot can't be evicted until it is released with SzstdReleaseFrame.
+ * Must be called with the mutex locked.
+ */
+static int SzstdAcquireFrame(pts_SzstdHandle p_szstd_handle,
+                             uint64_t frame,
+                             pts_SzstdSlot *pp_slot,
+                             int *p_errno)
+{
+  pts_SzstdSlot p_slot;
+  uint8_t counted=0;
+  int ret;
+
+  while(1) {
+    if(p_szstd_handle->p_frame_slot[frame]==0) {
+      p_slot=SzstdClaimSlot(p_szstd_handle,frame);
+      if(p_slot==NULL) {
+        // All slots are busy, wait for one to be loaded or released
+        pthread_cond_wait(&(p_szstd_handle->slot_cond),
+                          &(p_szstd_handle->mutex));
+        continue;
+      }
+      if(!counted) p_szstd_handle->misses++;
+      counted=1;
+      SzstdLoadSlot(p_szstd_handle,p_slot,NULL);
+      continue;
+    }
+
+    p_slot=&(p_szstd_handle->p_slots[p_szstd_handle->p_frame_slot[frame]-1]);
+    switch(p_slot->state) {
+      case SZSTD_SLOT_LOADING:
+        pthread_cond_wait(&(p_szstd_handle->slot_cond),
+                          &(p_szstd_handle->mutex));
+        break;
+      case SZSTD_SLOT_READY:
+        if(!counted) p_szstd_handle->hits++;
+        if(p_slot->prefetched) p_szstd_handle->prefetch_hits++;
+        p_slot->prefetched=0;
+        p_slot->readers++;
+        p_slot->last_used=++(p_szstd_handle->use_counter);
+        *pp_slot=p_slot;
+        return SZSTD_OK;
+      default:
+        // Failed, report the error and forget the frame so it is retried
+        // by the next read
+        ret=p_slot->ret;
+        if(p_errno!=NULL) *p_errno=p_slot->err;
+        p_slot->state=SZSTD_SLOT_EMPTY;
+        p_slot->last_used=0;
+        p_szstd_handle->p_frame_slot[frame]=0;
+        return ret;
+    }
+  }
+}
+
+/*
+ * SzstdReleaseFrame
+ *
+ * Must be called with the mutex locked.
+ */
+static void SzstdReleaseFrame(pts_SzstdHandle p_szstd_handle,
+                              pts_SzstdSlot p_slot)
+{
+  if(--(p_slot->readers)==0) {
+    pthread_cond_broadcast(&(p_szstd_handle->slot_cond));
+  }
+}
+
+/*
+ * SzstdStartThreads
+ */
+static int SzstdStartThreads(pts_SzstdHandle p_szstd_handle) {
+  p_szstd_handle->p_threads=
+    (pthread_t*)calloc(p_szstd_handle->threads,sizeof(pthread_t));
+  if(p_szstd_handle->p_threads==NULL) return SZSTD_MEMALLOC_FAILED;
+  p_szstd_handle->pool_stop=0;
+  for(uint32_t i=0;i<p_szstd_handle->threads;i++) {
+    if(pthread_create(&(p_szstd_handle->p_threads[i]),
+                      NULL,
+                      SzstdDecompressionThread,
+                      p_szstd_handle)!=0)
+    {
+      return SZSTD_THREAD_CREATE_FAILED;
+    }
+    p_szstd_handle->threads_running++;
+  }
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdStopThreads
+ */
+static void SzstdStopThreads(pts_SzstdHandle p_szstd_handle) {
+  pthread_mutex_lock(&(p_szstd_handle->mutex));
+  p_szstd_handle->pool_stop=1;
+  pthread_cond_broadcast(&(p_szstd_handle->job_cond));
+  pthread_mutex_unlock(&(p_szstd_handle->mutex));
+  for(uint32_t i=0;i<p_szstd_handle->threads_running;i++) {
+    pthread_join(p_szstd_handle->p_threads[i],NULL);
+  }
+  p_szstd_handle->threads_running=0;
+  free(p_szstd_handle->p_threads);
+  p_szstd_handle->p_threads=NULL;
+}
+
+/*
+ * SzstdCreateHandle
+ */
+static int SzstdCreateHandle(void **pp_handle,
+                             const char *p_format,
+                             uint8_t debug)
+{
+  (void)p_format;
+  pts_SzstdHandle p_szstd_handle;
+  long cpus;
+
+  // Alloc new lib handle
+  p_szstd_handle=(pts_SzstdHandle)calloc(1,sizeof(ts_SzstdHandle));
+  if(p_szstd_handle==NULL) return SZSTD_MEMALLOC_FAILED;
+
+  // Init handle values
+  p_szstd_handle->fd=-1;
+  p_szstd_handle->cache_size=SZSTD_DEFAULT_CACHE_SIZE;
+  p_szstd_handle->prefetch=SZSTD_DEFAULT_PREFETCH;
+  // A single CPU is better used by decompressing in the reading thread
+  cpus=sysconf(_SC_NPROCESSORS_ONLN);
+  if(cpus>1) p_szstd_handle->threads=GETMIN(cpus,SZSTD_MAX_DEFAULT_THREADS);
+  p_szstd_handle->debug=debug;
+  pthread_mutex_init(&(p_szstd_handle->mutex),NULL);
+  pthread_cond_init(&(p_szstd_handle->job_cond),NULL);
+  pthread_cond_init(&(p_szstd_handle->slot_cond),NULL);
+
+  *pp_handle=p_szstd_handle;
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdDestroyHandle
+ */
+static int SzstdDestroyHandle(void **pp_handle) {
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)*pp_handle;
+
+  if(p_szstd_handle!=NULL) {
+    pthread_cond_destroy(&(p_szstd_handle->slot_cond));
+    pthread_cond_destroy(&(p_szstd_handle->job_cond));
+    pthread_mutex_destroy(&(p_szstd_handle->mutex));
+    free(p_szstd_handle);
+  }
+
+  *pp_handle=NULL;
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdOpen
+ */
+static int SzstdOpen(void *p_handle,
+                     const char **pp_filename_arr,
+                     uint64_t filename_arr_len)
+{
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)p_handle;
+  struct stat file_stat;
+  uint64_t slots;
+  int ret;
+
+  if(filename_arr_len==0) return SZSTD_NO_INPUT_FILES;
+  if(filename_arr_len>1) return SZSTD_TOO_MANY_INPUT_FILES;
+
+#define SZSTD_OPEN_ERROR(err) { \
+  SzstdClose(p_handle);         \
+  return (err);                 \
+}
+
+  p_szstd_handle->p_filename=strdup(pp_filename_arr[0]);
+  if(p_szstd_handle->p_filename==NULL) {
+    SZSTD_OPEN_ERROR(SZSTD_MEMALLOC_FAILED);
+  }
+  p_szstd_handle->fd=open(p_szstd_handle->p_filename,O_RDONLY);
+  if(p_szstd_handle->fd==-1 || fstat(p_szstd_handle->fd,&file_stat)!=0) {
+    SZSTD_OPEN_ERROR(SZSTD_OPEN_FAILED);
+  }
+  p_szstd_handle->file_size=(uint64_t)file_stat.st_size;
+
+  ret=SzstdReadSeekTable(p_szstd_handle);
+  if(ret!=SZSTD_OK) SZSTD_OPEN_ERROR(ret);
+
+  // Size the frame cache by the biggest frame. There must always be enough
+  // slots for the frames being loaded by the threads, prefetched frames and
+  // the readers.
+  slots=p_szstd_handle->max_frame_size!=0 ?
+          (p_szstd_handle->cache_size*1024*1024)/
+            p_szstd_handle->max_frame_size :
+          0;
+  slots=GETMAX(slots,(uint64_t)p_szstd_handle->threads+
+                       p_szstd_handle->prefetch+2);
+  slots=GETMIN(slots,GETMAX(p_szstd_handle->frames,1));
+  p_szstd_handle->slots=(uint32_t)slots;
+  p_szstd_handle->p_slots=(pts_SzstdSlot)calloc(slots,sizeof(ts_SzstdSlot));
+  p_szstd_handle->p_queue=(uint32_t*)calloc(slots,sizeof(uint32_t));
+  p_szstd_handle->p_frame_slot=
+    (uint32_t*)calloc(GETMAX(p_szstd_handle->frames,1),sizeof(uint32_t));
+  if(p_szstd_handle->p_slots==NULL ||
+     p_szstd_handle->p_queue==NULL ||
+     p_szstd_handle->p_frame_slot==NULL)
+  {
+    SZSTD_OPEN_ERROR(SZSTD_MEMALLOC_FAILED);
+  }
+
+  if(p_szstd_handle->threads!=0 && p_szstd_handle->frames>1) {
+    ret=SzstdStartThreads(p_szstd_handle);
+    if(ret!=SZSTD_OK) SZSTD_OPEN_ERROR(ret);
+  }
+
+#undef SZSTD_OPEN_ERROR
+
+  LIBXMOUNT_LOG_DEBUG(p_szstd_handle->debug,
+                      "Opened seekable zstd image '%s' (%" PRIu64
+                        " frames, max. frame size %" PRIu32 ", size %"
+                        PRIu64 ", %" PRIu32 " cache slots)\n",
+                      p_szstd_handle->p_filename,
+                      p_szstd_handle->frames,
+                      p_szstd_handle->max_frame_size,
+                      p_szstd_handle->size,
+                      p_szstd_handle->slots);
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdClose
+ */
+static int SzstdClose(void *p_handle) {
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)p_handle;
+  int ret=SZSTD_OK;
+
+  LIBXMOUNT_LOG_DEBUG(p_szstd_handle->debug,
+                      "Frame cache: %" PRIu64 " hits, %" PRIu64 " misses; %"
+                        PRIu64 " frames decompressed, %" PRIu64
+                        " prefetched, %" PRIu64 " prefetched frames used\n",
+                      p_szstd_handle->hits,
+                      p_szstd_handle->misses,
+                      p_szstd_handle->frames_decompressed,
+                      p_szstd_handle->frames_prefetched,
+                      p_szstd_handle->prefetch_hits);
+
+  if(p_szstd_handle->p_threads!=NULL) SzstdStopThreads(p_szstd_handle);
+  if(p_szstd_handle->p_slots!=NULL) {
+    for(uint32_t i=0;i<p_szstd_handle->slots;i++) {
+      free(p_szstd_handle->p_slots[i].p_buf);
+    }
+  }
+  free(p_szstd_handle->p_slots);
+  p_szstd_handle->p_slots=NULL;
+  p_szstd_handle->slots=0;
+  free(p_szstd_handle->p_queue);
+  p_szstd_handle->p_queue=NULL;
+  p_szstd_handle->queue_len=0;
+  free(p_szstd_handle->p_frame_slot);
+  p_szstd_handle->p_frame_slot=NULL;
+  free(p_szstd_handle->p_frames);
+  p_szstd_handle->p_frames=NULL;
+  p_szstd_handle->frames=0;
+  free(p_szstd_handle->p_filename);
+  p_szstd_handle->p_filename=NULL;
+  if(p_szstd_handle->fd!=-1 && close(p_szstd_handle->fd)!=0) {
+    ret=SZSTD_CLOSE_FAILED;
+  }
+  p_szstd_handle->fd=-1;
+
+  return ret;
+}
+
+/*
+ * SzstdSize
+ */
+static int SzstdSize(void *p_handle, uint64_t *p_size) {
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)p_handle;
+
+  *p_size=p_szstd_handle->size;
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdRead
+ *
+ * All frames of the read but the first one are handed to the decompression
+ * threads, the first one is decompressed by the calling thread (unless it is
+ * cached) while the threads work on the others. Sequential reads additionally
+ * queue the frames following the read.
+ */
+static int SzstdRead(void *p_handle,
+                     char *p_buf,
+                     off_t offset,
+                     size_t count,
+                     size_t *p_read,
+                     int *p_errno)
+{
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)p_handle;
+  pts_SzstdFrame p_frame;
+  pts_SzstdSlot p_slot=NULL;
+  uint64_t first;
+  uint64_t last;
+  uint64_t pos;
+  uint64_t len;
+  uint64_t frame_pos;
+  int ret=SZSTD_OK;
+
+  *p_read=0;
+  if(offset<0 ||
+     (uint64_t)offset>p_szstd_handle->size ||
+     count>p_szstd_handle->size-(uint64_t)offset)
+  {
+    return SZSTD_READ_BEYOND_END_OF_IMAGE;
+  }
+  if(count==0) return SZSTD_OK;
+
+  first=SzstdFindFrame(p_szstd_handle,(uint64_t)offset);
+  last=SzstdFindFrame(p_szstd_handle,(uint64_t)offset+count-1);
+
+  pthread_mutex_lock(&(p_szstd_handle->mutex));
+  // Leave at least half of the slots to other readers
+  for(uint64_t frame=first+1;
+      frame<=last && frame-first<=p_szstd_handle->slots/2;
+      frame++)
+  {
+    SzstdQueueFrame(p_szstd_handle,frame,0);
+  }
+  if((uint64_t)offset==p_szstd_handle->next_offset) {
+    for(uint64_t frame=last+1;
+        frame<p_szstd_handle->frames && frame-last<=p_szstd_handle->prefetch;
+        frame++)
+    {
+      SzstdQueueFrame(p_szstd_handle,frame,1);
+    }
+  }
+  p_szstd_handle->next_offset=(uint64_t)offset+count;
+
+  pos=(uint64_t)offset;
+  for(uint64_t frame=first;frame<=last && ret==SZSTD_OK;frame++) {
+    p_frame=&(p_szstd_handle->p_frames[frame]);
+    if(p_frame->d_size==0) continue;
+    ret=SzstdAcquireFrame(p_szstd_handle,frame,&p_slot,p_errno);
+    if(ret!=SZSTD_OK) break;
+    frame_pos=pos-p_frame->d_offset;
+    len=GETMIN(p_frame->d_size-frame_pos,count-(pos-(uint64_t)offset));
+    // The slot can't be evicted while it has readers
+    pthread_mutex_unlock(&(p_szstd_handle->mutex));
+    memcpy(p_buf+(pos-(uint64_t)offset),p_slot->p_buf+frame_pos,len);
+    pthread_mutex_lock(&(p_szstd_handle->mutex));
+    SzstdReleaseFrame(p_szstd_handle,p_slot);
+    pos+=len;
+  }
+  pthread_mutex_unlock(&(p_szstd_handle->mutex));
+  if(ret!=SZSTD_OK) return ret;
+
+  *p_read=count;
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdWrite
+ */
+static int SzstdWrite(void *p_handle,
+                      const char *p_buf,
+                      off_t seek,
+                      size_t count,
+                      size_t *p_written,
+                      int *p_errno)
+{
+  return SZSTD_WRITE_FAILED;
+}
+
+/*
+ * SzstdOptionsHelp
+ */
+static int SzstdOptionsHelp(const char **pp_help) {
+  char *p_help=NULL;
+  int ret;
+
+  ret=asprintf(&p_help,
+               "    %-12s : Size of the decompressed frame cache in MiB. "
+                 "Default: %d\n"
+               "    %-12s : Number of threads decompressing frames, 0 to "
+                 "decompress in the reading thread. Default: number of CPUs "
+                 "(max. %d, 0 with a single CPU)\n"
+               "    %-12s : Number of frames to decompress ahead of "
+                 "sequential reads (needs threads). Default: %d\n",
+               SZSTD_OPTION_CACHE,SZSTD_DEFAULT_CACHE_SIZE,
+               SZSTD_OPTION_THREADS,SZSTD_MAX_DEFAULT_THREADS,
+               SZSTD_OPTION_PREFETCH,SZSTD_DEFAULT_PREFETCH);
+  if(ret<0 || p_help==NULL) return SZSTD_MEMALLOC_FAILED;
+
+  *pp_help=p_help;
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdOptionsParse
+ */
+static int SzstdOptionsParse(void *p_handle,
+                             uint32_t options_count,
+                             const pts_LibXmountOptions *pp_options,
+                             const char **pp_error)
+{
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)p_handle;
+  pts_LibXmountOptions p_option;
+  uint64_t value;
+  int ok;
+
+#define SZSTD_OPTION_ERROR(option) {                              \
+  *pp_error=strdup("Error in option " option ": Invalid value");  \
+  return SZSTD_INVALID_OPTION_VALUE;                              \
+}
+
+  *pp_error=NULL;
+  for(uint32_t i=0;i<options_count;i++) {
+    p_option=pp_options[i];
+    if(strcmp(p_option->p_key,SZSTD_OPTION_CACHE)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>UINT32_MAX) SZSTD_OPTION_ERROR(SZSTD_OPTION_CACHE);
+      p_szstd_handle->cache_size=value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SZSTD_OPTION_THREADS)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>SZSTD_MAX_THREADS) {
+        SZSTD_OPTION_ERROR(SZSTD_OPTION_THREADS);
+      }
+      p_szstd_handle->threads=(uint32_t)value;
+      p_option->valid=1;
+    } else if(strcmp(p_option->p_key,SZSTD_OPTION_PREFETCH)==0) {
+      value=StrToUint64(p_option->p_value,&ok);
+      if(!ok || value>SZSTD_MAX_PREFETCH) {
+        SZSTD_OPTION_ERROR(SZSTD_OPTION_PREFETCH);
+      }
+      p_szstd_handle->prefetch=(uint32_t)value;
+      p_option->valid=1;
+    }
+  }
+
+#undef SZSTD_OPTION_ERROR
+
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdGetInfofileContent
+ */
+static int SzstdGetInfofileContent(void *p_handle, const char **pp_info_buf) {
+  pts_SzstdHandle p_szstd_handle=(pts_SzstdHandle)p_handle;
+  char *p_infobuf=NULL;
+  int ret;
+
+  ret=asprintf(&p_infobuf,
+               "Seekable zstd image\n"
+                 "Uncompressed size: %" PRIu64 " bytes\n"
+                 "Compressed size: %" PRIu64 " bytes\n"
+                 "Frames: %" PRIu64 " (max. %" PRIu32 " bytes uncompressed)\n"
+                 "Frame checksums: %s\n"
+                 "Frame cache: %" PRIu32 " frames\n"
+                 "Decompression threads: %" PRIu32 "\n",
+               p_szstd_handle->size,
+               p_szstd_handle->file_size,
+               p_szstd_handle->frames,
+               p_szstd_handle->max_frame_size,
+               p_szstd_handle->checksums ? "verified" : "none",
+               p_szstd_handle->slots,
+               p_szstd_handle->threads_running);
+  if(ret<0 || p_infobuf==NULL) return SZSTD_MEMALLOC_FAILED;
+
+  *pp_info_buf=p_infobuf;
+  return SZSTD_OK;
+}
+
+/*
+ * SzstdGetErrorMessage
+ */
+static const char* SzstdGetErrorMessage(int err_num) {
+  switch(err_num) {
+    case SZSTD_MEMALLOC_FAILED:
+      return "Unable to allocate memory";
+      break;
+    case SZSTD_NO_INPUT_FILES:
+      return "No input file specified";
+      break;
+    case SZSTD_TOO_MANY_INPUT_FILES:
+      return "Only a single zstd file may be specified";
+      break;
+    case SZSTD_OPEN_FAILED:
+      return "Unable to open zstd file";
+      break;
+    case SZSTD_READ_FAILED:
+      return "Unable to read zstd data";
+      break;
+    case SZSTD_CLOSE_FAILED:
+      return "Unable to close zstd file";
+      break;
+    case SZSTD_NO_SEEK_TABLE:
+      return "The specified file is not a seekable zstd file (no seek table "
+               "found)";
+      break;
+    case SZSTD_INVALID_SEEK_TABLE:
+      return "Invalid seek table";
+      break;
+    case SZSTD_FRAME_TOO_BIG:
+      return "The image contains frames bigger than 256 MiB";
+      break;
+    case SZSTD_CORRUPT_IMAGE:
+      return "The zstd file is corrupt or truncated";
+      break;
+    case SZSTD_UNCOMPRESS_FAILED:
+      return "Unable to decompress frame";
+      break;
+    case SZSTD_CHECKSUM_MISMATCH:
+      return "Frame checksum mismatch";
+      break;
+    case SZSTD_THREAD_CREATE_FAILED:
+      return "Unable to create decompression thread";
+      break;
+    case SZSTD_READ_BEYOND_END_OF_IMAGE:
+      return "Unable to read beyond end of image";
+      break;
+    case SZSTD_WRITE_FAILED:
+      return "Write is not supported in zstd input module.";
+      break;
+    case SZSTD_INVALID_OPTION_VALUE:
+      return "Invalid option value";
+      break;
+    default:
+      return "Unknown error";
+  }
+}
+
+/*
+ * SzstdFreeBuffer
+ */
+static int SzstdFreeBuffer(void *p_buf) {
+  free(p_buf);
+  return SZSTD_OK;
+}
+
+/*
+  ----- Change log -----
+  20261019: * Initial version, reading seekable zstd images with a frame cache,
+              parallel decompression and prefetching.
+*/
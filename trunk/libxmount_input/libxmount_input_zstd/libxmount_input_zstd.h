@@ -0,0 +1,199 @@
+/*******************************************************************************
+* xmount Copyright (c) 2008-2015 by Gillen Daniel <gillen.dan@pinguin.lu>      *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify it      *
+* under the terms of the GNU General Public License as published by the Free   *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* This program is distributed in the hope that it will be useful, but WITHOUT  *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* this program. If not, see <http://www.gnu.org/licenses/>.                    *
+*******************************************************************************/
+
+#ifndef LIBXMOUNT_INPUT_ZSTD_H
+#define LIBXMOUNT_INPUT_ZSTD_H
+
+/*
+ * All names are prefixed with Szstd / SZSTD (seekable zstd) to keep clear of
+ * libzstd's ZSTD namespace.
+ */
+
+/*******************************************************************************
+ * Enums, Typedefs, etc...
+ ******************************************************************************/
+//! Possible error return codes
+enum {
+  SZSTD_OK=0,
+  SZSTD_MEMALLOC_FAILED,
+  SZSTD_NO_INPUT_FILES,
+  SZSTD_TOO_MANY_INPUT_FILES,
+  SZSTD_OPEN_FAILED,
+  SZSTD_READ_FAILED,
+  SZSTD_CLOSE_FAILED,
+  SZSTD_NO_SEEK_TABLE,
+  SZSTD_INVALID_SEEK_TABLE,
+  SZSTD_FRAME_TOO_BIG,
+  SZSTD_CORRUPT_IMAGE,
+  SZSTD_UNCOMPRESS_FAILED,
+  SZSTD_CHECKSUM_MISMATCH,
+  SZSTD_THREAD_CREATE_FAILED,
+  SZSTD_READ_BEYOND_END_OF_IMAGE,
+  SZSTD_WRITE_FAILED,
+  SZSTD_INVALID_OPTION_VALUE
+};
+
+#define GETMAX(a,b) ((a)>(b)?(a):(b))
+#define GETMIN(a,b) ((a)<(b)?(a):(b))
+
+//! Magic of the skippable frame holding the seek table
+#define SZSTD_SKIPPABLE_MAGIC 0x184d2a5eUL
+//! Size of the skippable frame header (magic and frame size)
+#define SZSTD_SKIPPABLE_HEADER_SIZE 8
+//! Seek table footer: number of frames, descriptor and magic
+#define SZSTD_FOOTER_SIZE 9
+#define SZSTD_SEEKABLE_MAGIC 0x8f92eab1UL
+//! Seek table descriptor bits
+#define SZSTD_DESCRIPTOR_CHECKSUM 0x80
+#define SZSTD_DESCRIPTOR_RESERVED 0x7c
+//! Max. number of frames and max. uncompressed size of a single frame
+#define SZSTD_MAX_FRAMES (1UL<<28)
+#define SZSTD_MAX_FRAME_SIZE (256*1024*1024)
+//! Default size of the decompressed frame cache in MiB
+#define SZSTD_DEFAULT_CACHE_SIZE 64
+//! Default number of frames decompressed ahead of sequential reads
+#define SZSTD_DEFAULT_PREFETCH 2
+//! Max. values of the threads and prefetch options
+#define SZSTD_MAX_THREADS 64
+#define SZSTD_MAX_DEFAULT_THREADS 8
+#define SZSTD_MAX_PREFETCH 64
+
+//! One frame of the image, taken from the seek table
+typedef struct s_SzstdFrame {
+  //! Offset of the compressed frame in the file and of its data in the image
+  uint64_t c_offset;
+  uint64_t d_offset;
+  uint32_t c_size;
+  uint32_t d_size;
+  //! Lower 32 bits of the XXH64 of the uncompressed data, if available
+  uint32_t checksum;
+} ts_SzstdFrame, *pts_SzstdFrame;
+
+//! States of a frame cache slot
+enum {
+  SZSTD_SLOT_EMPTY=0, //!< Unused
+  SZSTD_SLOT_LOADING, //!< Frame is being decompressed
+  SZSTD_SLOT_READY,   //!< Frame has been decompressed
+  SZSTD_SLOT_FAILED   //!< Decompressing the frame failed
+};
+
+//! Slot of the decompressed frame cache
+typedef struct s_SzstdSlot {
+  uint64_t frame;
+  uint8_t state;
+  //! Number of threads currently copying data from this slot
+  uint32_t readers;
+  //! Value of the cache's use counter when the slot was last used
+  uint64_t last_used;
+  //! Set if the frame was decompressed ahead of time and not yet read
+  uint8_t prefetched;
+  //! Error of a failed decompression
+  int ret;
+  int err;
+  //! Decompressed frame, allocated with the size of the biggest frame
+  char *p_buf;
+} ts_SzstdSlot, *pts_SzstdSlot;
+
+//! Library handle
+/*!
+ * Frames are decompressed into the slots of an LRU cache. A slot being loaded
+ * or read from is never evicted. Reads hand the frames they need (except the
+ * first one, which they decompress themselves) and, when reading sequentially,
+ * the following frames to a pool of decompression threads. Everything but
+ * the decompression itself is protected by the mutex.
+ */
+typedef struct s_SzstdHandle {
+  //! Image file name, descriptor and size
+  char *p_filename;
+  int fd;
+  uint64_t file_size;
+  //! Frames from the seek table
+  pts_SzstdFrame p_frames;
+  uint64_t frames;
+  uint32_t max_frame_size;
+  uint8_t checksums;
+  //! Uncompressed image size
+  uint64_t size;
+  //! Options
+  uint64_t cache_size;
+  uint32_t threads;
+  uint32_t prefetch;
+  //! Frame cache slots and the slot (plus 1) each frame is cached in
+  pts_SzstdSlot p_slots;
+  uint32_t slots;
+  uint32_t *p_frame_slot;
+  uint64_t use_counter;
+  //! Decompression thread pool and its ring buffer of slots to load
+  pthread_t *p_threads;
+  uint32_t threads_running;
+  uint32_t *p_queue;
+  uint32_t queue_head;
+  uint32_t queue_len;
+  uint8_t pool_stop;
+  //! End of the last read, to detect sequential reads
+  uint64_t next_offset;
+  //! Statistics
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t frames_decompressed;
+  uint64_t frames_prefetched;
+  uint64_t prefetch_hits;
+  //! Protects all of the above but the frame data of loading slots
+  pthread_mutex_t mutex;
+  //! Signaled when jobs are queued and when slots are loaded or released
+  pthread_cond_t job_cond;
+  pthread_cond_t slot_cond;
+  //! Debug settings
+  uint8_t debug;
+} ts_SzstdHandle, *pts_SzstdHandle;
+
+/*******************************************************************************
+ * Forward declarations
+ ******************************************************************************/
+static int SzstdCreateHandle(void **pp_handle,
+                             const char *p_format,
+                             uint8_t debug);
+static int SzstdDestroyHandle(void **pp_handle);
+static int SzstdOpen(void *p_handle,
+                     const char **pp_filename_arr,
+                     uint64_t filename_arr_len);
+static int SzstdClose(void *p_handle);
+static int SzstdSize(void *p_handle,
+                     uint64_t *p_size);
+static int SzstdRead(void *p_handle,
+                     char *p_buf,
+                     off_t seek,
+                     size_t count,
+                     size_t *p_read,
+                     int *p_errno);
+static int SzstdWrite(void *p_handle,
+                      const char *p_buf,
+                      off_t seek,
+                      size_t count,
+                      size_t *p_written,
+                      int *p_errno);
+static int SzstdOptionsHelp(const char **pp_help);
+static int SzstdOptionsParse(void *p_handle,
+                             uint32_t options_count,
+                             const pts_LibXmountOptions *pp_options,
+                             const char **pp_error);
+static int SzstdGetInfofileContent(void *p_handle,
+                                   const char **pp_info_buf);
+static const char* SzstdGetErrorMessage(int err_num);
+static int SzstdFreeBuffer(void *p_buf);
+
+#endif // LIBXMOUNT_INPUT_ZSTD_H
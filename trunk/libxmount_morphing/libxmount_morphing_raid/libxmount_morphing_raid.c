@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "../libxmount_morphing.h"
 #include "libxmount_morphing_raid.h"
@@ -26,44 +27,1902 @@
   LIBXMOUNT_LOG_DEBUG(p_raid_handle->debug,__VA_ARGS__); \
 }
 
+//! Names of the parity layouts, in the order of the RAID_LAYOUT_* values
+static const char *raid_layout_names[]={
+  "left-asymmetric","right-asymmetric","left-symmetric","right-symmetric",
+  "parity-first","parity-last","ddf-zero-restart","ddf-N-restart",
+  "ddf-N-continue",NULL
+};
+
+//! Names of the balance modes, in the order of the RAID_BALANCE_* values
+static const char *raid_balance_names[]={
+  "queue","stripe",NULL
+};
+
+//! Names of the GF(2^8) kernels, in the order of the RAID_GF_KERNEL_* values
+static const char *raid_gf_kernel_names[]={
+  "scalar","SSSE3","AVX2"
+};
+
+#ifdef __GNUC__
+//! Vector type used by RaidXor, gcc / clang map it to SSE2, NEON, etc.
+typedef uint64_t t_RaidVector __attribute__((vector_size(16)));
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// The SSSE3 / AVX2 kernels are compiled for their instruction set only and
+// are used if the CPU supports it.
+#include <immintrin.h>
+#define RAID_HAVE_X86_GF_KERNELS
+#endif
+
 /*******************************************************************************
  * LibXmount_Morphing API implementation
  ******************************************************************************/
 /*
- * LibXmount_Morphing_GetApiVersion
+ * LibXmount_Morphing_GetApiVersion
+ */
+uint8_t LibXmount_Morphing_GetApiVersion() {
+  return LIBXMOUNT_MORPHING_API_VERSION;
+}
+
+/*
+ * LibXmount_Morphing_GetSupportedFormats
+ */
+const char* LibXmount_Morphing_GetSupportedTypes() {
+  return "raid0\0raid1\0raid5\0raid6\0raid10\0\0";
+}
+
+/*
+ * LibXmount_Morphing_GetFunctions
+ */
+void LibXmount_Morphing_GetFunctions(ts_LibXmountMorphingFunctions *p_functions)
+{
+  p_functions->CreateHandle=&RaidCreateHandle;
+  p_functions->DestroyHandle=&RaidDestroyHandle;
+  p_functions->Morph=&RaidMorph;
+  p_functions->Size=&RaidSize;
+  p_functions->Read=&RaidRead;
+  p_functions->Write=&RaidWrite;
+  p_functions->OptionsHelp=&RaidOptionsHelp;
+  p_functions->OptionsParse=&RaidOptionsParse;
+  p_functions->GetInfofileContent=&RaidGetInfofileContent;
+  p_functions->GetErrorMessage=&RaidGetErrorMessage;
+  p_functions->FreeBuffer=&RaidFreeBuffer;
+}
+
+/*******************************************************************************
+ * Private
+ ******************************************************************************/
+/*
+ * RaidXor
+ *
+ * XORs count bytes of p_src into p_dst. Buffers don't need to be aligned,
+ * memcpy into vector variables compiles to unaligned vector loads / stores.
+ */
+static void RaidXor(char *p_dst, const char *p_src, size_t count) {
+  uint64_t dst_word;
+  uint64_t src_word;
+#ifdef __GNUC__
+  t_RaidVector dst[4];
+  t_RaidVector src[4];
+
+  while(count>=sizeof(dst)) {
+    memcpy(dst,p_dst,sizeof(dst));
+    memcpy(src,p_src,sizeof(src));
+    dst[0]^=src[0];
+    dst[1]^=src[1];
+    dst[2]^=src[2];
+    dst[3]^=src[3];
+    memcpy(p_dst,dst,sizeof(dst));
+    p_dst+=sizeof(dst);
+    p_src+=sizeof(src);
+    count-=sizeof(dst);
+  }
+#endif
+  while(count>=sizeof(uint64_t)) {
+    memcpy(&dst_word,p_dst,sizeof(uint64_t));
+    memcpy(&src_word,p_src,sizeof(uint64_t));
+    dst_word^=src_word;
+    memcpy(p_dst,&dst_word,sizeof(uint64_t));
+    p_dst+=sizeof(uint64_t);
+    p_src+=sizeof(uint64_t);
+    count-=sizeof(uint64_t);
+  }
+  while(count!=0) {
+    *(p_dst++)^=*(p_src++);
+    count--;
+  }
+}
+
+/*
+ * RaidGfInit
+ *
+ * Sets up the exponent and logarithm tables of GF(2^8) with the generator
+ * polynomial x^8+x^4+x^3+x^2+1 (0x11d) and generator 2, as used by Linux md
+ * and hardware controllers for the RAID-6 Q syndrome.
+ */
+static void RaidGfInit(pts_RaidHandle p_raid_handle) {
+  uint32_t value=1;
+
+  for(uint32_t i=0;i<255;i++) {
+    p_raid_handle->gf_exp[i]=(uint8_t)value;
+    p_raid_handle->gf_exp[i+255]=(uint8_t)value;
+    p_raid_handle->gf_log[value]=(uint8_t)i;
+    value<<=1;
+    if(value&0x100) value^=0x11d;
+  }
+  p_raid_handle->gf_log[0]=0;
+}
+
+/*
+ * RaidGfMul
+ */
+static uint8_t RaidGfMul(pts_RaidHandle p_raid_handle, uint8_t a, uint8_t b) {
+  if(a==0 || b==0) return 0;
+  return p_raid_handle->gf_exp[p_raid_handle->gf_log[a]+
+                               p_raid_handle->gf_log[b]];
+}
+
+/*
+ * RaidGfInv
+ */
+static uint8_t RaidGfInv(pts_RaidHandle p_raid_handle, uint8_t a) {
+  return p_raid_handle->gf_exp[255-p_raid_handle->gf_log[a]];
+}
+
+#ifdef RAID_HAVE_X86_GF_KERNELS
+/*
+ * RaidGfMulXorSsse3
+ *
+ * SSSE3 version of RaidGfMulXor for the first count&~15 bytes. The product of
+ * every byte is looked up in two 16 entry tables, one for each nibble.
+ */
+__attribute__((target("ssse3")))
+static size_t RaidGfMulXorSsse3(char *p_dst,
+                                const char *p_src,
+                                size_t count,
+                                const uint8_t *p_lo_tab,
+                                const uint8_t *p_hi_tab)
+{
+  const __m128i lo_tab=_mm_loadu_si128((const __m128i*)p_lo_tab);
+  const __m128i hi_tab=_mm_loadu_si128((const __m128i*)p_hi_tab);
+  const __m128i mask=_mm_set1_epi8(0x0f);
+  __m128i src;
+  __m128i dst;
+  size_t done;
+
+  for(done=0;done+16<=count;done+=16) {
+    src=_mm_loadu_si128((const __m128i*)(p_src+done));
+    dst=_mm_loadu_si128((const __m128i*)(p_dst+done));
+    dst=_mm_xor_si128(dst,
+                      _mm_shuffle_epi8(lo_tab,_mm_and_si128(src,mask)));
+    dst=_mm_xor_si128(dst,
+                      _mm_shuffle_epi8(hi_tab,
+                                       _mm_and_si128(_mm_srli_epi64(src,4),
+                                                     mask)));
+    _mm_storeu_si128((__m128i*)(p_dst+done),dst);
+  }
+  return done;
+}
+
+/*
+ * RaidGfMulXorAvx2
+ *
+ * AVX2 version of RaidGfMulXorSsse3 for the first count&~31 bytes.
+ */
+__attribute__((target("avx2")))
+static size_t RaidGfMulXorAvx2(char *p_dst,
+                               const char *p_src,
+                               size_t count,
+                               const uint8_t *p_lo_tab,
+                               const uint8_t *p_hi_tab)
+{
+  const __m256i lo_tab=
+    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p_lo_tab));
+  const __m256i hi_tab=
+    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p_hi_tab));
+  const __m256i mask=_mm256_set1_epi8(0x0f);
+  __m256i src;
+  __m256i dst;
+  size_t done;
+
+  for(done=0;done+32<=count;done+=32) {
+    src=_mm256_loadu_si256((const __m256i*)(p_src+done));
+    dst=_mm256_loadu_si256((const __m256i*)(p_dst+done));
+    dst=_mm256_xor_si256(dst,
+                         _mm256_shuffle_epi8(lo_tab,
+                                             _mm256_and_si256(src,mask)));
+    dst=_mm256_xor_si256(dst,
+                         _mm256_shuffle_epi8(hi_tab,
+                                             _mm256_and_si256(
+                                               _mm256_srli_epi64(src,4),
+                                               mask)));
+    _mm256_storeu_si256((__m256i*)(p_dst+done),dst);
+  }
+  return done;
+}
+#endif
+
+/*
+ * RaidGfMulXor
+ *
+ * Multiplies count bytes of p_src with factor in GF(2^8) and XORs the
+ * products into p_dst.
+ */
+static void RaidGfMulXor(pts_RaidHandle p_raid_handle,
+                         char *p_dst,
+                         const char *p_src,
+                         size_t count,
+                         uint8_t factor)
+{
+  uint8_t lo_tab[16];
+  uint8_t hi_tab[16];
+  uint8_t tab[256];
+  size_t done=0;
+
+  if(factor==0) return;
+  if(factor==1) {
+    RaidXor(p_dst,p_src,count);
+    return;
+  }
+
+  // Products of all values of the low and the high nibble of a byte
+  for(uint32_t i=0;i<16;i++) {
+    lo_tab[i]=RaidGfMul(p_raid_handle,factor,(uint8_t)i);
+    hi_tab[i]=RaidGfMul(p_raid_handle,factor,(uint8_t)(i<<4));
+  }
+
+#ifdef RAID_HAVE_X86_GF_KERNELS
+  switch(p_raid_handle->gf_kernel) {
+    case RAID_GF_KERNEL_AVX2:
+      done=RaidGfMulXorAvx2(p_dst,p_src,count,lo_tab,hi_tab);
+      break;
+    case RAID_GF_KERNEL_SSSE3:
+      done=RaidGfMulXorSsse3(p_dst,p_src,count,lo_tab,hi_tab);
+      break;
+  }
+#endif
+  if(done==count) return;
+
+  for(uint32_t i=0;i<256;i++) tab[i]=lo_tab[i&0x0f]^hi_tab[i>>4];
+  for(;done<count;done++) {
+    p_dst[done]^=(char)tab[(uint8_t)p_src[done]];
+  }
+}
+
+/*
+ * RaidStripeParity
+ *
+ * Gets the member disks holding the parity (P) and, for RAID-6, the Q
+ * syndrome chunk of a stripe. Parity rotates backwards (left) or forwards
+ * (right) over the members, or stays on the first / last members.
+ */
+static void RaidStripeParity(pts_RaidHandle p_raid_handle,
+                             uint64_t stripe,
+                             uint64_t *p_pd,
+                             uint64_t *p_qd)
+{
+  uint64_t members=p_raid_handle->members_count;
+
+  switch(p_raid_handle->layout) {
+    case RAID_LAYOUT_LEFT_ASYMMETRIC:
+    case RAID_LAYOUT_LEFT_SYMMETRIC:
+    case RAID_LAYOUT_DDF_N_CONTINUE:
+      *p_pd=members-1-(stripe%members);
+      break;
+    case RAID_LAYOUT_DDF_N_RESTART:
+      // Like left-asymmetric, but the first stripe is D D D P Q
+      *p_pd=members-1-((stripe+1)%members);
+      break;
+    case RAID_LAYOUT_PARITY_FIRST:
+      *p_pd=0;
+      break;
+    case RAID_LAYOUT_PARITY_LAST:
+      *p_pd=p_raid_handle->data_members_count;
+      break;
+    default:
+      // Right layouts and ddf-zero-restart
+      *p_pd=stripe%members;
+  }
+  // Q follows P, ddf-N-continue puts it in front of P
+  if(p_raid_handle->layout==RAID_LAYOUT_DDF_N_CONTINUE) {
+    *p_qd=(*p_pd+members-1)%members;
+  } else {
+    *p_qd=(*p_pd+1)%members;
+  }
+  if(p_raid_handle->level!=6) *p_qd=RAID_MEMBER_MISSING;
+}
+
+/*
+ * RaidMapChunk
+ *
+ * Maps a data chunk of the morphed image to the member disk holding it and to
+ * the stripe (the chunk's position on the member disk).
+ */
+static void RaidMapChunk(pts_RaidHandle p_raid_handle,
+                         uint64_t chunk,
+                         uint64_t *p_member,
+                         uint64_t *p_stripe)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint64_t stripe=chunk/p_raid_handle->data_members_count;
+  uint64_t data_chunk=chunk%p_raid_handle->data_members_count;
+  uint64_t member=data_chunk;
+  uint64_t pd;
+  uint64_t qd;
+
+  *p_stripe=stripe;
+  if(p_raid_handle->level==0) {
+    *p_member=data_chunk;
+    return;
+  }
+
+  RaidStripeParity(p_raid_handle,stripe,&pd,&qd);
+  switch(p_raid_handle->layout) {
+    case RAID_LAYOUT_LEFT_SYMMETRIC:
+    case RAID_LAYOUT_RIGHT_SYMMETRIC:
+      // Data continues on the member following the parity chunk(s)
+      if(qd!=RAID_MEMBER_MISSING) pd=qd;
+      member=(pd+1+data_chunk)%members;
+      break;
+    case RAID_LAYOUT_DDF_N_CONTINUE:
+      member=(pd+1+data_chunk)%members;
+      break;
+    default:
+      // Data is stored on the remaining members in ascending order
+      if(qd!=RAID_MEMBER_MISSING && qd<pd) {
+        if(member>=qd) member++;
+        if(member>=pd) member++;
+      } else {
+        if(member>=pd) member++;
+        if(qd!=RAID_MEMBER_MISSING && member>=qd) member++;
+      }
+  }
+  *p_member=member;
+}
+
+/*
+ * RaidSyndromeFactor
+ *
+ * Gets the factor a data member's chunk is multiplied with in the Q syndrome
+ * of a RAID-6 stripe. md numbers the data members starting after the Q chunk,
+ * DDF layouts just use the member number.
+ */
+static uint8_t RaidSyndromeFactor(pts_RaidHandle p_raid_handle,
+                                  uint64_t member,
+                                  uint64_t qd)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint64_t slot;
+
+  if(p_raid_handle->layout>=RAID_LAYOUT_DDF_ZERO_RESTART) {
+    slot=member;
+  } else {
+    slot=(member+members-(qd+1)%members)%members;
+  }
+  return p_raid_handle->gf_exp[slot%255];
+}
+
+/*
+ * RaidReadImage
+ *
+ * Reads data from the input image of a member disk. Reads of the same image
+ * are serialized as input libraries need not support concurrent reads.
+ */
+static int RaidReadImage(pts_RaidHandle p_raid_handle,
+                         uint64_t member,
+                         char *p_buf,
+                         uint64_t offset,
+                         size_t count)
+{
+  uint64_t image=p_raid_handle->p_member_images[member];
+  size_t read;
+  int ret;
+
+  pthread_mutex_lock(&(p_raid_handle->p_image_mutexes[image]));
+  ret=p_raid_handle->p_input_functions->Read(image,
+                                             p_buf,
+                                             offset,
+                                             count,
+                                             &read);
+  pthread_mutex_unlock(&(p_raid_handle->p_image_mutexes[image]));
+  if(ret!=0 || read!=count) return RAID_CANNOT_READ_DATA;
+  return RAID_OK;
+}
+
+/*
+ * RaidReadMember
+ *
+ * Reads data from a member disk. Data of a missing member is reconstructed
+ * from the other members' chunks at the same position:
+ *  - Using the parity, by XORing P and all other data chunks.
+ *  - For RAID-6 without P, from Q and all other data chunks.
+ *  - For RAID-6 with two missing data chunks, from P and Q.
+ * p_tmp_buf must be able to hold 2*count bytes for RAID-6 and count bytes
+ * otherwise.
+ */
+static int RaidReadMember(pts_RaidHandle p_raid_handle,
+                          uint64_t member,
+                          uint64_t stripe,
+                          char *p_buf,
+                          char *p_tmp_buf,
+                          uint64_t offset,
+                          size_t count)
+{
+  char *p_q_buf=p_tmp_buf+count;
+  uint64_t other=RAID_MEMBER_MISSING;
+  uint64_t pd;
+  uint64_t qd;
+  uint8_t use_p;
+  uint8_t use_q;
+  uint8_t factor;
+  uint8_t other_factor;
+  uint8_t inv;
+  int ret;
+
+#define RAID_READ(member,p_dst) {                               \
+  ret=RaidReadImage(p_raid_handle,(member),(p_dst),offset,count); \
+  if(ret!=RAID_OK) return ret;                                  \
+}
+
+  if(p_raid_handle->p_member_images[member]!=RAID_MEMBER_MISSING) {
+    RAID_READ(member,p_buf);
+    return RAID_OK;
+  }
+
+  // Find out which chunks of the stripe are available
+  RaidStripeParity(p_raid_handle,stripe,&pd,&qd);
+  for(uint64_t i=0;i<p_raid_handle->missing_members_count;i++) {
+    if(p_raid_handle->missing_members[i]!=member) {
+      other=p_raid_handle->missing_members[i];
+    }
+  }
+  use_p=(other!=pd);
+  use_q=(qd!=RAID_MEMBER_MISSING && other!=qd && other!=RAID_MEMBER_MISSING);
+
+  // Sum up P and / or Q with the available data chunks
+  if(use_p) RAID_READ(pd,p_buf);
+  if(use_q) RAID_READ(qd,p_q_buf);
+  for(uint64_t i=0;i<p_raid_handle->members_count;i++) {
+    if(i==member || i==other || i==pd || i==qd) continue;
+    RAID_READ(i,p_tmp_buf);
+    if(use_p) RaidXor(p_buf,p_tmp_buf,count);
+    if(use_q) {
+      RaidGfMulXor(p_raid_handle,
+                   p_q_buf,
+                   p_tmp_buf,
+                   count,
+                   RaidSyndromeFactor(p_raid_handle,i,qd));
+    }
+  }
+
+#undef RAID_READ
+
+  if(!use_q) return RAID_OK;
+
+  factor=RaidSyndromeFactor(p_raid_handle,member,qd);
+  if(!use_p) {
+    // Q now is factor*D, so D=Q/factor
+    memset(p_buf,0,count);
+    RaidGfMulXor(p_raid_handle,
+                 p_buf,
+                 p_q_buf,
+                 count,
+                 RaidGfInv(p_raid_handle,factor));
+    return RAID_OK;
+  }
+
+  // P now is Dx+Dy and Q is a*Dx+b*Dy, so Dx=(b*P+Q)/(a+b)
+  other_factor=RaidSyndromeFactor(p_raid_handle,other,qd);
+  inv=RaidGfInv(p_raid_handle,factor^other_factor);
+  memcpy(p_tmp_buf,p_buf,count);
+  memset(p_buf,0,count);
+  RaidGfMulXor(p_raid_handle,
+               p_buf,
+               p_tmp_buf,
+               count,
+               RaidGfMul(p_raid_handle,other_factor,inv));
+  RaidGfMulXor(p_raid_handle,p_buf,p_q_buf,count,inv);
+
+  return RAID_OK;
+}
+
+/*
+ * RaidGcd
+ */
+static uint64_t RaidGcd(uint64_t a, uint64_t b) {
+  uint64_t tmp;
+
+  while(b!=0) {
+    tmp=a%b;
+    a=b;
+    b=tmp;
+  }
+  return a;
+}
+
+/*
+ * RaidMapMirrorCopy
+ *
+ * Maps a data chunk of a RAID-1 / RAID-10 to the member disk and stripe
+ * holding its n-th available copy. Chunks are laid out like the "near" layout
+ * of Linux md: the copies of a chunk are stored on consecutive members, the
+ * next chunk follows on the next member. RAID-1 is the special case of as
+ * many copies as members.
+ * Returns 0 if there are less than n+1 available copies.
+ */
+static uint8_t RaidMapMirrorCopy(pts_RaidHandle p_raid_handle,
+                                 uint64_t chunk,
+                                 uint64_t n,
+                                 uint64_t *p_member,
+                                 uint64_t *p_stripe)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint64_t slot;
+
+  *p_member=RAID_MEMBER_MISSING;
+  *p_stripe=0;
+  for(uint64_t i=0;i<p_raid_handle->copies;i++) {
+    slot=chunk*p_raid_handle->copies+i;
+    if(p_raid_handle->p_member_images[slot%members]==RAID_MEMBER_MISSING) {
+      continue;
+    }
+    if(n--!=0) continue;
+    *p_member=slot%members;
+    *p_stripe=slot/members;
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * RaidChooseMirrorCopy
+ *
+ * Chooses which available copy of a RAID-1 / RAID-10 chunk to read from:
+ *  - RAID_BALANCE_STRIPE reads balance_chunks consecutive chunks, which are
+ *    all on different members, from the same copy and then switches to the
+ *    next copy. This way every member gets its share of sequential reads.
+ *  - RAID_BALANCE_QUEUE reads from the copy with the fewest bytes queued on
+ *    its member, ties are broken like in RAID_BALANCE_STRIPE. count bytes
+ *    are queued on the chosen copy's member and must be subtracted from
+ *    p_queued_bytes once they have been read.
+ * Returns the number of available copies.
+ */
+static uint64_t RaidChooseMirrorCopy(pts_RaidHandle p_raid_handle,
+                                     uint64_t chunk,
+                                     size_t count,
+                                     uint64_t *p_copy)
+{
+  uint64_t available=0;
+  uint64_t first;
+  uint64_t member;
+  uint64_t stripe;
+  uint64_t queued_member=0;
+  uint64_t min_queued=UINT64_MAX;
+
+  while(RaidMapMirrorCopy(p_raid_handle,chunk,available,&member,&stripe)) {
+    available++;
+  }
+  if(available==0) return 0;
+  first=(chunk/p_raid_handle->balance_chunks)%p_raid_handle->copies%available;
+  *p_copy=first;
+  if(p_raid_handle->balance!=RAID_BALANCE_QUEUE) return available;
+
+  pthread_mutex_lock(&(p_raid_handle->mutex));
+  for(uint64_t i=0;i<available;i++) {
+    RaidMapMirrorCopy(p_raid_handle,
+                      chunk,
+                      (first+i)%available,
+                      &member,
+                      &stripe);
+    if(p_raid_handle->p_queued_bytes[member]<min_queued) {
+      min_queued=p_raid_handle->p_queued_bytes[member];
+      *p_copy=(first+i)%available;
+      queued_member=member;
+    }
+  }
+  p_raid_handle->p_queued_bytes[queued_member]+=count;
+  pthread_mutex_unlock(&(p_raid_handle->mutex));
+
+  return available;
+}
+
+/*
+ * RaidReadMirror
+ *
+ * Reads data of a RAID-1 / RAID-10 chunk from one of its copies. If reading
+ * fails, the other copies are tried in turn.
+ */
+static int RaidReadMirror(pts_RaidHandle p_raid_handle,
+                          uint64_t chunk,
+                          char *p_buf,
+                          uint64_t chunk_offset,
+                          size_t count)
+{
+  uint64_t available;
+  uint64_t first=0;
+  uint64_t member;
+  uint64_t stripe;
+  uint64_t queued_member;
+  int ret=RAID_CANNOT_READ_DATA;
+
+  available=RaidChooseMirrorCopy(p_raid_handle,chunk,count,&first);
+  if(available==0) return RAID_CANNOT_READ_DATA;
+  RaidMapMirrorCopy(p_raid_handle,chunk,first,&queued_member,&stripe);
+
+  for(uint64_t i=0;i<available && ret!=RAID_OK;i++) {
+    RaidMapMirrorCopy(p_raid_handle,
+                      chunk,
+                      (first+i)%available,
+                      &member,
+                      &stripe);
+    if(i!=0) {
+      LOG_DEBUG("Reading chunk %" PRIu64 " failed, trying copy on member %"
+                  PRIu64 "\n",
+                chunk,
+                member);
+    }
+    ret=RaidReadImage(p_raid_handle,
+                      member,
+                      p_buf,
+                      stripe*p_raid_handle->chunk_size+chunk_offset,
+                      count);
+  }
+
+  if(p_raid_handle->balance==RAID_BALANCE_QUEUE) {
+    pthread_mutex_lock(&(p_raid_handle->mutex));
+    p_raid_handle->p_queued_bytes[queued_member]-=count;
+    pthread_mutex_unlock(&(p_raid_handle->mutex));
+  }
+
+  return ret;
+}
+
+/*
+ * RaidReadExtent
+ *
+ * Reads an extent with a single member read and scatters its data to the
+ * pieces' buffers. The data of a missing member is reconstructed, failed
+ * reads of RAID-1 / RAID-10 members are retried on the other copies.
+ */
+static int RaidReadExtent(pts_RaidHandle p_raid_handle,
+                          pts_RaidExtent p_extent)
+{
+  pts_RaidPiece p_pieces=p_extent->p_pieces;
+  pts_RaidPiece p_piece=&(p_pieces[p_extent->first_piece]);
+  char *p_buf;
+  char *p_next;
+  uint8_t direct=1;
+  uint64_t i;
+  int ret;
+
+  if(p_raid_handle->p_member_images[p_extent->member]==RAID_MEMBER_MISSING) {
+    p_buf=(char*)malloc(p_extent->size*p_raid_handle->parity_members_count);
+    if(p_buf==NULL) return RAID_MEMALLOC_FAILED;
+    ret=RaidReadMember(p_raid_handle,
+                       p_extent->member,
+                       p_piece->stripe,
+                       p_piece->p_buf,
+                       p_buf,
+                       p_extent->offset,
+                       p_extent->size);
+    free(p_buf);
+    return ret;
+  }
+
+  // Pieces that are contiguous in the request's buffer too are read directly
+  // into it, others through a bounce buffer
+  p_next=p_piece->p_buf;
+  for(i=p_extent->first_piece;i!=UINT64_MAX;i=p_pieces[i].next_piece) {
+    if(p_pieces[i].p_buf!=p_next) direct=0;
+    p_next=p_pieces[i].p_buf+p_pieces[i].count;
+  }
+  if(direct) {
+    p_buf=p_piece->p_buf;
+  } else {
+    p_buf=(char*)malloc(p_extent->size);
+    if(p_buf==NULL) return RAID_MEMALLOC_FAILED;
+  }
+
+  ret=RaidReadImage(p_raid_handle,
+                    p_extent->member,
+                    p_buf,
+                    p_extent->offset,
+                    p_extent->size);
+  if(ret==RAID_OK && !direct) {
+    p_next=p_buf;
+    for(i=p_extent->first_piece;i!=UINT64_MAX;i=p_pieces[i].next_piece) {
+      memcpy(p_pieces[i].p_buf,p_next,p_pieces[i].count);
+      p_next+=p_pieces[i].count;
+    }
+  }
+  if(!direct) free(p_buf);
+
+  if(ret!=RAID_OK && p_raid_handle->copies>1) {
+    LOG_DEBUG("Reading %zu bytes at offset %" PRIu64 " from member %" PRIu64
+                " failed, trying other copies\n",
+              p_extent->size,
+              p_extent->offset,
+              p_extent->member);
+    ret=RAID_OK;
+    for(i=p_extent->first_piece;
+        i!=UINT64_MAX && ret==RAID_OK;
+        i=p_pieces[i].next_piece)
+    {
+      ret=RaidReadMirror(p_raid_handle,
+                         p_pieces[i].chunk,
+                         p_pieces[i].p_buf,
+                         p_pieces[i].chunk_offset,
+                         p_pieces[i].count);
+    }
+  }
+
+  return ret;
+}
+
+/*
+ * RaidRunExtent
+ *
+ * Reads an extent and marks it as done.
+ */
+static void RaidRunExtent(pts_RaidHandle p_raid_handle,
+                          pts_RaidExtent p_extent)
+{
+  int ret;
+
+  ret=RaidReadExtent(p_raid_handle,p_extent);
+
+  pthread_mutex_lock(&(p_raid_handle->mutex));
+  if(p_raid_handle->copies>1 &&
+     p_raid_handle->balance==RAID_BALANCE_QUEUE)
+  {
+    p_raid_handle->p_queued_bytes[p_extent->member]-=p_extent->size;
+  }
+  p_extent->ret=ret;
+  if(--(*(p_extent->p_pending))==0) {
+    pthread_cond_broadcast(&(p_raid_handle->done_cond));
+  }
+  pthread_mutex_unlock(&(p_raid_handle->mutex));
+}
+
+/*
+ * RaidRunExtents
+ *
+ * Reads extents concurrently. All extents but the first one are queued, the
+ * first one is read by the calling thread, which then helps reading queued
+ * extents and waits for the others to be read. The result of each read is
+ * stored in its extent.
+ */
+static void RaidRunExtents(pts_RaidHandle p_raid_handle,
+                           pts_RaidExtent p_extents,
+                           uint64_t extents_count)
+{
+  pts_RaidExtent p_extent;
+  uint64_t pending=extents_count;
+
+  if(extents_count==0) return;
+  for(uint64_t i=0;i<extents_count;i++) p_extents[i].p_pending=&pending;
+  if(p_raid_handle->threads_running==0) {
+    for(uint64_t i=0;i<extents_count;i++) {
+      RaidRunExtent(p_raid_handle,&(p_extents[i]));
+    }
+  } else {
+    pthread_mutex_lock(&(p_raid_handle->mutex));
+    for(uint64_t i=1;i<extents_count;i++) {
+      if(p_raid_handle->p_jobs_tail==NULL) {
+        p_raid_handle->p_jobs_head=&(p_extents[i]);
+      } else {
+        p_raid_handle->p_jobs_tail->p_next=&(p_extents[i]);
+      }
+      p_raid_handle->p_jobs_tail=&(p_extents[i]);
+    }
+    if(extents_count>1) pthread_cond_broadcast(&(p_raid_handle->job_cond));
+    pthread_mutex_unlock(&(p_raid_handle->mutex));
+
+    RaidRunExtent(p_raid_handle,&(p_extents[0]));
+
+    pthread_mutex_lock(&(p_raid_handle->mutex));
+    while(pending!=0) {
+      p_extent=p_raid_handle->p_jobs_head;
+      if(p_extent==NULL) {
+        pthread_cond_wait(&(p_raid_handle->done_cond),
+                          &(p_raid_handle->mutex));
+        continue;
+      }
+      p_raid_handle->p_jobs_head=p_extent->p_next;
+      if(p_raid_handle->p_jobs_head==NULL) p_raid_handle->p_jobs_tail=NULL;
+      pthread_mutex_unlock(&(p_raid_handle->mutex));
+      RaidRunExtent(p_raid_handle,p_extent);
+      pthread_mutex_lock(&(p_raid_handle->mutex));
+    }
+    pthread_mutex_unlock(&(p_raid_handle->mutex));
+  }
+}
+
+/*
+ * RaidReadThread
+ */
+static void* RaidReadThread(void *p_arg) {
+  pts_RaidHandle p_raid_handle=(pts_RaidHandle)p_arg;
+  pts_RaidExtent p_extent;
+
+  pthread_mutex_lock(&(p_raid_handle->mutex));
+  while(1) {
+    while(p_raid_handle->p_jobs_head==NULL && !p_raid_handle->pool_stop) {
+      pthread_cond_wait(&(p_raid_handle->job_cond),&(p_raid_handle->mutex));
+    }
+    if(p_raid_handle->pool_stop) break;
+    p_extent=p_raid_handle->p_jobs_head;
+    p_raid_handle->p_jobs_head=p_extent->p_next;
+    if(p_raid_handle->p_jobs_head==NULL) p_raid_handle->p_jobs_tail=NULL;
+    pthread_mutex_unlock(&(p_raid_handle->mutex));
+    RaidRunExtent(p_raid_handle,p_extent);
+    pthread_mutex_lock(&(p_raid_handle->mutex));
+  }
+  pthread_mutex_unlock(&(p_raid_handle->mutex));
+
+  return NULL;
+}
+
+/*
+ * RaidStartThreads
+ *
+ * The calling thread of RaidRead reads extents too, so threads-1 threads are
+ * started.
+ */
+static int RaidStartThreads(pts_RaidHandle p_raid_handle) {
+  if(p_raid_handle->threads<2) return RAID_OK;
+  p_raid_handle->p_threads=
+    (pthread_t*)calloc(p_raid_handle->threads-1,sizeof(pthread_t));
+  if(p_raid_handle->p_threads==NULL) return RAID_MEMALLOC_FAILED;
+  p_raid_handle->pool_stop=0;
+  for(uint32_t i=0;i<p_raid_handle->threads-1;i++) {
+    if(pthread_create(&(p_raid_handle->p_threads[i]),
+                      NULL,
+                      RaidReadThread,
+                      p_raid_handle)!=0)
+    {
+      return RAID_CANNOT_CREATE_THREAD;
+    }
+    p_raid_handle->threads_running++;
+  }
+  return RAID_OK;
+}
+
+/*
+ * RaidStopThreads
+ */
+static void RaidStopThreads(pts_RaidHandle p_raid_handle) {
+  pthread_mutex_lock(&(p_raid_handle->mutex));
+  p_raid_handle->pool_stop=1;
+  pthread_cond_broadcast(&(p_raid_handle->job_cond));
+  pthread_mutex_unlock(&(p_raid_handle->mutex));
+  for(uint32_t i=0;i<p_raid_handle->threads_running;i++) {
+    pthread_join(p_raid_handle->p_threads[i],NULL);
+  }
+  p_raid_handle->threads_running=0;
+  free(p_raid_handle->p_threads);
+  p_raid_handle->p_threads=NULL;
+}
+
+/*
+ * RaidParseMemberOrder
+ *
+ * Parses a list of input image numbers or "missing", separated by colons.
+ * "auto", optionally followed by missing members, has the order of the
+ * input images detected.
+ */
+static int RaidParseMemberOrder(pts_RaidHandle p_raid_handle,
+                                const char *p_value)
+{
+  const char *p_entry=p_value;
+  uint64_t *p_members;
+  uint64_t count=1;
+  uint8_t detect_order=0;
+  size_t len;
+  char *p_buf;
+  int ok;
+
+  for(const char *p=p_value;*p!='\0';p++) {
+    if(*p==':') count++;
+  }
+  p_members=(uint64_t*)malloc(count*sizeof(uint64_t));
+  if(p_members==NULL) return RAID_MEMALLOC_FAILED;
+
+  for(uint64_t i=0;i<count;i++) {
+    len=strcspn(p_entry,":");
+    p_buf=strndup(p_entry,len);
+    if(p_buf==NULL) {
+      free(p_members);
+      return RAID_MEMALLOC_FAILED;
+    }
+    if(strcmp(p_buf,"missing")==0) {
+      p_members[i]=RAID_MEMBER_MISSING;
+      ok=1;
+    } else if(i==0 && strcmp(p_buf,"auto")==0) {
+      p_members[i]=RAID_MEMBER_MISSING;
+      detect_order=1;
+      ok=1;
+    } else {
+      p_members[i]=StrToUint64(p_buf,&ok);
+      if(p_members[i]==RAID_MEMBER_MISSING || detect_order) ok=0;
+    }
+    free(p_buf);
+    if(!ok) {
+      free(p_members);
+      return RAID_CANNOT_PARSE_OPTION;
+    }
+    p_entry+=len+1;
+  }
+
+  // With auto, only the missing members following it are known
+  free(p_raid_handle->p_member_images);
+  p_raid_handle->p_member_images=p_members;
+  if(detect_order) {
+    p_raid_handle->members_count=count-1;
+    p_raid_handle->detect|=RAID_DETECT_ORDER;
+  } else {
+    p_raid_handle->members_count=count;
+    p_raid_handle->detect&=~RAID_DETECT_ORDER;
+  }
+  return RAID_OK;
+}
+
+/*
+ * RaidDetectClass
+ *
+ * Classifies RAID_DETECT_WINDOW bytes of data as all zeros, text, random
+ * (compressed or encrypted) or other binary data.
+ */
+static uint8_t RaidDetectClass(const char *p_buf) {
+  uint8_t seen[256];
+  uint8_t byte;
+  uint32_t nonzero=0;
+  uint32_t printable=0;
+  uint32_t distinct=0;
+
+  memset(seen,0,sizeof(seen));
+  for(uint32_t i=0;i<RAID_DETECT_WINDOW;i++) {
+    byte=(uint8_t)p_buf[i];
+    if(byte!=0) nonzero++;
+    if((byte>=0x20 && byte<0x7f) || byte=='\t' || byte=='\n' || byte=='\r') {
+      printable++;
+    }
+    if(!seen[byte]) {
+      seen[byte]=1;
+      distinct++;
+    }
+  }
+  if(nonzero==0) return RAID_DATA_ZERO;
+  if(printable*20>=RAID_DETECT_WINDOW*19) return RAID_DATA_TEXT;
+  // Random data uses almost all byte values, 1024 random bytes ~251 of them
+  if(distinct>=200) return RAID_DATA_RANDOM;
+  return RAID_DATA_BINARY;
+}
+
+/*
+ * RaidDetectLe32
+ */
+static uint32_t RaidDetectLe32(const char *p_buf) {
+  const uint8_t *p=(const uint8_t*)p_buf;
+
+  return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;
+}
+
+/*
+ * RaidDetectWindowInfo
+ *
+ * Classifies the data before and after a sampled chunk boundary. If the
+ * data before it are records of up to RAID_DETECT_MAX_RECORD_SIZE bytes
+ * whose last 4 hold a 32 bit counter incremented by the same value (e.g.
+ * sequence or sector numbers, FAT chains), the counter of the next record
+ * is predicted.
+ */
+static void RaidDetectWindowInfo(const char *p_buf,
+                                 pts_RaidDetectWindow p_window)
+{
+  const char *p_end=p_buf+RAID_DETECT_WINDOW;
+  uint32_t values[4];
+  uint32_t step;
+  uint8_t found;
+
+  p_window->classes[0]=RaidDetectClass(p_buf);
+  p_window->classes[1]=RaidDetectClass(p_end);
+  p_window->has_counter=0;
+  if(p_window->classes[0]==RAID_DATA_ZERO ||
+     p_window->classes[0]==RAID_DATA_RANDOM)
+  {
+    return;
+  }
+
+  for(uint32_t size=4;size<=RAID_DETECT_MAX_RECORD_SIZE;size*=2) {
+    for(uint32_t offset=0;offset<size;offset+=4) {
+      for(uint32_t i=0;i<4;i++) {
+        values[i]=RaidDetectLe32(p_end-(4-i)*size+offset);
+      }
+      step=values[1]-values[0];
+      found=(step!=0);
+      for(uint32_t i=2;i<4 && found;i++) {
+        if(values[i]-values[i-1]!=step) found=0;
+      }
+      if(!found) continue;
+      p_window->has_counter=1;
+      p_window->counter_offset=offset;
+      p_window->counter=values[3]+step;
+      return;
+    }
+  }
+}
+
+/*
+ * RaidDetectJoin
+ *
+ * Scores how likely the data after the boundary of p_start continues the
+ * data before the boundary of p_end. Numbered NTFS MFT records and other
+ * records holding a counter must continue the numbering, other data is
+ * likely to stay of the same class. Zeros tell nothing.
+ */
+static int64_t RaidDetectJoin(const char *p_end,
+                              pts_RaidDetectWindow p_end_window,
+                              const char *p_start,
+                              pts_RaidDetectWindow p_start_window)
+{
+  uint8_t end_class=p_end_window->classes[0];
+  uint8_t start_class=p_start_window->classes[1];
+
+  if(end_class==RAID_DATA_ZERO || start_class==RAID_DATA_ZERO) return 0;
+  p_end+=RAID_DETECT_WINDOW-1024;
+  p_start+=RAID_DETECT_WINDOW;
+  if(memcmp(p_end,"FILE",4)==0 && memcmp(p_start,"FILE",4)==0) {
+    if(RaidDetectLe32(p_start+0x2c)==RaidDetectLe32(p_end+0x2c)+1) {
+      return RAID_DETECT_RECORD_SCORE;
+    }
+    return -RAID_DETECT_RECORD_SCORE;
+  }
+  if(p_end_window->has_counter) {
+    if(RaidDetectLe32(p_start+p_end_window->counter_offset)==
+         p_end_window->counter)
+    {
+      return RAID_DETECT_RECORD_SCORE;
+    }
+    return -RAID_DETECT_RECORD_SCORE;
+  }
+  if(end_class==start_class) return 1;
+  return -1;
+}
+
+/*
+ * RaidDetectIsBoot
+ *
+ * Checks for a MBR, boot sector (FAT, NTFS, etc.) or GPT header and, if
+ * check_superblock is set, for the superblock of an ext2/3/4 file system.
+ * p_buf must hold 2*RAID_DETECT_WINDOW bytes.
+ */
+static uint8_t RaidDetectIsBoot(const char *p_buf, uint8_t check_superblock) {
+  if((uint8_t)p_buf[510]==0x55 && (uint8_t)p_buf[511]==0xaa) return 1;
+  if(memcmp(p_buf+512,"EFI PART",8)==0) return 1;
+  if(check_superblock &&
+     (uint8_t)p_buf[1024+56]==0x53 && (uint8_t)p_buf[1024+57]==0xef)
+  {
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * RaidDetectAnchors
+ *
+ * The morphed image starts with a boot sector or file system superblock and
+ * so do the partitions listed in its MBR. The MBR is looked for on all
+ * members as it isn't known yet which one holds the first chunk.
+ */
+static int RaidDetectAnchors(pts_RaidHandle p_raid_handle,
+                             pts_RaidDetectEvidence p_evidence)
+{
+  uint8_t mbr[512];
+  const uint8_t *p_entry;
+  uint64_t start;
+  uint64_t i;
+  int ret;
+
+  p_evidence->anchors[0]=0;
+  p_evidence->anchors_count=1;
+  for(uint64_t member=0;member<p_raid_handle->members_count;member++) {
+    if(p_raid_handle->p_member_images[member]==RAID_MEMBER_MISSING) continue;
+    ret=RaidReadImage(p_raid_handle,member,(char*)mbr,0,sizeof(mbr));
+    if(ret!=RAID_OK) return ret;
+    if(mbr[510]!=0x55 || mbr[511]!=0xaa) continue;
+    for(uint8_t entry=0;entry<4;entry++) {
+      p_entry=mbr+446+16*entry;
+      // Skip unused, invalid and GPT protective entries
+      if((p_entry[0]!=0x00 && p_entry[0]!=0x80) ||
+         p_entry[4]==0x00 || p_entry[4]==0xee)
+      {
+        continue;
+      }
+      start=(p_entry[8] | p_entry[9]<<8 | p_entry[10]<<16 |
+               (uint64_t)p_entry[11]<<24)*512;
+      if(start==0) continue;
+      for(i=0;i<p_evidence->anchors_count;i++) {
+        if(p_evidence->anchors[i]==start) break;
+      }
+      if(i==p_evidence->anchors_count &&
+         p_evidence->anchors_count<RAID_DETECT_MAX_ANCHORS)
+      {
+        LOG_DEBUG("Member %" PRIu64 " lists a partition at offset %" PRIu64
+                    "\n",
+                  member,
+                  start);
+        p_evidence->anchors[p_evidence->anchors_count++]=start;
+      }
+    }
+  }
+  return RAID_OK;
+}
+
+/*
+ * RaidDetectStripes
+ *
+ * Chooses the stripes to sample for a chunk size. Half of them are spread
+ * over the first eighth of the members, where file system metadata is most
+ * likely, the others over all of them. Stripe 0 and the last stripe aren't
+ * used as the chunks before and after a sampled one are looked at too.
+ */
+static void RaidDetectStripes(uint64_t chunks_per_image, uint64_t *p_stripes) {
+  uint64_t half=RAID_DETECT_SAMPLES/2;
+  uint64_t span=chunks_per_image-2;
+
+  for(uint64_t i=0;i<half;i++) {
+    p_stripes[i]=1+i*(span/8+1)/half;
+    if(p_stripes[i]>span) p_stripes[i]=span;
+    p_stripes[half+i]=1+i*span/half;
+  }
+}
+
+/*
+ * RaidDetectSample
+ *
+ * Reads, from all members concurrently, 2*RAID_DETECT_WINDOW bytes around
+ * the start of each sampled stripe and of the stripe following it, followed
+ * by the same amount at the members' offsets of each anchor. Samples of
+ * missing members and those that can't be read are left zeroed. p_samples
+ * must be able to hold all of them.
+ */
+static int RaidDetectSample(pts_RaidHandle p_raid_handle,
+                            pts_RaidDetectEvidence p_evidence,
+                            uint32_t chunk_size,
+                            const uint64_t *p_stripes,
+                            char *p_samples)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint64_t blocks=2*RAID_DETECT_SAMPLES+p_evidence->anchors_count;
+  uint64_t sample_size=2*RAID_DETECT_WINDOW;
+  pts_RaidPiece p_pieces;
+  pts_RaidExtent p_extents;
+  uint64_t extents_count=0;
+  uint64_t offset;
+  uint64_t anchor;
+
+  p_pieces=(pts_RaidPiece)malloc(blocks*members*sizeof(ts_RaidPiece));
+  p_extents=(pts_RaidExtent)malloc(blocks*members*sizeof(ts_RaidExtent));
+  if(p_pieces==NULL || p_extents==NULL) {
+    free(p_pieces);
+    free(p_extents);
+    return RAID_MEMALLOC_FAILED;
+  }
+  memset(p_samples,0,blocks*members*sample_size);
+
+  for(uint64_t member=0;member<members;member++) {
+    if(p_raid_handle->p_member_images[member]==RAID_MEMBER_MISSING) continue;
+    for(uint64_t block=0;block<blocks;block++) {
+      if(block<2*RAID_DETECT_SAMPLES) {
+        offset=(p_stripes[block/2]+block%2)*chunk_size-RAID_DETECT_WINDOW;
+      } else {
+        // Member offset of the anchor's chunk
+        anchor=p_evidence->anchors[block-2*RAID_DETECT_SAMPLES];
+        offset=anchor/chunk_size/p_raid_handle->data_members_count*
+                 chunk_size+anchor%chunk_size;
+      }
+      if(offset+sample_size>p_evidence->image_size) continue;
+      p_pieces[extents_count].p_buf=p_samples+(block*members+member)*
+                                                sample_size;
+      p_pieces[extents_count].count=sample_size;
+      p_pieces[extents_count].chunk=0;
+      p_pieces[extents_count].chunk_offset=0;
+      p_pieces[extents_count].stripe=0;
+      p_pieces[extents_count].next_piece=UINT64_MAX;
+      p_extents[extents_count].member=member;
+      p_extents[extents_count].offset=offset;
+      p_extents[extents_count].size=sample_size;
+      p_extents[extents_count].p_pieces=p_pieces;
+      p_extents[extents_count].first_piece=extents_count;
+      p_extents[extents_count].last_piece=extents_count;
+      p_extents[extents_count].ret=RAID_OK;
+      p_extents[extents_count].p_next=NULL;
+      extents_count++;
+    }
+  }
+
+  RaidRunExtents(p_raid_handle,p_extents,extents_count);
+
+  for(uint64_t i=0;i<extents_count;i++) {
+    if(p_extents[i].ret==RAID_OK) continue;
+    LOG_DEBUG("Unable to read sample at offset %" PRIu64 " of member %"
+                PRIu64 "\n",
+              p_extents[i].offset,
+              p_extents[i].member);
+    memset(p_pieces[i].p_buf,0,sample_size);
+  }
+  free(p_pieces);
+  free(p_extents);
+  return RAID_OK;
+}
+
+/*
+ * RaidDetectGather
+ *
+ * Samples the members for a chunk size and sums up the evidence. For each
+ * pair of members, the end of the chunk before a sampled stripe's second
+ * boundary is joined with the start of the other member's chunk in the same
+ * stripe and in the next stripe. Parity is checked at both boundaries.
+ */
+static int RaidDetectGather(pts_RaidHandle p_raid_handle,
+                            pts_RaidDetectEvidence p_evidence,
+                            uint64_t chunk_size_index,
+                            char *p_samples,
+                            pts_RaidDetectWindow p_windows)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint32_t chunk_size=p_evidence->chunk_sizes[chunk_size_index];
+  uint64_t sample_size=2*RAID_DETECT_WINDOW;
+  uint64_t stripes[RAID_DETECT_SAMPLES];
+  uint64_t stripe;
+  uint64_t index;
+  uint64_t q_member;
+  uint64_t q_members;
+  uint8_t nonzero;
+  char parity[RAID_DETECT_WINDOW];
+  int ret;
+
+#define RAID_SAMPLE(block,member) \
+  (p_samples+((block)*members+(member))*sample_size)
+#define RAID_WINDOW(block,member) (&(p_windows[(block)*members+(member)]))
+
+  RaidDetectStripes(p_evidence->image_size/chunk_size,stripes);
+  ret=RaidDetectSample(p_raid_handle,p_evidence,chunk_size,stripes,p_samples);
+  if(ret!=RAID_OK) return ret;
+
+  for(uint64_t block=0;block<2*RAID_DETECT_SAMPLES;block++) {
+    for(uint64_t member=0;member<members;member++) {
+      RaidDetectWindowInfo(RAID_SAMPLE(block,member),
+                           RAID_WINDOW(block,member));
+    }
+  }
+
+  for(uint64_t i=0;i<RAID_DETECT_SAMPLES;i++) {
+    index=(chunk_size_index*members+stripes[i]%members)*members*members;
+    for(uint64_t a=0;a<members;a++) {
+      for(uint64_t b=0;b<members;b++) {
+        p_evidence->p_same[index+a*members+b]+=
+          RaidDetectJoin(RAID_SAMPLE(2*i+1,a),
+                         RAID_WINDOW(2*i+1,a),
+                         RAID_SAMPLE(2*i,b),
+                         RAID_WINDOW(2*i,b));
+        p_evidence->p_next[index+a*members+b]+=
+          RaidDetectJoin(RAID_SAMPLE(2*i+1,a),
+                         RAID_WINDOW(2*i+1,a),
+                         RAID_SAMPLE(2*i+1,b),
+                         RAID_WINDOW(2*i+1,b));
+      }
+    }
+  }
+
+  for(uint64_t anchor=0;anchor<p_evidence->anchors_count;anchor++) {
+    for(uint64_t member=0;member<members;member++) {
+      p_evidence->p_boot[(chunk_size_index*p_evidence->anchors_count+anchor)*
+                           members+member]=
+        RaidDetectIsBoot(RAID_SAMPLE(2*RAID_DETECT_SAMPLES+anchor,member),
+                         p_evidence->anchors[anchor]%chunk_size+
+                           sample_size<=chunk_size);
+    }
+  }
+
+  if(p_raid_handle->level==0) return RAID_OK;
+  for(uint64_t block=0;block<2*RAID_DETECT_SAMPLES;block++) {
+    stripe=stripes[block/2]+block%2;
+    nonzero=0;
+    memset(parity,0,sizeof(parity));
+    for(uint64_t member=0;member<members;member++) {
+      if(RAID_WINDOW(block,member)->classes[1]!=RAID_DATA_ZERO) nonzero=1;
+      RaidXor(parity,
+              RAID_SAMPLE(block,member)+RAID_DETECT_WINDOW,
+              RAID_DETECT_WINDOW);
+    }
+    if(!nonzero) continue;
+    p_evidence->p_parity_samples[chunk_size_index]++;
+    // The parity of RAID-5 adds up to zero, that of RAID-6 without Q does
+    q_members=0;
+    q_member=0;
+    for(uint64_t member=0;member<members;member++) {
+      if(memcmp(parity,
+                RAID_SAMPLE(block,member)+RAID_DETECT_WINDOW,
+                RAID_DETECT_WINDOW)==0)
+      {
+        q_member=member;
+        q_members++;
+      }
+    }
+    if(p_raid_handle->level==5) {
+      nonzero=1;
+      for(uint32_t i=0;i<RAID_DETECT_WINDOW && nonzero;i++) {
+        if(parity[i]!=0) nonzero=0;
+      }
+      if(nonzero) p_evidence->p_parity_ok[chunk_size_index]++;
+    } else if(q_members==1) {
+      p_evidence->p_parity_ok[chunk_size_index]++;
+      p_evidence->p_q[(chunk_size_index*members+stripe%members)*members+
+                        q_member]++;
+    }
+  }
+
+#undef RAID_WINDOW
+#undef RAID_SAMPLE
+
+  return RAID_OK;
+}
+
+/*
+ * RaidNextPermutation
+ *
+ * Rearranges p_values into the lexicographically next permutation. Returns
+ * 0 once all permutations have been enumerated.
+ */
+static uint8_t RaidNextPermutation(uint64_t *p_values, uint64_t count) {
+  uint64_t i=count-1;
+  uint64_t ii=count-1;
+  uint64_t value;
+
+  if(count<2) return 0;
+  while(i>0 && p_values[i-1]>=p_values[i]) i--;
+  if(i==0) return 0;
+  while(p_values[ii]<=p_values[i-1]) ii--;
+  value=p_values[i-1];
+  p_values[i-1]=p_values[ii];
+  p_values[ii]=value;
+  for(ii=count-1;i<ii;i++,ii--) {
+    value=p_values[i];
+    p_values[i]=p_values[ii];
+    p_values[ii]=value;
+  }
+  return 1;
+}
+
+/*
+ * RaidDetectRank
+ *
+ * Inserts a candidate into the list of best candidates, sorted by
+ * descending score. Of candidates mapping data the same way (e.g.
+ * parity-first and parity-last with rotated orders), only the first one
+ * with the best score is kept.
+ */
+static void RaidDetectRank(pts_RaidHandle p_raid_handle,
+                           pts_RaidCandidate p_top,
+                           uint64_t *p_top_count,
+                           pts_RaidCandidate p_candidate)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint64_t mapping_size=members*(p_raid_handle->data_members_count+2)*
+                          sizeof(uint64_t);
+  uint64_t free_pos=*p_top_count;
+  uint64_t pos;
+  ts_RaidCandidate spare;
+
+  // Replace an equivalent candidate, a free entry or the last one
+  for(uint64_t i=0;i<*p_top_count;i++) {
+    if(p_top[i].chunk_size_index==p_candidate->chunk_size_index &&
+       memcmp(p_top[i].p_mapping,p_candidate->p_mapping,mapping_size)==0)
+    {
+      if(p_top[i].score>=p_candidate->score) return;
+      free_pos=i;
+      break;
+    }
+  }
+  if(free_pos==RAID_DETECT_TOP_CANDIDATES) {
+    if(p_top[free_pos-1].score>=p_candidate->score) return;
+    free_pos--;
+  } else if(free_pos==*p_top_count) {
+    (*p_top_count)++;
+  }
+  pos=free_pos;
+  while(pos>0 && p_top[pos-1].score<p_candidate->score) pos--;
+
+  spare=p_top[free_pos];
+  for(uint64_t i=free_pos;i>pos;i--) p_top[i]=p_top[i-1];
+  spare.score=p_candidate->score;
+  spare.chunk_size_index=p_candidate->chunk_size_index;
+  spare.layout=p_candidate->layout;
+  memcpy(spare.p_order,p_candidate->p_order,members*sizeof(uint64_t));
+  memcpy(spare.p_mapping,p_candidate->p_mapping,mapping_size);
+  p_top[pos]=spare;
+}
+
+/*
+ * RaidDetectSyndromes
+ *
+ * Counts the sampled stripes of a RAID-6 whose Q syndrome, calculated with
+ * the current layout's syndrome factors, matches the one on the members.
+ * md and DDF layouts only differ in these factors.
  */
-uint8_t LibXmount_Morphing_GetApiVersion() {
-  return LIBXMOUNT_MORPHING_API_VERSION;
+static int RaidDetectSyndromes(pts_RaidHandle p_raid_handle,
+                               pts_RaidDetectEvidence p_evidence,
+                               pts_RaidCandidate p_candidate,
+                               char *p_samples,
+                               uint64_t *p_matches)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint32_t chunk_size=p_evidence->chunk_sizes[p_candidate->chunk_size_index];
+  uint64_t sample_size=2*RAID_DETECT_WINDOW;
+  uint64_t stripes[RAID_DETECT_SAMPLES];
+  uint64_t stripe;
+  uint64_t pd;
+  uint64_t qd;
+  char syndrome[RAID_DETECT_WINDOW];
+  char zero[RAID_DETECT_WINDOW];
+  char *p_sample;
+  int ret;
+
+  *p_matches=0;
+  memset(zero,0,sizeof(zero));
+  RaidDetectStripes(p_evidence->image_size/chunk_size,stripes);
+  ret=RaidDetectSample(p_raid_handle,p_evidence,chunk_size,stripes,p_samples);
+  if(ret!=RAID_OK) return ret;
+
+  for(uint64_t block=0;block<2*RAID_DETECT_SAMPLES;block++) {
+    stripe=stripes[block/2]+block%2;
+    RaidStripeParity(p_raid_handle,stripe,&pd,&qd);
+    memset(syndrome,0,sizeof(syndrome));
+    for(uint64_t member=0;member<members;member++) {
+      if(member==pd || member==qd) continue;
+      p_sample=p_samples+(block*members+p_candidate->p_order[member])*
+                           sample_size;
+      RaidGfMulXor(p_raid_handle,
+                   syndrome,
+                   p_sample+RAID_DETECT_WINDOW,
+                   RAID_DETECT_WINDOW,
+                   RaidSyndromeFactor(p_raid_handle,member,qd));
+    }
+    p_sample=p_samples+(block*members+p_candidate->p_order[qd])*sample_size;
+    if(memcmp(syndrome,zero,sizeof(zero))!=0 &&
+       memcmp(syndrome,p_sample+RAID_DETECT_WINDOW,RAID_DETECT_WINDOW)==0)
+    {
+      (*p_matches)++;
+    }
+  }
+  return RAID_OK;
 }
 
 /*
- * LibXmount_Morphing_GetSupportedFormats
+ * RaidDetectScore
+ *
+ * Scores all combinations of the chunk sizes, layouts and member orders to
+ * detect and keeps the best ones in p_top. The score of a candidate sums up
+ * the joins of consecutive data chunks, boot sectors found where they are
+ * expected and, for RAID-6, stripes whose Q syndrome is where expected.
  */
-const char* LibXmount_Morphing_GetSupportedTypes() {
-  return "raid0\0\0";
+static int RaidDetectScore(pts_RaidHandle p_raid_handle,
+                           pts_RaidDetectEvidence p_evidence,
+                           pts_RaidCandidate p_top,
+                           uint64_t *p_top_count,
+                           uint64_t *p_candidates_count)
+{
+  uint64_t members=p_raid_handle->members_count;
+  uint64_t data=p_raid_handle->data_members_count;
+  uint64_t anchors=p_evidence->anchors_count;
+  uint8_t first_layout=p_raid_handle->layout;
+  uint8_t last_layout=p_raid_handle->layout;
+  ts_RaidCandidate candidate;
+  uint64_t *p_sequence;
+  uint64_t *p_pd;
+  uint64_t *p_qd;
+  uint64_t anchor_members[RAID_DETECT_MAX_ANCHORS];
+  uint64_t *p_order;
+  uint64_t *p_mapping;
+  const int64_t *p_same;
+  const int64_t *p_next;
+  uint64_t chunk;
+  uint64_t stripe;
+  uint64_t slot;
+  int64_t score;
+
+  if(p_raid_handle->level!=0 && (p_raid_handle->detect&RAID_DETECT_LAYOUT)) {
+    first_layout=RAID_LAYOUT_LEFT_ASYMMETRIC;
+    if(p_raid_handle->level==6) last_layout=RAID_LAYOUT_DDF_N_CONTINUE;
+    else last_layout=RAID_LAYOUT_PARITY_LAST;
+  }
+
+  p_sequence=(uint64_t*)malloc(members*data*sizeof(uint64_t));
+  p_pd=(uint64_t*)malloc(members*sizeof(uint64_t));
+  p_qd=(uint64_t*)malloc(members*sizeof(uint64_t));
+  candidate.p_order=(uint64_t*)malloc(members*sizeof(uint64_t));
+  candidate.p_mapping=(uint64_t*)malloc(members*(data+2)*sizeof(uint64_t));
+  if(p_sequence==NULL || p_pd==NULL || p_qd==NULL ||
+     candidate.p_order==NULL || candidate.p_mapping==NULL)
+  {
+    free(p_sequence);
+    free(p_pd);
+    free(p_qd);
+    free(candidate.p_order);
+    free(candidate.p_mapping);
+    return RAID_MEMALLOC_FAILED;
+  }
+  p_order=candidate.p_order;
+  p_mapping=candidate.p_mapping;
+
+  for(uint64_t ci=0;ci<p_evidence->chunk_sizes_count;ci++) {
+    candidate.chunk_size_index=ci;
+    for(uint8_t layout=first_layout;layout<=last_layout;layout++) {
+      candidate.layout=layout;
+      p_raid_handle->layout=layout;
+
+      // Members holding the data and parity chunks of the stripes until the
+      // layout repeats and the data chunks at the anchors
+      for(uint64_t r=0;r<members;r++) {
+        for(uint64_t k=0;k<data;k++) {
+          RaidMapChunk(p_raid_handle,r*data+k,&(p_sequence[r*data+k]),&stripe);
+        }
+        if(p_raid_handle->level!=0) {
+          RaidStripeParity(p_raid_handle,r,&(p_pd[r]),&(p_qd[r]));
+        } else {
+          p_pd[r]=RAID_MEMBER_MISSING;
+          p_qd[r]=RAID_MEMBER_MISSING;
+        }
+      }
+      for(uint64_t a=0;a<anchors;a++) {
+        chunk=p_evidence->anchors[a]/p_evidence->chunk_sizes[ci];
+        anchor_members[a]=p_sequence[(chunk/data%members)*data+chunk%data];
+      }
+
+      for(uint64_t m=0;m<members;m++) p_order[m]=m;
+      do {
+        score=0;
+        for(uint64_t r=0;r<members;r++) {
+          p_same=p_evidence->p_same+(ci*members+r)*members*members;
+          p_next=p_evidence->p_next+(ci*members+r)*members*members;
+          for(uint64_t k=r*data;k<r*data+data-1;k++) {
+            score+=p_same[p_order[p_sequence[k]]*members+
+                            p_order[p_sequence[k+1]]];
+          }
+          score+=p_next[p_order[p_sequence[r*data+data-1]]*members+
+                          p_order[p_sequence[(r+1)%members*data]]];
+          if(p_raid_handle->level==6) {
+            score+=RAID_DETECT_PARITY_SCORE*
+                     p_evidence->p_q[(ci*members+r)*members+p_order[p_qd[r]]];
+          }
+        }
+        for(uint64_t a=0;a<anchors;a++) {
+          if(p_evidence->p_boot[(ci*anchors+a)*members+
+                                  p_order[anchor_members[a]]])
+          {
+            score+=RAID_DETECT_ANCHOR_SCORE;
+          }
+        }
+        (*p_candidates_count)++;
+        if(*p_top_count==RAID_DETECT_TOP_CANDIDATES &&
+           score<=p_top[RAID_DETECT_TOP_CANDIDATES-1].score)
+        {
+          continue;
+        }
+
+        // Missing members are all alike
+        for(uint64_t r=0;r<members;r++) {
+          for(uint64_t k=0;k<data+2;k++) {
+            if(k<data) {
+              slot=p_order[p_sequence[r*data+k]];
+            } else {
+              slot=(k==data) ? p_pd[r] : p_qd[r];
+              if(slot!=RAID_MEMBER_MISSING) slot=p_order[slot];
+            }
+            if(slot!=RAID_MEMBER_MISSING &&
+               p_raid_handle->p_member_images[slot]==RAID_MEMBER_MISSING)
+            {
+              slot=RAID_MEMBER_MISSING;
+            }
+            p_mapping[r*(data+2)+k]=slot;
+          }
+        }
+        candidate.score=score;
+        RaidDetectRank(p_raid_handle,p_top,p_top_count,&candidate);
+      } while((p_raid_handle->detect&RAID_DETECT_ORDER) &&
+              RaidNextPermutation(p_order,members));
+    }
+  }
+
+  free(p_sequence);
+  free(p_pd);
+  free(p_qd);
+  free(candidate.p_order);
+  free(candidate.p_mapping);
+  return RAID_OK;
 }
 
 /*
- * LibXmount_Morphing_GetFunctions
+ * RaidDetectParameters
+ *
+ * Formats the options selecting a candidate's parameters.
  */
-void LibXmount_Morphing_GetFunctions(ts_LibXmountMorphingFunctions *p_functions)
+static int RaidDetectParameters(pts_RaidHandle p_raid_handle,
+                                pts_RaidDetectEvidence p_evidence,
+                                pts_RaidCandidate p_candidate,
+                                char **pp_buf)
 {
-  p_functions->CreateHandle=&RaidCreateHandle;
-  p_functions->DestroyHandle=&RaidDestroyHandle;
-  p_functions->Morph=&RaidMorph;
-  p_functions->Size=&RaidSize;
-  p_functions->Read=&RaidRead;
-  p_functions->Write=&RaidWrite;
-  p_functions->OptionsHelp=&RaidOptionsHelp;
-  p_functions->OptionsParse=&RaidOptionsParse;
-  p_functions->GetInfofileContent=&RaidGetInfofileContent;
-  p_functions->GetErrorMessage=&RaidGetErrorMessage;
-  p_functions->FreeBuffer=&RaidFreeBuffer;
+  uint64_t image;
+  char *p_order;
+  char *p_pos;
+  int ret;
+
+  p_order=(char*)malloc(p_raid_handle->members_count*21+1);
+  if(p_order==NULL) return RAID_MEMALLOC_FAILED;
+  p_pos=p_order;
+  for(uint64_t m=0;m<p_raid_handle->members_count;m++) {
+    image=p_raid_handle->p_member_images[p_candidate->p_order[m]];
+    if(image==RAID_MEMBER_MISSING) {
+      p_pos+=sprintf(p_pos,"%smissing",m==0 ? "" : ":");
+    } else {
+      p_pos+=sprintf(p_pos,"%s%" PRIu64,m==0 ? "" : ":",image);
+    }
+  }
+
+  ret=asprintf(pp_buf,
+               "raid_chunksize=%" PRIu32 "%s%s,raid_order=%s",
+               p_evidence->chunk_sizes[p_candidate->chunk_size_index],
+               p_raid_handle->level==0 ? "" : ",raid_layout=",
+               p_raid_handle->level==0 ? "" :
+                 raid_layout_names[p_candidate->layout],
+               p_order);
+  free(p_order);
+  if(ret<0 || *pp_buf==NULL) return RAID_MEMALLOC_FAILED;
+  return RAID_OK;
+}
+
+/*
+ * RaidDetect
+ *
+ * Detects the parameters set to auto. The members are sampled concurrently
+ * for every chunk size tried, then all combinations of parameters are
+ * scored (see RaidDetectScore). The best candidate's parameters are used
+ * and reported in the info file.
+ */
+static int RaidDetect(pts_RaidHandle p_raid_handle) {
+  uint64_t members=p_raid_handle->members_count;
+  uint64_t blocks=2*RAID_DETECT_SAMPLES+RAID_DETECT_MAX_ANCHORS;
+  ts_RaidDetectEvidence evidence;
+  ts_RaidCandidate top[RAID_DETECT_TOP_CANDIDATES];
+  pts_RaidCandidate p_best=&(top[0]);
+  uint64_t top_count=0;
+  uint64_t candidates_count=0;
+  uint64_t evidence_size;
+  uint64_t image_size;
+  uint64_t matches;
+  uint64_t best_matches;
+  uint64_t *p_images=NULL;
+  uint32_t chunk_size;
+  uint8_t best_layout;
+  char *p_samples;
+  pts_RaidDetectWindow p_windows;
+  char *p_parameters=NULL;
+  char next_best[32];
+  char parity[80]="";
+  int ret=RAID_OK;
+
+  if((p_raid_handle->detect&RAID_DETECT_ORDER) &&
+     members>RAID_DETECT_MAX_MEMBERS)
+  {
+    return RAID_CANNOT_DETECT_TOO_MANY_MEMBERS;
+  }
+
+  // Chunk sizes to try, the members must hold at least 3 chunks of them
+  evidence.image_size=UINT64_MAX;
+  for(uint64_t m=0;m<members;m++) {
+    if(p_raid_handle->p_member_images[m]==RAID_MEMBER_MISSING) continue;
+    if(p_raid_handle->p_input_functions->
+         Size(p_raid_handle->p_member_images[m],&image_size)!=0)
+    {
+      return RAID_CANNOT_GET_IMAGESIZE;
+    }
+    if(image_size<evidence.image_size) evidence.image_size=image_size;
+  }
+  evidence.chunk_sizes_count=0;
+  if(p_raid_handle->detect&RAID_DETECT_CHUNKSIZE) {
+    for(chunk_size=RAID_DETECT_MIN_CHUNKSIZE;
+        chunk_size<=RAID_DETECT_MAX_CHUNKSIZE;
+        chunk_size*=2)
+    {
+      if(evidence.image_size/chunk_size<3) break;
+      evidence.chunk_sizes[evidence.chunk_sizes_count++]=chunk_size;
+    }
+  } else if(evidence.image_size/p_raid_handle->chunk_size>=3) {
+    evidence.chunk_sizes[evidence.chunk_sizes_count++]=
+      p_raid_handle->chunk_size;
+  }
+  if(evidence.chunk_sizes_count==0) {
+    return RAID_CANNOT_DETECT_IMAGES_TOO_SMALL;
+  }
+
+  ret=RaidDetectAnchors(p_raid_handle,&evidence);
+  if(ret!=RAID_OK) return ret;
+
+  evidence_size=evidence.chunk_sizes_count*members*members;
+  evidence.p_same=(int64_t*)calloc(evidence_size*members,sizeof(int64_t));
+  evidence.p_next=(int64_t*)calloc(evidence_size*members,sizeof(int64_t));
+  evidence.p_q=(int64_t*)calloc(evidence_size,sizeof(int64_t));
+  evidence.p_boot=
+    (uint8_t*)calloc(evidence.chunk_sizes_count*evidence.anchors_count*
+                       members,
+                     sizeof(uint8_t));
+  evidence.p_parity_samples=
+    (uint64_t*)calloc(evidence.chunk_sizes_count,sizeof(uint64_t));
+  evidence.p_parity_ok=
+    (uint64_t*)calloc(evidence.chunk_sizes_count,sizeof(uint64_t));
+  p_samples=(char*)malloc(blocks*members*2*RAID_DETECT_WINDOW);
+  p_windows=
+    (pts_RaidDetectWindow)malloc(blocks*members*sizeof(ts_RaidDetectWindow));
+  for(uint64_t i=0;i<RAID_DETECT_TOP_CANDIDATES;i++) {
+    top[i].p_order=(uint64_t*)malloc(members*sizeof(uint64_t));
+    top[i].p_mapping=
+      (uint64_t*)malloc(members*(p_raid_handle->data_members_count+2)*
+                          sizeof(uint64_t));
+    if(top[i].p_order==NULL || top[i].p_mapping==NULL) {
+      ret=RAID_MEMALLOC_FAILED;
+    }
+  }
+  if(evidence.p_same==NULL || evidence.p_next==NULL || evidence.p_q==NULL ||
+     evidence.p_boot==NULL || evidence.p_parity_samples==NULL ||
+     evidence.p_parity_ok==NULL || p_samples==NULL || p_windows==NULL)
+  {
+    ret=RAID_MEMALLOC_FAILED;
+  }
+
+  for(uint64_t ci=0;ci<evidence.chunk_sizes_count && ret==RAID_OK;ci++) {
+    ret=RaidDetectGather(p_raid_handle,&evidence,ci,p_samples,p_windows);
+  }
+  if(ret==RAID_OK) {
+    ret=RaidDetectScore(p_raid_handle,
+                        &evidence,
+                        top,
+                        &top_count,
+                        &candidates_count);
+  }
+
+  // md's right-asymmetric and DDF's zero-restart RAID-6 layouts store data
+  // and parity alike and only differ in how Q is calculated
+  if(ret==RAID_OK && p_raid_handle->level==6 &&
+     (p_raid_handle->detect&RAID_DETECT_LAYOUT) &&
+     (p_best->layout==RAID_LAYOUT_RIGHT_ASYMMETRIC ||
+      p_best->layout==RAID_LAYOUT_DDF_ZERO_RESTART))
+  {
+    best_layout=p_best->layout;
+    best_matches=0;
+    for(uint8_t layout=RAID_LAYOUT_RIGHT_ASYMMETRIC;
+        layout<=RAID_LAYOUT_DDF_ZERO_RESTART && ret==RAID_OK;
+        layout+=RAID_LAYOUT_DDF_ZERO_RESTART-RAID_LAYOUT_RIGHT_ASYMMETRIC)
+    {
+      p_raid_handle->layout=layout;
+      ret=RaidDetectSyndromes(p_raid_handle,
+                              &evidence,
+                              p_best,
+                              p_samples,
+                              &matches);
+      LOG_DEBUG("Q syndrome matches %" PRIu64 " sampled stripes using %s\n",
+                matches,
+                raid_layout_names[layout]);
+      if(matches>best_matches) {
+        best_matches=matches;
+        best_layout=layout;
+      }
+    }
+    p_best->layout=best_layout;
+  }
+
+  for(uint64_t i=0;i<top_count && ret==RAID_OK;i++) {
+    ret=RaidDetectParameters(p_raid_handle,&evidence,&(top[i]),&p_parameters);
+    if(ret!=RAID_OK) break;
+    LOG_DEBUG("Candidate %" PRIu64 ": %s (score %" PRId64 ")\n",
+              i+1,
+              p_parameters,
+              top[i].score);
+    free(p_parameters);
+    p_parameters=NULL;
+  }
+  if(ret==RAID_OK) {
+    ret=RaidDetectParameters(p_raid_handle,&evidence,p_best,&p_parameters);
+  }
+  if(ret==RAID_OK) {
+    p_images=(uint64_t*)malloc(members*sizeof(uint64_t));
+    if(p_images==NULL) ret=RAID_MEMALLOC_FAILED;
+  }
+
+  if(ret==RAID_OK) {
+    // Use the best candidate's parameters
+    p_raid_handle->chunk_size=evidence.chunk_sizes[p_best->chunk_size_index];
+    p_raid_handle->layout=p_best->layout;
+    p_raid_handle->missing_members_count=0;
+    for(uint64_t m=0;m<members;m++) {
+      p_images[m]=p_raid_handle->p_member_images[p_best->p_order[m]];
+      if(p_images[m]!=RAID_MEMBER_MISSING) continue;
+      if(p_raid_handle->missing_members_count<RAID_MAX_MISSING_MEMBERS) {
+        p_raid_handle->
+          missing_members[p_raid_handle->missing_members_count]=m;
+      }
+      p_raid_handle->missing_members_count++;
+    }
+    free(p_raid_handle->p_member_images);
+    p_raid_handle->p_member_images=p_images;
+
+    if(top_count>1) {
+      snprintf(next_best,sizeof(next_best),"%" PRId64,top[1].score);
+    } else {
+      snprintf(next_best,sizeof(next_best),"none");
+    }
+    if(p_best->score<=0 || (top_count>1 && top[1].score==p_best->score)) {
+      LIBXMOUNT_LOG_WARNING("Unable to reliably detect RAID parameters, "
+                              "using best guess %s\n",
+                            p_parameters);
+    }
+    if(p_raid_handle->level!=0 && p_raid_handle->missing_members_count==0 &&
+       2*evidence.p_parity_ok[p_best->chunk_size_index]<
+         evidence.p_parity_samples[p_best->chunk_size_index])
+    {
+      LIBXMOUNT_LOG_WARNING("Parity is consistent in only %" PRIu64 " of %"
+                              PRIu64 " sampled stripes, input images might "
+                              "not be the members of a RAID-%" PRIu8 "\n",
+                            evidence.p_parity_ok[p_best->chunk_size_index],
+                            evidence.
+                              p_parity_samples[p_best->chunk_size_index],
+                            p_raid_handle->level);
+    }
+    LOG_DEBUG("Detected %s\n",p_parameters);
+
+    if(p_raid_handle->level!=0 && p_raid_handle->missing_members_count==0) {
+      snprintf(parity,
+               sizeof(parity),
+               "Consistent parity: %" PRIu64 " of %" PRIu64
+                 " sampled stripes\n",
+               evidence.p_parity_ok[p_best->chunk_size_index],
+               evidence.p_parity_samples[p_best->chunk_size_index]);
+    }
+    if(asprintf(&(p_raid_handle->p_detect_info),
+                "Detected parameters: %s\n"
+                  "Detection score: %" PRId64 " (next best %s, %" PRIu64
+                  " candidates tried)\n"
+                  "%s",
+                p_parameters,
+                p_best->score,
+                next_best,
+                candidates_count,
+                parity)<0)
+    {
+      p_raid_handle->p_detect_info=NULL;
+      ret=RAID_MEMALLOC_FAILED;
+    }
+  }
+
+  free(p_parameters);
+  for(uint64_t i=0;i<RAID_DETECT_TOP_CANDIDATES;i++) {
+    free(top[i].p_order);
+    free(top[i].p_mapping);
+  }
+  free(p_windows);
+  free(p_samples);
+  free(evidence.p_parity_ok);
+  free(evidence.p_parity_samples);
+  free(evidence.p_boot);
+  free(evidence.p_q);
+  free(evidence.p_next);
+  free(evidence.p_same);
+  return ret;
 }
 
-/*******************************************************************************
- * Private
- ******************************************************************************/
 /*
  * RaidCreateHandle
  */
@@ -79,7 +1938,36 @@ static int RaidCreateHandle(void **pp_handle,
 
   // Init handle values
   p_raid_handle->debug=debug;
+  if(strcmp(p_format,"raid10")==0) p_raid_handle->level=10;
+  else if(strcmp(p_format,"raid6")==0) p_raid_handle->level=6;
+  else if(strcmp(p_format,"raid5")==0) p_raid_handle->level=5;
+  else if(strcmp(p_format,"raid1")==0) p_raid_handle->level=1;
+  else p_raid_handle->level=0;
+  p_raid_handle->layout=RAID_DEFAULT_LAYOUT;
   p_raid_handle->input_images_count=0;
+  p_raid_handle->members_count=0;
+  p_raid_handle->p_member_images=NULL;
+  p_raid_handle->missing_members_count=0;
+  p_raid_handle->data_members_count=0;
+  p_raid_handle->parity_members_count=0;
+  p_raid_handle->gf_kernel=RAID_GF_KERNEL_SCALAR;
+  if(p_raid_handle->level==10) p_raid_handle->copies=RAID_DEFAULT_COPIES;
+  else p_raid_handle->copies=1;
+  p_raid_handle->balance=RAID_DEFAULT_BALANCE;
+  p_raid_handle->balance_chunks=1;
+  pthread_mutex_init(&(p_raid_handle->mutex),NULL);
+  p_raid_handle->p_queued_bytes=NULL;
+  p_raid_handle->threads=0;
+  p_raid_handle->p_threads=NULL;
+  p_raid_handle->threads_running=0;
+  p_raid_handle->p_jobs_head=NULL;
+  p_raid_handle->p_jobs_tail=NULL;
+  p_raid_handle->pool_stop=0;
+  pthread_cond_init(&(p_raid_handle->job_cond),NULL);
+  pthread_cond_init(&(p_raid_handle->done_cond),NULL);
+  p_raid_handle->p_image_mutexes=NULL;
+  p_raid_handle->detect=0;
+  p_raid_handle->p_detect_info=NULL;
   p_raid_handle->chunk_size=RAID_DEFAULT_CHUNKSIZE;
   p_raid_handle->chunks_per_image=0;
   p_raid_handle->p_input_functions=NULL;
@@ -100,7 +1988,22 @@ static int RaidDestroyHandle(void **pp_handle) {
 
   LOG_DEBUG("Destroying LibXmount_Morphing_Raid handle\n");
 
+  // Stop thread pool
+  RaidStopThreads(p_raid_handle);
+
   // Free handle
+  if(p_raid_handle->p_image_mutexes!=NULL) {
+    for(uint64_t i=0;i<p_raid_handle->input_images_count;i++) {
+      pthread_mutex_destroy(&(p_raid_handle->p_image_mutexes[i]));
+    }
+    free(p_raid_handle->p_image_mutexes);
+  }
+  pthread_cond_destroy(&(p_raid_handle->done_cond));
+  pthread_cond_destroy(&(p_raid_handle->job_cond));
+  pthread_mutex_destroy(&(p_raid_handle->mutex));
+  free(p_raid_handle->p_detect_info);
+  free(p_raid_handle->p_queued_bytes);
+  free(p_raid_handle->p_member_images);
   free(p_raid_handle);
 
   *pp_handle=NULL;
@@ -116,7 +2019,14 @@ static int RaidMorph(void *p_handle,
   pts_RaidHandle p_raid_handle=(pts_RaidHandle)p_handle;
   int ret;
   uint64_t input_image_size;
+  uint64_t min_image_size=0;
   uint64_t chunks_per_image;
+  uint64_t image;
+  uint64_t used_images=0;
+  uint64_t missing_members;
+  uint64_t *p_member_images;
+  uint64_t member;
+  uint64_t stripe;
 
   LOG_DEBUG("Initializing LibXmount_Morphing_Raid\n");
 
@@ -129,6 +2039,140 @@ static int RaidMorph(void *p_handle,
     return RAID_CANNOT_GET_IMAGECOUNT;
   }
 
+  // Without raid_order, the input images are the members in the given order.
+  // With raid_order=auto, they are followed by the missing members and their
+  // order is detected later on.
+  if(p_raid_handle->p_member_images==NULL ||
+     (p_raid_handle->detect&RAID_DETECT_ORDER))
+  {
+    if(p_raid_handle->p_member_images==NULL) missing_members=0;
+    else missing_members=p_raid_handle->members_count;
+    p_member_images=
+      (uint64_t*)malloc((p_raid_handle->input_images_count+missing_members)*
+                          sizeof(uint64_t));
+    if(p_member_images==NULL) return RAID_MEMALLOC_FAILED;
+    for(uint64_t i=0;i<p_raid_handle->input_images_count;i++) {
+      p_member_images[i]=i;
+    }
+    for(uint64_t i=0;i<missing_members;i++) {
+      p_member_images[p_raid_handle->input_images_count+i]=
+        RAID_MEMBER_MISSING;
+    }
+    free(p_raid_handle->p_member_images);
+    p_raid_handle->p_member_images=p_member_images;
+    p_raid_handle->members_count=
+      p_raid_handle->input_images_count+missing_members;
+  }
+
+  // Every input image must be a member exactly once
+  for(uint64_t i=0;i<p_raid_handle->members_count;i++) {
+    image=p_raid_handle->p_member_images[i];
+    if(image==RAID_MEMBER_MISSING) {
+      if(p_raid_handle->missing_members_count<RAID_MAX_MISSING_MEMBERS) {
+        p_raid_handle->
+          missing_members[p_raid_handle->missing_members_count]=i;
+      }
+      p_raid_handle->missing_members_count++;
+      continue;
+    }
+    if(image>=p_raid_handle->input_images_count) {
+      return RAID_INVALID_MEMBER_ORDER;
+    }
+    for(uint64_t ii=0;ii<i;ii++) {
+      if(p_raid_handle->p_member_images[ii]==image) {
+        return RAID_INVALID_MEMBER_ORDER;
+      }
+    }
+    used_images++;
+  }
+  if(used_images!=p_raid_handle->input_images_count) {
+    return RAID_INVALID_MEMBER_ORDER;
+  }
+
+  if(p_raid_handle->level==1 || p_raid_handle->level==10) {
+    // RAID-1 / RAID-10 can do without members as long as every chunk has at
+    // least one copy left. The copies of chunk i+members are on the same
+    // members as those of chunk i, so checking the first chunks is enough.
+    if(p_raid_handle->level==1) {
+      p_raid_handle->copies=p_raid_handle->members_count;
+    }
+    if(p_raid_handle->members_count<2 ||
+       p_raid_handle->members_count<p_raid_handle->copies)
+    {
+      return RAID_TOO_FEW_MEMBERS;
+    }
+    for(uint64_t i=0;i<p_raid_handle->members_count;i++) {
+      if(!RaidMapMirrorCopy(p_raid_handle,i,0,&member,&stripe)) {
+        return RAID_TOO_MANY_MISSING_MEMBERS;
+      }
+    }
+    // Chunks i to i+members/gcd(members,copies)-1 have their copies on
+    // different members
+    p_raid_handle->balance_chunks=
+      p_raid_handle->members_count/RaidGcd(p_raid_handle->members_count,
+                                           p_raid_handle->copies);
+    p_raid_handle->p_queued_bytes=
+      (uint64_t*)calloc(p_raid_handle->members_count,sizeof(uint64_t));
+    if(p_raid_handle->p_queued_bytes==NULL) return RAID_MEMALLOC_FAILED;
+  } else {
+    // RAID-5 / RAID-6 can do without as many members as they have parity
+    // chunks per stripe, RAID-0 can't do without any
+    if(p_raid_handle->level==6) p_raid_handle->parity_members_count=2;
+    else if(p_raid_handle->level==5) p_raid_handle->parity_members_count=1;
+    if(p_raid_handle->members_count<2*p_raid_handle->parity_members_count+1) {
+      return RAID_TOO_FEW_MEMBERS;
+    }
+    if(p_raid_handle->missing_members_count>
+         p_raid_handle->parity_members_count)
+    {
+      return RAID_TOO_MANY_MISSING_MEMBERS;
+    }
+  }
+  p_raid_handle->data_members_count=
+    p_raid_handle->members_count-p_raid_handle->parity_members_count;
+
+  // Choose the fastest GF(2^8) kernel supported by the CPU
+  if(p_raid_handle->level==6) {
+    RaidGfInit(p_raid_handle);
+#ifdef RAID_HAVE_X86_GF_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+      p_raid_handle->gf_kernel=RAID_GF_KERNEL_AVX2;
+    } else if(__builtin_cpu_supports("ssse3")) {
+      p_raid_handle->gf_kernel=RAID_GF_KERNEL_SSSE3;
+    }
+#endif
+    LOG_DEBUG("Using %s GF(2^8) kernel\n",
+              raid_gf_kernel_names[p_raid_handle->gf_kernel]);
+  }
+
+  // Start thread pool reading from all members concurrently
+  p_raid_handle->p_image_mutexes=
+    (pthread_mutex_t*)malloc(p_raid_handle->input_images_count*
+                               sizeof(pthread_mutex_t));
+  if(p_raid_handle->p_image_mutexes==NULL) return RAID_MEMALLOC_FAILED;
+  for(uint64_t i=0;i<p_raid_handle->input_images_count;i++) {
+    pthread_mutex_init(&(p_raid_handle->p_image_mutexes[i]),NULL);
+  }
+  if(p_raid_handle->threads==0) {
+    if(p_raid_handle->members_count<RAID_MAX_DEFAULT_THREADS) {
+      p_raid_handle->threads=(uint32_t)p_raid_handle->members_count;
+    } else {
+      p_raid_handle->threads=RAID_MAX_DEFAULT_THREADS;
+    }
+  }
+  ret=RaidStartThreads(p_raid_handle);
+  if(ret!=RAID_OK) return ret;
+
+  LOG_DEBUG("Issuing up to %" PRIu32 " member reads concurrently\n",
+            p_raid_handle->threads);
+
+  // Detect the parameters set to auto
+  if(p_raid_handle->detect!=0) {
+    ret=RaidDetect(p_raid_handle);
+    if(ret!=RAID_OK) return ret;
+  }
+
   // Calculate chunks per image
   for(uint64_t i=0;i<p_raid_handle->input_images_count;i++) {
     ret=p_raid_handle->
@@ -150,16 +2194,25 @@ static int RaidMorph(void *p_handle,
     } else if(chunks_per_image<p_raid_handle->chunks_per_image) {
       p_raid_handle->chunks_per_image=chunks_per_image;
     }
+    if(min_image_size==0 || input_image_size<min_image_size) {
+      min_image_size=input_image_size;
+    }
   }
 
   LOG_DEBUG("Smallest image holds %" PRIu64 " chunks of %" PRIu32 " bytes\n",
             p_raid_handle->chunks_per_image,
             p_raid_handle->chunk_size);
 
-  // Calculate total raid capacity based on smallest disk
-  p_raid_handle->morphed_image_size=
-    p_raid_handle->chunks_per_image*
-      p_raid_handle->chunk_size*p_raid_handle->input_images_count;
+  // Calculate total raid capacity based on smallest disk. A RAID-1 isn't
+  // split into chunks and uses all of it. Like md, a RAID-10 only exposes
+  // chunks all of whose copies fit on the members.
+  if(p_raid_handle->level==1) {
+    p_raid_handle->morphed_image_size=min_image_size;
+  } else {
+    p_raid_handle->morphed_image_size=
+      (p_raid_handle->chunks_per_image*p_raid_handle->data_members_count/
+         p_raid_handle->copies)*p_raid_handle->chunk_size;
+  }
 
   LOG_DEBUG("Total raid capacity is %" PRIu64 " bytes\n",
             p_raid_handle->morphed_image_size);
@@ -177,6 +2230,12 @@ static int RaidSize(void *p_handle, uint64_t *p_size) {
 
 /*
  * RaidRead
+ *
+ * The request is split into pieces lying in a single chunk. Pieces that are
+ * contiguous on a member disk are merged into an extent, so each member is
+ * read with as few reads as possible, and all extents are read concurrently.
+ * Parity chunks are skipped, they are only read to reconstruct the data of
+ * missing members. Data of RAID-1 / RAID-10 is read from one of its copies.
  */
 static int RaidRead(void *p_handle,
                     char *p_buf,
@@ -185,13 +2244,21 @@ static int RaidRead(void *p_handle,
                     size_t *p_read)
 {
   pts_RaidHandle p_raid_handle=(pts_RaidHandle)p_handle;
+  pts_RaidPiece p_pieces;
+  pts_RaidPiece p_piece;
+  pts_RaidExtent p_extents;
+  pts_RaidExtent p_extent;
+  uint64_t *p_member_extents;
+  uint64_t pieces_count;
+  uint64_t extents_count=0;
   uint64_t cur_chunk;
-  uint64_t cur_image;
+  uint64_t cur_copy=0;
+  uint64_t cur_member;
+  uint64_t cur_stripe;
   off_t cur_chunk_offset;
   off_t cur_image_offset;
   size_t cur_count;
-  int ret;
-  size_t read;
+  int ret=RAID_OK;
 
   LOG_DEBUG("Reading %zu bytes at offset %zu from morphed image\n",
             count,
@@ -210,13 +2277,25 @@ static int RaidRead(void *p_handle,
 
   // Init p_read
   *p_read=0;
+  if(count==0) return RAID_OK;
 
-  while(count!=0) {
-    // Calculate image and image offset to read from
-    cur_image=cur_chunk%p_raid_handle->input_images_count;
-    cur_image_offset=
-      (cur_chunk/p_raid_handle->input_images_count)*p_raid_handle->chunk_size;
+  pieces_count=(cur_chunk_offset+count+p_raid_handle->chunk_size-1)/
+                 p_raid_handle->chunk_size;
+  p_pieces=(pts_RaidPiece)malloc(pieces_count*sizeof(ts_RaidPiece));
+  p_extents=(pts_RaidExtent)malloc(pieces_count*sizeof(ts_RaidExtent));
+  p_member_extents=
+    (uint64_t*)malloc(p_raid_handle->members_count*sizeof(uint64_t));
+  if(p_pieces==NULL || p_extents==NULL || p_member_extents==NULL) {
+    free(p_pieces);
+    free(p_extents);
+    free(p_member_extents);
+    return RAID_MEMALLOC_FAILED;
+  }
+  for(uint64_t i=0;i<p_raid_handle->members_count;i++) {
+    p_member_extents[i]=UINT64_MAX;
+  }
 
+  for(uint64_t i=0;i<pieces_count;i++) {
     // Calculate how many bytes to read from current chunk
     if(cur_chunk_offset+count>p_raid_handle->chunk_size) {
       cur_count=p_raid_handle->chunk_size-cur_chunk_offset;
@@ -224,21 +2303,58 @@ static int RaidRead(void *p_handle,
       cur_count=count;
     }
 
-    LOG_DEBUG("Reading %zu bytes at offset %zu from image %" PRIu64
+    // Calculate member and member offset to read from
+    if(p_raid_handle->copies>1) {
+      RaidChooseMirrorCopy(p_raid_handle,cur_chunk,cur_count,&cur_copy);
+      RaidMapMirrorCopy(p_raid_handle,
+                        cur_chunk,
+                        cur_copy,
+                        &cur_member,
+                        &cur_stripe);
+    } else {
+      RaidMapChunk(p_raid_handle,cur_chunk,&cur_member,&cur_stripe);
+    }
+    cur_image_offset=cur_stripe*p_raid_handle->chunk_size+cur_chunk_offset;
+
+    LOG_DEBUG("Reading %zu bytes at offset %zu from member %" PRIu64
                 " (chunk %" PRIu64 ")\n",
               cur_count,
-              cur_image_offset+cur_chunk_offset,
-              cur_image,
+              cur_image_offset,
+              cur_member,
               cur_chunk);
 
-    // Read bytes
-    ret=p_raid_handle->p_input_functions->
-          Read(cur_image,
-               p_buf,
-               cur_image_offset+cur_chunk_offset,
-               cur_count,
-               &read);
-    if(ret!=0 || read!=cur_count) return RAID_CANNOT_READ_DATA;
+    p_piece=&(p_pieces[i]);
+    p_piece->p_buf=p_buf;
+    p_piece->count=cur_count;
+    p_piece->chunk=cur_chunk;
+    p_piece->chunk_offset=cur_chunk_offset;
+    p_piece->stripe=cur_stripe;
+    p_piece->next_piece=UINT64_MAX;
+
+    // Append piece to the member's last extent if it directly follows it
+    p_extent=NULL;
+    if(p_member_extents[cur_member]!=UINT64_MAX &&
+       p_raid_handle->p_member_images[cur_member]!=RAID_MEMBER_MISSING)
+    {
+      p_extent=&(p_extents[p_member_extents[cur_member]]);
+      if(p_extent->offset+p_extent->size!=cur_image_offset) p_extent=NULL;
+    }
+    if(p_extent!=NULL) {
+      p_extent->size+=cur_count;
+      p_pieces[p_extent->last_piece].next_piece=i;
+      p_extent->last_piece=i;
+    } else {
+      p_member_extents[cur_member]=extents_count;
+      p_extent=&(p_extents[extents_count++]);
+      p_extent->member=cur_member;
+      p_extent->offset=cur_image_offset;
+      p_extent->size=cur_count;
+      p_extent->p_pieces=p_pieces;
+      p_extent->first_piece=i;
+      p_extent->last_piece=i;
+      p_extent->ret=RAID_OK;
+      p_extent->p_next=NULL;
+    }
 
     p_buf+=cur_count;
     cur_chunk_offset=0;
@@ -246,8 +2362,22 @@ static int RaidRead(void *p_handle,
     cur_chunk++;
     (*p_read)+=cur_count;
   }
+  free(p_member_extents);
 
-  return RAID_OK;
+  LOG_DEBUG("Reading %" PRIu64 " pieces in %" PRIu64 " extents\n",
+            pieces_count,
+            extents_count);
+
+  RaidRunExtents(p_raid_handle,p_extents,extents_count);
+
+  for(uint64_t i=0;i<extents_count && ret==RAID_OK;i++) {
+    ret=p_extents[i].ret;
+  }
+  free(p_pieces);
+  free(p_extents);
+  if(ret!=RAID_OK) *p_read=0;
+
+  return ret;
 }
 
 /*
@@ -271,7 +2401,29 @@ static int RaidOptionsHelp(const char **pp_help) {
 
   ok=asprintf(&p_buf,
               "    raid_chunksize : Specify the chunk size to use in bytes. "
-                "Defaults to 524288 (512k).\n");
+                "Defaults to 524288 (512k).\n"
+              "    raid_layout : RAID-5 / RAID-6 parity layout, one of "
+                "left-asymmetric, right-asymmetric, left-symmetric, "
+                "right-symmetric, parity-first, parity-last or (RAID-6 only) "
+                "ddf-zero-restart, ddf-N-restart, ddf-N-continue. Defaults "
+                "to left-symmetric.\n"
+              "    raid_order : Input image of each member disk, separated by "
+                "colons, \"missing\" for a missing member (e.g. "
+                "1:0:missing:2). Defaults to the input images in the given "
+                "order.\n"
+              "    Setting raid_chunksize, raid_layout and / or raid_order to "
+                "auto detects them by sampling the member disks (RAID-0 / "
+                "RAID-5 / RAID-6 only, max. 8 members for raid_order). Use "
+                "auto:missing for a missing member of unknown position.\n"
+              "    raid_copies : Number of copies of each chunk of a RAID-10. "
+                "Defaults to 2.\n"
+              "    raid_threads : Number of member disk reads issued "
+                "concurrently. Defaults to the number of member disks (max. "
+                "16), 1 reads all members in turn.\n"
+              "    raid_balance : How RAID-1 / RAID-10 reads are balanced over "
+                "the copies, either queue (from the copy whose member disk "
+                "has the fewest bytes queued) or stripe (alternating from "
+                "stripe to stripe). Defaults to queue.\n");
   if(ok<0 || p_buf==NULL) {
     *pp_help=NULL;
     return RAID_MEMALLOC_FAILED;
@@ -292,10 +2444,43 @@ static int RaidOptionsParse(void *p_handle,
   pts_RaidHandle p_raid_handle=(pts_RaidHandle)p_handle;
   int ok;
   uint32_t uint32value;
+  uint8_t layout;
   char *p_buf;
 
   for(uint32_t i=0;i<options_count;i++) {
-    if(strcmp(pp_options[i]->p_key,"raid_chunksize")) {
+    // Only the parameters of RAID-0 / RAID-5 / RAID-6 can be detected
+    if((strcmp(pp_options[i]->p_key,"raid_chunksize")==0 ||
+        strcmp(pp_options[i]->p_key,"raid_layout")==0 ||
+        strcmp(pp_options[i]->p_key,"raid_order")==0) &&
+       (strcmp(pp_options[i]->p_value,"auto")==0 ||
+        (strcmp(pp_options[i]->p_key,"raid_order")==0 &&
+         strncmp(pp_options[i]->p_value,"auto:",5)==0)))
+    {
+      if(p_raid_handle->level==1 || p_raid_handle->level==10) {
+        ok=asprintf(&p_buf,
+                    "Detecting '%s' is not supported for RAID-1 / RAID-10",
+                    pp_options[i]->p_key);
+        if(ok<0 || p_buf==NULL) {
+          *pp_error=NULL;
+          return RAID_MEMALLOC_FAILED;
+        }
+        *pp_error=p_buf;
+        return RAID_CANNOT_PARSE_OPTION;
+      }
+      if(strcmp(pp_options[i]->p_key,"raid_chunksize")==0) {
+        LOG_DEBUG("Detecting chunk size\n");
+        p_raid_handle->detect|=RAID_DETECT_CHUNKSIZE;
+        pp_options[i]->valid=1;
+        continue;
+      }
+      if(strcmp(pp_options[i]->p_key,"raid_layout")==0) {
+        LOG_DEBUG("Detecting parity layout\n");
+        p_raid_handle->detect|=RAID_DETECT_LAYOUT;
+        pp_options[i]->valid=1;
+        continue;
+      }
+    }
+    if(strcmp(pp_options[i]->p_key,"raid_chunksize")==0) {
       // Convert value to uint32
       uint32value=StrToUint32(pp_options[i]->p_value,&ok);
       if(ok==0 || uint32value==0) {
@@ -304,7 +2489,7 @@ static int RaidOptionsParse(void *p_handle,
                     "Unable to parse value '%s' of '%s' as valid 32bit number",
                     pp_options[i]->p_value,
                     pp_options[i]->p_key);
-        if(ok<0 || *pp_error==NULL) {
+        if(ok<0 || p_buf==NULL) {
           *pp_error=NULL;
           return RAID_MEMALLOC_FAILED;
         }
@@ -316,6 +2501,123 @@ static int RaidOptionsParse(void *p_handle,
 
       // Conversion ok, save value and mark option as valid
       p_raid_handle->chunk_size=uint32value;
+      p_raid_handle->detect&=~RAID_DETECT_CHUNKSIZE;
+      pp_options[i]->valid=1;
+      continue;
+    }
+    if(strcmp(pp_options[i]->p_key,"raid_layout")==0) {
+      for(layout=0;raid_layout_names[layout]!=NULL;layout++) {
+        if(strcmp(pp_options[i]->p_value,raid_layout_names[layout])==0) break;
+      }
+      if(raid_layout_names[layout]==NULL ||
+         (layout>=RAID_LAYOUT_DDF_ZERO_RESTART && p_raid_handle->level!=6) ||
+         p_raid_handle->level==1 || p_raid_handle->level==10)
+      {
+        ok=asprintf(&p_buf,
+                    "Unknown or unsupported layout '%s'",
+                    pp_options[i]->p_value);
+        if(ok<0 || p_buf==NULL) {
+          *pp_error=NULL;
+          return RAID_MEMALLOC_FAILED;
+        }
+        *pp_error=p_buf;
+        return RAID_CANNOT_PARSE_OPTION;
+      }
+
+      LOG_DEBUG("Setting parity layout to %s\n",raid_layout_names[layout]);
+
+      p_raid_handle->layout=layout;
+      p_raid_handle->detect&=~RAID_DETECT_LAYOUT;
+      pp_options[i]->valid=1;
+      continue;
+    }
+    if(strcmp(pp_options[i]->p_key,"raid_copies")==0) {
+      uint32value=StrToUint32(pp_options[i]->p_value,&ok);
+      if(ok==0 || uint32value<2 || p_raid_handle->level!=10) {
+        ok=asprintf(&p_buf,
+                    "Invalid or unsupported number of copies '%s'",
+                    pp_options[i]->p_value);
+        if(ok<0 || p_buf==NULL) {
+          *pp_error=NULL;
+          return RAID_MEMALLOC_FAILED;
+        }
+        *pp_error=p_buf;
+        return RAID_CANNOT_PARSE_OPTION;
+      }
+
+      LOG_DEBUG("Setting copies to %" PRIu32 "\n",uint32value);
+
+      p_raid_handle->copies=uint32value;
+      pp_options[i]->valid=1;
+      continue;
+    }
+    if(strcmp(pp_options[i]->p_key,"raid_threads")==0) {
+      uint32value=StrToUint32(pp_options[i]->p_value,&ok);
+      if(ok==0 || uint32value==0) {
+        ok=asprintf(&p_buf,
+                    "Unable to parse value '%s' of '%s' as valid 32bit number",
+                    pp_options[i]->p_value,
+                    pp_options[i]->p_key);
+        if(ok<0 || p_buf==NULL) {
+          *pp_error=NULL;
+          return RAID_MEMALLOC_FAILED;
+        }
+        *pp_error=p_buf;
+        return RAID_CANNOT_PARSE_OPTION;
+      }
+
+      LOG_DEBUG("Setting concurrent member reads to %" PRIu32 "\n",
+                uint32value);
+
+      p_raid_handle->threads=uint32value;
+      pp_options[i]->valid=1;
+      continue;
+    }
+    if(strcmp(pp_options[i]->p_key,"raid_balance")==0) {
+      for(layout=0;raid_balance_names[layout]!=NULL;layout++) {
+        if(strcmp(pp_options[i]->p_value,raid_balance_names[layout])==0) break;
+      }
+      if(raid_balance_names[layout]==NULL ||
+         (p_raid_handle->level!=1 && p_raid_handle->level!=10))
+      {
+        ok=asprintf(&p_buf,
+                    "Unknown or unsupported balance mode '%s'",
+                    pp_options[i]->p_value);
+        if(ok<0 || p_buf==NULL) {
+          *pp_error=NULL;
+          return RAID_MEMALLOC_FAILED;
+        }
+        *pp_error=p_buf;
+        return RAID_CANNOT_PARSE_OPTION;
+      }
+
+      LOG_DEBUG("Setting balance mode to %s\n",raid_balance_names[layout]);
+
+      p_raid_handle->balance=layout;
+      pp_options[i]->valid=1;
+      continue;
+    }
+    if(strcmp(pp_options[i]->p_key,"raid_order")==0) {
+      ok=RaidParseMemberOrder(p_raid_handle,pp_options[i]->p_value);
+      if(ok==RAID_MEMALLOC_FAILED) {
+        *pp_error=NULL;
+        return RAID_MEMALLOC_FAILED;
+      }
+      if(ok!=RAID_OK) {
+        ok=asprintf(&p_buf,
+                    "Unable to parse member order '%s'",
+                    pp_options[i]->p_value);
+        if(ok<0 || p_buf==NULL) {
+          *pp_error=NULL;
+          return RAID_MEMALLOC_FAILED;
+        }
+        *pp_error=p_buf;
+        return RAID_CANNOT_PARSE_OPTION;
+      }
+
+      LOG_DEBUG("Raid consists of %" PRIu64 " member disks\n",
+                p_raid_handle->members_count);
+
       pp_options[i]->valid=1;
       continue;
     }
@@ -333,18 +2635,54 @@ static int RaidGetInfofileContent(void *p_handle,
   pts_RaidHandle p_raid_handle=(pts_RaidHandle)p_handle;
   int ret;
   char *p_buf;
+  char *p_layout=NULL;
+
+  if(p_raid_handle->level==6) {
+    ret=asprintf(&p_layout,
+                 "Layout: %s\n"
+                   "Missing disks: %" PRIu64 " (reconstructed from parity, "
+                   "using the %s GF(2^8) kernel)\n",
+                 raid_layout_names[p_raid_handle->layout],
+                 p_raid_handle->missing_members_count,
+                 raid_gf_kernel_names[p_raid_handle->gf_kernel]);
+  } else if(p_raid_handle->level==5) {
+    ret=asprintf(&p_layout,
+                 "Layout: %s\n"
+                   "Missing disks: %" PRIu64 " (reconstructed from parity)\n",
+                 raid_layout_names[p_raid_handle->layout],
+                 p_raid_handle->missing_members_count);
+  } else if(p_raid_handle->copies>1) {
+    ret=asprintf(&p_layout,
+                 "Copies: %" PRIu64 " (reads balanced by %s)\n"
+                   "Missing disks: %" PRIu64 "\n",
+                 p_raid_handle->copies,
+                 raid_balance_names[p_raid_handle->balance],
+                 p_raid_handle->missing_members_count);
+  } else {
+    ret=asprintf(&p_layout,"%s","");
+  }
+  if(ret<0 || p_layout==NULL) return RAID_MEMALLOC_FAILED;
 
   ret=asprintf(&p_buf,
-               "Simulating RAID level 0 over %" PRIu64 " disks.\n"
+               "Simulating RAID level %" PRIu8 " over %" PRIu64 " disks.\n"
+                 "%s"
+                 "%s"
                  "Chunk size: %" PRIu32 " bytes\n"
                  "Chunks per disk: %" PRIu64 "\n"
+                 "Concurrent member reads: %" PRIu32 "\n"
                  "Total capacity: %" PRIu64 " bytes (%0.3f GiB)\n",
-               p_raid_handle->input_images_count,
+               p_raid_handle->level,
+               p_raid_handle->members_count,
+               p_layout,
+               p_raid_handle->p_detect_info!=NULL ?
+                 p_raid_handle->p_detect_info : "",
                p_raid_handle->chunk_size,
                p_raid_handle->chunks_per_image,
+               p_raid_handle->threads,
                p_raid_handle->morphed_image_size,
                p_raid_handle->morphed_image_size/(1024.0*1024.0*1024.0));
-  if(ret<0 || *pp_info_buf==NULL) return RAID_MEMALLOC_FAILED;
+  free(p_layout);
+  if(ret<0 || p_buf==NULL) return RAID_MEMALLOC_FAILED;
 
   *pp_info_buf=p_buf;
   return RAID_OK;
@@ -379,6 +2717,25 @@ static const char* RaidGetErrorMessage(int err_num) {
     case RAID_CANNOT_PARSE_OPTION:
       return "Unable to parse library option";
       break;
+    case RAID_INVALID_MEMBER_ORDER:
+      return "Invalid member order: Every input image must be a member disk "
+               "exactly once";
+      break;
+    case RAID_TOO_FEW_MEMBERS:
+      return "Too few member disks for this RAID level";
+      break;
+    case RAID_TOO_MANY_MISSING_MEMBERS:
+      return "Too many missing member disks for this RAID level";
+      break;
+    case RAID_CANNOT_CREATE_THREAD:
+      return "Unable to create thread";
+      break;
+    case RAID_CANNOT_DETECT_TOO_MANY_MEMBERS:
+      return "Unable to detect member order: Too many member disks";
+      break;
+    case RAID_CANNOT_DETECT_IMAGES_TOO_SMALL:
+      return "Unable to detect RAID parameters: Member disks are too small";
+      break;
     default:
       return "Unknown error";
   }
@@ -30,13 +30,216 @@ enum {
   RAID_WRITE_BEYOND_END_OF_IMAGE,
   RAID_CANNOT_READ_DATA,
   RAID_CANNOT_WRITE_DATA,
-  RAID_CANNOT_PARSE_OPTION
+  RAID_CANNOT_PARSE_OPTION,
+  RAID_INVALID_MEMBER_ORDER,
+  RAID_TOO_FEW_MEMBERS,
+  RAID_TOO_MANY_MISSING_MEMBERS,
+  RAID_CANNOT_CREATE_THREAD,
+  RAID_CANNOT_DETECT_TOO_MANY_MEMBERS,
+  RAID_CANNOT_DETECT_IMAGES_TOO_SMALL
+};
+
+//! RAID-5 / RAID-6 parity layouts, the first six numbered like Linux md does
+enum {
+  RAID_LAYOUT_LEFT_ASYMMETRIC=0,
+  RAID_LAYOUT_RIGHT_ASYMMETRIC,
+  RAID_LAYOUT_LEFT_SYMMETRIC,
+  RAID_LAYOUT_RIGHT_SYMMETRIC,
+  RAID_LAYOUT_PARITY_FIRST,
+  RAID_LAYOUT_PARITY_LAST,
+  //! SNIA DDF layouts used by hardware controllers, RAID-6 only
+  RAID_LAYOUT_DDF_ZERO_RESTART,
+  RAID_LAYOUT_DDF_N_RESTART,
+  RAID_LAYOUT_DDF_N_CONTINUE
+};
+
+//! Kernels used to multiply data with a constant in GF(2^8)
+enum {
+  RAID_GF_KERNEL_SCALAR=0,
+  RAID_GF_KERNEL_SSSE3,
+  RAID_GF_KERNEL_AVX2
+};
+
+//! How reads are balanced over the copies of a RAID-1 / RAID-10 chunk
+enum {
+  RAID_BALANCE_QUEUE=0,
+  RAID_BALANCE_STRIPE
 };
 
 #define RAID_DEFAULT_CHUNKSIZE 512*1024
+#define RAID_DEFAULT_LAYOUT RAID_LAYOUT_LEFT_SYMMETRIC
+#define RAID_DEFAULT_COPIES 2
+#define RAID_DEFAULT_BALANCE RAID_BALANCE_QUEUE
+//! Value of p_member_images for a missing member disk
+#define RAID_MEMBER_MISSING UINT64_MAX
+//! Max. number of missing member disks (RAID-6)
+#define RAID_MAX_MISSING_MEMBERS 2
+//! Max. default number of member reads issued concurrently
+#define RAID_MAX_DEFAULT_THREADS 16
+
+//! Parameters detected by sampling the member disks (raid_*=auto)
+#define RAID_DETECT_CHUNKSIZE 0x01
+#define RAID_DETECT_LAYOUT 0x02
+#define RAID_DETECT_ORDER 0x04
+//! Range of chunk sizes tried, all powers of two in between
+#define RAID_DETECT_MIN_CHUNKSIZE 4096
+#define RAID_DETECT_MAX_CHUNKSIZE 4*1024*1024
+//! Chunk boundaries sampled per chunk size and bytes looked at on each side
+#define RAID_DETECT_SAMPLES 128
+#define RAID_DETECT_WINDOW 1024
+//! Max. member disks whose order is detected, as all orders are tried
+#define RAID_DETECT_MAX_MEMBERS 8
+//! Max. boot sectors looked for (the morphed image's and its partitions')
+#define RAID_DETECT_MAX_ANCHORS 5
+//! Best candidates kept to report the runner-up and for debugging
+#define RAID_DETECT_TOP_CANDIDATES 5
+//! Weights of a boot sector found where a candidate expects one and of a
+//! sampled stripe whose Q syndrome is on the member the candidate expects
+#define RAID_DETECT_ANCHOR_SCORE 16
+#define RAID_DETECT_PARITY_SCORE 4
+//! Weight of a join of records with (non-)consecutive numbers or counters
+#define RAID_DETECT_RECORD_SCORE 8
+//! Max. size of records whose counters are looked for, at least 4 of them
+//! must fit into a window
+#define RAID_DETECT_MAX_RECORD_SIZE 256
+
+//! Classes of data telling whether two chunks may hold contiguous data
+enum {
+  RAID_DATA_ZERO=0,
+  RAID_DATA_TEXT,
+  RAID_DATA_RANDOM,
+  RAID_DATA_BINARY
+};
+
+//! Part of a read request that lies in a single chunk
+typedef struct s_RaidPiece {
+  //! Where the data goes to
+  char *p_buf;
+  size_t count;
+  //! Where the data comes from
+  uint64_t chunk;
+  uint64_t chunk_offset;
+  uint64_t stripe;
+  //! Next piece of the same extent or UINT64_MAX
+  uint64_t next_piece;
+} ts_RaidPiece, *pts_RaidPiece;
+
+//! Contiguous range of a member disk, made up of one or more pieces
+/*!
+ * Extents are read concurrently by the thread pool. An extent of a missing
+ * member always consists of a single piece that is reconstructed.
+ */
+typedef struct s_RaidExtent {
+  uint64_t member;
+  uint64_t offset;
+  size_t size;
+  pts_RaidPiece p_pieces;
+  uint64_t first_piece;
+  uint64_t last_piece;
+  //! Result of reading the extent
+  int ret;
+  //! Extents of the request not yet read, protected by the handle's mutex
+  uint64_t *p_pending;
+  //! Next extent in the job queue
+  struct s_RaidExtent *p_next;
+} ts_RaidExtent, *pts_RaidExtent;
+
+//! What is known about the data around a sampled chunk boundary
+typedef struct s_RaidDetectWindow {
+  //! Class of the data before and after the boundary
+  uint8_t classes[2];
+  //! If the data before the boundary are records holding a counter, where
+  //! and which value the counter of the record after the boundary has
+  uint8_t has_counter;
+  uint32_t counter_offset;
+  uint32_t counter;
+} ts_RaidDetectWindow, *pts_RaidDetectWindow;
+
+//! Evidence gathered by sampling the member disks for the auto detection
+/*!
+ * Arrays are indexed by chunk size, stripe modulo members and member disks,
+ * in this order. Layouts repeat after as many stripes as there are members.
+ */
+typedef struct s_RaidDetectEvidence {
+  //! Chunk sizes tried, at most one per bit of a uint32_t
+  uint32_t chunk_sizes[32];
+  uint64_t chunk_sizes_count;
+  //! Size of the smallest member
+  uint64_t image_size;
+  //! Offsets in the morphed image where a boot sector is expected
+  uint64_t anchors[RAID_DETECT_MAX_ANCHORS];
+  uint64_t anchors_count;
+  //! How well the end of a chunk joins the start of the chunk on another
+  //! member in the same / the next stripe
+  int64_t *p_same;
+  int64_t *p_next;
+  //! Sampled stripes whose parity only adds up without a member's chunk,
+  //! which thus must be the Q syndrome (RAID-6)
+  int64_t *p_q;
+  //! Whether a member holds a boot sector where an anchor would be
+  uint8_t *p_boot;
+  //! Sampled stripes holding data and those of them with consistent parity
+  uint64_t *p_parity_samples;
+  uint64_t *p_parity_ok;
+} ts_RaidDetectEvidence, *pts_RaidDetectEvidence;
+
+//! Candidate parameters scored by the auto detection
+typedef struct s_RaidCandidate {
+  int64_t score;
+  uint64_t chunk_size_index;
+  uint8_t layout;
+  //! Member disk (slot of the given member order) of each member
+  uint64_t *p_order;
+  //! Member disks holding the data, P and Q chunks of each stripe until the
+  //! layout repeats, equal for candidates mapping data the same way
+  uint64_t *p_mapping;
+} ts_RaidCandidate, *pts_RaidCandidate;
+
 typedef struct s_RaidHandle {
   uint8_t debug;
+  //! RAID level (0, 1, 5, 6 or 10) and parity layout
+  uint8_t level;
+  uint8_t layout;
   uint64_t input_images_count;
+  //! Member disks of the raid, including a missing one
+  uint64_t members_count;
+  //! Input image of each member disk or RAID_MEMBER_MISSING
+  uint64_t *p_member_images;
+  //! Missing member disks (only the first ones are listed)
+  uint64_t missing_members_count;
+  uint64_t missing_members[RAID_MAX_MISSING_MEMBERS];
+  //! Member disks holding data / parity in each stripe
+  uint64_t data_members_count;
+  uint64_t parity_members_count;
+  //! GF(2^8) exponent / logarithm tables and kernel used for RAID-6
+  uint8_t gf_exp[2*255];
+  uint8_t gf_log[256];
+  uint8_t gf_kernel;
+  //! Copies of each chunk (RAID-1 / RAID-10) and how reads are balanced
+  uint64_t copies;
+  uint8_t balance;
+  //! Consecutive chunks read from the same copy with RAID_BALANCE_STRIPE
+  uint64_t balance_chunks;
+  //! Bytes of reads queued on each member disk, protected by mutex
+  pthread_mutex_t mutex;
+  uint64_t *p_queued_bytes;
+  //! Member reads issued concurrently and the thread pool doing so. The
+  //! job queue is protected by mutex.
+  uint32_t threads;
+  pthread_t *p_threads;
+  uint32_t threads_running;
+  pts_RaidExtent p_jobs_head;
+  pts_RaidExtent p_jobs_tail;
+  uint8_t pool_stop;
+  //! Signaled when extents are queued and when all extents of a request
+  //! have been read
+  pthread_cond_t job_cond;
+  pthread_cond_t done_cond;
+  //! Serializes reads of each input image
+  pthread_mutex_t *p_image_mutexes;
+  //! Parameters to detect (RAID_DETECT_*) and report of their detection
+  uint8_t detect;
+  char *p_detect_info;
   uint32_t chunk_size;
   uint64_t chunks_per_image;
   pts_LibXmountMorphingInputFunctions p_input_functions;